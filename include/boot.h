@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Bump when a release changes what is kept in NVS, and add the step that
+// upgrades the previous layout to the migrations table in boot.cpp.
+#define NVS_SCHEMA_VERSION 1
+
+enum NvsBootAction {
+  NVS_KEPT,      // schema matched, nothing touched
+  NVS_MIGRATED,  // upgraded from an older schema
+  NVS_ERASED     // unreadable, newer or unmigratable contents were wiped
+};
+
+struct BootStats {
+  NvsBootAction nvs;
+  uint32_t schemaFound;    // version stored before this boot (0 if none)
+  uint32_t nvsMs;          // time spent bringing NVS up
+  uint32_t apReadyMs;      // boot to AP and web server up
+  uint32_t lastApReadyMs;  // the same for the previous boot (0 if unknown)
+};
+
+// Initialises NVS, erasing it only when it cannot be used as is, and brings
+// the stored schema up to NVS_SCHEMA_VERSION.
+NvsBootAction bootPrepareNvs();
+
+// Records boot-to-ready time; call once the portal is reachable.
+void bootMarkApReady();
+
+const BootStats& bootStats();
+const char* nvsBootActionName(NvsBootAction action);
+size_t bootStatsJson(const BootStats& stats, char* buf, size_t len);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <Arduino.h>
+
+// NVS namespace and key names are shared with code that reads the settings
+// through Preferences (see README), so they stay as they were.
+#define CONFIG_NAMESPACE "credentials"
+
+enum ConfigResult {
+  CONFIG_OK,
+  CONFIG_UNKNOWN_KEY,
+  CONFIG_TOO_LONG,
+  CONFIG_BAD_REQUEST,
+  CONFIG_STORAGE_ERROR
+};
+
+struct DeviceConfig {
+  char wifiSsid[33];      // 802.11 limit of 32 bytes
+  char wifiPassword[64];  // WPA2 passphrase, at most 63 characters
+  char gsmApn[64];
+  char manifestUrl[160];  // firmware manifest; empty uses OTA_MANIFEST_URL
+};
+
+typedef ConfigResult (*ConfigVisitor)(const char* key, const char* value);
+
+// Device settings loaded once from NVS. Changes are made in RAM, values
+// that did not change are dropped, and commit() writes the rest in one
+// NVS session.
+class ConfigStore {
+ public:
+  ConfigStore();
+
+  bool begin();
+  const DeviceConfig& get() const { return values_; }
+
+  // Validates a setting without changing anything
+  ConfigResult check(const char* key, const char* value) const;
+  // Updates a setting in RAM; marks it dirty only if the value changed
+  ConfigResult set(const char* key, const char* value);
+  bool dirty() const { return dirty_ != 0; }
+  // Writes every dirty setting and commits once. Returns the number of
+  // settings written, or -1 on a storage error.
+  int commit();
+
+ private:
+  DeviceConfig values_;
+  uint32_t dirty_;
+};
+
+extern ConfigStore Config;
+
+// Calls visit for each member of a flat JSON object whose values are all
+// strings, stopping at the first result other than CONFIG_OK.
+ConfigResult configParseJson(const char* json, ConfigVisitor visit);
+
+const char* configResultName(ConfigResult result);
+
+// JSON helpers shared with the firmware manifest parser. jsonParseString
+// starts after the opening quote, copies the string into out and returns
+// the position after the closing quote, or NULL if it is malformed or does
+// not fit (overflow set).
+const char* jsonParseString(const char* p, char* out, size_t size, bool& overflow);
+const char* jsonSkipSpace(const char* p);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Upper bounds of the request latency buckets in microseconds; a final
+// +Inf bucket catches the rest
+#define METRICS_LATENCY_BUCKETS 10
+
+// Fixed-bucket latency histogram. Recording is a bounds scan and a few
+// adds, so it can run on every request.
+struct LatencyHistogram {
+  uint32_t buckets[METRICS_LATENCY_BUCKETS + 1];  // per bucket, not cumulative
+  uint32_t count;
+  uint64_t sumUs;
+
+  void record(uint32_t us);
+};
+
+struct RouteMetrics {
+  LatencyHistogram latency;  // request line to last response byte handed to the socket
+  uint64_t responseBytes;    // status line, headers and body
+  uint32_t errors;           // 4xx/5xx answers and connections dropped mid-response
+};
+
+class PortalServer;
+
+// Answers GET /metrics in the Prometheus text format: per-route latency,
+// response bytes and errors from the server, heap, the last OTA job's
+// throughput and phase timings, and TLS handshake times.
+void sendMetrics(PortalServer& server);
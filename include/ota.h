@@ -0,0 +1,72 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Transport.h>
+
+enum OtaState {
+  OTA_IDLE,
+  OTA_CONNECTING,
+  OTA_DOWNLOADING,
+  OTA_SUCCESS,
+  OTA_FAILED,
+  OTA_UP_TO_DATE   // the requested image is the one running
+};
+
+// Snapshot of the current (or last) OTA job, safe to read from any task.
+struct OtaStatus {
+  uint32_t jobId;
+  OtaState state;
+  size_t written;        // download bytes committed so far
+  size_t total;          // download size
+  size_t imageBytes;     // firmware bytes in flash (differs when compressed)
+  size_t resumedFrom;    // offset the current download continued from
+  bool compressed;
+  uint32_t elapsedMs;    // since the job was started
+  uint32_t bytesPerSec;  // download throughput so far
+  uint32_t tlsHandshakeMs;
+  bool tlsResumed;       // last handshake reused a cached TLS session
+  bool verified;         // download matched the manifest's SHA-256
+  uint32_t wifiMs;       // time to an IP address for this job
+  bool wifiFast;         // joined with the cached association
+  LinkType link;         // link the job ran over
+  uint32_t linkMs;       // time to a working link, cellular failover included
+  uint32_t manifestMs;   // manifest request, TLS handshake included
+  uint32_t downloadMs;   // all download attempts, retry delays included
+  uint32_t finishMs;     // digest check and making the partition bootable
+  char message[64];
+};
+
+// Starts an OTA job on a background task pinned to the core the Arduino loop
+// does not use, so the portal keeps serving while the image downloads.
+// Returns the job id, or 0 if a job is already running or the task could not
+// be created. With an APN, the job falls back to cellular when WiFi stays
+// down or no network is saved.
+uint32_t otaStart(const char* url, const String& ssid, const String& password, const String& apn);
+
+// Starts an OTA job for a manifest entry. The job refreshes the manifest
+// first, so the image URL is current, and stops in OTA_UP_TO_DATE without
+// downloading anything when the image is already running.
+uint32_t otaStartManifest(const char* id, const char* manifestUrl, const String& ssid,
+                          const String& password, const String& apn);
+
+// Starts a job that only refreshes the cached manifest; it ends in OTA_IDLE
+// with the outcome in the status message.
+uint32_t otaCheckManifest(const char* manifestUrl, const String& ssid, const String& password,
+                          const String& apn);
+
+// True once after an OTA job replaced the cached manifest
+bool otaManifestChanged();
+
+// Restarts an update that was interrupted by a reboot, continuing from the
+// last offset committed to flash. Returns the job id, or 0 if nothing is
+// pending.
+uint32_t otaResumePending(const String& ssid, const String& password, const String& apn);
+
+void otaGetStatus(OtaStatus& out);
+
+bool otaBusy();
+
+const char* otaStateName(OtaState state);
+
+// Writes the status as a small JSON object into buf; returns its length.
+size_t otaStatusJson(const OtaStatus& status, char* buf, size_t len);
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <mbedtls/sha256.h>
+
+#define OTA_SECTOR_SIZE 4096
+
+// Writes a firmware image straight into the next OTA partition. Unlike
+// Update, writing may start at any sector boundary, so an interrupted
+// download can continue where it stopped, even after a reboot. Sectors are
+// erased as the write position reaches them.
+class OtaFlashWriter {
+ public:
+  OtaFlashWriter();
+
+  // Selects the next update partition and positions the writer at offset,
+  // which must be sector aligned. A total of 0 means the image size is not
+  // known up front (compressed downloads). Returns false if it cannot fit.
+  bool begin(size_t total, size_t offset);
+
+  bool write(const uint8_t* data, size_t len);
+
+  // Checks that the whole image was written, lets the bootloader verify it
+  // and marks it as the boot partition.
+  bool finish();
+
+  size_t offset() const { return offset_; }
+  const esp_partition_t* partition() const { return partition_; }
+  uint32_t partitionAddress() const { return partition_ ? partition_->address : 0; }
+  const char* lastError() const { return error_; }
+
+ private:
+  const esp_partition_t* partition_;
+  size_t total_;
+  bool sizeKnown_;
+  size_t offset_;
+  const char* error_;
+};
+
+// SHA-256 of an image fed one buffer at a time as it streams into flash,
+// so checking it needs no second pass over the partition. mbedtls runs it
+// on the SHA peripheral whenever the engine is not taken by TLS.
+class OtaDigest {
+ public:
+  OtaDigest();
+  ~OtaDigest();
+
+  void begin();
+  // Restarts over the first len bytes of partition; used when a download
+  // continues after data that is already in flash
+  bool beginFrom(const esp_partition_t* partition, size_t len);
+  void update(const uint8_t* data, size_t len);
+  void finish(uint8_t out[32]);
+
+  size_t length() const { return length_; }
+
+ private:
+  mbedtls_sha256_context ctx_;
+  size_t length_;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Arduino.h>
+#include "rom/miniz.h"
+
+// Streams a gzip-compressed firmware image through the ROM inflater. Memory is
+// bounded by the 32 KB deflate window plus the decompressor state, both
+// allocated in begin() and released in end(), whatever the image size.
+class OtaInflater {
+ public:
+  // Receives decompressed bytes; returning false aborts decompression.
+  typedef bool (*Sink)(const uint8_t* data, size_t len);
+
+  OtaInflater();
+  ~OtaInflater();
+
+  static bool isGzip(const uint8_t* data, size_t len);
+
+  bool begin(Sink sink);
+  void end();
+
+  // Feeds the next piece of the compressed stream, in any split
+  bool write(const uint8_t* data, size_t len);
+
+  // True once the deflate stream and its trailer checked out
+  bool finished() const { return state_ == STATE_DONE; }
+  size_t outputSize() const { return outputSize_; }
+  const char* lastError() const { return error_; }
+
+ private:
+  enum State {
+    STATE_HEADER,
+    STATE_EXTRA_LEN,
+    STATE_EXTRA,
+    STATE_NAME,
+    STATE_COMMENT,
+    STATE_HEADER_CRC,
+    STATE_DEFLATE,
+    STATE_TRAILER,
+    STATE_DONE,
+    STATE_ERROR
+  };
+
+  size_t parseHeader(const uint8_t* data, size_t len);
+  size_t inflate(const uint8_t* data, size_t len);
+  size_t parseTrailer(const uint8_t* data, size_t len);
+  bool failWith(const char* error);
+
+  Sink sink_;
+  tinfl_decompressor* decomp_;
+  uint8_t* window_;
+  size_t windowPos_;
+  State state_;
+  uint8_t flags_;
+  uint8_t field_[10];  // header or trailer bytes collected so far
+  size_t fieldLen_;
+  size_t skip_;        // bytes left in the current optional header field
+  uint32_t crc_;
+  size_t outputSize_;
+  const char* error_;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include <WiFiClient.h>
+
+// Manifest URL used when the manifest_url setting is empty. Set it per
+// fleet with -DOTA_MANIFEST_URL=\"https://...\" in build_flags.
+#ifndef OTA_MANIFEST_URL
+#define OTA_MANIFEST_URL ""
+#endif
+
+#define OTA_MANIFEST_PATH "/manifest.json"
+#define OTA_MANIFEST_MAX 8192        // bytes of JSON
+#define OTA_MANIFEST_ENTRIES 8
+#define OTA_MANIFEST_URL_MAX 1024    // image URLs may be pre-signed
+#define OTA_MANIFEST_TIMEOUT_MS 10000
+
+// One firmware image offered by the manifest.
+struct ManifestEntry {
+  char id[24];         // value posted to /ota
+  char label[48];      // text shown in the drop-down
+  char version[32];
+  size_t size;         // bytes as served
+  uint8_t sha256[32];  // of the file as served
+  // The image as flashed: decompressed when the file is gzipped, otherwise
+  // the same as size and sha256
+  size_t imageSize;
+  uint8_t imageSha256[32];
+  String url;
+};
+
+enum ManifestResult {
+  MANIFEST_OK,             // new manifest fetched and cached
+  MANIFEST_NOT_MODIFIED,   // cached copy is current
+  MANIFEST_NO_URL,
+  MANIFEST_FETCH_FAILED,
+  MANIFEST_TOO_LARGE,      // over OTA_MANIFEST_MAX, by Content-Length or as read
+  MANIFEST_NO_MEMORY,      // no buffer for the body
+  MANIFEST_INVALID,
+  MANIFEST_STORAGE_ERROR   // fetched and parsed, but not cached
+};
+
+// Firmware list published as
+//   {"firmware":[{"id":"v2.4.0","label":"Firmware 2.4.0","version":"2.4.0",
+//                 "url":"https://...","size":1234567,"sha256":"<64 hex>",
+//                 "image_size":2345678,"image_sha256":"<64 hex>"}]}
+// where image_size and image_sha256 describe the decompressed image of a
+// gzipped file and may be left out for an uncompressed one.
+// A copy is cached on flash with its ETag, so later checks are conditional
+// GETs that cost one round trip when nothing changed. An invalid manifest
+// is rejected as a whole and the cached one is kept.
+class OtaManifest {
+ public:
+  OtaManifest();
+
+  // Replaces the entries; on failure the manifest is left empty
+  bool parse(const char* json);
+  // Loads the cached copy
+  bool load(fs::FS& fs);
+  // timeoutMs bounds the connect and each wait for data
+  ManifestResult fetch(fs::FS& fs, WiFiClient& net, const char* url,
+                       uint32_t timeoutMs = OTA_MANIFEST_TIMEOUT_MS);
+
+  size_t count() const { return count_; }
+  const ManifestEntry& entry(size_t i) const { return entries_[i]; }
+  const ManifestEntry* find(const char* id) const;
+
+ private:
+  ManifestEntry entries_[OTA_MANIFEST_ENTRIES];
+  size_t count_;
+};
+
+// Cached manifest behind the portal's drop-down; owned by the loop task
+extern OtaManifest Manifest;
+
+// True when the running app partition holds exactly this image, compared
+// by SHA-256 over entry.imageSize bytes
+bool manifestIsRunning(const ManifestEntry& entry);
+
+const char* manifestResultName(ManifestResult result);
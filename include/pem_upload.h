@@ -0,0 +1,86 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+// Largest certificate chain or key accepted; the credential cache keeps both
+// in RAM
+#define PEM_UPLOAD_MAX (16 * 1024)
+// File writes are batched to one flash sector, a multiple of the 256-byte
+// SPIFFS page, so the file system never rewrites a partial page
+#define PEM_UPLOAD_WRITE_SIZE 4096
+#define PEM_LINE_MAX 80
+// Name a validated upload takes before it replaces the saved file
+#define PEM_UPLOAD_OK_SUFFIX ".ok"
+
+enum PemKind {
+  PEM_CERTIFICATE,  // one or more CERTIFICATE blocks (a chain)
+  PEM_PRIVATE_KEY   // exactly one PKCS#8, RSA or EC private key
+};
+
+// Checks PEM text as it arrives, one line at a time, and rejects it at the
+// first line that cannot belong to a valid file of the expected kind.
+class PemValidator {
+ public:
+  void begin(PemKind kind);
+  bool feed(const uint8_t* data, size_t len);
+  // Validates the last line and that at least one block was completed
+  bool finish();
+  const char* lastError() const { return error_; }
+
+ private:
+  enum State { BEFORE_BLOCK, BLOCK_HEADERS, BLOCK_BODY, BLOCK_PADDED };
+
+  bool line();
+  bool beginLine();
+  bool bodyLine();
+  bool fail(const char* error);
+
+  PemKind kind_;
+  State state_;
+  char line_[PEM_LINE_MAX + 1];
+  size_t lineLen_;
+  size_t preambleLen_;
+  char label_[24];
+  uint8_t blocks_;
+  bool encrypted_;
+  bool firstBodyLine_;
+  const char* error_;
+};
+
+// Streams an upload into path + ".tmp" (or another suffix) through a
+// sector-sized buffer while validating it, then swaps it in place of path
+// by way of path + ".ok". A rejected upload never touches the existing file.
+class PemUpload {
+ public:
+  PemUpload();
+
+  bool begin(fs::FS& fs, const char* path, PemKind kind, const char* suffix = ".tmp");
+  bool write(const uint8_t* data, size_t len);
+  bool finish();
+  // Validates and closes the file but leaves it at path + suffix, for a
+  // caller that swaps several files in together (see provision.h)
+  bool stage();
+  void abort();
+  const char* lastError() const { return error_; }
+
+ private:
+  bool flush();
+  bool close();
+  bool fail(const char* error);
+
+  fs::FS* fs_;
+  const char* path_;
+  char tmpPath_[48];
+  File file_;
+  size_t size_;
+  size_t fill_;
+  bool failed_;
+  const char* error_;
+  PemValidator validator_;
+  uint8_t buffer_[PEM_UPLOAD_WRITE_SIZE];
+};
+
+// Completes a swap that a power loss interrupted once the upload had been
+// validated (path + ".ok"), and discards one interrupted before (".tmp")
+void pemUploadRecover(fs::FS& fs, const char* path);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <Arduino.h>
+#include "portal_server.h"
+
+// One entry in the firmware drop-down on the portal page.
+struct FirmwareOption {
+  const char* id;     // value posted to /ota
+  const char* label;  // text shown in the drop-down
+};
+
+// Streams the portal page with chunked transfer encoding. The static HTML is
+// sent straight from flash and links the stylesheet (see web_assets.h); only
+// the status message and the firmware options are spliced in, through a
+// small stack buffer, so rendering a page does not touch the heap.
+void sendPortalPage(PortalServer& server, int code, const char* statusMsg,
+                    const FirmwareOption* options, size_t optionCount);
+
+// The answer to a form post: the status message and a link back to the
+// portal, a few hundred bytes instead of the whole page.
+void sendResultPage(PortalServer& server, int code, const char* statusMsg);
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WebServer.h>
+#include <functional>
+#include <vector>
+
+#include "metrics.h"
+
+#define PORTAL_MAX_CLIENTS 4
+#define PORTAL_IDLE_TIMEOUT_MS 5000       // keep-alive connection with no request
+#define PORTAL_REQUEST_TIMEOUT_MS 15000   // request that stops arriving
+#define PORTAL_WRITE_TIMEOUT_MS 5000      // response the client stops taking, in total
+#define PORTAL_OUT_MAX 16384              // response bytes queued per connection
+#define PORTAL_MAX_KEEPALIVE_REQUESTS 100
+#define PORTAL_LINE_MAX 512               // request, header and part header lines
+#define PORTAL_BODY_MAX 2048              // form, JSON and non-file multipart fields
+#define PORTAL_DISCARD_MAX 16384          // rejected body drained before closing
+#define PORTAL_RECV_SIZE 1460
+#define PORTAL_BOUNDARY_MAX 70            // RFC 2046
+
+// HTTP/1.1 server for the portal that multiplexes up to PORTAL_MAX_CLIENTS
+// sockets with select(), keeps connections alive between requests, and
+// streams multipart bodies into upload handlers as the bytes arrive.
+//
+// Routes and handlers are registered exactly as with WebServer, and
+// handleClient() is still called from loop(); it services every socket that
+// is ready and never blocks waiting for one. Handlers run on the loop task,
+// one at a time, with the request accessors and response calls bound to the
+// connection being served. What a socket cannot take at once is queued on
+// its connection and sent as it drains, so a client that reads slowly holds
+// up only itself; one that has not taken its whole response within
+// PORTAL_WRITE_TIMEOUT_MS is closed.
+//
+// Only one multipart upload is in progress at a time, because the upload
+// handlers share one buffer; a second upload waits until the first ends while
+// other requests carry on.
+class PortalServer {
+ public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  explicit PortalServer(uint16_t port = 80);
+  ~PortalServer();
+
+  void begin();
+  // Blocks until a socket needs service or waitMs passes, so an idle loop
+  // sleeps instead of spinning. True if handleClient() has work.
+  bool waitForActivity(uint32_t waitMs);
+  void handleClient();
+
+  void on(const String& uri, THandlerFunction handler);
+  void on(const String& uri, HTTPMethod method, THandlerFunction handler);
+  void on(const String& uri, HTTPMethod method, THandlerFunction handler, THandlerFunction upload);
+  void onNotFound(THandlerFunction handler);
+
+  // Request being handled
+  String uri() const;
+  HTTPMethod method() const;
+  HTTPUpload& upload();
+  String arg(const String& name) const;
+  String arg(int i) const;
+  String argName(int i) const;
+  int args() const;
+  bool hasArg(const String& name) const;
+  void collectHeaders(const char* headerKeys[], const size_t headerKeysCount);
+  String header(const String& name) const;
+  bool hasHeader(const String& name) const;
+  // Distinct for every request the server has accepted, so state built up
+  // by an upload handler can be matched to the request that finishes it
+  uint32_t requestId() const;
+
+  // Response to it
+  void setContentLength(const size_t length);
+  void sendHeader(const String& name, const String& value, bool first = false);
+  void send(int code, const char* contentType = NULL, const String& content = String());
+  void send(int code, const String& contentType, const String& content);
+  void send(int code, const char* contentType, const char* content);
+  void send_P(int code, PGM_P contentType, PGM_P content);
+  void send_P(int code, PGM_P contentType, PGM_P content, size_t len);
+  void sendContent(const String& content);
+  void sendContent(const char* content, size_t len);
+  void sendContent_P(PGM_P content);
+  void sendContent_P(PGM_P content, size_t len);
+
+  size_t connections() const;
+  uint32_t requestsServed() const { return requestsServed_; }
+
+  // Request metrics per route, in registration order, and for requests no
+  // route matched. Every request is recorded once it has been answered.
+  size_t routeCount() const { return routes_.size(); }
+  const String& routeUri(size_t i) const { return routes_[i].uri; }
+  HTTPMethod routeMethod(size_t i) const { return routes_[i].method; }
+  const RouteMetrics& routeMetrics(size_t i) const { return routeMetrics_[i]; }
+  const RouteMetrics& unmatchedMetrics() const { return unmatchedMetrics_; }
+
+ private:
+  enum ConnState {
+    CONN_IDLE,             // keep-alive, waiting for the next request
+    CONN_REQUEST_LINE,
+    CONN_HEADERS,
+    CONN_BODY,             // form, JSON or other buffered body
+    CONN_MULTIPART,
+    CONN_DISCARD           // rest of a rejected body, then close
+  };
+  enum PartState {
+    PART_PREAMBLE,         // before the first boundary
+    PART_AFTER_BOUNDARY,   // "--" ends the body, CRLF starts a part
+    PART_HEADERS,
+    PART_DATA,
+    PART_DONE
+  };
+  struct Pair {
+    String name;
+    String value;
+  };
+  struct Route {
+    String uri;
+    HTTPMethod method;
+    THandlerFunction handler;
+    THandlerFunction upload;
+  };
+  struct Connection {
+    int fd;
+    ConnState state;
+    uint32_t lastActivity;
+    uint16_t requests;
+    uint8_t in[PORTAL_RECV_SIZE];
+    size_t inLen;
+    size_t inPos;
+    char line[PORTAL_LINE_MAX + 1];
+    size_t lineLen;
+
+    // Request
+    uint32_t id;
+    HTTPMethod method;
+    String uri;
+    bool http11;
+    bool keepAlive;
+    bool expectContinue;
+    bool chunkedBody;
+    size_t contentLength;
+    size_t bodyRead;
+    String contentType;
+    String body;
+    std::vector<Pair> args;
+    std::vector<Pair> headers;   // collected ones only
+    const Route* route;
+
+    // Multipart body
+    PartState part;
+    char delimiter[PORTAL_BOUNDARY_MAX + 4];  // CRLF "--" boundary
+    uint8_t failure[PORTAL_BOUNDARY_MAX + 4]; // KMP failure function
+    size_t delimiterLen;
+    size_t matched;
+    char afterBoundary[2];
+    size_t afterBoundaryLen;
+    String partName;
+    bool partIsFile;
+    bool uploading;
+    int errorCode;
+
+    // Response. out holds bytes not yet sent, from outPos on; they outlive
+    // the request, which is answered once they are queued.
+    String responseHeaders;
+    size_t responseLength;
+    String out;
+    size_t outPos;
+    bool blocked;                // the socket refused bytes still queued
+    uint32_t blockedSince;
+    bool closeAfterWrite;
+    bool responded;
+    bool chunked;
+    bool failed;
+
+    // Metrics
+    uint32_t startedUs;
+    int status;
+    size_t sentBytes;            // response bytes, sent or queued
+  };
+
+  void acceptClient();
+  void closeConnection(size_t index);
+  void endConnection(size_t index);
+  bool writing(size_t index) const;
+  void drain(size_t index);
+  void resetRequest(Connection& c);
+  bool paused(size_t index) const;
+  void service(size_t index);
+  bool processInput(size_t index);
+  int takeLine(Connection& c);
+  bool requestLine(Connection& c);
+  bool headerLine(Connection& c);
+  bool startBody(size_t index);
+  bool multipartBytes(Connection& c, const uint8_t* data, size_t len);
+  void partBytes(Connection& c, const uint8_t* data, size_t len);
+  bool partHeaderLine(Connection& c);
+  void startPart(Connection& c);
+  void endPart(Connection& c);
+  void finishUpload(Connection& c, HTTPUploadStatus status);
+  void parseForm(Connection& c, const String& form);
+  bool dispatch(Connection& c);
+  bool reject(Connection& c, int code);
+  void recordRequest(Connection& c);
+
+  void sendStatus(int code, const char* contentType, size_t length);
+  void writeOut(Connection& c, const char* data, size_t len);
+  bool flushOut(Connection& c);
+  size_t sendNow(Connection& c, const char* data, size_t len);
+  void waitWritable(Connection& c);
+
+  uint16_t port_;
+  int listenFd_;
+  std::vector<Route> routes_;
+  std::vector<RouteMetrics> routeMetrics_;
+  RouteMetrics unmatchedMetrics_;
+  std::vector<String> headerKeys_;
+  THandlerFunction notFound_;
+  Connection* clients_[PORTAL_MAX_CLIENTS];
+  Connection* current_;  // connection whose handler is running
+  int uploadOwner_;      // connection streaming a multipart body, or -1
+  uint32_t nextRequestId_;
+  uint32_t requestsServed_;
+  HTTPUpload upload_;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define POWER_ACTIVE_MHZ 240
+#define POWER_IDLE_MHZ 160
+#define POWER_SLEEP_MHZ 80           // lowest clock the radio runs at
+#define POWER_IDLE_AFTER_MS 5000     // no request for this long
+#define POWER_SLEEP_AFTER_MS 30000   // no station and no request for this long
+// Longest time loop() blocks waiting for a socket. A socket wakes it at
+// once; these only delay the loop's other work.
+#define POWER_ACTIVE_WAIT_MS 1
+#define POWER_IDLE_WAIT_MS 50
+#define POWER_SLEEP_WAIT_MS 200
+
+enum PowerState {
+  POWER_ACTIVE,  // full clock, serving requests
+  POWER_IDLE,    // a station is associated but quiet
+  POWER_SLEEP,   // nobody there
+  POWER_STATES
+};
+
+struct PowerStats {
+  PowerState state;
+  uint32_t cpuMhz;
+  uint32_t stateMs[POWER_STATES];  // time spent in each state since boot
+  uint32_t wakes;                  // returns to POWER_ACTIVE
+  uint32_t lastWakeUs;             // socket activity to full clock
+  uint32_t lastFirstRequestUs;     // socket activity to the first answer after a wake
+  uint32_t maxFirstRequestUs;
+};
+
+// Picks the CPU clock from what the portal is doing. loop() blocks on its
+// sockets for waitMs() instead of spinning, so the idle task halts the CPU
+// between events, and the clock drops once requests stop and again once no
+// station is left. Socket activity brings the clock back up before the
+// request is read.
+class PowerManager {
+ public:
+  PowerManager();
+
+  void begin();
+  uint32_t waitMs() const;
+  // A socket is ready: back to full clock before it is served
+  void activity();
+  // After the server has run; busy holds the clock up (e.g. an OTA job)
+  void update(uint8_t stations, bool busy, uint32_t requestsServed);
+
+  PowerStats stats() const;
+
+ private:
+  void enter(PowerState state);
+
+  PowerState state_;
+  uint32_t stateMs_[POWER_STATES];
+  uint32_t enteredMs_;
+  uint32_t lastActivityMs_;
+  uint32_t lastStationMs_;
+  uint32_t wakes_;
+  uint32_t wakeStartUs_;
+  uint32_t requests_;        // requests served as of the last update
+  uint32_t wakeRequests_;    // the same when the wake began
+  bool measuring_;           // waiting for the first answer after a wake
+  uint32_t lastWakeUs_;
+  uint32_t lastFirstRequestUs_;
+  uint32_t maxFirstRequestUs_;
+};
+
+extern PowerManager Power;
+
+const char* powerStateName(PowerState state);
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "config_store.h"
+#include "pem_upload.h"
+
+// Written when a bundle commits and removed once it has been applied; a
+// reset in between applies it again at boot
+#define PROVISION_JOURNAL "/provision.json"
+#define PROVISION_SUFFIX ".new"      // staged certificate and key
+#define PROVISION_JOURNAL_MAX 1024   // settings as a JSON object
+
+enum ProvisionResult {
+  PROVISION_OK,
+  PROVISION_BAD_FILE,      // certificate or key rejected
+  PROVISION_BAD_SETTING,   // unknown or too long
+  PROVISION_EMPTY,         // nothing to apply
+  PROVISION_STORAGE_ERROR
+};
+
+// One provisioning bundle: a certificate, a key and settings that are
+// applied together or not at all. The files stream into PROVISION_SUFFIX
+// files next to the live ones as they arrive and settings are only checked,
+// so an incomplete or rejected bundle changes nothing. commit() writes a
+// journal naming everything, swaps the files in and writes the settings in
+// one NVS commit.
+class ProvisionBundle {
+ public:
+  // Shares the upload buffer with the single-file upload routes; the
+  // server streams one upload at a time
+  explicit ProvisionBundle(PemUpload& upload);
+
+  // Starts a bundle for a request, discarding whatever a previous one left
+  // staged
+  void begin(fs::FS& fs, uint32_t requestId);
+  uint32_t requestId() const { return requestId_; }
+
+  // File parts, streamed; name is "cert" or "key"
+  bool startFile(const char* name);
+  bool writeFile(const uint8_t* data, size_t len);
+  bool endFile();
+
+  // Checked against the config store now, applied by commit()
+  ConfigResult addSetting(const char* key, const char* value);
+
+  ProvisionResult commit();
+  void abort();
+
+  bool hasCert() const { return cert_; }
+  bool hasKey() const { return key_; }
+  int settingsWritten() const { return written_; }
+  // Why the bundle failed, and the part that caused it
+  const char* lastError() const { return error_; }
+  const char* field() const { return field_; }
+
+ private:
+  bool fail(ProvisionResult result, const char* field, const char* error);
+  void discard();
+  bool append(const char* data, size_t len);
+  bool hasSetting(const char* key) const;
+
+  fs::FS* fs_;
+  uint32_t requestId_;
+  PemUpload& upload_;
+  const char* fileName_;  // part being streamed, or NULL
+  bool cert_;
+  bool key_;
+  ProvisionResult result_;
+  int written_;
+  char journal_[PROVISION_JOURNAL_MAX];
+  size_t journalLen_;
+  char field_[16];
+  const char* error_;
+};
+
+// Applies a bundle whose commit a reset interrupted and removes staged
+// files of one that never committed. Call after Config.begin().
+void provisionRecover(fs::FS& fs);
+
+const char* provisionResultName(ProvisionResult result);
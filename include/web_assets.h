@@ -0,0 +1,27 @@
+#pragma once
+
+#include <Arduino.h>
+#include "portal_server.h"
+#include "web_assets_gen.h"
+
+#define WEB_ASSET_MAX_AGE 31536000  // links carry ?v=, so a cached copy never goes stale
+
+// A file from web/, gzipped at build time and kept in flash
+struct WebAsset {
+  const char* uri;
+  const char* contentType;
+  const uint8_t* data;   // gzip stream
+  size_t length;
+  const char* etag;      // quoted, from the compressed bytes
+};
+
+// Generated by scripts/web_assets.py
+extern const WebAsset WEB_ASSETS[];
+extern const size_t WEB_ASSET_COUNT;
+
+// Adds a GET route per asset. The server must collect If-None-Match.
+void registerWebAssets(PortalServer& server);
+
+// Answers 304 when the client's copy is current, otherwise sends the
+// compressed bytes straight from flash with Content-Encoding: gzip.
+void sendWebAsset(PortalServer& server, const WebAsset& asset);
@@ -0,0 +1,6 @@
+#pragma once
+
+// Generated by scripts/web_assets.py from web/; do not edit.
+
+// Appended to asset links as ?v=, so a new build is fetched at once
+#define WEB_STYLE_CSS_VERSION "058669b3"
@@ -0,0 +1,153 @@
+#include "CommandDispatcher.h"
+
+#include <Logger.h>
+
+#define COMMAND_IDLE_WAIT_MS 1000  // worker re-checks the queue at least this often
+
+CommandDispatcher Commands;
+
+static portMUX_TYPE commandMux = portMUX_INITIALIZER_UNLOCKED;
+
+// FNV-1a
+static uint32_t hashName(const char* name, size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+  }
+  return hash;
+}
+
+CommandDispatcher::CommandDispatcher()
+    : prefixLength_(0), routes_(NULL), count_(0), fallback_(NULL), busy_(false),
+      waiting_(false), task_(NULL) {
+  prefix_[0] = 0;
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+bool CommandDispatcher::begin(const char* prefix, const CommandRoute* routes, size_t count,
+                              CommandHandler fallback) {
+  size_t prefixLength = strlen(prefix);
+  if (prefixLength >= sizeof(prefix_) || count > COMMAND_ROUTES_MAX) {
+    LOG_ERROR("Commands: prefix or route table too large");
+    return false;
+  }
+  for (size_t i = 0; i < count; i++) {
+    size_t length = strlen(routes[i].name);
+    if (length == 0 || length > COMMAND_TOPIC_MAX) {
+      LOG_ERROR("Commands: bad route name \"%s\"", routes[i].name);
+      return false;
+    }
+    compiled_[i].hash = hashName(routes[i].name, length);
+    compiled_[i].length = length;
+    compiled_[i].index = i;
+  }
+  memcpy(prefix_, prefix, prefixLength + 1);
+  prefixLength_ = prefixLength;
+  routes_ = routes;
+  count_ = count;
+  fallback_ = fallback;
+
+  if (task_ == NULL) {
+    xTaskCreate(workerTask, "commands", COMMAND_TASK_STACK, this, COMMAND_TASK_PRIORITY, &task_);
+  }
+  return true;
+}
+
+bool CommandDispatcher::submit(const char* topic, const uint8_t* payload, size_t length) {
+  if (!queue_.push(topic, payload, length)) {
+    return false;
+  }
+  // Pairs with the fence in workerTask: either the worker sees this message
+  // or this call sees that the worker is waiting
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiting_.load(std::memory_order_relaxed) && waiting_.exchange(false)) {
+    xTaskNotifyGive(task_);
+  }
+  return true;
+}
+
+int CommandDispatcher::match(const char* topic, size_t topicLength) const {
+  if (topicLength <= prefixLength_ || memcmp(topic, prefix_, prefixLength_) != 0) {
+    return -1;
+  }
+  const char* name = topic + prefixLength_;
+  size_t length = topicLength - prefixLength_;
+  uint32_t hash = hashName(name, length);
+  for (size_t i = 0; i < count_; i++) {
+    const CompiledRoute& route = compiled_[i];
+    if (route.hash == hash && route.length == length &&
+        memcmp(routes_[route.index].name, name, length) == 0) {
+      return route.index;
+    }
+  }
+  return -1;
+}
+
+// Handles the oldest message; false when there is none
+bool CommandDispatcher::dispatchOne() {
+  Command command;
+  busy_.store(true);
+  if (!queue_.peek(command)) {
+    busy_.store(false);
+    return false;
+  }
+  uint32_t start = micros();
+  uint32_t latency = start - command.receivedUs;
+
+  int index = match(command.topic, command.topicLength);
+  CommandHandler handler = index >= 0 ? routes_[index].handler : fallback_;
+  if (handler != NULL) {
+    handler(command);
+  }
+  uint32_t elapsed = micros() - start;
+  queue_.pop();
+  busy_.store(false);
+
+  portENTER_CRITICAL(&commandMux);
+  if (index >= 0) {
+    stats_.handled++;
+  } else {
+    stats_.unrouted++;
+  }
+  stats_.lastLatencyUs = latency;
+  if (latency > stats_.maxLatencyUs) {
+    stats_.maxLatencyUs = latency;
+  }
+  stats_.latencyUsTotal += latency;
+  if (elapsed > stats_.maxHandlerUs) {
+    stats_.maxHandlerUs = elapsed;
+  }
+  portEXIT_CRITICAL(&commandMux);
+  return true;
+}
+
+void CommandDispatcher::workerTask(void* arg) {
+  CommandDispatcher* dispatcher = (CommandDispatcher*)arg;
+  for (;;) {
+    while (dispatcher->dispatchOne()) {
+    }
+    // Announce the wait first, then look again, so a message pushed in
+    // between is not left until the timeout
+    dispatcher->waiting_.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!dispatcher->dispatchOne()) {
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(COMMAND_IDLE_WAIT_MS));
+    }
+    dispatcher->waiting_.store(false);
+  }
+}
+
+bool CommandDispatcher::idle() const {
+  return queue_.empty() && !busy_.load();
+}
+
+CommandStats CommandDispatcher::stats() const {
+  portENTER_CRITICAL(&commandMux);
+  CommandStats s = stats_;
+  portEXIT_CRITICAL(&commandMux);
+  CommandQueueStats q = queue_.stats();
+  s.received = q.pushed;
+  s.dropped = q.dropped;
+  s.queuedBytesMax = q.highWater;
+  return s;
+}
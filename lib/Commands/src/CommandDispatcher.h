@@ -0,0 +1,88 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+#include "CommandQueue.h"
+
+#define COMMAND_ROUTES_MAX 16
+#define COMMAND_PREFIX_MAX 64
+#ifndef COMMAND_TASK_STACK
+#define COMMAND_TASK_STACK 8192     // handlers may open a TLS connection
+#endif
+#define COMMAND_TASK_PRIORITY 1
+
+// Called on the dispatcher's task with the message still in the queue;
+// copy anything needed after returning
+typedef void (*CommandHandler)(const Command& command);
+
+// Topic prefix + name -> handler, e.g. "ota" under "devices/abc/cmd/"
+struct CommandRoute {
+  const char* name;
+  CommandHandler handler;
+};
+
+struct CommandStats {
+  uint32_t received;      // accepted into the queue
+  uint32_t dropped;       // queue full or message too large
+  uint32_t handled;
+  uint32_t unrouted;      // no route for the topic
+  uint32_t queuedBytesMax;
+  uint32_t lastLatencyUs; // push to handler start
+  uint32_t maxLatencyUs;
+  uint64_t latencyUsTotal;
+  uint32_t maxHandlerUs;
+};
+
+// Runs inbound MQTT commands off the MQTT client's task. submit() copies
+// the message into a CommandQueue and returns, so the client's loop (and
+// its keepalives) never waits for a handler; a task pops the messages in
+// order and calls the handler routed for each topic.
+//
+// The route table is compiled by begin(): each name is hashed once, so a
+// message costs a prefix compare, one hash of its topic's last part and a
+// scan of at most COMMAND_ROUTES_MAX integers before the final compare.
+class CommandDispatcher {
+ public:
+  CommandDispatcher();
+
+  // routes must stay valid; topics not under prefix, or with no route,
+  // go to fallback when one is given
+  bool begin(const char* prefix, const CommandRoute* routes, size_t count,
+             CommandHandler fallback = NULL);
+
+  // From the MQTT callback (one task only). False when the message was
+  // dropped.
+  bool submit(const char* topic, const uint8_t* payload, size_t length);
+
+  // Index into the routes passed to begin(), or -1
+  int match(const char* topic, size_t topicLength) const;
+
+  // True when nothing is queued or being handled
+  bool idle() const;
+  CommandStats stats() const;
+
+ private:
+  struct CompiledRoute {
+    uint32_t hash;
+    uint16_t length;
+    uint8_t index;
+  };
+
+  static void workerTask(void* arg);
+  bool dispatchOne();
+
+  CommandQueue queue_;
+  char prefix_[COMMAND_PREFIX_MAX];
+  size_t prefixLength_;
+  const CommandRoute* routes_;
+  CompiledRoute compiled_[COMMAND_ROUTES_MAX];
+  size_t count_;
+  CommandHandler fallback_;
+  std::atomic<bool> busy_;       // a handler is running
+  std::atomic<bool> waiting_;    // worker is asleep and wants a notification
+  TaskHandle_t task_;
+  CommandStats stats_;           // handler side; received/dropped come from the queue
+};
+
+extern CommandDispatcher Commands;
@@ -0,0 +1,110 @@
+#include "CommandQueue.h"
+
+#define RECORD_ALIGN 8   // records start aligned, so a header always fits before the end
+#define RECORD_WRAP 0xFFFF
+
+static_assert((COMMAND_QUEUE_BYTES & (COMMAND_QUEUE_BYTES - 1)) == 0,
+              "COMMAND_QUEUE_BYTES must be a power of two");
+static_assert(COMMAND_QUEUE_BYTES % RECORD_ALIGN == 0, "COMMAND_QUEUE_BYTES too small");
+
+CommandQueue::CommandQueue() : head_(0), tail_(0), pushed_(0), dropped_(0), highWater_(0) {
+}
+
+size_t CommandQueue::recordSize(size_t topicLength, size_t length) {
+  size_t size = sizeof(Header) + topicLength + 1 + length + 1;
+  return (size + RECORD_ALIGN - 1) & ~(size_t)(RECORD_ALIGN - 1);
+}
+
+bool CommandQueue::push(const char* topic, const uint8_t* payload, size_t length) {
+  size_t topicLength = strlen(topic);
+  if (topicLength > COMMAND_TOPIC_MAX || length > COMMAND_PAYLOAD_MAX) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  uint32_t size = recordSize(topicLength, length);
+  uint32_t head = head_.load(std::memory_order_relaxed);
+  uint32_t tail = tail_.load(std::memory_order_acquire);
+  uint32_t offset = head & (COMMAND_QUEUE_BYTES - 1);
+
+  // A record never wraps: when it does not fit before the end of the
+  // arena, the rest is skipped and it goes at the start
+  uint32_t skip = COMMAND_QUEUE_BYTES - offset;
+  if (skip >= size) {
+    skip = 0;
+  }
+  uint32_t inUse = head + skip + size - tail;
+  if (inUse > COMMAND_QUEUE_BYTES) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  if (skip > 0) {
+    ((Header*)(arena_ + offset))->topicLength = RECORD_WRAP;
+    offset = 0;
+  }
+
+  Header* header = (Header*)(arena_ + offset);
+  header->topicLength = topicLength;
+  header->length = length;
+  header->receivedUs = micros();
+  char* text = (char*)(header + 1);
+  memcpy(text, topic, topicLength + 1);
+  uint8_t* data = (uint8_t*)text + topicLength + 1;
+  memcpy(data, payload, length);
+  data[length] = 0;
+
+  head_.store(head + skip + size, std::memory_order_release);
+  pushed_.fetch_add(1, std::memory_order_relaxed);
+  if (inUse > highWater_.load(std::memory_order_relaxed)) {
+    highWater_.store(inUse, std::memory_order_relaxed);
+  }
+  return true;
+}
+
+bool CommandQueue::peek(Command& command) {
+  uint32_t tail = tail_.load(std::memory_order_relaxed);
+  for (;;) {
+    if (tail == head_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    uint32_t offset = tail & (COMMAND_QUEUE_BYTES - 1);
+    const Header* header = (const Header*)(arena_ + offset);
+    if (header->topicLength != RECORD_WRAP) {
+      command.topic = (const char*)(header + 1);
+      command.topicLength = header->topicLength;
+      command.payload = (const uint8_t*)command.topic + header->topicLength + 1;
+      command.length = header->length;
+      command.receivedUs = header->receivedUs;
+      return true;
+    }
+    // Give the skipped end back before looking at the start
+    tail += COMMAND_QUEUE_BYTES - offset;
+    tail_.store(tail, std::memory_order_release);
+  }
+}
+
+void CommandQueue::pop() {
+  uint32_t tail = tail_.load(std::memory_order_relaxed);
+  if (tail == head_.load(std::memory_order_acquire)) {
+    return;
+  }
+  // peek() has already stepped over a wrap marker
+  const Header* header = (const Header*)(arena_ + (tail & (COMMAND_QUEUE_BYTES - 1)));
+  tail_.store(tail + recordSize(header->topicLength, header->length), std::memory_order_release);
+}
+
+bool CommandQueue::empty() const {
+  return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire);
+}
+
+size_t CommandQueue::used() const {
+  uint32_t tail = tail_.load(std::memory_order_acquire);
+  return head_.load(std::memory_order_acquire) - tail;
+}
+
+CommandQueueStats CommandQueue::stats() const {
+  CommandQueueStats s;
+  s.pushed = pushed_.load(std::memory_order_relaxed);
+  s.dropped = dropped_.load(std::memory_order_relaxed);
+  s.highWater = highWater_.load(std::memory_order_relaxed);
+  return s;
+}
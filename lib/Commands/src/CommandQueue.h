@@ -0,0 +1,67 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+#ifndef COMMAND_QUEUE_BYTES
+#define COMMAND_QUEUE_BYTES 4096   // arena shared by queued commands; a power of two
+#endif
+#define COMMAND_TOPIC_MAX 128
+#define COMMAND_PAYLOAD_MAX 1024   // the MQTT sketch's message size
+
+// A queued message. topic and payload point into the queue and stay valid
+// until pop(); both are NUL-terminated, so text payloads can be parsed in
+// place.
+struct Command {
+  const char* topic;
+  size_t topicLength;
+  const uint8_t* payload;
+  size_t length;
+  uint32_t receivedUs;   // micros() when pushed
+};
+
+struct CommandQueueStats {
+  uint32_t pushed;
+  uint32_t dropped;      // queue full, or topic or payload over the limit
+  uint32_t highWater;    // most arena bytes in use at once
+};
+
+// Single-producer, single-consumer queue of variable-length messages in a
+// preallocated byte arena. push() copies the topic and payload once, next
+// to a small header, and publishes the record by advancing the head; the
+// consumer reads it where it lies and advances the tail when done. Neither
+// side locks or allocates, and a full queue drops the new message instead
+// of waiting. One task may push and one other task may peek and pop.
+class CommandQueue {
+ public:
+  CommandQueue();
+
+  // Producer side
+  bool push(const char* topic, const uint8_t* payload, size_t length);
+
+  // Consumer side: the oldest message, without removing it
+  bool peek(Command& command);
+  // Frees the message returned by peek()
+  void pop();
+
+  bool empty() const;
+  // Arena bytes in use, headers and padding included
+  size_t used() const;
+  CommandQueueStats stats() const;
+
+ private:
+  struct Header {
+    uint16_t topicLength;   // RECORD_WRAP: the rest of the arena is unused
+    uint16_t length;
+    uint32_t receivedUs;
+  };
+
+  static size_t recordSize(size_t topicLength, size_t length);
+
+  alignas(8) uint8_t arena_[COMMAND_QUEUE_BYTES];
+  std::atomic<uint32_t> head_;   // advanced by the producer only
+  std::atomic<uint32_t> tail_;   // advanced by the consumer only
+  std::atomic<uint32_t> pushed_;
+  std::atomic<uint32_t> dropped_;
+  std::atomic<uint32_t> highWater_;  // written by the producer only
+};
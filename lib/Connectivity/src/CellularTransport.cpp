@@ -0,0 +1,361 @@
+#include "CellularTransport.h"
+
+#include <Logger.h>
+#include <esp_netif_ppp.h>
+
+#define MODEM_READ_CHUNK 256
+#define MODEM_STOP_TIMEOUT_MS 10000  // PPP terminate, escape and ATH
+#define PPP_STOP_TIMEOUT_MS 3000
+
+static portMUX_TYPE cellularMux = portMUX_INITIALIZER_UNLOCKED;
+
+CellularTransport::CellularTransport(HardwareSerial& uart)
+    : Transport(CELLULAR_PRIOR_RTT_MS, CELLULAR_PRIOR_BYTES_PER_SEC), uart_(uart), netif_(NULL),
+      task_(NULL), stop_(false), up_(false), pppFailed_(false), pppDead_(false), dialled_(false),
+      eventsRegistered_(false), backoff_(CELLULAR_BACKOFF_BASE_MS, CELLULAR_BACKOFF_MAX_MS) {
+  apn_[0] = '\0';
+  memset(&driver_, 0, sizeof(driver_));
+  memset(&stats_, 0, sizeof(stats_));
+  stats_.signal = 99;
+  done_ = xSemaphoreCreateBinary();
+}
+
+void CellularTransport::begin(const char* apn) {
+  portENTER_CRITICAL(&cellularMux);
+  bool running = task_ != NULL;
+  bool same = running && strcmp(apn, apn_) == 0;
+  portEXIT_CRITICAL(&cellularMux);
+  if (same) {
+    return;
+  }
+  if (running) {
+    end();
+  }
+  if (!eventsRegistered_) {
+    // Both exist already when WiFi is in use; these only matter without it
+    esp_netif_init();
+    esp_event_loop_create_default();
+    esp_event_handler_register(IP_EVENT, IP_EVENT_PPP_GOT_IP, onIpEvent, this);
+    esp_event_handler_register(IP_EVENT, IP_EVENT_PPP_LOST_IP, onIpEvent, this);
+    esp_event_handler_register(NETIF_PPP_STATUS, ESP_EVENT_ANY_ID, onPppEvent, this);
+    eventsRegistered_ = true;
+  }
+  strncpy(apn_, apn, sizeof(apn_) - 1);
+  apn_[sizeof(apn_) - 1] = '\0';
+  stop_ = false;
+  backoff_.reset();
+  xSemaphoreTake(done_, 0);
+  TaskHandle_t handle;
+  if (xTaskCreatePinnedToCore(task, "modem", MODEM_TASK_STACK, this, MODEM_TASK_PRIORITY,
+                              &handle, tskNO_AFFINITY) != pdPASS) {
+    LOG_ERROR("Cellular: could not start the modem task");
+    return;
+  }
+  portENTER_CRITICAL(&cellularMux);
+  task_ = handle;
+  portEXIT_CRITICAL(&cellularMux);
+}
+
+void CellularTransport::end() {
+  portENTER_CRITICAL(&cellularMux);
+  bool running = task_ != NULL;
+  portEXIT_CRITICAL(&cellularMux);
+  if (!running) {
+    return;
+  }
+  stop_ = true;
+  if (xSemaphoreTake(done_, pdMS_TO_TICKS(MODEM_STOP_TIMEOUT_MS)) != pdTRUE) {
+    LOG_WARN("Cellular: modem task did not stop");
+  }
+}
+
+bool CellularTransport::connected() {
+  return up_;
+}
+
+CellularStats CellularTransport::stats() {
+  portENTER_CRITICAL(&cellularMux);
+  CellularStats s = stats_;
+  portEXIT_CRITICAL(&cellularMux);
+  return s;
+}
+
+void CellularTransport::task(void* arg) {
+  CellularTransport* self = (CellularTransport*)arg;
+  self->run();
+  portENTER_CRITICAL(&cellularMux);
+  self->task_ = NULL;
+  portEXIT_CRITICAL(&cellularMux);
+  xSemaphoreGive(self->done_);
+  vTaskDelete(NULL);
+}
+
+void CellularTransport::run() {
+  uart_.setRxBufferSize(MODEM_RX_BUFFER);
+  uart_.begin(MODEM_BAUD, SERIAL_8N1, MODEM_RX_PIN, MODEM_TX_PIN);
+  while (!stop_) {
+    uint32_t start = millis();
+    portENTER_CRITICAL(&cellularMux);
+    stats_.dials++;
+    portEXIT_CRITICAL(&cellularMux);
+    dialled_ = false;
+    bool wasUp = dial() && session(start);
+    if (dialled_) {
+      hangUp();
+    }
+    if (stop_) {
+      break;
+    }
+    if (wasUp) {
+      // The call dropped after working; redial soon
+      backoff_.reset();
+    } else {
+      portENTER_CRITICAL(&cellularMux);
+      stats_.failures++;
+      portEXIT_CRITICAL(&cellularMux);
+    }
+    uint32_t wait = backoff_.next();
+    LOG_WARN("Cellular: %s, redialling in %u ms", wasUp ? "call dropped" : "no connection", wait);
+    uint32_t waitStart = millis();
+    while (!stop_ && millis() - waitStart < wait) {
+      vTaskDelay(pdMS_TO_TICKS(100));
+    }
+  }
+  uart_.end();
+  LOG_INFO("Cellular: stopped");
+}
+
+// Reads one reply line without its CR LF; false at the deadline
+bool CellularTransport::readLine(char* line, size_t len, uint32_t deadline) {
+  size_t n = 0;
+  while ((int32_t)(millis() - deadline) < 0) {
+    int c = uart_.read();
+    if (c < 0) {
+      vTaskDelay(1);
+    } else if (c == '\r' || c == '\n') {
+      if (n > 0) {
+        line[n] = '\0';
+        return true;
+      }
+    } else if (c >= 0x20 && c < 0x7f && n < len - 1) {
+      line[n++] = (char)c;
+    }
+  }
+  return false;
+}
+
+// Sends a command and waits for a line containing expect. Echoed commands
+// and unsolicited lines are skipped; ERROR ends the wait early.
+bool CellularTransport::command(const char* cmd, const char* expect, uint32_t timeoutMs,
+                                char* reply, size_t replyLen) {
+  // Whatever is left of an earlier reply
+  while (uart_.available() > 0) {
+    uart_.read();
+  }
+  uart_.write((const uint8_t*)cmd, strlen(cmd));
+  uart_.write('\r');
+  uint32_t deadline = millis() + timeoutMs;
+  char line[96];
+  while (readLine(line, sizeof(line), deadline)) {
+    if (strstr(line, expect) != NULL) {
+      if (reply != NULL) {
+        strncpy(reply, line, replyLen - 1);
+        reply[replyLen - 1] = '\0';
+      }
+      return true;
+    }
+    if (strcmp(line, "ERROR") == 0 || strncmp(line, "+CME ERROR", 10) == 0 ||
+        strcmp(line, "NO CARRIER") == 0) {
+      return false;
+    }
+  }
+  return false;
+}
+
+bool CellularTransport::commandRetry(const char* cmd, const char* expect, char* reply, size_t replyLen) {
+  for (int i = 0; i < MODEM_AT_TRIES; i++) {
+    if (i > 0) {
+      portENTER_CRITICAL(&cellularMux);
+      stats_.atRetries++;
+      portEXIT_CRITICAL(&cellularMux);
+    }
+    if (command(cmd, expect, MODEM_AT_TIMEOUT_MS, reply, replyLen)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Registers and dials; on success the modem is in data mode
+bool CellularTransport::dial() {
+  if (!commandRetry("AT", "OK")) {
+    // A reset can leave the modem in data mode from an earlier call
+    hangUp();
+    if (!commandRetry("AT", "OK")) {
+      LOG_WARN("Cellular: modem does not answer");
+      return false;
+    }
+  }
+  // Without the echo the slow UART carries half as much
+  commandRetry("ATE0", "OK");
+
+  char reply[48];
+  if (commandRetry("AT+CSQ", "+CSQ:", reply, sizeof(reply))) {
+    portENTER_CRITICAL(&cellularMux);
+    stats_.signal = atoi(reply + 5);
+    portEXIT_CRITICAL(&cellularMux);
+  }
+
+  // Packet data needs +CGREG registered (1) or roaming (5)
+  uint32_t deadline = millis() + MODEM_REGISTER_TIMEOUT_MS;
+  for (;;) {
+    if (stop_) {
+      return false;
+    }
+    if (command("AT+CGREG?", "+CGREG:", MODEM_AT_TIMEOUT_MS, reply, sizeof(reply))) {
+      const char* comma = strchr(reply, ',');
+      int stat = comma != NULL ? atoi(comma + 1) : 0;
+      if (stat == 1 || stat == 5) {
+        break;
+      }
+    }
+    if ((int32_t)(millis() - deadline) >= 0) {
+      LOG_WARN("Cellular: not registered with the network");
+      return false;
+    }
+    vTaskDelay(pdMS_TO_TICKS(1000));
+  }
+
+  char cmd[96];
+  snprintf(cmd, sizeof(cmd), "AT+CGDCONT=1,\"IP\",\"%s\"", apn_);
+  if (!commandRetry(cmd, "OK")) {
+    LOG_WARN("Cellular: APN \"%s\" rejected", apn_);
+    return false;
+  }
+  // Not retried: if only the CONNECT was lost, the modem is in data mode
+  dialled_ = true;
+  if (!command("ATD*99#", "CONNECT", MODEM_CONNECT_TIMEOUT_MS)) {
+    LOG_WARN("Cellular: dial failed");
+    return false;
+  }
+  return true;
+}
+
+esp_err_t CellularTransport::postAttach(esp_netif_t* netif, void* args) {
+  Driver* driver = (Driver*)args;
+  driver->base.netif = netif;
+  esp_netif_driver_ifconfig_t ifconfig = {};
+  ifconfig.handle = driver;
+  ifconfig.transmit = transmit;
+  esp_netif_set_driver_config(netif, &ifconfig);
+  esp_netif_ppp_config_t ppp = {};
+  ppp.ppp_phase_event_enabled = true;
+  ppp.ppp_error_event_enabled = true;
+  esp_netif_ppp_set_params(netif, &ppp);
+  return ESP_OK;
+}
+
+// Called by lwIP with a PPP frame for the modem
+esp_err_t CellularTransport::transmit(void* handle, void* buffer, size_t len) {
+  CellularTransport* self = ((Driver*)handle)->owner;
+  size_t sent = self->uart_.write((const uint8_t*)buffer, len);
+  portENTER_CRITICAL(&cellularMux);
+  self->stats_.txBytes += sent;
+  portEXIT_CRITICAL(&cellularMux);
+  return sent == len ? ESP_OK : ESP_FAIL;
+}
+
+void CellularTransport::onIpEvent(void* arg, esp_event_base_t base, int32_t id, void* data) {
+  CellularTransport* self = (CellularTransport*)arg;
+  ip_event_got_ip_t* event = (ip_event_got_ip_t*)data;
+  if (id == IP_EVENT_PPP_GOT_IP && event->esp_netif == self->netif_) {
+    self->up_ = true;
+  } else if (id == IP_EVENT_PPP_LOST_IP) {
+    self->up_ = false;
+  }
+}
+
+void CellularTransport::onPppEvent(void* arg, esp_event_base_t base, int32_t id, void* data) {
+  CellularTransport* self = (CellularTransport*)arg;
+  if (id > NETIF_PPP_ERRORNONE && id < NETIF_PP_PHASE_OFFSET) {
+    LOG_DEBUG("Cellular: PPP error %d", (int)id);
+    self->pppFailed_ = true;
+  } else if (id == NETIF_PPP_PHASE_DEAD) {
+    self->pppDead_ = true;
+  }
+}
+
+// Hands what the modem sent to the PPP stack
+void CellularTransport::pump(uint8_t* buf, size_t len) {
+  int n = uart_.available();
+  if (n <= 0) {
+    vTaskDelay(1);
+    return;
+  }
+  n = uart_.read(buf, (size_t)n < len ? (size_t)n : len);
+  if (n > 0) {
+    esp_netif_receive(netif_, buf, n, NULL);
+    portENTER_CRITICAL(&cellularMux);
+    stats_.rxBytes += n;
+    portEXIT_CRITICAL(&cellularMux);
+  }
+}
+
+// Runs PPP over the call until it drops or end() is called. Returns true
+// if the link came up.
+bool CellularTransport::session(uint32_t dialStart) {
+  esp_netif_config_t config = ESP_NETIF_DEFAULT_PPP();
+  netif_ = esp_netif_new(&config);
+  if (netif_ == NULL) {
+    LOG_ERROR("Cellular: could not create the PPP interface");
+    return false;
+  }
+  driver_.base.post_attach = postAttach;
+  driver_.owner = this;
+  esp_netif_attach(netif_, &driver_);
+  up_ = false;
+  pppFailed_ = false;
+  pppDead_ = false;
+  esp_netif_action_start(netif_, 0, 0, NULL);
+
+  uint8_t buf[MODEM_READ_CHUNK];
+  uint32_t pppStart = millis();
+  bool wasUp = false;
+  while (!stop_ && !pppFailed_) {
+    if (up_ && !wasUp) {
+      wasUp = true;
+      uint32_t elapsed = millis() - dialStart;
+      portENTER_CRITICAL(&cellularMux);
+      stats_.connects++;
+      stats_.lastDialMs = elapsed;
+      int signal = stats_.signal;
+      portEXIT_CRITICAL(&cellularMux);
+      LOG_INFO("Cellular: connected to \"%s\" in %u ms (signal %d)", apn_, elapsed, signal);
+    } else if (wasUp && !up_) {
+      break;
+    } else if (!wasUp && millis() - pppStart > MODEM_PPP_TIMEOUT_MS) {
+      LOG_WARN("Cellular: PPP did not come up");
+      break;
+    }
+    pump(buf, sizeof(buf));
+  }
+
+  // Let PPP terminate politely before the interface goes away
+  esp_netif_action_stop(netif_, 0, 0, NULL);
+  uint32_t stopStart = millis();
+  while (!pppDead_ && millis() - stopStart < PPP_STOP_TIMEOUT_MS) {
+    pump(buf, sizeof(buf));
+  }
+  up_ = false;
+  esp_netif_destroy(netif_);
+  netif_ = NULL;
+  return wasUp;
+}
+
+// Back to command mode, then hang up
+void CellularTransport::hangUp() {
+  vTaskDelay(pdMS_TO_TICKS(MODEM_GUARD_MS));
+  uart_.write((const uint8_t*)"+++", 3);
+  vTaskDelay(pdMS_TO_TICKS(MODEM_GUARD_MS));
+  commandRetry("ATH", "OK");
+}
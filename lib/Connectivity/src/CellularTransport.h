@@ -0,0 +1,108 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_event.h>
+#include <esp_netif.h>
+
+#include "ConnectionManager.h"
+#include "Transport.h"
+
+// Modem wiring; override with build flags for other boards
+#ifndef MODEM_UART
+#define MODEM_UART Serial2
+#endif
+#ifndef MODEM_RX_PIN
+#define MODEM_RX_PIN 16
+#endif
+#ifndef MODEM_TX_PIN
+#define MODEM_TX_PIN 17
+#endif
+#ifndef MODEM_BAUD
+#define MODEM_BAUD 115200
+#endif
+
+#define MODEM_RX_BUFFER 2048             // PPP arrives in bursts
+#define MODEM_AT_TIMEOUT_MS 1000
+#define MODEM_AT_TRIES 3                 // a reply can be lost on a noisy line
+#define MODEM_REGISTER_TIMEOUT_MS 60000
+#define MODEM_CONNECT_TIMEOUT_MS 30000   // ATD to CONNECT
+#define MODEM_PPP_TIMEOUT_MS 30000       // CONNECT to an IP address
+#define MODEM_GUARD_MS 1100              // silence around the +++ escape
+#define MODEM_TASK_STACK 4096
+#define MODEM_TASK_PRIORITY 2
+#define CELLULAR_BACKOFF_BASE_MS 5000
+#define CELLULAR_BACKOFF_MAX_MS 300000
+
+// Prior until the link is measured: a 3G-class connection
+#define CELLULAR_PRIOR_RTT_MS 600
+#define CELLULAR_PRIOR_BYTES_PER_SEC 8000
+
+struct CellularStats {
+  uint32_t dials;         // attempts started
+  uint32_t connects;      // attempts that got an IP address
+  uint32_t failures;      // attempts that did not
+  uint32_t atRetries;     // commands repeated after a lost or garbled reply
+  uint32_t lastDialMs;    // first AT command to an IP address
+  int signal;             // AT+CSQ, 0-31, 99 when unknown
+  uint32_t rxBytes;       // PPP bytes over the UART
+  uint32_t txBytes;
+};
+
+// Cellular data through a modem on a UART. AT commands register and dial
+// the APN, then the UART carries PPP for an esp_netif interface, and lwIP
+// routes sockets over it while no other link is up. A task owns the modem:
+// it dials, feeds received bytes to the PPP stack and redials with backoff
+// when the call drops.
+class CellularTransport : public Transport {
+ public:
+  explicit CellularTransport(HardwareSerial& uart);
+
+  // Starts dialling in the background; keeps a call to the same APN
+  void begin(const char* apn);
+
+  LinkType type() const override { return LINK_CELLULAR; }
+  void loop() override {}
+  bool connected() override;
+  // Hangs up; returns once the modem is back in command mode
+  void end() override;
+
+  CellularStats stats();
+
+ private:
+  // Handed to esp_netif_attach(); the netif calls back with its own handle
+  struct Driver {
+    esp_netif_driver_base_t base;
+    CellularTransport* owner;
+  };
+
+  static void task(void* arg);
+  static esp_err_t postAttach(esp_netif_t* netif, void* args);
+  static esp_err_t transmit(void* handle, void* buffer, size_t len);
+  static void onIpEvent(void* arg, esp_event_base_t base, int32_t id, void* data);
+  static void onPppEvent(void* arg, esp_event_base_t base, int32_t id, void* data);
+
+  void run();
+  bool dial();
+  bool session(uint32_t dialStart);
+  void pump(uint8_t* buf, size_t len);
+  void hangUp();
+  bool readLine(char* line, size_t len, uint32_t deadline);
+  bool command(const char* cmd, const char* expect, uint32_t timeoutMs,
+               char* reply = NULL, size_t replyLen = 0);
+  bool commandRetry(const char* cmd, const char* expect, char* reply = NULL, size_t replyLen = 0);
+
+  HardwareSerial& uart_;
+  Driver driver_;
+  esp_netif_t* netif_;
+  char apn_[64];
+  TaskHandle_t task_;
+  SemaphoreHandle_t done_;
+  volatile bool stop_;
+  volatile bool up_;          // PPP has an IP address
+  volatile bool pppFailed_;
+  volatile bool pppDead_;
+  bool dialled_;              // ATD sent; the modem may be in data mode
+  bool eventsRegistered_;
+  Backoff backoff_;
+  CellularStats stats_;
+};
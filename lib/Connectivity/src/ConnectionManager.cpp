@@ -0,0 +1,302 @@
+#include "ConnectionManager.h"
+
+#include <Logger.h>
+#include <Preferences.h>
+
+// Reason the driver gives when the station itself leaves, e.g. from
+// WiFi.disconnect() after a timeout or from WiFi.begin() replacing an attempt
+#define REASON_ASSOC_LEAVE 8
+
+ConnectionManager Connection;
+
+static portMUX_TYPE connectionMux = portMUX_INITIALIZER_UNLOCKED;
+
+Backoff::Backoff(uint32_t baseMs, uint32_t maxMs) : baseMs_(baseMs), maxMs_(maxMs), attempts_(0) {}
+
+uint32_t Backoff::next() {
+  uint32_t ceiling = maxMs_;
+  if (attempts_ < 16 && (baseMs_ << attempts_) < ceiling) {
+    ceiling = baseMs_ << attempts_;
+  }
+  attempts_++;
+  return ceiling / 2 + random(ceiling / 2 + 1);
+}
+
+ConnectionManager::ConnectionManager()
+    : state_(STATE_IDLE), fast_(false), attemptStart_(0), linkRequested_(0), retryAt_(0),
+      backoff_(WIFI_BACKOFF_BASE_MS, WIFI_BACKOFF_MAX_MS), cacheDirty_(false),
+      eventsRegistered_(false) {
+  ssid_[0] = '\0';
+  password_[0] = '\0';
+  memset(&cache_, 0, sizeof(cache_));
+  memset(&seen_, 0, sizeof(seen_));
+  memset(&stats_, 0, sizeof(stats_));
+  up_ = xSemaphoreCreateBinary();
+}
+
+void ConnectionManager::onEvent(arduino_event_id_t event, arduino_event_info_t info) {
+  Connection.handleEvent(event, info);
+}
+
+void ConnectionManager::begin(const char* ssid, const char* password) {
+  if (!eventsRegistered_) {
+    WiFi.onEvent(onEvent);
+    eventsRegistered_ = true;
+  }
+  portENTER_CRITICAL(&connectionMux);
+  bool same = state_ != STATE_IDLE && strcmp(ssid, ssid_) == 0 && strcmp(password, password_) == 0;
+  bool active = state_ != STATE_IDLE;
+  state_ = same ? state_ : STATE_IDLE;
+  portEXIT_CRITICAL(&connectionMux);
+  if (same) {
+    return;
+  }
+  if (active) {
+    WiFi.disconnect();
+  }
+
+  strncpy(ssid_, ssid, sizeof(ssid_) - 1);
+  ssid_[sizeof(ssid_) - 1] = '\0';
+  strncpy(password_, password, sizeof(password_) - 1);
+  password_[sizeof(password_) - 1] = '\0';
+  if ((WiFi.getMode() & WIFI_STA) == 0) {
+    WiFi.mode((wifi_mode_t)(WiFi.getMode() | WIFI_STA));
+  }
+  // Retries are ours; the driver's own reconnect would bypass the backoff
+  WiFi.setAutoReconnect(false);
+  loadCache();
+
+  uint32_t now = millis();
+  portENTER_CRITICAL(&connectionMux);
+  backoff_.reset();
+  linkRequested_ = now;
+  retryAt_ = now;
+  state_ = STATE_WAITING;
+  portEXIT_CRITICAL(&connectionMux);
+  loop();
+}
+
+void ConnectionManager::end() {
+  portENTER_CRITICAL(&connectionMux);
+  state_ = STATE_IDLE;
+  portEXIT_CRITICAL(&connectionMux);
+  WiFi.disconnect();
+}
+
+// Called with connectionMux held
+void ConnectionManager::attemptFailed(uint32_t now) {
+  stats_.failures++;
+  state_ = STATE_WAITING;
+  if (fast_) {
+    // The AP moved or the address is gone; scan right away
+    cache_.valid = false;
+    cacheDirty_ = true;
+    retryAt_ = now;
+  } else {
+    retryAt_ = now + backoff_.next();
+  }
+}
+
+void ConnectionManager::handleEvent(arduino_event_id_t event, const arduino_event_info_t& info) {
+  uint32_t now = millis();
+  bool up = false;
+  bool lost = false;
+  uint32_t elapsed = 0;
+  bool fast = false;
+
+  portENTER_CRITICAL(&connectionMux);
+  switch (event) {
+    case ARDUINO_EVENT_WIFI_STA_CONNECTED:
+      if (state_ == STATE_CONNECTING) {
+        memcpy(seen_.bssid, info.wifi_sta_connected.bssid, sizeof(seen_.bssid));
+        seen_.channel = info.wifi_sta_connected.channel;
+      }
+      break;
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+      if (state_ == STATE_CONNECTING) {
+        seen_.ip = info.got_ip.ip_info.ip.addr;
+        seen_.gateway = info.got_ip.ip_info.gw.addr;
+        seen_.mask = info.got_ip.ip_info.netmask.addr;
+        seen_.dns = cache_.valid ? cache_.dns : 0;
+        seen_.valid = seen_.channel != 0;
+        if (seen_.valid) {
+          cache_ = seen_;
+          cacheDirty_ = true;
+        }
+        state_ = STATE_CONNECTED;
+        backoff_.reset();
+        elapsed = now - linkRequested_;
+        fast = fast_;
+        stats_.connects++;
+        stats_.lastMs = elapsed;
+        stats_.lastFast = fast;
+        if (fast) {
+          stats_.fastConnects++;
+          stats_.fastMsTotal += elapsed;
+        } else {
+          stats_.fullMsTotal += elapsed;
+        }
+        up = true;
+      }
+      break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+      if (state_ == STATE_CONNECTED) {
+        // Try the known AP again at once
+        state_ = STATE_WAITING;
+        linkRequested_ = now;
+        retryAt_ = now;
+        lost = true;
+      } else if (state_ == STATE_CONNECTING &&
+                 info.wifi_sta_disconnected.reason != REASON_ASSOC_LEAVE) {
+        attemptFailed(now);
+      }
+      break;
+    default:
+      break;
+  }
+  portEXIT_CRITICAL(&connectionMux);
+
+  if (up) {
+    LOG_INFO("WiFi: connected to %s in %u ms (%s)", ssid_, elapsed, fast ? "fast" : "scan");
+    xSemaphoreGive(up_);
+  }
+  if (lost) {
+    LOG_WARN("WiFi: link lost (reason %u), reconnecting", info.wifi_sta_disconnected.reason);
+  }
+}
+
+void ConnectionManager::startAttempt(const FastConnect& known) {
+  if (known.valid) {
+    IPAddress dns(known.dns != 0 ? known.dns : known.gateway);
+    WiFi.config(IPAddress(known.ip), IPAddress(known.gateway), IPAddress(known.mask), dns);
+    WiFi.begin(ssid_, password_, known.channel, known.bssid);
+  } else {
+    // All zeros switches the station back to DHCP
+    WiFi.config(IPAddress(), IPAddress(), IPAddress());
+    WiFi.begin(ssid_, password_);
+  }
+}
+
+void ConnectionManager::loop() {
+  uint32_t now = millis();
+  bool start = false;
+  bool timedOut = false;
+  FastConnect known;
+  portENTER_CRITICAL(&connectionMux);
+  if (state_ == STATE_WAITING && (int32_t)(now - retryAt_) >= 0) {
+    // Claimed here, so only one task starts the attempt
+    state_ = STATE_CONNECTING;
+    fast_ = cache_.valid;
+    attemptStart_ = now;
+    memset(&seen_, 0, sizeof(seen_));
+    known = cache_;
+    start = true;
+  } else if (state_ == STATE_CONNECTING &&
+             now - attemptStart_ > (fast_ ? WIFI_FAST_TIMEOUT_MS : WIFI_ATTEMPT_TIMEOUT_MS)) {
+    attemptFailed(now);
+    timedOut = true;
+  }
+  bool dirty = cacheDirty_;
+  cacheDirty_ = false;
+  portEXIT_CRITICAL(&connectionMux);
+
+  if (timedOut) {
+    LOG_WARN("WiFi: connection attempt timed out");
+    WiFi.disconnect();
+  }
+  if (dirty) {
+    saveCache();
+  }
+  if (start) {
+    xSemaphoreTake(up_, 0);
+    startAttempt(known);
+  }
+}
+
+bool ConnectionManager::connected() {
+  portENTER_CRITICAL(&connectionMux);
+  bool up = state_ == STATE_CONNECTED;
+  portEXIT_CRITICAL(&connectionMux);
+  return up;
+}
+
+bool ConnectionManager::waitConnected(uint32_t timeoutMs) {
+  uint32_t start = millis();
+  while (!connected()) {
+    uint32_t elapsed = millis() - start;
+    if (elapsed >= timeoutMs) {
+      return false;
+    }
+    loop();
+    uint32_t wait = timeoutMs - elapsed < 100 ? timeoutMs - elapsed : 100;
+    xSemaphoreTake(up_, pdMS_TO_TICKS(wait));
+  }
+  loop();  // stores the new association
+  return true;
+}
+
+WiFiConnectStats ConnectionManager::stats() {
+  portENTER_CRITICAL(&connectionMux);
+  WiFiConnectStats s = stats_;
+  portEXIT_CRITICAL(&connectionMux);
+  return s;
+}
+
+void ConnectionManager::loadCache() {
+  FastConnect c;
+  memset(&c, 0, sizeof(c));
+  Preferences prefs;
+  prefs.begin("wifi_fast", true);
+  char ssid[33];
+  if (prefs.getString("ssid", ssid, sizeof(ssid)) > 0 && strcmp(ssid, ssid_) == 0 &&
+      prefs.getBytes("bssid", c.bssid, sizeof(c.bssid)) == sizeof(c.bssid)) {
+    c.channel = prefs.getUChar("ch", 0);
+    c.ip = prefs.getUInt("ip", 0);
+    c.gateway = prefs.getUInt("gw", 0);
+    c.mask = prefs.getUInt("mask", 0);
+    c.dns = prefs.getUInt("dns", 0);
+    c.valid = c.channel != 0 && c.ip != 0 && c.mask != 0;
+  }
+  prefs.end();
+  portENTER_CRITICAL(&connectionMux);
+  cache_ = c;
+  portEXIT_CRITICAL(&connectionMux);
+}
+
+// Writes the cache to NVS only when it differs from what is stored there
+void ConnectionManager::saveCache() {
+  portENTER_CRITICAL(&connectionMux);
+  FastConnect c = cache_;
+  portEXIT_CRITICAL(&connectionMux);
+
+  Preferences prefs;
+  prefs.begin("wifi_fast", false);
+  if (!c.valid) {
+    prefs.clear();
+    prefs.end();
+    return;
+  }
+  if (c.dns == 0) {
+    c.dns = WiFi.dnsIP(0);
+    portENTER_CRITICAL(&connectionMux);
+    cache_.dns = c.dns;
+    portEXIT_CRITICAL(&connectionMux);
+  }
+  uint8_t bssid[6];
+  char ssid[33];
+  bool same = prefs.getString("ssid", ssid, sizeof(ssid)) > 0 && strcmp(ssid, ssid_) == 0 &&
+              prefs.getBytes("bssid", bssid, sizeof(bssid)) == sizeof(bssid) &&
+              memcmp(bssid, c.bssid, sizeof(bssid)) == 0 && prefs.getUChar("ch", 0) == c.channel &&
+              prefs.getUInt("ip", 0) == c.ip && prefs.getUInt("gw", 0) == c.gateway &&
+              prefs.getUInt("mask", 0) == c.mask && prefs.getUInt("dns", 0) == c.dns;
+  if (!same) {
+    prefs.putString("ssid", ssid_);
+    prefs.putBytes("bssid", c.bssid, sizeof(c.bssid));
+    prefs.putUChar("ch", c.channel);
+    prefs.putUInt("ip", c.ip);
+    prefs.putUInt("gw", c.gateway);
+    prefs.putUInt("mask", c.mask);
+    prefs.putUInt("dns", c.dns);
+  }
+  prefs.end();
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#define WIFI_BACKOFF_BASE_MS 500
+#define WIFI_BACKOFF_MAX_MS 60000
+#define WIFI_ATTEMPT_TIMEOUT_MS 15000  // scan, association and DHCP
+#define WIFI_FAST_TIMEOUT_MS 3000      // known AP; falls back to a scan after this
+
+// Exponential backoff with jitter: the n-th delay is picked at random from
+// the upper half of base * 2^(n-1), capped at max, so devices that lost
+// the same AP do not retry in lockstep.
+class Backoff {
+ public:
+  Backoff(uint32_t baseMs, uint32_t maxMs);
+
+  // Delay before the next attempt; each call doubles the range
+  uint32_t next();
+  void reset() { attempts_ = 0; }
+  uint32_t attempts() const { return attempts_; }
+
+ private:
+  uint32_t baseMs_;
+  uint32_t maxMs_;
+  uint32_t attempts_;
+};
+
+struct WiFiConnectStats {
+  uint32_t connects;
+  uint32_t fastConnects;    // used the cached BSSID, channel and IP
+  uint32_t failures;        // attempts that timed out or were rejected
+  uint32_t lastMs;          // from losing (or requesting) the link to having an IP
+  bool lastFast;
+  uint32_t fastMsTotal;
+  uint32_t fullMsTotal;
+};
+
+// Keeps the station connected without blocking the caller. Progress comes
+// from WiFi events; loop() only starts retries whose backoff has expired
+// and enforces attempt timeouts.
+//
+// After a good association the BSSID, channel and IP settings are kept in
+// NVS. The next attempt joins that AP directly, with the cached address as
+// a static IP, which skips the scan and DHCP. If that attempt fails, the
+// cache is dropped and the following attempts scan and use DHCP.
+class ConnectionManager {
+ public:
+  ConnectionManager();
+
+  // Starts connecting in the background. Keeps an existing connection to
+  // the same network. The soft AP, if running, stays up.
+  void begin(const char* ssid, const char* password);
+  // Disconnects and stops retrying
+  void end();
+
+  // Call regularly from the task that called begin()
+  void loop();
+
+  bool connected();
+  // Drives loop() until the link is up; for background tasks that cannot
+  // continue without it
+  bool waitConnected(uint32_t timeoutMs);
+
+  WiFiConnectStats stats();
+
+ private:
+  enum State {
+    STATE_IDLE,
+    STATE_CONNECTING,
+    STATE_CONNECTED,
+    STATE_WAITING  // for the backoff to expire
+  };
+
+  struct FastConnect {
+    bool valid;
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t mask;
+    uint32_t dns;
+  };
+
+  static void onEvent(arduino_event_id_t event, arduino_event_info_t info);
+  void handleEvent(arduino_event_id_t event, const arduino_event_info_t& info);
+  void startAttempt(const FastConnect& known);
+  void attemptFailed(uint32_t now);
+  void loadCache();
+  void saveCache();
+
+  char ssid_[33];
+  char password_[64];
+  State state_;
+  bool fast_;            // current attempt uses the cache
+  uint32_t attemptStart_;
+  uint32_t linkRequested_;
+  uint32_t retryAt_;
+  Backoff backoff_;
+  FastConnect cache_;
+  FastConnect seen_;     // filled in by events of the current attempt
+  bool cacheDirty_;
+  bool eventsRegistered_;
+  SemaphoreHandle_t up_;
+  WiFiConnectStats stats_;
+};
+
+extern ConnectionManager Connection;
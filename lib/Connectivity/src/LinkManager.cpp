@@ -0,0 +1,190 @@
+#include "LinkManager.h"
+
+#include <Logger.h>
+
+LinkManager Link;
+
+static portMUX_TYPE linkMux = portMUX_INITIALIZER_UNLOCKED;
+
+LinkManager::LinkManager()
+    : cellular_(MODEM_UART), wifiConfigured_(false), cellularRunning_(false), wifiUp_(false),
+      wifiChangedAt_(0) {
+  apn_[0] = '\0';
+  memset(&stats_, 0, sizeof(stats_));
+  stats_.active = LINK_NONE;
+}
+
+void LinkManager::begin(const char* ssid, const char* password, const char* apn) {
+  wifiConfigured_ = ssid != NULL && ssid[0] != '\0';
+  strncpy(apn_, apn != NULL ? apn : "", sizeof(apn_) - 1);
+  apn_[sizeof(apn_) - 1] = '\0';
+  if (wifiConfigured_) {
+    wifi_.begin(ssid, password);
+  }
+  if (!wifiUp_) {
+    // The failover delay counts from the request
+    wifiChangedAt_ = millis();
+  }
+  if (cellularRunning_ && apn_[0] == '\0') {
+    cellular_.end();
+    cellularRunning_ = false;
+  }
+  loop();
+}
+
+void LinkManager::end() {
+  wifi_.end();
+  cellular_.end();
+  cellularRunning_ = false;
+  wifiConfigured_ = false;
+  wifiUp_ = false;
+  setActive(LINK_NONE);
+}
+
+void LinkManager::hangUp() {
+  // No redial until the next begin()
+  apn_[0] = '\0';
+  if (cellularRunning_) {
+    cellular_.end();
+    cellularRunning_ = false;
+  }
+  loop();
+}
+
+void LinkManager::loop() {
+  if (wifiConfigured_) {
+    wifi_.loop();
+  }
+  uint32_t now = millis();
+  bool wifiUp = wifiConfigured_ && wifi_.connected();
+  if (wifiUp != wifiUp_) {
+    wifiUp_ = wifiUp;
+    wifiChangedAt_ = now;
+  }
+  bool cellularUp = cellularRunning_ && cellular_.connected();
+
+  LinkType next;
+  if (active() == LINK_CELLULAR && cellularUp) {
+    // WiFi has to stay up a while before the call is given up for it
+    next = wifiUp && now - wifiChangedAt_ >= LINK_FAILBACK_MS ? LINK_WIFI : LINK_CELLULAR;
+  } else if (wifiUp) {
+    next = LINK_WIFI;
+  } else if (cellularUp) {
+    next = LINK_CELLULAR;
+  } else {
+    next = LINK_NONE;
+  }
+
+  if (next == LINK_WIFI && cellularRunning_) {
+    // Blocks for the PPP terminate and the modem's escape guard times
+    cellular_.end();
+    cellularRunning_ = false;
+  } else if (next != LINK_WIFI && !cellularRunning_ && apn_[0] != '\0' &&
+             (!wifiConfigured_ || (!wifiUp && now - wifiChangedAt_ >= LINK_FAILOVER_MS))) {
+    if (wifiConfigured_) {
+      LOG_WARN("Link: WiFi down for %u ms, dialling cellular", now - wifiChangedAt_);
+    }
+    cellular_.begin(apn_);
+    cellularRunning_ = true;
+  }
+  setActive(next);
+}
+
+void LinkManager::setActive(LinkType type) {
+  portENTER_CRITICAL(&linkMux);
+  LinkType previous = stats_.active;
+  if (previous != type) {
+    stats_.active = type;
+    stats_.switches++;
+    stats_.generation++;
+    if (type == LINK_CELLULAR) {
+      stats_.failovers++;
+    }
+  }
+  portEXIT_CRITICAL(&linkMux);
+  if (previous != type) {
+    LinkTuning t = tuning();
+    LOG_INFO("Link: %s -> %s (chunks of %u bytes, %u in flight, %u ms timeout)",
+             linkTypeName(previous), linkTypeName(type), (unsigned)t.chunkBytes, t.inFlight,
+             t.timeoutMs);
+  }
+}
+
+bool LinkManager::connected() {
+  Transport* t = transport(active());
+  return t != NULL && t->connected();
+}
+
+bool LinkManager::waitConnected(uint32_t timeoutMs) {
+  uint32_t start = millis();
+  for (;;) {
+    loop();
+    if (connected()) {
+      loop();  // stores the new WiFi association
+      return true;
+    }
+    uint32_t elapsed = millis() - start;
+    if (elapsed >= timeoutMs) {
+      return false;
+    }
+    vTaskDelay(pdMS_TO_TICKS(timeoutMs - elapsed < LINK_POLL_MS ? timeoutMs - elapsed : LINK_POLL_MS));
+  }
+}
+
+LinkType LinkManager::active() {
+  portENTER_CRITICAL(&linkMux);
+  LinkType type = stats_.active;
+  portEXIT_CRITICAL(&linkMux);
+  return type;
+}
+
+uint32_t LinkManager::generation() {
+  portENTER_CRITICAL(&linkMux);
+  uint32_t generation = stats_.generation;
+  portEXIT_CRITICAL(&linkMux);
+  return generation;
+}
+
+Transport* LinkManager::transport(LinkType type) {
+  switch (type) {
+    case LINK_WIFI: return &wifi_;
+    case LINK_CELLULAR: return &cellular_;
+    default: return NULL;
+  }
+}
+
+// Without a link, transfers are sized for WiFi, the link tried first
+LinkTuning LinkManager::tuning() {
+  Transport* t = transport(active());
+  return (t != NULL ? t : &wifi_)->estimator().tuning();
+}
+
+void LinkManager::sampleRtt(uint32_t ms) {
+  Transport* t = transport(active());
+  if (t != NULL) {
+    t->estimator().sampleRtt(ms);
+  }
+}
+
+void LinkManager::sampleTransfer(size_t bytes, uint32_t ms) {
+  Transport* t = transport(active());
+  if (t != NULL) {
+    t->estimator().sampleTransfer(bytes, ms);
+  }
+}
+
+LinkEstimate LinkManager::estimate(LinkType type) {
+  Transport* t = transport(type);
+  if (t == NULL) {
+    LinkEstimate none = {};
+    return none;
+  }
+  return t->estimator().estimate();
+}
+
+LinkStats LinkManager::stats() {
+  portENTER_CRITICAL(&linkMux);
+  LinkStats s = stats_;
+  portEXIT_CRITICAL(&linkMux);
+  return s;
+}
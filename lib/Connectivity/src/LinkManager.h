@@ -0,0 +1,73 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "CellularTransport.h"
+#include "Transport.h"
+#include "WiFiTransport.h"
+
+#define LINK_FAILOVER_MS 20000   // WiFi down this long before cellular is dialled
+#define LINK_FAILBACK_MS 30000   // WiFi back this long before cellular hangs up
+#define LINK_POLL_MS 50
+
+struct LinkStats {
+  LinkType active;
+  uint32_t switches;       // changes of the active link, to none included
+  uint32_t failovers;      // switches to cellular
+  uint32_t generation;
+};
+
+// Picks the link traffic goes over. WiFi is preferred; when it stays down
+// for LINK_FAILOVER_MS (or no network is saved) and an APN is set, the
+// modem dials. WiFi keeps retrying meanwhile, and once it has been back for
+// LINK_FAILBACK_MS the call is hung up.
+//
+// Sockets opened on one link die when traffic moves to another, so
+// clients compare generation() to reconnect after a switch. Transfers ask
+// tuning() how to size themselves and feed back what they measured.
+class LinkManager {
+ public:
+  LinkManager();
+
+  // Either network may be empty. Keeps links that are already up.
+  void begin(const char* ssid, const char* password, const char* apn);
+  // Takes every link down
+  void end();
+  // Hangs up a cellular call and stops dialling until begin(); WiFi is
+  // left as it is
+  void hangUp();
+
+  // Call regularly from the task that called begin()
+  void loop();
+
+  bool connected();
+  // Drives loop() until a link is up
+  bool waitConnected(uint32_t timeoutMs);
+
+  LinkType active();
+  uint32_t generation();
+
+  // For the active link
+  LinkTuning tuning();
+  void sampleRtt(uint32_t ms);
+  void sampleTransfer(size_t bytes, uint32_t ms);
+
+  LinkEstimate estimate(LinkType type);
+  CellularStats cellularStats() { return cellular_.stats(); }
+  LinkStats stats();
+
+ private:
+  Transport* transport(LinkType type);
+  void setActive(LinkType type);
+
+  WiFiTransport wifi_;
+  CellularTransport cellular_;
+  bool wifiConfigured_;
+  char apn_[64];
+  bool cellularRunning_;
+  bool wifiUp_;
+  uint32_t wifiChangedAt_;   // when WiFi last came up or went down
+  LinkStats stats_;
+};
+
+extern LinkManager Link;
@@ -0,0 +1,81 @@
+#include "Transport.h"
+
+static portMUX_TYPE estimateMux = portMUX_INITIALIZER_UNLOCKED;
+
+LinkEstimator::LinkEstimator(uint32_t rttMs, uint32_t bytesPerSec)
+    : priorRttMs_(rttMs), priorBytesPerSec_(bytesPerSec) {
+  reset();
+}
+
+void LinkEstimator::reset() {
+  portENTER_CRITICAL(&estimateMux);
+  estimate_.rttMs = priorRttMs_;
+  estimate_.bytesPerSec = priorBytesPerSec_;
+  estimate_.rttSamples = 0;
+  estimate_.rateSamples = 0;
+  portEXIT_CRITICAL(&estimateMux);
+}
+
+void LinkEstimator::sampleRtt(uint32_t ms) {
+  portENTER_CRITICAL(&estimateMux);
+  if (estimate_.rttSamples == 0) {
+    estimate_.rttMs = ms;
+  } else {
+    estimate_.rttMs = (int32_t)estimate_.rttMs + ((int32_t)ms - (int32_t)estimate_.rttMs) / 8;
+  }
+  estimate_.rttSamples++;
+  portEXIT_CRITICAL(&estimateMux);
+}
+
+void LinkEstimator::sampleTransfer(size_t bytes, uint32_t ms) {
+  if (ms == 0 || bytes == 0) {
+    return;
+  }
+  uint32_t rate = (uint64_t)bytes * 1000 / ms;
+  portENTER_CRITICAL(&estimateMux);
+  if (estimate_.rateSamples == 0) {
+    estimate_.bytesPerSec = rate;
+  } else {
+    estimate_.bytesPerSec = (int32_t)estimate_.bytesPerSec +
+                            ((int32_t)rate - (int32_t)estimate_.bytesPerSec) / 4;
+  }
+  estimate_.rateSamples++;
+  portEXIT_CRITICAL(&estimateMux);
+}
+
+LinkEstimate LinkEstimator::estimate() const {
+  portENTER_CRITICAL(&estimateMux);
+  LinkEstimate e = estimate_;
+  portEXIT_CRITICAL(&estimateMux);
+  return e;
+}
+
+LinkTuning LinkEstimator::tuning() const {
+  LinkEstimate e = estimate();
+  uint32_t rate = e.bytesPerSec > 0 ? e.bytesPerSec : 1;
+  LinkTuning t;
+
+  uint64_t bdp = (uint64_t)rate * e.rttMs / 1000;
+  t.chunkBytes = LINK_CHUNK_MIN;
+  while (t.chunkBytes < bdp && t.chunkBytes < LINK_CHUNK_MAX) {
+    t.chunkBytes *= 2;
+  }
+
+  uint64_t timeout = 4 * (uint64_t)e.rttMs + 2 * (uint64_t)t.chunkBytes * 1000 / rate;
+  t.timeoutMs = timeout < LINK_TIMEOUT_MIN_MS ? LINK_TIMEOUT_MIN_MS
+              : timeout > LINK_TIMEOUT_MAX_MS ? LINK_TIMEOUT_MAX_MS : (uint32_t)timeout;
+
+  uint64_t buffered = (uint64_t)rate * (e.rttMs + LINK_WRITE_STALL_MS) / 1000;
+  uint64_t inFlight = (buffered + t.chunkBytes - 1) / t.chunkBytes + 1;
+  t.inFlight = inFlight < LINK_IN_FLIGHT_MIN ? LINK_IN_FLIGHT_MIN
+             : inFlight > LINK_IN_FLIGHT_MAX ? LINK_IN_FLIGHT_MAX : (uint8_t)inFlight;
+  return t;
+}
+
+const char* linkTypeName(LinkType type) {
+  switch (type) {
+    case LINK_WIFI: return "wifi";
+    case LINK_CELLULAR: return "cellular";
+    default: return "none";
+  }
+}
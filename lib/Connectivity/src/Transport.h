@@ -0,0 +1,84 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Limits of LinkEstimator::tuning()
+#define LINK_CHUNK_MIN 512
+#define LINK_CHUNK_MAX 4096          // one flash sector
+#define LINK_TIMEOUT_MIN_MS 10000    // room for a few TCP retransmissions
+#define LINK_TIMEOUT_MAX_MS 60000
+#define LINK_IN_FLIGHT_MIN 2         // one buffer filling while one drains
+#define LINK_IN_FLIGHT_MAX 4
+#define LINK_WRITE_STALL_MS 100      // longest flash erase the buffers must cover
+
+enum LinkType {
+  LINK_NONE,
+  LINK_WIFI,
+  LINK_CELLULAR,
+  LINK_TYPES
+};
+
+// How a transfer should use the link it runs over
+struct LinkTuning {
+  size_t chunkBytes;    // read and buffer size
+  uint32_t timeoutMs;   // connect and read stall timeout
+  uint8_t inFlight;     // buffers (or messages) queued at once
+};
+
+struct LinkEstimate {
+  uint32_t rttMs;
+  uint32_t bytesPerSec;
+  uint32_t rttSamples;   // 0 while the prior is in use
+  uint32_t rateSamples;
+};
+
+// Smoothed round-trip time and throughput of one link, kept the way TCP
+// keeps its RTT: each sample moves the estimate an eighth of the way (a
+// quarter for throughput). It starts from a prior for the link type, so
+// the first transfer is already sized for it.
+class LinkEstimator {
+ public:
+  LinkEstimator(uint32_t rttMs, uint32_t bytesPerSec);
+
+  // Back to the prior, e.g. when a new session starts
+  void reset();
+  // A TCP connect: one round trip
+  void sampleRtt(uint32_t ms);
+  // Bytes received while the reader was waiting on the link
+  void sampleTransfer(size_t bytes, uint32_t ms);
+
+  LinkEstimate estimate() const;
+  // Chunks of about one bandwidth-delay product, a timeout of a few round
+  // trips plus the time a chunk takes, and enough buffers to keep reading
+  // through a round trip and a flash erase
+  LinkTuning tuning() const;
+
+ private:
+  uint32_t priorRttMs_;
+  uint32_t priorBytesPerSec_;
+  LinkEstimate estimate_;
+};
+
+// A way onto the network. Sockets (WiFiClient, TlsClient) go over
+// whichever interface lwIP routes to; a transport brings its interface up,
+// keeps it up and measures it.
+class Transport {
+ public:
+  virtual ~Transport() {}
+
+  virtual LinkType type() const = 0;
+  // Call regularly from the task that started the transport
+  virtual void loop() = 0;
+  virtual bool connected() = 0;
+  // Takes the link down and stops retrying
+  virtual void end() = 0;
+
+  LinkEstimator& estimator() { return estimator_; }
+
+ protected:
+  Transport(uint32_t rttMs, uint32_t bytesPerSec) : estimator_(rttMs, bytesPerSec) {}
+
+  LinkEstimator estimator_;
+};
+
+const char* linkTypeName(LinkType type);
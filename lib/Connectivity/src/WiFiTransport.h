@@ -0,0 +1,21 @@
+#pragma once
+
+#include "ConnectionManager.h"
+#include "Transport.h"
+
+// Prior until the link is measured
+#define WIFI_PRIOR_RTT_MS 20
+#define WIFI_PRIOR_BYTES_PER_SEC 200000
+
+// The station link, kept up by the shared connection manager
+class WiFiTransport : public Transport {
+ public:
+  WiFiTransport() : Transport(WIFI_PRIOR_RTT_MS, WIFI_PRIOR_BYTES_PER_SEC) {}
+
+  void begin(const char* ssid, const char* password) { Connection.begin(ssid, password); }
+
+  LinkType type() const override { return LINK_WIFI; }
+  void loop() override { Connection.loop(); }
+  bool connected() override { return Connection.connected(); }
+  void end() override { Connection.end(); }
+};
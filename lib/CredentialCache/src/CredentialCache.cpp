@@ -0,0 +1,137 @@
+#include "CredentialCache.h"
+
+CredentialCache Credentials;
+
+CredentialCache::CredentialCache()
+  : buffer_(NULL), cert_(NULL), key_(NULL), certLen_(0), keyLen_(0) {}
+
+CredentialCache::~CredentialCache() {
+  clear();
+}
+
+void CredentialCache::clear() {
+  free(buffer_);
+  buffer_ = NULL;
+  cert_ = NULL;
+  key_ = NULL;
+  certLen_ = 0;
+  keyLen_ = 0;
+}
+
+// Reads a whole file into dst; len is the file size
+static bool readInto(fs::FS& fs, const char* path, uint8_t* dst, size_t len) {
+  File file = fs.open(path, FILE_READ);
+  if (!file) {
+    return false;
+  }
+  size_t got = file.read(dst, len);
+  file.close();
+  return got == len;
+}
+
+static int base64Value(uint8_t c) {
+  if (c >= 'A' && c <= 'Z') {
+    return c - 'A';
+  }
+  if (c >= 'a' && c <= 'z') {
+    return c - 'a' + 26;
+  }
+  if (c >= '0' && c <= '9') {
+    return c - '0' + 52;
+  }
+  return c == '+' ? 62 : c == '/' ? 63 : -1;
+}
+
+// Decodes the body of every PEM block in buf, in place, and returns the
+// length of the DER written from buf[0]: one structure per block, back to
+// back. Text outside blocks and header lines ("Proc-Type: ...") are
+// skipped. The output never overtakes the input, since four base64
+// characters make three bytes. Returns 0 if there is no block.
+static size_t pemToDer(uint8_t* buf, size_t len) {
+  size_t out = 0;
+  bool inBlock = false;
+  uint32_t bits = 0;
+  int count = 0;
+  for (size_t pos = 0; pos < len;) {
+    size_t end = pos;
+    while (end < len && buf[end] != '\n') {
+      end++;
+    }
+    const char* line = (const char*)buf + pos;
+    size_t lineLen = end - pos;
+    if (lineLen >= 5 && strncmp(line, "-----", 5) == 0) {
+      // A padded block ends with two or three characters left: one or two
+      // more bytes
+      if (inBlock && count >= 2) {
+        bits <<= 6 * (4 - count);
+        buf[out++] = bits >> 16;
+        if (count == 3) {
+          buf[out++] = bits >> 8;
+        }
+      }
+      inBlock = lineLen >= 11 && strncmp(line, "-----BEGIN ", 11) == 0;
+      bits = 0;
+      count = 0;
+    } else if (inBlock && memchr(line, ':', lineLen) == NULL) {
+      for (size_t i = pos; i < end; i++) {
+        int value = base64Value(buf[i]);
+        if (value < 0) {
+          continue;  // '\r', trailing spaces, '=' padding
+        }
+        bits = bits << 6 | value;
+        if (++count == 4) {
+          buf[out++] = bits >> 16;
+          buf[out++] = bits >> 8;
+          buf[out++] = bits;
+          bits = 0;
+          count = 0;
+        }
+      }
+    }
+    pos = end + 1;
+  }
+  return out;
+}
+
+bool CredentialCache::load(fs::FS& fs) {
+  clear();
+  if (!fs.exists(DEVICE_CERT_PATH) || !fs.exists(DEVICE_KEY_PATH)) {
+    return false;
+  }
+  File certFile = fs.open(DEVICE_CERT_PATH, FILE_READ);
+  File keyFile = fs.open(DEVICE_KEY_PATH, FILE_READ);
+  size_t certLen = certFile ? certFile.size() : 0;
+  size_t keyLen = keyFile ? keyFile.size() : 0;
+  certFile.close();
+  keyFile.close();
+  if (certLen == 0 || keyLen == 0) {
+    return false;
+  }
+
+  // Certificate and key share one allocation. Each PEM file is decoded
+  // where it was read, the key straight after the certificate's DER, and
+  // the buffer is trimmed to the DER at the end.
+  uint8_t* buffer = (uint8_t*)malloc(certLen + keyLen);
+  if (buffer == NULL) {
+    return false;
+  }
+  size_t certDer = 0;
+  size_t keyDer = 0;
+  if (readInto(fs, DEVICE_CERT_PATH, buffer, certLen)) {
+    certDer = pemToDer(buffer, certLen);
+  }
+  if (certDer > 0 && readInto(fs, DEVICE_KEY_PATH, buffer + certDer, keyLen)) {
+    keyDer = pemToDer(buffer + certDer, keyLen);
+  }
+  if (certDer == 0 || keyDer == 0) {
+    free(buffer);
+    return false;
+  }
+  uint8_t* trimmed = (uint8_t*)realloc(buffer, certDer + keyDer);
+  buffer_ = trimmed != NULL ? trimmed : buffer;
+  cert_ = buffer_;
+  key_ = buffer_ + certDer;
+  certLen_ = certDer;
+  keyLen_ = keyDer;
+  return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+#define DEVICE_CERT_PATH "/cert/device.pem"
+#define DEVICE_KEY_PATH "/cert/private.pem"
+
+// Device certificate and private key, read from the filesystem and decoded
+// from PEM to DER once, when they are loaded (at boot and after an upload is
+// committed), into a single long-lived buffer. TLS clients get pointers into
+// that buffer and parse the DER in place, so a connection costs no file
+// reads, no base64 decoding and no copies.
+//
+// TlsClient keeps the pointers it is given, so load() and clear() must not
+// run while a client configured from the cache may still connect.
+class CredentialCache {
+ public:
+  CredentialCache();
+  ~CredentialCache();
+
+  // Reads and decodes both PEM files. Returns false (and leaves the cache
+  // empty) if either is missing, empty, unreadable or holds no PEM block.
+  bool load(fs::FS& fs);
+  void clear();
+
+  bool ready() const { return buffer_ != NULL; }
+  // The certificate chain is its DER certificates back to back
+  const uint8_t* certificate() const { return cert_; }
+  const uint8_t* privateKey() const { return key_; }
+  size_t certificateLength() const { return certLen_; }
+  size_t privateKeyLength() const { return keyLen_; }
+
+  // Sets the client certificate and key on a TlsClient; false if the cache
+  // is empty
+  template <typename Client>
+  bool apply(Client& client) const {
+    if (!ready()) {
+      return false;
+    }
+    client.setCertificate(cert_, certLen_);
+    client.setPrivateKey(key_, keyLen_);
+    return true;
+  }
+
+ private:
+  uint8_t* buffer_;
+  const uint8_t* cert_;
+  const uint8_t* key_;
+  size_t certLen_;
+  size_t keyLen_;
+};
+
+extern CredentialCache Credentials;
@@ -0,0 +1,117 @@
+#include "Logger.h"
+
+#include <stdarg.h>
+
+#define LOG_IDLE_WAIT_MS 1000  // writer re-checks the ring at least this often
+
+Logger Log;
+
+static const char LEVEL_TAGS[] = { ' ', 'E', 'W', 'I', 'D' };
+
+Logger::Logger() : head_(0), tail_(0), dropped_(0), written_(0), waiting_(false), task_(NULL) {
+  for (uint32_t i = 0; i < LOG_SLOTS; i++) {
+    slots_[i].seq.store(i, std::memory_order_relaxed);
+  }
+}
+
+void Logger::begin() {
+  if (task_ == NULL) {
+    xTaskCreate(writerTask, "log", LOG_TASK_STACK, this, LOG_TASK_PRIORITY, &task_);
+  }
+}
+
+void Logger::write(uint8_t level, const char* format, ...) {
+  // Claim the next free slot (bounded MPMC queue after D. Vyukov)
+  uint32_t pos = head_.load(std::memory_order_relaxed);
+  Slot* slot;
+  for (;;) {
+    slot = &slots_[pos & (LOG_SLOTS - 1)];
+    int32_t diff = (int32_t)(slot->seq.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      pos = head_.load(std::memory_order_relaxed);
+    }
+  }
+
+  uint32_t ms = millis();
+  int n = snprintf(slot->text, LOG_LINE_MAX, "[%6u.%03u] %c ", (unsigned)(ms / 1000),
+                   (unsigned)(ms % 1000), LEVEL_TAGS[level <= LOG_LEVEL_DEBUG ? level : 0]);
+  va_list args;
+  va_start(args, format);
+  int m = vsnprintf(slot->text + n, LOG_LINE_MAX - n, format, args);
+  va_end(args);
+  size_t len = n + (m > 0 ? m : 0);
+  slot->len = len < LOG_LINE_MAX ? len : LOG_LINE_MAX - 1;
+  slot->seq.store(pos + 1, std::memory_order_release);
+
+  // Pairs with the fence in writerTask: either the writer sees this line
+  // or this call sees that the writer is waiting
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiting_.load(std::memory_order_relaxed) && waiting_.exchange(false)) {
+    xTaskNotifyGive(task_);
+  }
+}
+
+// Writes the oldest line if it is complete; false when there is none
+bool Logger::drainOne() {
+  uint32_t pos = tail_.load(std::memory_order_relaxed);
+  Slot& slot = slots_[pos & (LOG_SLOTS - 1)];
+  if (slot.seq.load(std::memory_order_acquire) != pos + 1) {
+    return false;
+  }
+  Serial.write((const uint8_t*)slot.text, slot.len);
+  Serial.write((const uint8_t*)"\r\n", 2);
+  written_.fetch_add(1, std::memory_order_relaxed);
+  slot.seq.store(pos + LOG_SLOTS, std::memory_order_release);
+  tail_.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+void Logger::writerTask(void* arg) {
+  Logger* log = (Logger*)arg;
+  for (;;) {
+    while (log->drainOne()) {
+    }
+    // Announce the wait first, then look again, so a line logged in between
+    // is not left until the timeout
+    log->waiting_.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!log->drainOne()) {
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOG_IDLE_WAIT_MS));
+    }
+    log->waiting_.store(false);
+  }
+}
+
+bool Logger::flush(uint32_t timeoutMs) {
+  uint32_t target = head_.load(std::memory_order_acquire);
+  uint32_t start = millis();
+  while ((int32_t)(tail_.load(std::memory_order_acquire) - target) < 0) {
+    if (task_ == NULL) {
+      // No writer task yet: write from the caller
+      if (!drainOne()) {
+        return false;
+      }
+      continue;
+    }
+    if (millis() - start >= timeoutMs) {
+      return false;
+    }
+    vTaskDelay(pdMS_TO_TICKS(5));
+  }
+  Serial.flush();
+  return true;
+}
+
+LogStats Logger::stats() const {
+  LogStats s;
+  s.written = written_.load(std::memory_order_relaxed);
+  s.dropped = dropped_.load(std::memory_order_relaxed);
+  return s;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+// Calls above this level are compiled out, arguments included; build with
+// e.g. -DLOG_LEVEL=LOG_LEVEL_DEBUG for more detail
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Never runs and is removed by the compiler, but still checks the format
+// and keeps variables only used for logging from being reported as unused
+#define LOG_DISCARD(...) do { if (false) Log.write(LOG_LEVEL_NONE, __VA_ARGS__); } while (0)
+
+#ifndef LOG_SLOTS
+#define LOG_SLOTS 32        // lines buffered; a power of two
+#endif
+#define LOG_LINE_MAX 128    // longer lines are truncated
+#define LOG_TASK_STACK 3072
+#define LOG_TASK_PRIORITY 1
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) Log.write(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) Log.write(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) Log.write(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) Log.write(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+
+struct LogStats {
+  uint32_t written;   // lines handed to the UART
+  uint32_t dropped;   // lines lost because the buffer was full
+};
+
+// Leveled logging that never waits for the UART. A call formats its line
+// straight into a slot of a fixed ring, claimed with a compare-and-swap, so
+// any task can log without taking a lock; a low-priority task writes the
+// slots to Serial in order. When the UART falls behind and the ring is
+// full, new lines are dropped and counted rather than blocking the caller.
+// Not for use from interrupts.
+class Logger {
+ public:
+  Logger();
+
+  // Starts the writer task; lines logged earlier wait in the ring
+  void begin();
+
+  // One line, without a trailing newline, prefixed with the uptime and level
+  void write(uint8_t level, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+  // Waits until everything logged so far has been written, e.g. before a
+  // restart. Returns false on timeout.
+  bool flush(uint32_t timeoutMs);
+
+  LogStats stats() const;
+
+ private:
+  struct Slot {
+    std::atomic<uint32_t> seq;  // position + 1 once written, position + LOG_SLOTS once free
+    uint16_t len;
+    char text[LOG_LINE_MAX];
+  };
+
+  static void writerTask(void* arg);
+  bool drainOne();
+
+  Slot slots_[LOG_SLOTS];
+  std::atomic<uint32_t> head_;   // next position to claim
+  std::atomic<uint32_t> tail_;   // next position to write; advanced by the writer only
+  std::atomic<uint32_t> dropped_;
+  std::atomic<uint32_t> written_;
+  std::atomic<bool> waiting_;    // writer is asleep and wants a notification
+  TaskHandle_t task_;
+};
+
+extern Logger Log;
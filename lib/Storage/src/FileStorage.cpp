@@ -0,0 +1,251 @@
+#include "FileStorage.h"
+
+#include <Logger.h>
+#include <SPIFFS.h>
+#ifdef STORAGE_LITTLEFS
+#include <LittleFS.h>
+#include <Preferences.h>
+#endif
+
+// NVS namespace holding files while the partition changes file system
+#define STASH_NAMESPACE "fs_move"
+
+FileStorage Storage;
+
+FileStorage::FileStorage() {
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+fs::FS& FileStorage::fs() {
+#ifdef STORAGE_LITTLEFS
+  return LittleFS;
+#else
+  return SPIFFS;
+#endif
+}
+
+size_t FileStorage::totalBytes() {
+#ifdef STORAGE_LITTLEFS
+  return LittleFS.totalBytes();
+#else
+  return SPIFFS.totalBytes();
+#endif
+}
+
+size_t FileStorage::usedBytes() {
+#ifdef STORAGE_LITTLEFS
+  return LittleFS.usedBytes();
+#else
+  return SPIFFS.usedBytes();
+#endif
+}
+
+bool FileStorage::begin() {
+  uint32_t start = millis();
+#ifdef STORAGE_LITTLEFS
+  stats_.mount = mountLittleFs();
+#else
+  if (SPIFFS.begin(false)) {
+    stats_.mount = STORAGE_MOUNTED;
+  } else {
+    stats_.mount = SPIFFS.begin(true) ? STORAGE_FORMATTED : STORAGE_FAILED;
+  }
+#endif
+  stats_.mountMs = millis() - start;
+  if (stats_.mount == STORAGE_MIGRATED) {
+    LOG_INFO("Storage: moved %u files from SPIFFS to LittleFS, %u left behind",
+             stats_.migrated, stats_.skipped);
+  }
+  return stats_.mount != STORAGE_FAILED;
+}
+
+#ifdef STORAGE_LITTLEFS
+
+struct StashCandidate {
+  char path[STORAGE_PATH_MAX];
+  size_t size;
+};
+
+// Collects the smallest files under dir. SPIFFS lists every file from the
+// root; LittleFS (and the native stand-in) have real directories.
+static void listFiles(File dir, StashCandidate* files, size_t& count, uint16_t& skipped) {
+  File entry;
+  while ((entry = dir.openNextFile())) {
+    if (entry.isDirectory()) {
+      listFiles(entry, files, count, skipped);
+      continue;
+    }
+    if (strlen(entry.path()) >= STORAGE_PATH_MAX) {
+      skipped++;
+      continue;
+    }
+    size_t slot = count;
+    if (count == STORAGE_MIGRATE_FILES) {
+      // Full: replace the largest if this one is smaller
+      slot = 0;
+      for (size_t i = 1; i < count; i++) {
+        if (files[i].size > files[slot].size) {
+          slot = i;
+        }
+      }
+      skipped++;
+      if (entry.size() >= files[slot].size) {
+        continue;
+      }
+    } else {
+      count++;
+    }
+    strcpy(files[slot].path, entry.path());
+    files[slot].size = entry.size();
+  }
+}
+
+static void stashKeys(uint8_t index, char* pathKey, char* dataKey) {
+  sprintf(pathKey, "p%u", index);
+  sprintf(dataKey, "d%u", index);
+}
+
+// Copies files from SPIFFS into NVS, smallest first, until the budget is
+// used. The count is written last, so a partial stash is never restored.
+uint16_t FileStorage::stashSpiffs() {
+  StashCandidate files[STORAGE_MIGRATE_FILES];
+  size_t count = 0;
+  File root = SPIFFS.open("/");
+  if (root) {
+    listFiles(root, files, count, stats_.skipped);
+    root.close();
+  }
+  for (size_t i = 1; i < count; i++) {
+    for (size_t j = i; j > 0 && files[j].size < files[j - 1].size; j--) {
+      StashCandidate swap = files[j];
+      files[j] = files[j - 1];
+      files[j - 1] = swap;
+    }
+  }
+
+  Preferences prefs;
+  prefs.begin(STASH_NAMESPACE, false);
+  prefs.clear();
+  size_t budget = STORAGE_MIGRATE_BUDGET;
+  uint8_t stashed = 0;
+  for (size_t i = 0; i < count; i++) {
+    size_t size = files[i].size;
+    if (size > budget) {
+      stats_.skipped++;
+      continue;
+    }
+    uint8_t* data = (uint8_t*)malloc(size > 0 ? size : 1);
+    File file = SPIFFS.open(files[i].path, FILE_READ);
+    bool ok = data != NULL && file && file.read(data, size) == size;
+    file.close();
+    char pathKey[4];
+    char dataKey[4];
+    stashKeys(stashed, pathKey, dataKey);
+    // Preferences refuses empty blobs; an empty file is stored as its path
+    ok = ok && prefs.putString(pathKey, files[i].path) > 0 &&
+         (size == 0 || prefs.putBytes(dataKey, data, size) == size);
+    free(data);
+    if (!ok) {
+      stats_.skipped++;
+      continue;
+    }
+    budget -= size;
+    stashed++;
+  }
+  prefs.putUChar("n", stashed);
+  prefs.end();
+  return stashed;
+}
+
+// Creates the directories leading up to path
+static void makeParents(const char* path) {
+  char dir[STORAGE_PATH_MAX];
+  strncpy(dir, path, sizeof(dir) - 1);
+  dir[sizeof(dir) - 1] = 0;
+  for (char* slash = strchr(dir + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+    *slash = 0;
+    if (!LittleFS.exists(dir)) {
+      LittleFS.mkdir(dir);
+    }
+    *slash = '/';
+  }
+}
+
+// Writes the stashed files to LittleFS, then drops the stash
+uint16_t FileStorage::restoreStash() {
+  Preferences prefs;
+  prefs.begin(STASH_NAMESPACE, false);
+  uint8_t count = prefs.getUChar("n", 0);
+  uint16_t restored = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    char pathKey[4];
+    char dataKey[4];
+    stashKeys(i, pathKey, dataKey);
+    char path[STORAGE_PATH_MAX];
+    if (prefs.getString(pathKey, path, sizeof(path)) == 0) {
+      stats_.skipped++;
+      continue;
+    }
+    size_t len = prefs.getBytesLength(dataKey);
+    uint8_t* data = (uint8_t*)malloc(len > 0 ? len : 1);
+    bool ok = data != NULL && (len == 0 || prefs.getBytes(dataKey, data, len) == len);
+    if (ok) {
+      makeParents(path);
+      File file = LittleFS.open(path, FILE_WRITE);
+      ok = file && file.write(data, len) == len;
+      file.close();
+    }
+    free(data);
+    if (ok) {
+      restored++;
+    } else {
+      stats_.skipped++;
+    }
+  }
+  prefs.clear();
+  prefs.end();
+  return restored;
+}
+
+StorageMount FileStorage::mountLittleFs() {
+  // A stash left by an interrupted move means the partition may already be
+  // reformatted, with the files still to be written back
+  Preferences prefs;
+  prefs.begin(STASH_NAMESPACE, true);
+  bool pending = prefs.getUChar("n", 0) > 0;
+  prefs.end();
+
+  if (!pending && LittleFS.begin(false)) {
+    return STORAGE_MOUNTED;
+  }
+  bool migrate = pending;
+  if (!pending && SPIFFS.begin(false)) {
+    stashSpiffs();
+    SPIFFS.end();
+    migrate = true;
+  }
+  // Formats the partition unless it already holds LittleFS
+  if (!LittleFS.begin(true)) {
+    return STORAGE_FAILED;
+  }
+  if (!migrate) {
+    return STORAGE_FORMATTED;
+  }
+  stats_.migrated = restoreStash();
+  return STORAGE_MIGRATED;
+}
+
+#endif
+
+const char* storageMountName(StorageMount mount) {
+  switch (mount) {
+    case STORAGE_MOUNTED:
+      return "mounted";
+    case STORAGE_FORMATTED:
+      return "formatted";
+    case STORAGE_MIGRATED:
+      return "migrated";
+    default:
+      return "failed";
+  }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+// Build with -DSTORAGE_LITTLEFS to keep files on LittleFS instead of SPIFFS.
+// Both use the partition labelled "spiffs", so switching needs no new
+// partition table.
+#ifdef STORAGE_LITTLEFS
+#define STORAGE_NAME "littlefs"
+#else
+#define STORAGE_NAME "spiffs"
+#endif
+
+// Files carried over when a LittleFS build first boots on a SPIFFS partition.
+// They are held in NVS while the partition is reformatted, so the budget has
+// to fit next to the settings; smaller files go first, which keeps the
+// certificate and key ahead of queued telemetry.
+#define STORAGE_MIGRATE_FILES 8
+#define STORAGE_MIGRATE_BUDGET 8192  // bytes
+#define STORAGE_PATH_MAX 48
+
+enum StorageMount {
+  STORAGE_MOUNTED,    // existing file system
+  STORAGE_FORMATTED,  // partition was blank or unreadable
+  STORAGE_MIGRATED,   // SPIFFS contents moved to LittleFS
+  STORAGE_FAILED
+};
+
+struct StorageStats {
+  StorageMount mount;
+  uint32_t mountMs;
+  uint16_t migrated;  // files carried over from SPIFFS
+  uint16_t skipped;   // files left behind: over the budget or unreadable
+};
+
+// The file system the firmware keeps its files on. Callers take fs() and
+// use the usual fs::FS calls, so the backend only matters to begin().
+class FileStorage {
+ public:
+  FileStorage();
+
+  // Mounts the backend chosen at build time, formatting the partition when
+  // nothing usable is on it. A LittleFS build that finds SPIFFS moves the
+  // files over once; a reboot during the move finishes it on the next boot.
+  bool begin();
+
+  fs::FS& fs();
+  const char* name() const { return STORAGE_NAME; }
+  size_t totalBytes();
+  size_t usedBytes();
+
+  const StorageStats& stats() const { return stats_; }
+
+ private:
+#ifdef STORAGE_LITTLEFS
+  StorageMount mountLittleFs();
+  uint16_t stashSpiffs();
+  uint16_t restoreStash();
+#endif
+
+  StorageStats stats_;
+};
+
+const char* storageMountName(StorageMount mount);
+
+extern FileStorage Storage;
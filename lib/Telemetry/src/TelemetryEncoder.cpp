@@ -0,0 +1,202 @@
+#include "TelemetryEncoder.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+
+enum FieldType {
+  FIELD_U32,
+  FIELD_I16
+};
+
+struct TelemetryField {
+  const char* name;  // JSON key
+  uint8_t offset;
+  uint8_t type;
+};
+
+// The schema: one entry per sample field, in wire order
+static const TelemetryField FIELDS[] = {
+  { "message_count", offsetof(TelemetrySample, seq), FIELD_U32 },
+  { "uptime", offsetof(TelemetrySample, uptime), FIELD_U32 },
+  { "rssi", offsetof(TelemetrySample, rssi), FIELD_I16 },
+  { "free_heap", offsetof(TelemetrySample, freeHeap), FIELD_U32 },
+};
+#define FIELD_COUNT (sizeof(FIELDS) / sizeof(FIELDS[0]))
+
+// CBOR major types (RFC 8949)
+#define CBOR_UINT 0
+#define CBOR_NEGINT 1
+#define CBOR_TEXT 3
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+
+static int32_t fieldValue(const TelemetrySample& sample, const TelemetryField& field) {
+  const uint8_t* at = (const uint8_t*)&sample + field.offset;
+  if (field.type == FIELD_I16) {
+    int16_t v;
+    memcpy(&v, at, sizeof(v));
+    return v;
+  }
+  uint32_t v;
+  memcpy(&v, at, sizeof(v));
+  return (int32_t)v;
+}
+
+// Bounded writer over the caller's buffer; once something does not fit,
+// everything after it is dropped and ok() turns false
+class EncodeBuffer {
+ public:
+  EncodeBuffer(uint8_t* buf, size_t len) : buf_(buf), len_(len), used_(0), ok_(true) {}
+
+  void put(const void* data, size_t n) {
+    if (!ok_ || n > len_ - used_) {
+      ok_ = false;
+      return;
+    }
+    memcpy(buf_ + used_, data, n);
+    used_ += n;
+  }
+
+  void text(const char* s) { put(s, strlen(s)); }
+
+  void format(const char* fmt, ...) {
+    if (!ok_) {
+      return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf((char*)buf_ + used_, len_ - used_, fmt, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= len_ - used_) {
+      ok_ = false;
+      return;
+    }
+    used_ += n;
+  }
+
+  void cborHead(uint8_t major, uint32_t value) {
+    uint8_t head[5];
+    size_t n;
+    if (value < 24) {
+      head[0] = (major << 5) | value;
+      n = 1;
+    } else if (value <= 0xff) {
+      head[0] = (major << 5) | 24;
+      head[1] = value;
+      n = 2;
+    } else if (value <= 0xffff) {
+      head[0] = (major << 5) | 25;
+      head[1] = value >> 8;
+      head[2] = value;
+      n = 3;
+    } else {
+      head[0] = (major << 5) | 26;
+      head[1] = value >> 24;
+      head[2] = value >> 16;
+      head[3] = value >> 8;
+      head[4] = value;
+      n = 5;
+    }
+    put(head, n);
+  }
+
+  void cborInt(int32_t value, uint8_t type) {
+    if (type == FIELD_U32) {
+      cborHead(CBOR_UINT, (uint32_t)value);
+    } else if (value < 0) {
+      cborHead(CBOR_NEGINT, (uint32_t)(-1 - value));
+    } else {
+      cborHead(CBOR_UINT, (uint32_t)value);
+    }
+  }
+
+  void cborText(const char* s) {
+    size_t n = strlen(s);
+    cborHead(CBOR_TEXT, n);
+    put(s, n);
+  }
+
+  size_t used() const { return used_; }
+  bool ok() const { return ok_; }
+
+ private:
+  uint8_t* buf_;
+  size_t len_;
+  size_t used_;
+  bool ok_;
+};
+
+static void encodeCbor(EncodeBuffer& out, const char* deviceId,
+                       const TelemetrySample* samples, size_t count) {
+  out.cborHead(CBOR_MAP, 3);
+  out.cborHead(CBOR_UINT, 0);
+  out.cborHead(CBOR_UINT, TELEMETRY_SCHEMA_VERSION);
+  out.cborHead(CBOR_UINT, 1);
+  out.cborText(deviceId);
+  out.cborHead(CBOR_UINT, 2);
+  out.cborHead(CBOR_ARRAY, count);
+  for (size_t i = 0; i < count && out.ok(); i++) {
+    out.cborHead(CBOR_ARRAY, FIELD_COUNT);
+    for (size_t f = 0; f < FIELD_COUNT; f++) {
+      out.cborInt(fieldValue(samples[i], FIELDS[f]), FIELDS[f].type);
+    }
+  }
+}
+
+static void encodeJson(EncodeBuffer& out, const char* deviceId,
+                       const TelemetrySample* samples, size_t count) {
+  out.format("{\"schema\":%d,\"device_id\":\"%s\",\"samples\":[", TELEMETRY_SCHEMA_VERSION, deviceId);
+  for (size_t i = 0; i < count && out.ok(); i++) {
+    out.text(i > 0 ? ",{" : "{");
+    for (size_t f = 0; f < FIELD_COUNT; f++) {
+      int32_t value = fieldValue(samples[i], FIELDS[f]);
+      if (FIELDS[f].type == FIELD_U32) {
+        out.format("%s\"%s\":%u", f > 0 ? "," : "", FIELDS[f].name, (unsigned)value);
+      } else {
+        out.format("%s\"%s\":%d", f > 0 ? "," : "", FIELDS[f].name, (int)value);
+      }
+    }
+    out.text("}");
+  }
+  out.text("]}");
+}
+
+size_t telemetryEncode(TelemetryFormat format, const char* deviceId,
+                       const TelemetrySample* samples, size_t count,
+                       uint8_t* buf, size_t len) {
+  EncodeBuffer out(buf, len);
+  if (format == TELEMETRY_CBOR) {
+    encodeCbor(out, deviceId, samples, count);
+  } else {
+    encodeJson(out, deviceId, samples, count);
+  }
+  return out.ok() ? out.used() : 0;
+}
+
+size_t telemetrySampleMax(TelemetryFormat format) {
+  // CBOR: array head, then at most 5 bytes per integer. JSON: a separator,
+  // braces, and per field a comma, the quoted key, a colon and 11 digits.
+  size_t size = format == TELEMETRY_CBOR ? 1 : 3;
+  for (size_t f = 0; f < FIELD_COUNT; f++) {
+    size += format == TELEMETRY_CBOR ? 5 : strlen(FIELDS[f].name) + 15;
+  }
+  return size;
+}
+
+size_t telemetryBatchMax(TelemetryFormat format, const char* deviceId, size_t len) {
+  // Everything but the samples. CBOR: map head, three keys, then heads of
+  // at most 5 bytes for the schema, the id and the sample array. JSON: the
+  // opening up to the sample array, then "]}".
+  size_t envelope;
+  if (format == TELEMETRY_CBOR) {
+    envelope = 1 + 3 + 5 + 5 + strlen(deviceId) + 5;
+  } else {
+    envelope = snprintf(NULL, 0, "{\"schema\":%d,\"device_id\":\"%s\",\"samples\":[",
+                        TELEMETRY_SCHEMA_VERSION, deviceId) + 2;
+  }
+  return len > envelope ? (len - envelope) / telemetrySampleMax(format) : 0;
+}
+
+const char* telemetryFormatName(TelemetryFormat format) {
+  return format == TELEMETRY_CBOR ? "cbor" : "json";
+}
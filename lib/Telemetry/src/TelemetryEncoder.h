@@ -0,0 +1,34 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "TelemetryQueue.h"
+
+#define TELEMETRY_SCHEMA_VERSION 1
+
+enum TelemetryFormat {
+  TELEMETRY_CBOR,  // compact, for the wire
+  TELEMETRY_JSON   // readable, for debugging
+};
+
+// Batch layout, shared by both formats. Sample fields always appear in
+// this order; the CBOR form sends them as a plain array and relies on the
+// schema version instead of repeating names.
+//
+//   CBOR: {0: schema, 1: "device id", 2: [[message_count, uptime, rssi, free_heap], ...]}
+//   JSON: {"schema":1,"device_id":"...","samples":[{"message_count":1,"uptime":10,...}, ...]}
+//
+// Writes into buf without touching the heap. Returns the encoded length,
+// or 0 if the batch does not fit.
+size_t telemetryEncode(TelemetryFormat format, const char* deviceId,
+                       const TelemetrySample* samples, size_t count,
+                       uint8_t* buf, size_t len);
+
+// Worst-case encoded size of one sample, for sizing batches and buffers
+size_t telemetrySampleMax(TelemetryFormat format);
+
+// How many samples always fit in len bytes, whatever their values, so a
+// batch can be sized before it is encoded
+size_t telemetryBatchMax(TelemetryFormat format, const char* deviceId, size_t len);
+
+const char* telemetryFormatName(TelemetryFormat format);
@@ -0,0 +1,298 @@
+#include "TelemetryQueue.h"
+
+#include <Logger.h>
+
+#define SAMPLE_SIZE sizeof(TelemetrySample)
+
+TelemetryQueue::TelemetryQueue()
+    : first_(0), count_(0), fs_(NULL), headSegment_(0), tailSegment_(0),
+      headRead_(0), headCount_(0), tailCount_(0), onFlash_(0), lastSeq_(0) {
+  dir_[0] = '\0';
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+void TelemetryQueue::segmentPath(uint32_t segment, char* out) const {
+  snprintf(out, sizeof(dir_) + 10, "%s/%08x", dir_, (unsigned)segment);
+}
+
+// Reads the last complete sample of a segment file
+bool TelemetryQueue::readLast(uint32_t segment, TelemetrySample& out) {
+  char path[sizeof(dir_) + 10];
+  segmentPath(segment, path);
+  File f = fs_->open(path, FILE_READ);
+  if (!f) {
+    return false;
+  }
+  size_t samples = f.size() / SAMPLE_SIZE;
+  bool ok = samples > 0 && f.seek((samples - 1) * SAMPLE_SIZE) &&
+            f.read((uint8_t*)&out, SAMPLE_SIZE) == SAMPLE_SIZE;
+  f.close();
+  return ok;
+}
+
+bool TelemetryQueue::begin(fs::FS& fs, const char* dir) {
+  fs_ = &fs;
+  strncpy(dir_, dir, sizeof(dir_) - 1);
+  dir_[sizeof(dir_) - 1] = '\0';
+  onFlash_ = 0;
+  headRead_ = 0;
+
+  // Segment files are named by an increasing hex number; the lowest is the
+  // oldest. A file cut short by a reset during a write keeps its complete
+  // samples, and appending continues in a new file.
+  bool found = false;
+  uint32_t lowest = 0;
+  uint32_t highest = 0;
+  size_t lowestSize = 0;
+  size_t highestSize = 0;
+  File root = fs.open(dir_);
+  if (root && root.isDirectory()) {
+    for (File f = root.openNextFile(); f; f = root.openNextFile()) {
+      const char* name = strrchr(f.name(), '/');
+      name = name ? name + 1 : f.name();
+      char* end;
+      uint32_t segment = strtoul(name, &end, 16);
+      if (strlen(name) != 8 || *end != '\0') {
+        continue;
+      }
+      size_t size = f.size();
+      onFlash_ += size / SAMPLE_SIZE;
+      if (!found || segment < lowest) {
+        lowest = segment;
+        lowestSize = size;
+      }
+      if (!found || segment > highest) {
+        highest = segment;
+        highestSize = size;
+      }
+      found = true;
+    }
+  }
+  if (!found) {
+    headSegment_ = tailSegment_ = 0;
+    headCount_ = tailCount_ = 0;
+    // SPIFFS has no directories and ignores this; LittleFS needs it
+    fs.mkdir(dir_);
+    return true;
+  }
+  headSegment_ = lowest;
+  headCount_ = lowestSize / SAMPLE_SIZE;
+  tailSegment_ = highest;
+  tailCount_ = highestSize / SAMPLE_SIZE;
+  if (highestSize % SAMPLE_SIZE != 0) {
+    startSegment();
+  }
+  // The newest sample is the last one in the highest segment, or in an
+  // earlier one if a reset left that empty
+  TelemetrySample last;
+  for (uint32_t segment = highest + 1; segment-- > lowest;) {
+    if (readLast(segment, last)) {
+      lastSeq_ = last.seq;
+      break;
+    }
+  }
+  LOG_INFO("Telemetry: %u samples queued on flash, up to seq %u", (unsigned)onFlash_,
+           (unsigned)lastSeq_);
+  return true;
+}
+
+size_t TelemetryQueue::segmentSamples(uint32_t segment) {
+  if (segment == headSegment_) {
+    return headSegment_ == tailSegment_ ? tailCount_ : headCount_;
+  }
+  if (segment == tailSegment_) {
+    return tailCount_;
+  }
+  char path[sizeof(dir_) + 10];
+  segmentPath(segment, path);
+  File f = fs_->open(path, FILE_READ);
+  if (!f) {
+    return 0;
+  }
+  size_t samples = f.size() / SAMPLE_SIZE;
+  f.close();
+  return samples;
+}
+
+// Removes the fully read (or dropped) head segment and moves on to the next
+void TelemetryQueue::advanceHead() {
+  char path[sizeof(dir_) + 10];
+  segmentPath(headSegment_, path);
+  fs_->remove(path);
+  headRead_ = 0;
+  if (headSegment_ == tailSegment_) {
+    // Flash is empty; appending continues in a fresh file
+    tailSegment_++;
+    headSegment_ = tailSegment_;
+    tailCount_ = 0;
+    headCount_ = 0;
+    onFlash_ = 0;
+    return;
+  }
+  headSegment_++;
+  headCount_ = segmentSamples(headSegment_);
+}
+
+void TelemetryQueue::dropHeadSegment() {
+  size_t count = segmentSamples(headSegment_);
+  size_t unread = count > headRead_ ? count - headRead_ : 0;
+  if (unread > onFlash_) {
+    unread = onFlash_;
+  }
+  onFlash_ -= unread;
+  stats_.dropped += unread;
+  advanceHead();
+}
+
+void TelemetryQueue::startSegment() {
+  if (headSegment_ == tailSegment_) {
+    headCount_ = tailCount_;
+  }
+  tailSegment_++;
+  tailCount_ = 0;
+  if (tailSegment_ - headSegment_ >= TELEMETRY_MAX_SEGMENTS) {
+    dropHeadSegment();
+  }
+}
+
+// Appends the n oldest RAM samples to flash
+bool TelemetryQueue::spill(size_t n) {
+  if (fs_ == NULL) {
+    return false;
+  }
+  while (n > 0) {
+    if (tailCount_ >= TELEMETRY_SEGMENT_SAMPLES) {
+      startSegment();
+    }
+    size_t room = TELEMETRY_SEGMENT_SAMPLES - tailCount_;
+    size_t batch = n < room ? n : room;
+    char path[sizeof(dir_) + 10];
+    segmentPath(tailSegment_, path);
+    File f = fs_->open(path, FILE_APPEND);
+    if (!f) {
+      return false;
+    }
+    // The batch may wrap around the end of the ring
+    size_t written = 0;
+    while (written < batch) {
+      size_t at = (first_ + written) % TELEMETRY_RING_SIZE;
+      size_t run = TELEMETRY_RING_SIZE - at;
+      if (run > batch - written) {
+        run = batch - written;
+      }
+      size_t bytes = f.write((const uint8_t*)&ring_[at], run * SAMPLE_SIZE);
+      written += bytes / SAMPLE_SIZE;
+      if (bytes != run * SAMPLE_SIZE) {
+        break;
+      }
+    }
+    f.close();
+    first_ = (first_ + written) % TELEMETRY_RING_SIZE;
+    count_ -= written;
+    tailCount_ += written;
+    onFlash_ += written;
+    stats_.spilled += written;
+    n -= written;
+    if (written < batch) {
+      // A partial record may be left behind; later samples go to a new file
+      startSegment();
+      return false;
+    }
+  }
+  return true;
+}
+
+void TelemetryQueue::push(const TelemetrySample& sample) {
+  stats_.pushed++;
+  lastSeq_ = sample.seq;
+  if (count_ == TELEMETRY_RING_SIZE && !spill(TELEMETRY_SPILL_BATCH)) {
+    // No flash to fall back on: keep the newest samples
+    first_ = (first_ + 1) % TELEMETRY_RING_SIZE;
+    count_--;
+    stats_.dropped++;
+  }
+  ring_[(first_ + count_) % TELEMETRY_RING_SIZE] = sample;
+  count_++;
+}
+
+size_t TelemetryQueue::peek(TelemetrySample* out, size_t max) {
+  size_t got = 0;
+  uint32_t segment = headSegment_;
+  size_t skip = headRead_;
+  size_t flashLeft = onFlash_;
+  while (got < max && flashLeft > 0) {
+    size_t count = segmentSamples(segment);
+    size_t want = count > skip ? count - skip : 0;
+    if (want > max - got) {
+      want = max - got;
+    }
+    if (want > flashLeft) {
+      want = flashLeft;
+    }
+    size_t read = 0;
+    if (want > 0) {
+      char path[sizeof(dir_) + 10];
+      segmentPath(segment, path);
+      File f = fs_->open(path, FILE_READ);
+      if (f && f.seek(skip * SAMPLE_SIZE)) {
+        read = f.read((uint8_t*)&out[got], want * SAMPLE_SIZE) / SAMPLE_SIZE;
+      }
+      f.close();
+    }
+    if (read < want) {
+      if (got == 0 && segment == headSegment_) {
+        // Unreadable head segment: give it up rather than stall the queue
+        LOG_WARN("Telemetry: dropping unreadable segment %08x", (unsigned)segment);
+        dropHeadSegment();
+        segment = headSegment_;
+        skip = 0;
+        flashLeft = onFlash_;
+        continue;
+      }
+      return got;  // never skip ahead of older samples
+    }
+    got += read;
+    flashLeft -= read;
+    segment++;
+    skip = 0;
+  }
+  for (size_t i = 0; got < max && i < count_; i++) {
+    out[got++] = ring_[(first_ + i) % TELEMETRY_RING_SIZE];
+  }
+  return got;
+}
+
+void TelemetryQueue::pop(size_t n) {
+  while (n > 0 && onFlash_ > 0) {
+    size_t count = segmentSamples(headSegment_);
+    size_t take = count > headRead_ ? count - headRead_ : 0;
+    if (take > n) {
+      take = n;
+    }
+    if (take > onFlash_) {
+      take = onFlash_;
+    }
+    headRead_ += take;
+    onFlash_ -= take;
+    stats_.sent += take;
+    n -= take;
+    if (headRead_ >= count) {
+      advanceHead();
+    }
+  }
+  size_t take = n < count_ ? n : count_;
+  first_ = (first_ + take) % TELEMETRY_RING_SIZE;
+  count_ -= take;
+  stats_.sent += take;
+}
+
+bool TelemetryQueue::flush() {
+  return spill(count_);
+}
+
+TelemetryStats TelemetryQueue::stats() const {
+  TelemetryStats s = stats_;
+  s.pending = pending();
+  s.onFlash = onFlash_;
+  return s;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+#ifndef TELEMETRY_RING_SIZE
+#define TELEMETRY_RING_SIZE 64         // samples held in RAM
+#endif
+#define TELEMETRY_SPILL_BATCH (TELEMETRY_RING_SIZE / 2)
+#define TELEMETRY_SEGMENT_SAMPLES 256  // samples per flash file (4 KB)
+#ifndef TELEMETRY_MAX_SEGMENTS
+#define TELEMETRY_MAX_SEGMENTS 32      // flash budget: 128 KB
+#endif
+
+// One reading, stored on flash as is. Fixed size so the queue never
+// allocates and a record can be located by its index.
+struct TelemetrySample {
+  uint32_t seq;       // increases by one per sample, also across outages
+  uint32_t uptime;    // seconds since boot when taken
+  uint32_t freeHeap;
+  int16_t rssi;       // dBm, 0 when not associated
+  uint16_t reserved;
+};
+
+struct TelemetryStats {
+  uint32_t pushed;
+  uint32_t sent;
+  uint32_t spilled;   // samples moved from RAM to flash
+  uint32_t dropped;   // oldest samples discarded with the flash budget full
+  size_t pending;
+  size_t onFlash;
+};
+
+// Store-and-forward queue for telemetry. Samples go into a preallocated
+// ring; when it fills up (usually because the broker is unreachable) the
+// older half is appended to a segment file in the given directory. Reads
+// always return the oldest samples first, flash before RAM, so delivery
+// order matches recording order. When the flash budget is used up, the
+// oldest segment is dropped.
+//
+// Delivery is at least once: the read position within a segment is not
+// persisted, so after a reboot the first segment is sent again from its
+// start. begin() finds the newest sample on flash and lastSeq() returns its
+// seq; numbering new samples on from it keeps them clear of the replayed
+// ones, which receivers can then drop by seq. (With nothing on flash there
+// is nothing to replay, and seq starts again at 1 along with uptime.) Not
+// thread safe; use it from one task.
+class TelemetryQueue {
+ public:
+  TelemetryQueue();
+
+  // Picks up segments left by an earlier boot
+  bool begin(fs::FS& fs, const char* dir);
+
+  void push(const TelemetrySample& sample);
+  // seq of the newest sample pushed, or found on flash by begin(); 0 if none
+  uint32_t lastSeq() const { return lastSeq_; }
+
+  // Copies up to max of the oldest samples into out without removing them
+  size_t peek(TelemetrySample* out, size_t max);
+  // Removes the n oldest samples, e.g. once peek()ed ones were delivered
+  void pop(size_t n);
+
+  // Moves everything in RAM to flash, e.g. before a restart or deep sleep
+  bool flush();
+
+  size_t pending() const { return count_ + onFlash_; }
+  TelemetryStats stats() const;
+
+ private:
+  bool spill(size_t n);
+  void startSegment();
+  void dropHeadSegment();
+  void advanceHead();
+  size_t segmentSamples(uint32_t segment);
+  bool readLast(uint32_t segment, TelemetrySample& out);
+  void segmentPath(uint32_t segment, char* out) const;
+
+  TelemetrySample ring_[TELEMETRY_RING_SIZE];
+  size_t first_;
+  size_t count_;
+
+  fs::FS* fs_;
+  char dir_[16];
+  uint32_t headSegment_;   // oldest segment on flash
+  uint32_t tailSegment_;   // segment being appended to
+  size_t headRead_;        // samples of the head segment already popped
+  size_t headCount_;
+  size_t tailCount_;
+  size_t onFlash_;         // unread samples across all segments
+  uint32_t lastSeq_;
+
+  TelemetryStats stats_;
+};
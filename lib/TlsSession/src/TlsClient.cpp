@@ -0,0 +1,359 @@
+#include "TlsClient.h"
+
+#include <Logger.h>
+#include <mbedtls/error.h>
+
+#define TLS_DEFAULT_CONNECT_TIMEOUT_MS 3000
+#define TLS_DEFAULT_HANDSHAKE_TIMEOUT_MS 120000
+#define TLS_DEFAULT_WRITE_TIMEOUT_MS 5000
+
+TlsClient::TlsClient()
+  : cache_(&TlsSessions), caPem_(NULL), certDer_(NULL), certDerLen_(0), keyDer_(NULL),
+    keyDerLen_(0), insecure_(false),
+    identityLoaded_(false), active_(false), handshakeTimeoutMs_(TLS_DEFAULT_HANDSHAKE_TIMEOUT_MS),
+    writeTimeoutMs_(TLS_DEFAULT_WRITE_TIMEOUT_MS), connectMs_(0), handshakeMs_(0), resumed_(false), error_(0), peeked_(-1) {
+  mbedtls_x509_crt_init(&ca_);
+  mbedtls_x509_crt_init(&cert_);
+  mbedtls_pk_init(&key_);
+}
+
+TlsClient::~TlsClient() {
+  stop();
+  mbedtls_x509_crt_free(&ca_);
+  mbedtls_x509_crt_free(&cert_);
+  mbedtls_pk_free(&key_);
+}
+
+void TlsClient::setCACert(const char* pem) {
+  caPem_ = pem;
+  identityLoaded_ = false;
+}
+
+void TlsClient::setCertificate(const uint8_t* der, size_t len) {
+  certDer_ = der;
+  certDerLen_ = len;
+  identityLoaded_ = false;
+}
+
+void TlsClient::setPrivateKey(const uint8_t* der, size_t len) {
+  keyDer_ = der;
+  keyDerLen_ = len;
+  identityLoaded_ = false;
+}
+
+void TlsClient::setInsecure() {
+  insecure_ = true;
+}
+
+void TlsClient::setHandshakeTimeout(uint32_t seconds) {
+  handshakeTimeoutMs_ = seconds * 1000;
+}
+
+int TlsClient::setTimeout(uint32_t seconds) {
+  writeTimeoutMs_ = seconds * 1000;
+  return tcp_.setTimeout(seconds);
+}
+
+void TlsClient::setSessionCache(TlsSessionCache* cache) {
+  cache_ = cache;
+}
+
+// Length of the DER SEQUENCE at der, header included; 0 if malformed
+static size_t derSequenceLength(const uint8_t* der, size_t len) {
+  if (len < 2 || der[0] != 0x30) {
+    return 0;
+  }
+  size_t header = 2;
+  size_t body = der[1];
+  if (body & 0x80) {
+    size_t bytes = body & 0x7f;
+    if (bytes == 0 || bytes > 3 || len < 2 + bytes) {
+      return 0;
+    }
+    body = 0;
+    for (size_t i = 0; i < bytes; i++) {
+      body = body << 8 | der[2 + i];
+    }
+    header += bytes;
+  }
+  return header + body <= len ? header + body : 0;
+}
+
+// Certificates back to back, each referenced in place rather than copied
+bool TlsClient::parseChain(const uint8_t* der, size_t len) {
+  while (len > 0) {
+    size_t one = derSequenceLength(der, len);
+    if (one == 0) {
+      error_ = MBEDTLS_ERR_X509_INVALID_FORMAT;
+      return false;
+    }
+    if ((error_ = mbedtls_x509_crt_parse_der_nocopy(&cert_, der, one)) != 0) {
+      return false;
+    }
+    der += one;
+    len -= one;
+  }
+  return true;
+}
+
+// Parses the CA and the client certificate and key on first use only
+bool TlsClient::loadIdentity() {
+  if (identityLoaded_) {
+    return true;
+  }
+  mbedtls_x509_crt_free(&ca_);
+  mbedtls_x509_crt_free(&cert_);
+  mbedtls_pk_free(&key_);
+  mbedtls_x509_crt_init(&ca_);
+  mbedtls_x509_crt_init(&cert_);
+  mbedtls_pk_init(&key_);
+  if (caPem_ != NULL &&
+      (error_ = mbedtls_x509_crt_parse(&ca_, (const unsigned char*)caPem_, strlen(caPem_) + 1)) != 0) {
+    return false;
+  }
+  if (certDer_ != NULL && keyDer_ != NULL) {
+    if (!parseChain(certDer_, certDerLen_) ||
+        (error_ = mbedtls_pk_parse_key(&key_, keyDer_, keyDerLen_, NULL, 0)) != 0) {
+      return false;
+    }
+  }
+  identityLoaded_ = true;
+  return true;
+}
+
+int TlsClient::bioSend(void* ctx, const unsigned char* buf, size_t len) {
+  WiFiClient& tcp = ((TlsClient*)ctx)->tcp_;
+  if (!tcp.connected()) {
+    return MBEDTLS_ERR_NET_CONN_RESET;
+  }
+  size_t sent = tcp.write(buf, len);
+  return sent > 0 ? (int)sent : MBEDTLS_ERR_SSL_WANT_WRITE;
+}
+
+int TlsClient::bioRecv(void* ctx, unsigned char* buf, size_t len) {
+  WiFiClient& tcp = ((TlsClient*)ctx)->tcp_;
+  if (tcp.available() <= 0) {
+    return tcp.connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+  }
+  int got = tcp.read(buf, len);
+  return got > 0 ? got : MBEDTLS_ERR_SSL_WANT_READ;
+}
+
+bool TlsClient::handshake(const char* host, uint16_t port) {
+  mbedtls_ssl_init(&ssl_);
+  mbedtls_ssl_config_init(&conf_);
+  mbedtls_entropy_init(&entropy_);
+  mbedtls_ctr_drbg_init(&drbg_);
+  active_ = true;
+
+  if ((error_ = mbedtls_ctr_drbg_seed(&drbg_, mbedtls_entropy_func, &entropy_,
+                                      (const unsigned char*)"TlsClient", 9)) != 0 ||
+      (error_ = mbedtls_ssl_config_defaults(&conf_, MBEDTLS_SSL_IS_CLIENT,
+                                            MBEDTLS_SSL_TRANSPORT_STREAM,
+                                            MBEDTLS_SSL_PRESET_DEFAULT)) != 0) {
+    return false;
+  }
+  if (!loadIdentity()) {
+    return false;
+  }
+  if (insecure_ || caPem_ == NULL) {
+    mbedtls_ssl_conf_authmode(&conf_, MBEDTLS_SSL_VERIFY_NONE);
+  } else {
+    mbedtls_ssl_conf_authmode(&conf_, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(&conf_, &ca_, NULL);
+  }
+  if (certDer_ != NULL && keyDer_ != NULL &&
+      (error_ = mbedtls_ssl_conf_own_cert(&conf_, &cert_, &key_)) != 0) {
+    return false;
+  }
+  mbedtls_ssl_conf_rng(&conf_, mbedtls_ctr_drbg_random, &drbg_);
+  mbedtls_ssl_conf_session_tickets(&conf_, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+  if ((error_ = mbedtls_ssl_setup(&ssl_, &conf_)) != 0 ||
+      (error_ = mbedtls_ssl_set_hostname(&ssl_, host)) != 0) {
+    return false;
+  }
+  mbedtls_ssl_set_bio(&ssl_, this, bioSend, bioRecv, NULL);
+
+  bool offered = cache_ != NULL && cache_->restore(host, port, &ssl_);
+
+  // Step the handshake by hand: whether the server accepted the offered
+  // session is only visible while the handshake parameters still exist.
+  uint32_t start = millis();
+  resumed_ = false;
+  while (ssl_.state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+    if (ssl_.handshake != NULL) {
+      resumed_ = ssl_.handshake->resume != 0;
+    }
+    error_ = mbedtls_ssl_handshake_step(&ssl_);
+    if (error_ == MBEDTLS_ERR_SSL_WANT_READ || error_ == MBEDTLS_ERR_SSL_WANT_WRITE) {
+      if (millis() - start > handshakeTimeoutMs_) {
+        error_ = MBEDTLS_ERR_SSL_TIMEOUT;
+        return false;
+      }
+      delay(1);
+      continue;
+    }
+    if (error_ != 0) {
+      if (offered && cache_ != NULL) {
+        cache_->forget(host, port);
+      }
+      return false;
+    }
+  }
+  handshakeMs_ = millis() - start;
+  if (cache_ != NULL) {
+    cache_->recordHandshake(handshakeMs_, resumed_);
+    cache_->store(host, port, &ssl_);
+  }
+  return true;
+}
+
+void TlsClient::release() {
+  if (!active_) {
+    return;
+  }
+  mbedtls_ssl_free(&ssl_);
+  mbedtls_ssl_config_free(&conf_);
+  mbedtls_ctr_drbg_free(&drbg_);
+  mbedtls_entropy_free(&entropy_);
+  active_ = false;
+}
+
+int TlsClient::connect(const char* host, uint16_t port, int32_t timeout) {
+  stop();
+  uint32_t start = millis();
+  if (!tcp_.connect(host, port, timeout)) {
+    return 0;
+  }
+  connectMs_ = millis() - start;
+  if (!handshake(host, port)) {
+    char msg[96];
+    mbedtls_strerror(error_, msg, sizeof(msg));
+    LOG_WARN("TLS: handshake with %s:%u failed: %s", host, port, msg);
+    stop();
+    return 0;
+  }
+  LOG_INFO("TLS: %s handshake with %s:%u in %u ms", resumed_ ? "resumed" : "full",
+           host, port, handshakeMs_);
+  return 1;
+}
+
+int TlsClient::connect(const char* host, uint16_t port) {
+  return connect(host, port, TLS_DEFAULT_CONNECT_TIMEOUT_MS);
+}
+
+int TlsClient::connect(IPAddress ip, uint16_t port, int32_t timeout) {
+  return connect(ip.toString().c_str(), port, timeout);
+}
+
+int TlsClient::connect(IPAddress ip, uint16_t port) {
+  return connect(ip, port, TLS_DEFAULT_CONNECT_TIMEOUT_MS);
+}
+
+size_t TlsClient::write(uint8_t data) {
+  return write(&data, 1);
+}
+
+size_t TlsClient::write(const uint8_t* buf, size_t size) {
+  if (!active_) {
+    return 0;
+  }
+  size_t sent = 0;
+  uint32_t progress = millis();
+  while (sent < size) {
+    int ret = mbedtls_ssl_write(&ssl_, buf + sent, size - sent);
+    if (ret > 0) {
+      sent += ret;
+      progress = millis();
+    } else if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+      // A peer that stops reading would otherwise hold the caller here forever
+      if (millis() - progress > writeTimeoutMs_) {
+        LOG_WARN("TLS: write stalled for %u ms, closing", (unsigned)writeTimeoutMs_);
+        error_ = MBEDTLS_ERR_SSL_TIMEOUT;
+        stop();
+        break;
+      }
+      delay(1);
+    } else {
+      error_ = ret;
+      stop();
+      break;
+    }
+  }
+  return sent;
+}
+
+int TlsClient::available() {
+  if (!active_) {
+    return peeked_ >= 0 ? 1 : 0;
+  }
+  // A zero-length read processes pending records without consuming data
+  int ret = mbedtls_ssl_read(&ssl_, NULL, 0);
+  int avail = mbedtls_ssl_get_bytes_avail(&ssl_) + (peeked_ >= 0 ? 1 : 0);
+  if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE && avail == 0) {
+    error_ = ret;
+    stop();
+  }
+  return avail;
+}
+
+int TlsClient::read(uint8_t* buf, size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+  int got = 0;
+  if (peeked_ >= 0) {
+    buf[got++] = (uint8_t)peeked_;
+    peeked_ = -1;
+    if (--size == 0 || !active_) {
+      return got;
+    }
+  }
+  if (!active_) {
+    return got > 0 ? got : -1;
+  }
+  int ret = mbedtls_ssl_read(&ssl_, buf + got, size);
+  if (ret > 0) {
+    return got + ret;
+  }
+  if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+    error_ = ret;
+    stop();
+  }
+  return got > 0 ? got : -1;
+}
+
+int TlsClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int TlsClient::peek() {
+  if (peeked_ < 0) {
+    peeked_ = read();
+  }
+  return peeked_;
+}
+
+void TlsClient::flush() {
+  tcp_.flush();
+}
+
+void TlsClient::stop() {
+  if (active_ && tcp_.connected()) {
+    mbedtls_ssl_close_notify(&ssl_);
+  }
+  release();
+  tcp_.stop();
+  peeked_ = -1;
+}
+
+uint8_t TlsClient::connected() {
+  if (!active_) {
+    return peeked_ >= 0;
+  }
+  if (!tcp_.connected() && available() == 0) {
+    stop();
+  }
+  return active_;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/x509_crt.h>
+#include <mbedtls/pk.h>
+
+#include "TlsSessionCache.h"
+
+// TLS client that resumes sessions from a TlsSessionCache. It is a drop-in
+// for WiFiClientSecure with HTTPClient and PubSubClient; unlike it, the
+// handshake is driven here so a cached session can be offered first, and the
+// client certificate and key are parsed from DER once per client rather than
+// from PEM once per connection.
+class TlsClient : public WiFiClient {
+ public:
+  TlsClient();
+  ~TlsClient();
+
+  // Buffers must outlive the client. The certificate chain and key are DER,
+  // as CredentialCache holds them; the chain is parsed in place.
+  void setCACert(const char* pem);
+  void setCertificate(const uint8_t* der, size_t len);
+  void setPrivateKey(const uint8_t* der, size_t len);
+  void setInsecure();
+  void setHandshakeTimeout(uint32_t seconds);
+  // Also bounds write(): a write that makes no progress for this long stops
+  // the client. Five seconds unless set.
+  int setTimeout(uint32_t seconds);
+  void setSessionCache(TlsSessionCache* cache);
+
+  int connect(IPAddress ip, uint16_t port);
+  int connect(IPAddress ip, uint16_t port, int32_t timeout);
+  int connect(const char* host, uint16_t port);
+  int connect(const char* host, uint16_t port, int32_t timeout);
+  size_t write(uint8_t data);
+  size_t write(const uint8_t* buf, size_t size);
+  int available();
+  int read();
+  int read(uint8_t* buf, size_t size);
+  int peek();
+  void flush();
+  void stop();
+  uint8_t connected();
+  operator bool() { return connected(); }
+
+  // TCP connect alone: one round trip, for link estimates
+  uint32_t lastConnectMs() const { return connectMs_; }
+  uint32_t lastHandshakeMs() const { return handshakeMs_; }
+  bool lastHandshakeResumed() const { return resumed_; }
+  int lastError() const { return error_; }
+
+ private:
+  static int bioSend(void* ctx, const unsigned char* buf, size_t len);
+  static int bioRecv(void* ctx, unsigned char* buf, size_t len);
+
+  bool parseChain(const uint8_t* der, size_t len);
+  bool loadIdentity();
+  bool handshake(const char* host, uint16_t port);
+  void release();
+
+  WiFiClient tcp_;
+  TlsSessionCache* cache_;
+  const char* caPem_;
+  const uint8_t* certDer_;
+  size_t certDerLen_;
+  const uint8_t* keyDer_;
+  size_t keyDerLen_;
+  bool insecure_;
+  bool identityLoaded_;
+  bool active_;
+  uint32_t handshakeTimeoutMs_;
+  uint32_t writeTimeoutMs_;
+  uint32_t connectMs_;
+  uint32_t handshakeMs_;
+  bool resumed_;
+  int error_;
+  int peeked_;
+
+  mbedtls_ssl_context ssl_;
+  mbedtls_ssl_config conf_;
+  mbedtls_entropy_context entropy_;
+  mbedtls_ctr_drbg_context drbg_;
+  mbedtls_x509_crt ca_;
+  mbedtls_x509_crt cert_;
+  mbedtls_pk_context key_;
+};
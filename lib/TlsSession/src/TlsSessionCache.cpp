@@ -0,0 +1,189 @@
+#include "TlsSessionCache.h"
+
+#include <Preferences.h>
+
+TlsSessionCache TlsSessions;
+
+static void endpointName(const char* host, uint16_t port, char* out) {
+  snprintf(out, TLS_ENDPOINT_MAX, "%s:%u", host, port);
+}
+
+TlsSessionCache::TlsSessionCache() : persist_(false) {
+  memset(slots_, 0, sizeof(slots_));
+  memset(&stats_, 0, sizeof(stats_));
+  lock_ = xSemaphoreCreateMutex();
+}
+
+void TlsSessionCache::begin(bool persist) {
+  persist_ = persist;
+  if (!persist_) {
+    return;
+  }
+  Preferences prefs;
+  prefs.begin("tls", true);
+  xSemaphoreTake(lock_, portMAX_DELAY);
+  for (int i = 0; i < TLS_SESSION_SLOTS; i++) {
+    char key[4] = { 'e', (char)('0' + i), '\0' };
+    char endpoint[TLS_ENDPOINT_MAX];
+    size_t endpointLen = prefs.getString(key, endpoint, sizeof(endpoint));
+    key[0] = 's';
+    size_t len = prefs.getBytesLength(key);
+    if (endpointLen == 0 || len == 0) {
+      continue;
+    }
+    uint8_t* data = (uint8_t*)malloc(len);
+    if (data == NULL) {
+      continue;
+    }
+    if (prefs.getBytes(key, data, len) == len) {
+      setSlot(i, endpoint, data, len);
+    }
+    free(data);
+  }
+  xSemaphoreGive(lock_);
+  prefs.end();
+}
+
+int TlsSessionCache::find(const char* endpoint) {
+  for (int i = 0; i < TLS_SESSION_SLOTS; i++) {
+    if (slots_[i].data != NULL && strcmp(slots_[i].endpoint, endpoint) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Empty slot if there is one, otherwise the least recently used
+int TlsSessionCache::victim() {
+  int oldest = 0;
+  for (int i = 0; i < TLS_SESSION_SLOTS; i++) {
+    if (slots_[i].data == NULL) {
+      return i;
+    }
+    if (slots_[i].lastUsed < slots_[oldest].lastUsed) {
+      oldest = i;
+    }
+  }
+  return oldest;
+}
+
+void TlsSessionCache::setSlot(int index, const char* endpoint, const uint8_t* data, size_t len) {
+  Slot& slot = slots_[index];
+  free(slot.data);
+  slot.data = NULL;
+  slot.len = 0;
+  if (data != NULL && len > 0) {
+    slot.data = (uint8_t*)malloc(len);
+    if (slot.data == NULL) {
+      return;
+    }
+    memcpy(slot.data, data, len);
+    slot.len = len;
+  }
+  strncpy(slot.endpoint, endpoint, sizeof(slot.endpoint) - 1);
+  slot.endpoint[sizeof(slot.endpoint) - 1] = '\0';
+  slot.lastUsed = millis();
+}
+
+void TlsSessionCache::persist(int index) {
+  if (!persist_) {
+    return;
+  }
+  Preferences prefs;
+  prefs.begin("tls", false);
+  char key[4] = { 'e', (char)('0' + index), '\0' };
+  if (slots_[index].data != NULL) {
+    prefs.putString(key, slots_[index].endpoint);
+    key[0] = 's';
+    prefs.putBytes(key, slots_[index].data, slots_[index].len);
+  } else {
+    prefs.remove(key);
+    key[0] = 's';
+    prefs.remove(key);
+  }
+  prefs.end();
+}
+
+bool TlsSessionCache::restore(const char* host, uint16_t port, mbedtls_ssl_context* ssl) {
+  char endpoint[TLS_ENDPOINT_MAX];
+  endpointName(host, port, endpoint);
+  bool offered = false;
+  xSemaphoreTake(lock_, portMAX_DELAY);
+  int index = find(endpoint);
+  if (index >= 0) {
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    if (mbedtls_ssl_session_load(&session, slots_[index].data, slots_[index].len) == 0 &&
+        mbedtls_ssl_set_session(ssl, &session) == 0) {
+      slots_[index].lastUsed = millis();
+      offered = true;
+    }
+    mbedtls_ssl_session_free(&session);
+  }
+  xSemaphoreGive(lock_);
+  return offered;
+}
+
+void TlsSessionCache::store(const char* host, uint16_t port, const mbedtls_ssl_context* ssl) {
+  mbedtls_ssl_session session;
+  mbedtls_ssl_session_init(&session);
+  if (mbedtls_ssl_get_session(ssl, &session) != 0) {
+    mbedtls_ssl_session_free(&session);
+    return;
+  }
+  size_t len = 0;
+  mbedtls_ssl_session_save(&session, NULL, 0, &len);
+  uint8_t* data = len > 0 ? (uint8_t*)malloc(len) : NULL;
+  if (data != NULL && mbedtls_ssl_session_save(&session, data, len, &len) == 0) {
+    char endpoint[TLS_ENDPOINT_MAX];
+    endpointName(host, port, endpoint);
+    xSemaphoreTake(lock_, portMAX_DELAY);
+    int index = find(endpoint);
+    if (index >= 0 && slots_[index].len == len && memcmp(slots_[index].data, data, len) == 0) {
+      // A resumed session the server did not renew: nothing new for NVS
+      slots_[index].lastUsed = millis();
+    } else {
+      if (index < 0) {
+        index = victim();
+      }
+      setSlot(index, endpoint, data, len);
+      persist(index);
+    }
+    xSemaphoreGive(lock_);
+  }
+  free(data);
+  mbedtls_ssl_session_free(&session);
+}
+
+void TlsSessionCache::forget(const char* host, uint16_t port) {
+  char endpoint[TLS_ENDPOINT_MAX];
+  endpointName(host, port, endpoint);
+  xSemaphoreTake(lock_, portMAX_DELAY);
+  int index = find(endpoint);
+  if (index >= 0) {
+    setSlot(index, "", NULL, 0);
+    persist(index);
+  }
+  xSemaphoreGive(lock_);
+}
+
+void TlsSessionCache::recordHandshake(uint32_t ms, bool resumed) {
+  xSemaphoreTake(lock_, portMAX_DELAY);
+  if (resumed) {
+    stats_.resumed++;
+    stats_.resumedMsTotal += ms;
+  } else {
+    stats_.full++;
+    stats_.fullMsTotal += ms;
+  }
+  stats_.lastMs = ms;
+  stats_.lastResumed = resumed;
+  xSemaphoreGive(lock_);
+}
+
+TlsHandshakeStats TlsSessionCache::stats() {
+  xSemaphoreTake(lock_, portMAX_DELAY);
+  TlsHandshakeStats copy = stats_;
+  xSemaphoreGive(lock_);
+  return copy;
+}
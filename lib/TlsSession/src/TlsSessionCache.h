@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Arduino.h>
+#include <mbedtls/ssl.h>
+
+#define TLS_SESSION_SLOTS 4
+#define TLS_ENDPOINT_MAX 64
+
+// Handshake counters, split by whether the server accepted the cached session
+struct TlsHandshakeStats {
+  uint32_t full;
+  uint32_t resumed;
+  uint32_t fullMsTotal;
+  uint32_t resumedMsTotal;
+  uint32_t lastMs;
+  bool lastResumed;
+};
+
+// Keeps the last TLS session (ticket or session ID) per endpoint so the next
+// connection can resume it instead of repeating the full handshake with
+// client-certificate authentication. Sessions live in RAM and, if enabled,
+// in NVS so they survive a reboot. Safe to share between tasks.
+class TlsSessionCache {
+ public:
+  TlsSessionCache();
+
+  // Loads persisted sessions when persist is true; later stores go to NVS too
+  void begin(bool persist);
+
+  // Offers the cached session for host:port to a context that is set up but
+  // has not started its handshake. Returns true if one was offered.
+  bool restore(const char* host, uint16_t port, mbedtls_ssl_context* ssl);
+
+  // Saves the session negotiated by a completed handshake. NVS is written
+  // only when it differs from the cached one (a full handshake or a new
+  // ticket), not after every resumption.
+  void store(const char* host, uint16_t port, const mbedtls_ssl_context* ssl);
+
+  // Drops the session for host:port, e.g. after the server rejected it
+  void forget(const char* host, uint16_t port);
+
+  void recordHandshake(uint32_t ms, bool resumed);
+  TlsHandshakeStats stats();
+
+ private:
+  struct Slot {
+    char endpoint[TLS_ENDPOINT_MAX];
+    uint8_t* data;
+    size_t len;
+    uint32_t lastUsed;
+  };
+
+  int find(const char* endpoint);
+  int victim();
+  void setSlot(int index, const char* endpoint, const uint8_t* data, size_t len);
+  void persist(int index);
+
+  Slot slots_[TLS_SESSION_SLOTS];
+  TlsHandshakeStats stats_;
+  SemaphoreHandle_t lock_;
+  bool persist_;
+};
+
+extern TlsSessionCache TlsSessions;
@@ -0,0 +1,100 @@
+#pragma once
+
+// Host (Linux) stand-in for the parts of the ESP32 Arduino core the portal
+// uses. Only built by [env:native]; see native/README.md.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+#include <type_traits>
+
+#include "WString.h"
+#include "Stream.h"
+#include "IPAddress.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#define PROGMEM
+#define PGM_P const char*
+#define F(x) x
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define ARDUINO_RUNNING_CORE 1
+
+typedef uint8_t byte;
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void yield();
+bool setCpuFrequencyMhz(uint32_t mhz);
+uint32_t getCpuFrequencyMhz();
+long random(long max);
+long random(long min, long max);
+
+// By value: with equal types the conditional is an lvalue, and returning
+// its decltype would be a reference to a parameter
+template <typename T, typename U>
+typename std::common_type<T, U>::type min(T a, U b) { return a < b ? a : b; }
+template <typename T, typename U>
+typename std::common_type<T, U>::type max(T a, U b) { return a > b ? a : b; }
+
+#define SERIAL_8N1 0x800001c
+
+// UART 0 is stdout; UART 2 is wired to a simulated modem (native/src/modem.cpp)
+class HardwareSerial : public Stream {
+ public:
+  explicit HardwareSerial(int uart) : uart_(uart) {}
+
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1);
+  void end();
+  size_t setRxBufferSize(size_t size) { return size; }
+  void flush();
+  int availableForWrite();
+  int available() override;
+  int read() override;
+  size_t read(uint8_t* buf, size_t len);
+  int peek() override;
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buf, size_t len) override;
+  operator bool() const { return true; }
+
+ private:
+  int uart_;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial2;
+
+class EspClass {
+ public:
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getMaxAllocHeap();
+  uint64_t getEfuseMac();
+  void restart();
+};
+
+extern EspClass ESP;
+
+// Host only: the process's heap use, counted by the allocator stand-in
+// (native/src/heap.cpp), for benchmarks that report allocations
+struct NativeHeapStats {
+  uint32_t allocations;  // since start
+  size_t inUse;
+  size_t peak;           // since the last nativeHeapResetPeak()
+};
+
+NativeHeapStats nativeHeapStats();
+void nativeHeapResetPeak();
+
+// Entry points provided by the sketch
+void setup();
+void loop();
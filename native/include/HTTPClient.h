@@ -0,0 +1,70 @@
+#pragma once
+
+// HTTP/1.1 client that speaks over whatever Client it is given, like the
+// ESP32 HTTPClient: https URLs go through the TLS client passed in.
+
+#include <Arduino.h>
+#include <vector>
+
+#include "WiFiClient.h"
+
+#define HTTP_CODE_OK 200
+#define HTTP_CODE_PARTIAL_CONTENT 206
+#define HTTP_CODE_NOT_MODIFIED 304
+#define HTTP_CODE_NOT_FOUND 404
+#define HTTP_CODE_RANGE_NOT_SATISFIABLE 416
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_NO_STREAM (-6)
+#define HTTPC_ERROR_ENCODING (-9)
+#define HTTPC_ERROR_STREAM_WRITE (-10)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+class HTTPClient {
+ public:
+  HTTPClient() {}
+  ~HTTPClient() { end(); }
+
+  bool begin(WiFiClient& client, const String& url);
+  void end();
+  void setTimeout(uint16_t timeout) { timeout_ = timeout; }
+  void setConnectTimeout(int32_t timeout) { connectTimeout_ = timeout; }
+  void setReuse(bool reuse) {}
+  void addHeader(const String& name, const String& value);
+  void collectHeaders(const char* headerKeys[], const size_t count);
+  String header(const char* name);
+  bool hasHeader(const char* name);
+
+  int GET();
+  int getSize() { return size_; }
+  String getString();
+  // Copies the body to stream, undoing chunked transfer encoding; returns
+  // the bytes written or an HTTPC_ERROR_ code
+  int writeToStream(Stream* stream);
+  WiFiClient* getStreamPtr() { return connected() ? client_ : NULL; }
+  WiFiClient& getStream() { return *client_; }
+  bool connected() { return client_ != NULL && client_->connected(); }
+  static String errorToString(int error);
+
+ private:
+  struct Header {
+    String name;
+    String value;
+  };
+
+  bool readLine(String& line);
+  int copyBody(Stream* stream, int len);
+
+  WiFiClient* client_ = NULL;
+  String host_;
+  uint16_t port_ = 80;
+  String path_;
+  String requestHeaders_;
+  std::vector<Header> headers_;
+  int size_ = -1;
+  uint16_t timeout_ = 5000;
+  int32_t connectTimeout_ = 5000;
+};
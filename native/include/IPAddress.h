@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "WString.h"
+
+class IPAddress {
+ public:
+  IPAddress() : addr_(0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+    : addr_(a | (b << 8) | (c << 16) | ((uint32_t)d << 24)) {}
+  IPAddress(uint32_t addr) : addr_(addr) {}
+  operator uint32_t() const { return addr_; }
+  uint8_t operator[](int i) const { return (addr_ >> (8 * i)) & 0xff; }
+  String toString() const;
+
+ private:
+  uint32_t addr_;  // network byte order, as on the ESP32
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "FS.h"
+
+namespace fs {
+
+class LittleFSFS : public FS {
+ public:
+  LittleFSFS() : FS("littlefs") {}
+  bool begin(bool formatOnFail = false, const char* basePath = "/littlefs", uint8_t maxOpenFiles = 10,
+             const char* partitionLabel = "spiffs") { return mount(formatOnFail); }
+  void end() { mounted_ = false; }
+  bool format();
+  size_t totalBytes() { return 1408 * 1024; }
+  size_t usedBytes() { return usedSize(); }
+};
+
+}  // namespace fs
+
+extern fs::LittleFSFS LittleFS;
@@ -0,0 +1,53 @@
+#pragma once
+
+// NVS stand-in: namespaces live in memory and are mirrored to a file in the
+// native data directory so they survive a restart of the process.
+
+#include <Arduino.h>
+
+class Preferences {
+ public:
+  bool begin(const char* name, bool readOnly = false, const char* partitionLabel = NULL);
+  void end();
+
+  bool clear();
+  bool remove(const char* key);
+  bool isKey(const char* key);
+
+  size_t putBool(const char* key, bool value) { return putValue(key, &value, sizeof(value)); }
+  size_t putUChar(const char* key, uint8_t value) { return putValue(key, &value, sizeof(value)); }
+  size_t putUShort(const char* key, uint16_t value) { return putValue(key, &value, sizeof(value)); }
+  size_t putInt(const char* key, int32_t value) { return putValue(key, &value, sizeof(value)); }
+  size_t putUInt(const char* key, uint32_t value) { return putValue(key, &value, sizeof(value)); }
+  size_t putULong(const char* key, uint32_t value) { return putValue(key, &value, sizeof(value)); }
+  size_t putULong64(const char* key, uint64_t value) { return putValue(key, &value, sizeof(value)); }
+  size_t putString(const char* key, const char* value) { return putValue(key, value, strlen(value)); }
+  size_t putString(const char* key, const String& value) { return putString(key, value.c_str()); }
+  size_t putBytes(const char* key, const void* value, size_t len) { return putValue(key, value, len); }
+
+  bool getBool(const char* key, bool defaultValue = false) { return getValue(key, defaultValue); }
+  uint8_t getUChar(const char* key, uint8_t defaultValue = 0) { return getValue(key, defaultValue); }
+  uint16_t getUShort(const char* key, uint16_t defaultValue = 0) { return getValue(key, defaultValue); }
+  int32_t getInt(const char* key, int32_t defaultValue = 0) { return getValue(key, defaultValue); }
+  uint32_t getUInt(const char* key, uint32_t defaultValue = 0) { return getValue(key, defaultValue); }
+  uint32_t getULong(const char* key, uint32_t defaultValue = 0) { return getValue(key, defaultValue); }
+  uint64_t getULong64(const char* key, uint64_t defaultValue = 0) { return getValue(key, defaultValue); }
+  String getString(const char* key, const String& defaultValue = String());
+  size_t getString(const char* key, char* value, size_t maxLen);
+  size_t getBytesLength(const char* key);
+  size_t getBytes(const char* key, void* buf, size_t maxLen);
+
+ private:
+  size_t putValue(const char* key, const void* value, size_t len);
+  bool readValue(const char* key, void* value, size_t len);
+
+  template <typename T>
+  T getValue(const char* key, T defaultValue) {
+    T value;
+    return readValue(key, &value, sizeof(value)) ? value : defaultValue;
+  }
+
+  String name_;
+  bool open_ = false;
+  bool readOnly_ = false;
+};
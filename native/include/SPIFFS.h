@@ -0,0 +1,20 @@
+#pragma once
+
+#include "FS.h"
+
+namespace fs {
+
+class SPIFFSFS : public FS {
+ public:
+  SPIFFSFS() : FS("spiffs") {}
+  bool begin(bool formatOnFail = false, const char* basePath = "/spiffs", uint8_t maxOpenFiles = 10,
+             const char* partitionLabel = NULL) { return mount(formatOnFail); }
+  void end() { mounted_ = false; }
+  bool format();
+  size_t totalBytes() { return 1408 * 1024; }
+  size_t usedBytes() { return usedSize(); }
+};
+
+}  // namespace fs
+
+extern fs::SPIFFSFS SPIFFS;
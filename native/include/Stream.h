@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "WString.h"
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buf, size_t len);
+  size_t write(const char* str);
+
+  size_t print(const String& s);
+  size_t print(const char* s);
+  size_t print(char c);
+  size_t print(int n);
+  size_t print(unsigned int n);
+  size_t print(long n);
+  size_t print(unsigned long n);
+  size_t print(double n, int digits = 2);
+  size_t println();
+  size_t println(const String& s);
+  size_t println(const char* s);
+  size_t println(char c);
+  size_t println(int n);
+  size_t println(unsigned int n);
+  size_t println(long n);
+  size_t println(unsigned long n);
+  size_t println(double n, int digits = 2);
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+ public:
+  Stream() : timeout_(1000) {}
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+  virtual void flush() {}
+
+  void setTimeout(unsigned long ms) { timeout_ = ms; }
+  size_t readBytes(uint8_t* buf, size_t len);
+  size_t readBytes(char* buf, size_t len) { return readBytes((uint8_t*)buf, len); }
+  String readString();
+  String readStringUntil(char terminator);
+
+ protected:
+  int timedRead();
+  unsigned long timeout_;
+};
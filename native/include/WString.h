@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+// Arduino String on top of std::string; covers the members the portal uses.
+class String {
+ public:
+  String() {}
+  String(const char* s) : s_(s ? s : "") {}
+  String(const std::string& s) : s_(s) {}
+  explicit String(char c) : s_(1, c) {}
+  String(int v) : s_(std::to_string(v)) {}
+  String(unsigned int v) : s_(std::to_string(v)) {}
+  String(long v) : s_(std::to_string(v)) {}
+  String(unsigned long v) : s_(std::to_string(v)) {}
+  String(float v, unsigned int decimals = 2);
+  String(double v, unsigned int decimals = 2);
+
+  unsigned int length() const { return s_.size(); }
+  const char* c_str() const { return s_.c_str(); }
+  bool reserve(unsigned int size) { s_.reserve(size); return true; }
+  bool isEmpty() const { return s_.empty(); }
+
+  String substring(unsigned int from) const;
+  String substring(unsigned int from, unsigned int to) const;
+  int indexOf(char c, unsigned int from = 0) const;
+  int indexOf(const char* str, unsigned int from = 0) const;
+  int lastIndexOf(char c) const;
+  bool startsWith(const String& prefix) const;
+  bool endsWith(const String& suffix) const;
+  bool equals(const String& other) const { return s_ == other.s_; }
+  bool equalsIgnoreCase(const String& other) const;
+  void replace(const String& from, const String& to);
+  void trim();
+  void toLowerCase();
+  long toInt() const { return strtol(s_.c_str(), NULL, 10); }
+  void toCharArray(char* buf, unsigned int size) const;
+  bool concat(const char* str, unsigned int len) { s_.append(str, len); return true; }
+  char charAt(unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+  char operator[](unsigned int i) const { return charAt(i); }
+
+  String& operator+=(const String& rhs) { s_ += rhs.s_; return *this; }
+  String& operator+=(const char* rhs) { s_ += rhs; return *this; }
+  String& operator+=(char rhs) { s_ += rhs; return *this; }
+  String& operator+=(int rhs) { s_ += std::to_string(rhs); return *this; }
+  String& operator+=(unsigned int rhs) { s_ += std::to_string(rhs); return *this; }
+  String& operator+=(long rhs) { s_ += std::to_string(rhs); return *this; }
+  String& operator+=(unsigned long rhs) { s_ += std::to_string(rhs); return *this; }
+
+  bool operator==(const String& rhs) const { return s_ == rhs.s_; }
+  bool operator==(const char* rhs) const { return s_ == (rhs ? rhs : ""); }
+  bool operator!=(const String& rhs) const { return s_ != rhs.s_; }
+  bool operator!=(const char* rhs) const { return !(*this == rhs); }
+  bool operator<(const String& rhs) const { return s_ < rhs.s_; }
+
+  const std::string& str() const { return s_; }
+
+ private:
+  std::string s_;
+};
+
+String operator+(const String& lhs, const String& rhs);
+String operator+(const String& lhs, const char* rhs);
+String operator+(const char* lhs, const String& rhs);
@@ -0,0 +1,107 @@
+#pragma once
+
+// HTTP server on a POSIX listening socket. handleClient() serves at most one
+// request per call and closes the connection afterwards. Form and multipart
+// bodies are parsed into args and upload callbacks like the ESP32 WebServer.
+// NATIVE_HTTP_PORT overrides the port, since 80 needs root on the host.
+
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+
+#include "FS.h"
+#include "WiFiClient.h"
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+#define HTTP_UPLOAD_BUFLEN 1436
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+enum HTTPUploadStatus { UPLOAD_FILE_START, UPLOAD_FILE_WRITE, UPLOAD_FILE_END, UPLOAD_FILE_ABORTED };
+
+struct HTTPUpload {
+  HTTPUploadStatus status;
+  String filename;
+  String name;
+  String type;
+  size_t totalSize;
+  size_t currentSize;
+  uint8_t buf[HTTP_UPLOAD_BUFLEN];
+};
+
+class WebServer {
+ public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  explicit WebServer(int port = 80);
+  ~WebServer();
+
+  void begin();
+  void close();
+  void handleClient();
+
+  void on(const String& uri, THandlerFunction handler);
+  void on(const String& uri, HTTPMethod method, THandlerFunction handler);
+  void on(const String& uri, HTTPMethod method, THandlerFunction handler, THandlerFunction upload);
+  void onNotFound(THandlerFunction handler);
+
+  String uri() const { return uri_; }
+  HTTPMethod method() const { return method_; }
+  HTTPUpload& upload() { return upload_; }
+  WiFiClient client() { return client_; }
+
+  String arg(const String& name) const;
+  String arg(int i) const;
+  String argName(int i) const;
+  int args() const { return args_.size(); }
+  bool hasArg(const String& name) const;
+  void collectHeaders(const char* headerKeys[], const size_t count);
+  String header(const String& name) const;
+  bool hasHeader(const String& name) const;
+
+  void setContentLength(const size_t length) { contentLength_ = length; }
+  void sendHeader(const String& name, const String& value, bool first = false);
+  void send(int code, const char* contentType = NULL, const String& content = String());
+  void send(int code, const String& contentType, const String& content);
+  void send(int code, const char* contentType, const char* content);
+  void send_P(int code, PGM_P contentType, PGM_P content);
+  void send_P(int code, PGM_P contentType, PGM_P content, size_t len);
+  void sendContent(const String& content);
+  void sendContent(const char* content, size_t len);
+  void sendContent_P(PGM_P content);
+  void sendContent_P(PGM_P content, size_t len);
+
+ private:
+  struct Route {
+    String uri;
+    HTTPMethod method;
+    THandlerFunction handler;
+    THandlerFunction upload;
+  };
+  struct Pair {
+    String name;
+    String value;
+  };
+
+  bool readRequest();
+  bool readLine(String& line);
+  void parseQuery(const String& query);
+  bool parseMultipart(const String& boundary, size_t length);
+  void sendStatus(int code, const char* contentType, size_t length);
+  void writeRaw(const char* data, size_t len);
+
+  int port_;
+  int listenFd_;
+  std::vector<Route> routes_;
+  THandlerFunction notFound_;
+  WiFiClient client_;
+  String uri_;
+  HTTPMethod method_;
+  std::vector<Pair> args_;
+  std::vector<Pair> headers_;
+  String responseHeaders_;
+  size_t contentLength_;
+  bool chunked_;
+  const Route* route_;
+  HTTPUpload upload_;
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+// WiFi stand-in: station connects always succeed, after a delay that stands
+// in for the scan (skipped when BSSID and channel are given) and DHCP
+// (skipped with a static IP). The soft AP is the host's loopback interface.
+
+#include <Arduino.h>
+#include "WiFiClient.h"
+#include "esp_netif.h"
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum {
+  ARDUINO_EVENT_WIFI_STA_START,
+  ARDUINO_EVENT_WIFI_STA_STOP,
+  ARDUINO_EVENT_WIFI_STA_CONNECTED,
+  ARDUINO_EVENT_WIFI_STA_DISCONNECTED,
+  ARDUINO_EVENT_WIFI_STA_GOT_IP,
+  ARDUINO_EVENT_WIFI_STA_LOST_IP,
+  ARDUINO_EVENT_MAX
+} arduino_event_id_t;
+
+typedef struct {
+  uint8_t ssid[32];
+  uint8_t ssid_len;
+  uint8_t bssid[6];
+  uint8_t channel;
+  int authmode;
+  uint16_t aid;
+} wifi_event_sta_connected_t;
+
+typedef struct {
+  uint8_t ssid[32];
+  uint8_t ssid_len;
+  uint8_t bssid[6];
+  uint8_t reason;
+} wifi_event_sta_disconnected_t;
+
+typedef union {
+  wifi_event_sta_connected_t wifi_sta_connected;
+  wifi_event_sta_disconnected_t wifi_sta_disconnected;
+  ip_event_got_ip_t got_ip;
+} arduino_event_info_t;
+
+typedef void (*WiFiEventFuncCb)(arduino_event_id_t event, arduino_event_info_t info);
+typedef size_t wifi_event_id_t;
+
+class WiFiClass {
+ public:
+  wl_status_t begin(const char* ssid, const char* password = NULL, int32_t channel = 0,
+                    const uint8_t* bssid = NULL, bool connect = true);
+  bool disconnect(bool wifiOff = false, bool eraseAp = false);
+  bool reconnect();
+  wl_status_t status();
+  bool mode(wifi_mode_t mode);
+  wifi_mode_t getMode();
+  bool softAP(const char* ssid, const char* password = NULL, int channel = 1, int hidden = 0,
+              int maxConnection = 4);
+  IPAddress softAPIP();
+  uint8_t softAPgetStationNum();
+  IPAddress localIP();
+  String SSID();
+  int8_t RSSI();
+  uint8_t* macAddress(uint8_t* mac);
+  String macAddress();
+  bool setSleep(bool enabled) { return true; }
+  bool setAutoReconnect(bool enabled) { return true; }
+  bool config(IPAddress localIp, IPAddress gateway, IPAddress subnet,
+              IPAddress dns1 = IPAddress(), IPAddress dns2 = IPAddress());
+  uint8_t* BSSID();
+  int32_t channel();
+  IPAddress gatewayIP();
+  IPAddress subnetMask();
+  IPAddress dnsIP(uint8_t index = 0);
+  wifi_event_id_t onEvent(WiFiEventFuncCb cb, arduino_event_id_t event = ARDUINO_EVENT_MAX);
+  int hostByName(const char* host, IPAddress& result);
+
+ private:
+  wifi_mode_t mode_ = WIFI_OFF;
+  wl_status_t status_ = WL_DISCONNECTED;
+  String ssid_;
+  uint32_t staticIp_ = 0;
+
+  friend void nativeWifiDrop();
+};
+
+extern WiFiClass WiFi;
+
+// Drops the station link as if the AP went away
+void nativeWifiDrop();
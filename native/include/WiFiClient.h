@@ -0,0 +1,51 @@
+#pragma once
+
+// TCP client on POSIX sockets. Copies share the socket, as on the device.
+
+#include <Arduino.h>
+#include <memory>
+
+class Client : public Stream {
+ public:
+  virtual int connect(IPAddress ip, uint16_t port) = 0;
+  virtual int connect(const char* host, uint16_t port) = 0;
+  virtual int connect(IPAddress ip, uint16_t port, int32_t timeout) { return connect(ip, port); }
+  virtual int connect(const char* host, uint16_t port, int32_t timeout) { return connect(host, port); }
+  virtual int read(uint8_t* buf, size_t size) = 0;
+  int read() override = 0;
+  virtual void stop() = 0;
+  virtual uint8_t connected() = 0;
+  virtual operator bool() = 0;
+  using Print::write;
+};
+
+class WiFiSocket;
+
+class WiFiClient : public Client {
+ public:
+  WiFiClient() {}
+  explicit WiFiClient(int fd);
+
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(IPAddress ip, uint16_t port, int32_t timeout) override;
+  int connect(const char* host, uint16_t port) override;
+  int connect(const char* host, uint16_t port, int32_t timeout) override;
+  size_t write(uint8_t data) override;
+  size_t write(const uint8_t* buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t* buf, size_t size) override;
+  int peek() override;
+  void flush() override {}
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override { return connected(); }
+
+  int fd() const;
+  int setNoDelay(bool nodelay);
+  int setTimeout(uint32_t seconds);
+  IPAddress remoteIP() const;
+
+ private:
+  std::shared_ptr<WiFiSocket> socket_;
+};
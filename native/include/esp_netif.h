@@ -0,0 +1,71 @@
+#pragma once
+
+// esp_netif stand-in. Only PPP interfaces are backed: they run a short
+// frame exchange over the driver's transmit and esp_netif_receive(), as
+// LCP and IPCP would, and then report an address. Sockets keep using the
+// host's network; see native/README.md.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_event.h"
+
+typedef struct esp_netif_obj esp_netif_t;
+typedef void* esp_netif_iodriver_handle;
+
+typedef struct {
+  esp_err_t (*post_attach)(esp_netif_t* netif, esp_netif_iodriver_handle handle);
+  esp_netif_t* netif;
+} esp_netif_driver_base_t;
+
+typedef struct {
+  esp_netif_iodriver_handle handle;
+  esp_err_t (*transmit)(void* handle, void* buffer, size_t len);
+  esp_err_t (*transmit_wrap)(void* handle, void* buffer, size_t len, void* netstack_buffer);
+  void (*driver_free_rx_buffer)(void* handle, void* buffer);
+} esp_netif_driver_ifconfig_t;
+
+typedef struct {
+  int kind;
+} esp_netif_config_t;
+
+#define ESP_NETIF_DEFAULT_PPP() { 1 }
+
+typedef struct {
+  uint32_t addr;
+} esp_ip4_addr_t;
+
+typedef struct {
+  esp_ip4_addr_t ip;
+  esp_ip4_addr_t netmask;
+  esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+typedef struct {
+  int if_index;
+  esp_netif_t* esp_netif;
+  esp_netif_ip_info_t ip_info;
+  bool ip_changed;
+} ip_event_got_ip_t;
+
+typedef enum {
+  IP_EVENT_STA_GOT_IP,
+  IP_EVENT_STA_LOST_IP,
+  IP_EVENT_AP_STAIPASSIGNED,
+  IP_EVENT_GOT_IP6,
+  IP_EVENT_ETH_GOT_IP,
+  IP_EVENT_PPP_GOT_IP,
+  IP_EVENT_PPP_LOST_IP
+} ip_event_t;
+
+ESP_EVENT_DECLARE_BASE(IP_EVENT);
+
+esp_err_t esp_netif_init();
+esp_netif_t* esp_netif_new(const esp_netif_config_t* config);
+void esp_netif_destroy(esp_netif_t* netif);
+esp_err_t esp_netif_attach(esp_netif_t* netif, esp_netif_iodriver_handle driver);
+esp_err_t esp_netif_set_driver_config(esp_netif_t* netif, const esp_netif_driver_ifconfig_t* config);
+esp_err_t esp_netif_receive(esp_netif_t* netif, void* buffer, size_t len, void* eb);
+void esp_netif_action_start(void* netif, esp_event_base_t base, int32_t id, void* data);
+void esp_netif_action_stop(void* netif, esp_event_base_t base, int32_t id, void* data);
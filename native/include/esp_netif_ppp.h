@@ -0,0 +1,43 @@
+#pragma once
+
+#include "esp_netif.h"
+
+#define NETIF_PP_PHASE_OFFSET 0x100
+
+typedef enum {
+  NETIF_PPP_ERRORNONE = 0,
+  NETIF_PPP_ERRORPARAM = 1,
+  NETIF_PPP_ERROROPEN = 2,
+  NETIF_PPP_ERRORDEVICE = 3,
+  NETIF_PPP_ERRORALLOC = 4,
+  NETIF_PPP_ERRORUSER = 5,
+  NETIF_PPP_ERRORCONNECT = 6,
+  NETIF_PPP_ERRORAUTHFAIL = 7,
+  NETIF_PPP_ERRORPROTOCOL = 8,
+  NETIF_PPP_ERRORPEERDEAD = 9,
+  NETIF_PPP_ERRORIDLETIMEOUT = 10,
+  NETIF_PPP_ERRORCONNECTTIME = 11,
+  NETIF_PPP_ERRORLOOPBACK = 12,
+  NETIF_PPP_PHASE_DEAD = NETIF_PP_PHASE_OFFSET,
+  NETIF_PPP_PHASE_MASTER,
+  NETIF_PPP_PHASE_HOLDOFF,
+  NETIF_PPP_PHASE_INITIALIZE,
+  NETIF_PPP_PHASE_SERIALCONN,
+  NETIF_PPP_PHASE_DORMANT,
+  NETIF_PPP_PHASE_ESTABLISH,
+  NETIF_PPP_PHASE_AUTHENTICATE,
+  NETIF_PPP_PHASE_CALLBACK,
+  NETIF_PPP_PHASE_NETWORK,
+  NETIF_PPP_PHASE_RUNNING,
+  NETIF_PPP_PHASE_TERMINATE,
+  NETIF_PPP_PHASE_DISCONNECT
+} esp_netif_ppp_status_event_t;
+
+typedef struct {
+  bool ppp_phase_event_enabled;
+  bool ppp_error_event_enabled;
+} esp_netif_ppp_config_t;
+
+ESP_EVENT_DECLARE_BASE(NETIF_PPP_STATUS);
+
+esp_err_t esp_netif_ppp_set_params(esp_netif_t* netif, const esp_netif_ppp_config_t* config);
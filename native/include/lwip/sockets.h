@@ -0,0 +1,17 @@
+#pragma once
+
+// lwIP's BSD socket API is the host's own socket API.
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <stdint.h>
+
+// Port a device server on `port` listens on here: NATIVE_HTTP_PORT if set,
+// otherwise 8080 in place of 80, which needs root on the host
+uint16_t nativeListenPort(uint16_t port);
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stddef.h>
+
+typedef struct {
+  int unused;
+} mbedtls_ctr_drbg_context;
+
+void mbedtls_ctr_drbg_init(mbedtls_ctr_drbg_context* ctx);
+void mbedtls_ctr_drbg_free(mbedtls_ctr_drbg_context* ctx);
+int mbedtls_ctr_drbg_seed(mbedtls_ctr_drbg_context* ctx, int (*entropy)(void*, unsigned char*, size_t),
+                          void* entropyCtx, const unsigned char* custom, size_t len);
+int mbedtls_ctr_drbg_random(void* ctx, unsigned char* out, size_t len);
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stddef.h>
+
+typedef struct {
+  int parsed;
+} mbedtls_pk_context;
+
+void mbedtls_pk_init(mbedtls_pk_context* pk);
+void mbedtls_pk_free(mbedtls_pk_context* pk);
+int mbedtls_pk_parse_key(mbedtls_pk_context* pk, const unsigned char* key, size_t keyLen,
+                         const unsigned char* pwd, size_t pwdLen);
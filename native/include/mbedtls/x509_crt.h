@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stddef.h>
+
+#define MBEDTLS_ERR_X509_INVALID_FORMAT -0x2180
+
+typedef struct {
+  int parsed;
+} mbedtls_x509_crt;
+
+void mbedtls_x509_crt_init(mbedtls_x509_crt* crt);
+void mbedtls_x509_crt_free(mbedtls_x509_crt* crt);
+int mbedtls_x509_crt_parse(mbedtls_x509_crt* crt, const unsigned char* buf, size_t len);
+int mbedtls_x509_crt_parse_der(mbedtls_x509_crt* crt, const unsigned char* buf, size_t len);
+int mbedtls_x509_crt_parse_der_nocopy(mbedtls_x509_crt* crt, const unsigned char* buf, size_t len);
@@ -0,0 +1,400 @@
+#include <Arduino.h>
+
+#include <chrono>
+#include <mutex>
+#include <strings.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "native.h"
+
+HardwareSerial Serial(0);
+HardwareSerial Serial2(2);
+EspClass ESP;
+
+static const auto bootTime = std::chrono::steady_clock::now();
+static char** savedArgv = NULL;
+
+std::string nativeDataPath(const char* name) {
+  const char* dir = getenv("NATIVE_DATA_DIR");
+  std::string root = dir != NULL && dir[0] != 0 ? dir : "native_data";
+  ::mkdir(root.c_str(), 0755);
+  return root + "/" + name;
+}
+
+void nativeRestart() {
+  fflush(stdout);
+  // Sockets opened through the lwIP API are not close-on-exec
+  for (int fd = 3; fd < 1024; fd++) {
+    ::close(fd);
+  }
+  execv("/proc/self/exe", savedArgv);
+  perror("restart");
+  exit(1);
+}
+
+uint32_t millis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+           std::chrono::steady_clock::now() - bootTime).count();
+}
+
+uint32_t micros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+           std::chrono::steady_clock::now() - bootTime).count();
+}
+
+void delay(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield() {
+  std::this_thread::yield();
+}
+
+long random(long max) {
+  return max > 0 ? rand() % max : 0;
+}
+
+long random(long min, long max) {
+  return max > min ? min + random(max - min) : min;
+}
+
+const char* esp_err_to_name(esp_err_t err) {
+  switch (err) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_OTA_VALIDATE_FAILED: return "ESP_ERR_OTA_VALIDATE_FAILED";
+    case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+    case ESP_ERR_NVS_READ_ONLY: return "ESP_ERR_NVS_READ_ONLY";
+    case ESP_ERR_NVS_INVALID_HANDLE: return "ESP_ERR_NVS_INVALID_HANDLE";
+    case ESP_ERR_NVS_KEY_TOO_LONG: return "ESP_ERR_NVS_KEY_TOO_LONG";
+    case ESP_ERR_NVS_INVALID_LENGTH: return "ESP_ERR_NVS_INVALID_LENGTH";
+    case ESP_ERR_NVS_NO_FREE_PAGES: return "ESP_ERR_NVS_NO_FREE_PAGES";
+    default: return "UNKNOWN ERROR";
+  }
+}
+
+// String
+
+String::String(float v, unsigned int decimals) : String((double)v, decimals) {}
+
+String::String(double v, unsigned int decimals) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+  s_ = buf;
+}
+
+String String::substring(unsigned int from) const {
+  return from < s_.size() ? String(s_.substr(from)) : String();
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) {
+    unsigned int t = from;
+    from = to;
+    to = t;
+  }
+  if (from >= s_.size()) {
+    return String();
+  }
+  return String(s_.substr(from, to - from));
+}
+
+int String::indexOf(char c, unsigned int from) const {
+  size_t pos = s_.find(c, from);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const char* str, unsigned int from) const {
+  size_t pos = s_.find(str, from);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(char c) const {
+  size_t pos = s_.rfind(c);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+bool String::startsWith(const String& prefix) const {
+  return s_.compare(0, prefix.s_.size(), prefix.s_) == 0;
+}
+
+bool String::endsWith(const String& suffix) const {
+  return s_.size() >= suffix.s_.size() &&
+         s_.compare(s_.size() - suffix.s_.size(), suffix.s_.size(), suffix.s_) == 0;
+}
+
+bool String::equalsIgnoreCase(const String& other) const {
+  return strcasecmp(s_.c_str(), other.s_.c_str()) == 0;
+}
+
+void String::replace(const String& from, const String& to) {
+  if (from.s_.empty()) {
+    return;
+  }
+  size_t pos = 0;
+  while ((pos = s_.find(from.s_, pos)) != std::string::npos) {
+    s_.replace(pos, from.s_.size(), to.s_);
+    pos += to.s_.size();
+  }
+}
+
+void String::trim() {
+  size_t start = s_.find_first_not_of(" \t\r\n");
+  size_t end = s_.find_last_not_of(" \t\r\n");
+  s_ = start == std::string::npos ? std::string() : s_.substr(start, end - start + 1);
+}
+
+void String::toLowerCase() {
+  for (char& c : s_) {
+    c = tolower((unsigned char)c);
+  }
+}
+
+void String::toCharArray(char* buf, unsigned int size) const {
+  if (size == 0) {
+    return;
+  }
+  size_t n = s_.size() < size - 1 ? s_.size() : size - 1;
+  memcpy(buf, s_.data(), n);
+  buf[n] = 0;
+}
+
+String operator+(const String& lhs, const String& rhs) {
+  return String(lhs.str() + rhs.str());
+}
+
+String operator+(const String& lhs, const char* rhs) {
+  return String(lhs.str() + rhs);
+}
+
+String operator+(const char* lhs, const String& rhs) {
+  return String(lhs + rhs.str());
+}
+
+String IPAddress::toString() const {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+  return String(buf);
+}
+
+// Print and Stream
+
+size_t Print::write(const uint8_t* buf, size_t len) {
+  size_t n = 0;
+  while (n < len && write(buf[n])) {
+    n++;
+  }
+  return n;
+}
+
+size_t Print::write(const char* str) {
+  return write((const uint8_t*)str, strlen(str));
+}
+
+size_t Print::print(const String& s) { return write((const uint8_t*)s.c_str(), s.length()); }
+size_t Print::print(const char* s) { return write(s); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(int n) { return printf("%d", n); }
+size_t Print::print(unsigned int n) { return printf("%u", n); }
+size_t Print::print(long n) { return printf("%ld", n); }
+size_t Print::print(unsigned long n) { return printf("%lu", n); }
+size_t Print::print(double n, int digits) { return printf("%.*f", digits, n); }
+size_t Print::println() { return write("\r\n"); }
+size_t Print::println(const String& s) { return print(s) + println(); }
+size_t Print::println(const char* s) { return print(s) + println(); }
+size_t Print::println(char c) { return print(c) + println(); }
+size_t Print::println(int n) { return print(n) + println(); }
+size_t Print::println(unsigned int n) { return print(n) + println(); }
+size_t Print::println(long n) { return print(n) + println(); }
+size_t Print::println(unsigned long n) { return print(n) + println(); }
+size_t Print::println(double n, int digits) { return print(n, digits) + println(); }
+
+size_t Print::printf(const char* format, ...) {
+  char buf[256];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  if (len < 0) {
+    return 0;
+  }
+  if ((size_t)len < sizeof(buf)) {
+    return write((const uint8_t*)buf, len);
+  }
+  std::string big(len + 1, 0);
+  va_start(args, format);
+  vsnprintf(&big[0], big.size(), format, args);
+  va_end(args);
+  return write((const uint8_t*)big.data(), len);
+}
+
+int Stream::timedRead() {
+  uint32_t start = millis();
+  do {
+    int c = read();
+    if (c >= 0) {
+      return c;
+    }
+    delay(1);
+  } while (millis() - start < timeout_);
+  return -1;
+}
+
+size_t Stream::readBytes(uint8_t* buf, size_t len) {
+  size_t n = 0;
+  while (n < len) {
+    int c = timedRead();
+    if (c < 0) {
+      break;
+    }
+    buf[n++] = (uint8_t)c;
+  }
+  return n;
+}
+
+String Stream::readString() {
+  String s;
+  int c;
+  while ((c = timedRead()) >= 0) {
+    s += (char)c;
+  }
+  return s;
+}
+
+String Stream::readStringUntil(char terminator) {
+  String s;
+  int c;
+  while ((c = timedRead()) >= 0 && c != terminator) {
+    s += (char)c;
+  }
+  return s;
+}
+
+// The clock only changes what getCpuFrequencyMhz() reports
+static uint32_t cpuMhz = 240;
+
+bool setCpuFrequencyMhz(uint32_t mhz) {
+  cpuMhz = mhz;
+  return true;
+}
+
+uint32_t getCpuFrequencyMhz() {
+  return cpuMhz;
+}
+
+// Serial and ESP
+
+// With NATIVE_SERIAL_PACED set, writes take as long as they would on the
+// UART: bytes leave at the begin() baud rate and a writer blocks once the
+// 128-byte FIFO is full.
+#define NATIVE_UART_FIFO 128
+
+static std::mutex serialMutex;
+static double serialByteUs = 0;  // 0: not paced
+static std::chrono::steady_clock::time_point serialDrainedAt;
+
+static void paceSerial(size_t len) {
+  if (serialByteUs == 0) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(serialMutex);
+  auto now = std::chrono::steady_clock::now();
+  if (serialDrainedAt < now) {
+    serialDrainedAt = now;
+  }
+  serialDrainedAt += std::chrono::microseconds((long)(len * serialByteUs));
+  // Wait until what is left to send fits in the FIFO
+  auto fifoTime = std::chrono::microseconds((long)(NATIVE_UART_FIFO * serialByteUs));
+  auto canReturn = serialDrainedAt - fifoTime;
+  lock.unlock();
+  if (canReturn > now) {
+    std::this_thread::sleep_until(canReturn);
+  }
+}
+
+void HardwareSerial::begin(unsigned long baud, uint32_t config, int8_t rxPin, int8_t txPin) {
+  if (uart_ != 0) {
+    nativeModemBegin(baud);
+    return;
+  }
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  if (getenv("NATIVE_SERIAL_PACED") != NULL && baud > 0) {
+    serialByteUs = 10e6 / baud;  // start, 8 data and stop bit
+  }
+}
+
+void HardwareSerial::end() {
+  if (uart_ != 0) {
+    nativeModemEnd();
+  }
+}
+
+void HardwareSerial::flush() {
+  if (uart_ != 0) {
+    return;
+  }
+  fflush(stdout);
+  if (serialByteUs != 0) {
+    std::unique_lock<std::mutex> lock(serialMutex);
+    auto drained = serialDrainedAt;
+    lock.unlock();
+    std::this_thread::sleep_until(drained);
+  }
+}
+
+int HardwareSerial::availableForWrite() {
+  return 128;
+}
+
+// Nothing is typed into stdout's UART
+int HardwareSerial::available() {
+  return uart_ != 0 ? nativeModemAvailable() : 0;
+}
+
+int HardwareSerial::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+size_t HardwareSerial::read(uint8_t* buf, size_t len) {
+  return uart_ != 0 ? nativeModemRead(buf, len) : 0;
+}
+
+int HardwareSerial::peek() {
+  return uart_ != 0 ? nativeModemPeek() : -1;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t len) {
+  if (uart_ != 0) {
+    return nativeModemWrite(buf, len);
+  }
+  paceSerial(len);
+  return fwrite(buf, 1, len, stdout);
+}
+
+uint64_t EspClass::getEfuseMac() { return 0x563412CDAB02ULL; }
+
+void EspClass::restart() {
+  Serial.println("Restarting...");
+  nativeRestart();
+}
+
+int main(int argc, char** argv) {
+  savedArgv = argv;
+  setup();
+  for (;;) {
+    loop();
+    // Yield between iterations so an idle portal does not spin a host core
+    delay(1);
+  }
+}
@@ -0,0 +1,245 @@
+#include <FS.h>
+#include <SPIFFS.h>
+#include <LittleFS.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "native.h"
+
+fs::SPIFFSFS SPIFFS;
+fs::LittleFSFS LittleFS;
+
+namespace fs {
+
+class FileImpl {
+ public:
+  ~FileImpl() { close(); }
+
+  void close() {
+    if (file != NULL) {
+      fclose(file);
+      file = NULL;
+    }
+    if (dir != NULL) {
+      closedir(dir);
+      dir = NULL;
+    }
+  }
+
+  FILE* file = NULL;
+  DIR* dir = NULL;
+  std::string hostPath;
+  std::string path;
+  std::string name;
+  const FS* fs = NULL;
+};
+
+size_t File::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t File::write(const uint8_t* buf, size_t len) {
+  return impl_ && impl_->file ? fwrite(buf, 1, len, impl_->file) : 0;
+}
+
+int File::available() {
+  return impl_ && impl_->file ? (int)(size() - position()) : 0;
+}
+
+int File::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int File::peek() {
+  if (!impl_ || !impl_->file) {
+    return -1;
+  }
+  int c = fgetc(impl_->file);
+  if (c != EOF) {
+    ungetc(c, impl_->file);
+  }
+  return c == EOF ? -1 : c;
+}
+
+void File::flush() {
+  if (impl_ && impl_->file) {
+    fflush(impl_->file);
+  }
+}
+
+size_t File::read(uint8_t* buf, size_t len) {
+  return impl_ && impl_->file ? fread(buf, 1, len, impl_->file) : 0;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  static const int whence[] = {SEEK_SET, SEEK_CUR, SEEK_END};
+  return impl_ && impl_->file && fseek(impl_->file, pos, whence[mode]) == 0;
+}
+
+size_t File::position() const {
+  return impl_ && impl_->file ? ftell(impl_->file) : 0;
+}
+
+size_t File::size() const {
+  if (!impl_ || !impl_->file) {
+    return 0;
+  }
+  fflush(impl_->file);
+  struct stat st;
+  return fstat(fileno(impl_->file), &st) == 0 ? st.st_size : 0;
+}
+
+void File::close() {
+  if (impl_) {
+    impl_->close();
+  }
+  impl_.reset();
+}
+
+const char* File::name() const {
+  return impl_ ? impl_->name.c_str() : "";
+}
+
+const char* File::path() const {
+  return impl_ ? impl_->path.c_str() : "";
+}
+
+bool File::isDirectory() const {
+  return impl_ && impl_->dir != NULL;
+}
+
+File File::openNextFile() {
+  if (!impl_ || impl_->dir == NULL) {
+    return File();
+  }
+  struct dirent* entry;
+  while ((entry = readdir(impl_->dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+      std::string path = impl_->path == "/" ? "/" : impl_->path + "/";
+      return const_cast<FS*>(impl_->fs)->open((path + entry->d_name).c_str());
+    }
+  }
+  return File();
+}
+
+File::operator bool() const {
+  return impl_ && (impl_->file != NULL || impl_->dir != NULL);
+}
+
+std::string FS::hostPath(const char* path) const {
+  return nativeDataPath(root_.c_str()) + (path[0] == '/' ? "" : "/") + path;
+}
+
+// SPIFFS and LittleFS share the "spiffs" partition. A marker file records
+// which of them formatted it, so mounting the other one fails as on a device.
+static std::string partitionOwner() {
+  FILE* marker = fopen(nativeDataPath("partition").c_str(), "r");
+  if (marker != NULL) {
+    char owner[16];
+    if (fgets(owner, sizeof(owner), marker) == NULL) {
+      owner[0] = 0;
+    }
+    fclose(marker);
+    return owner;
+  }
+  // Data directories from before the marker
+  struct stat st;
+  return stat(nativeDataPath("spiffs").c_str(), &st) == 0 ? "spiffs" : "";
+}
+
+bool FS::mount(bool formatOnFail) {
+  if (partitionOwner() != root_) {
+    return formatOnFail && formatPartition();
+  }
+  std::string dir = nativeDataPath(root_.c_str());
+  mounted_ = ::mkdir(dir.c_str(), 0755) == 0 || errno == EEXIST;
+  return mounted_;
+}
+
+bool FS::formatPartition() {
+  mounted_ = false;
+  std::string command = "rm -rf '" + nativeDataPath("spiffs") + "' '" + nativeDataPath("littlefs") + "'";
+  if (system(command.c_str()) != 0) {
+    return false;
+  }
+  FILE* marker = fopen(nativeDataPath("partition").c_str(), "w");
+  if (marker == NULL) {
+    return false;
+  }
+  fputs(root_.c_str(), marker);
+  fclose(marker);
+  return mount(false);
+}
+
+size_t FS::usedSize() {
+  std::string command = "du -sb '" + nativeDataPath(root_.c_str()) + "' 2>/dev/null";
+  FILE* du = popen(command.c_str(), "r");
+  unsigned long used = 0;
+  if (du != NULL) {
+    if (fscanf(du, "%lu", &used) != 1) {
+      used = 0;
+    }
+    pclose(du);
+  }
+  return used;
+}
+
+File FS::open(const char* path, const char* mode, bool create) {
+  if (!mounted_) {
+    return File();
+  }
+  auto impl = std::make_shared<FileImpl>();
+  impl->hostPath = hostPath(path);
+  impl->path = path;
+  const char* slash = strrchr(path, '/');
+  impl->name = slash != NULL ? slash + 1 : path;
+  impl->fs = this;
+
+  struct stat st;
+  if (stat(impl->hostPath.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+    impl->dir = opendir(impl->hostPath.c_str());
+  } else {
+    // "r" opens read-only; "w" and "a" truncate and append as on SPIFFS
+    impl->file = fopen(impl->hostPath.c_str(), strcmp(mode, FILE_READ) == 0 ? "rb" : mode[0] == 'a' ? "ab" : "w+b");
+  }
+  if (impl->file == NULL && impl->dir == NULL) {
+    return File();
+  }
+  return File(impl);
+}
+
+bool FS::exists(const char* path) {
+  struct stat st;
+  return mounted_ && stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char* path) {
+  return mounted_ && ::unlink(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char* from, const char* to) {
+  return mounted_ && ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool FS::mkdir(const char* path) {
+  return mounted_ && (::mkdir(hostPath(path).c_str(), 0755) == 0 || errno == EEXIST);
+}
+
+bool FS::rmdir(const char* path) {
+  return mounted_ && ::rmdir(hostPath(path).c_str()) == 0;
+}
+
+bool SPIFFSFS::format() {
+  return formatPartition();
+}
+
+bool LittleFSFS::format() {
+  return formatPartition();
+}
+
+}  // namespace fs
@@ -0,0 +1,208 @@
+#include <HTTPClient.h>
+
+bool HTTPClient::begin(WiFiClient& client, const String& url) {
+  end();
+  int schemeEnd = url.indexOf("://");
+  if (schemeEnd < 0) {
+    return false;
+  }
+  String scheme = url.substring(0, schemeEnd);
+  String rest = url.substring(schemeEnd + 3);
+  int slash = rest.indexOf('/');
+  String authority = slash < 0 ? rest : rest.substring(0, slash);
+  path_ = slash < 0 ? String("/") : rest.substring(slash);
+  int colon = authority.indexOf(':');
+  host_ = colon < 0 ? authority : authority.substring(0, colon);
+  port_ = colon < 0 ? (scheme == "https" ? 443 : 80) : authority.substring(colon + 1).toInt();
+  client_ = &client;
+  requestHeaders_ = "";
+  headers_.clear();
+  size_ = -1;
+  return host_.length() > 0;
+}
+
+void HTTPClient::end() {
+  if (client_ != NULL) {
+    client_->stop();
+    client_ = NULL;
+  }
+}
+
+void HTTPClient::addHeader(const String& name, const String& value) {
+  requestHeaders_ += name + ": " + value + "\r\n";
+}
+
+// Every response header is kept, so collecting is a no-op here
+void HTTPClient::collectHeaders(const char* headerKeys[], const size_t count) {}
+
+String HTTPClient::header(const char* name) {
+  for (const Header& header : headers_) {
+    if (header.name.equalsIgnoreCase(name)) {
+      return header.value;
+    }
+  }
+  return String();
+}
+
+bool HTTPClient::hasHeader(const char* name) {
+  for (const Header& header : headers_) {
+    if (header.name.equalsIgnoreCase(name)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool HTTPClient::readLine(String& line) {
+  line = "";
+  uint32_t start = millis();
+  while (millis() - start < timeout_) {
+    if (client_->available() <= 0) {
+      if (!client_->connected()) {
+        return false;
+      }
+      delay(1);
+      continue;
+    }
+    int c = client_->read();
+    if (c == '\n') {
+      if (line.endsWith("\r")) {
+        line = line.substring(0, line.length() - 1);
+      }
+      return true;
+    }
+    if (c >= 0) {
+      line += (char)c;
+    }
+  }
+  return false;
+}
+
+int HTTPClient::GET() {
+  if (client_ == NULL) {
+    return HTTPC_ERROR_NOT_CONNECTED;
+  }
+  if (!client_->connect(host_.c_str(), port_, connectTimeout_)) {
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+  String request = "GET " + path_ + " HTTP/1.1\r\nHost: " + host_ +
+                   "\r\nUser-Agent: ESP32HTTPClient\r\nConnection: close\r\n" + requestHeaders_ + "\r\n";
+  if (client_->write((const uint8_t*)request.c_str(), request.length()) != request.length()) {
+    return HTTPC_ERROR_SEND_HEADER_FAILED;
+  }
+
+  String line;
+  if (!readLine(line)) {
+    return HTTPC_ERROR_READ_TIMEOUT;
+  }
+  int sp = line.indexOf(' ');
+  int code = sp < 0 ? 0 : line.substring(sp + 1).toInt();
+  if (code <= 0) {
+    return HTTPC_ERROR_CONNECTION_LOST;
+  }
+  headers_.clear();
+  while (readLine(line) && line.length() > 0) {
+    int colon = line.indexOf(':');
+    if (colon < 0) {
+      continue;
+    }
+    String value = line.substring(colon + 1);
+    value.trim();
+    headers_.push_back({line.substring(0, colon), value});
+  }
+  size_ = hasHeader("Content-Length") ? header("Content-Length").toInt() : -1;
+  return code;
+}
+
+String HTTPClient::getString() {
+  String body;
+  uint8_t buf[512];
+  uint32_t lastData = millis();
+  while (connected() && (size_ < 0 || (int)body.length() < size_) && millis() - lastData < timeout_) {
+    int n = client_->available() > 0 ? client_->read(buf, sizeof(buf)) : 0;
+    if (n > 0) {
+      body.concat((const char*)buf, n);
+      lastData = millis();
+    } else {
+      delay(1);
+    }
+  }
+  return body;
+}
+
+// Copies len bytes, or up to the end of the connection when len < 0
+int HTTPClient::copyBody(Stream* stream, int len) {
+  uint8_t buf[512];
+  int copied = 0;
+  uint32_t lastData = millis();
+  while (len < 0 || copied < len) {
+    size_t want = len < 0 || len - copied > (int)sizeof(buf) ? sizeof(buf) : len - copied;
+    int n = client_->available() > 0 ? client_->read(buf, want) : 0;
+    if (n > 0) {
+      if (stream->write(buf, n) != (size_t)n) {
+        return HTTPC_ERROR_STREAM_WRITE;
+      }
+      copied += n;
+      lastData = millis();
+    } else if (!client_->connected()) {
+      return len < 0 ? copied : HTTPC_ERROR_CONNECTION_LOST;
+    } else if (millis() - lastData >= timeout_) {
+      return HTTPC_ERROR_READ_TIMEOUT;
+    } else {
+      delay(1);
+    }
+  }
+  return copied;
+}
+
+int HTTPClient::writeToStream(Stream* stream) {
+  if (stream == NULL) {
+    return HTTPC_ERROR_NO_STREAM;
+  }
+  if (!connected() && client_->available() <= 0) {
+    return HTTPC_ERROR_NOT_CONNECTED;
+  }
+  if (!header("Transfer-Encoding").equalsIgnoreCase("chunked")) {
+    return copyBody(stream, size_);
+  }
+  int total = 0;
+  String line;
+  for (;;) {
+    // Chunk size in hex, possibly followed by ";extension"
+    if (!readLine(line)) {
+      return HTTPC_ERROR_READ_TIMEOUT;
+    }
+    if (line.length() == 0 || !isxdigit((unsigned char)line[0])) {
+      return HTTPC_ERROR_ENCODING;
+    }
+    int len = (int)strtol(line.c_str(), NULL, 16);
+    if (len == 0) {
+      // Trailer fields up to the blank line
+      while (readLine(line) && line.length() > 0) {
+      }
+      return total;
+    }
+    int n = copyBody(stream, len);
+    if (n < 0) {
+      return n;
+    }
+    total += n;
+    if (!readLine(line) || line.length() != 0) {
+      return HTTPC_ERROR_ENCODING;
+    }
+  }
+}
+
+String HTTPClient::errorToString(int error) {
+  switch (error) {
+    case HTTPC_ERROR_CONNECTION_REFUSED: return "connection refused";
+    case HTTPC_ERROR_SEND_HEADER_FAILED: return "send header failed";
+    case HTTPC_ERROR_NOT_CONNECTED: return "not connected";
+    case HTTPC_ERROR_CONNECTION_LOST: return "connection lost";
+    case HTTPC_ERROR_NO_STREAM: return "no stream";
+    case HTTPC_ERROR_ENCODING: return "Transfer-Encoding not supported";
+    case HTTPC_ERROR_STREAM_WRITE: return "Stream write error";
+    case HTTPC_ERROR_READ_TIMEOUT: return "read Timeout";
+    default: return String();
+  }
+}
@@ -0,0 +1,289 @@
+#include <Preferences.h>
+#include <nvs_flash.h>
+
+#include <map>
+#include <vector>
+#include <mutex>
+#include <stdio.h>
+
+#include "native.h"
+
+typedef std::map<std::string, std::string> Namespace;
+
+static std::mutex storeLock;
+static std::map<std::string, Namespace> store;
+static bool storeLoaded = false;
+
+static void loadStore() {
+  if (storeLoaded) {
+    return;
+  }
+  storeLoaded = true;
+  FILE* file = fopen(nativeDataPath("nvs.txt").c_str(), "r");
+  if (file == NULL) {
+    return;
+  }
+  // One "namespace key hex-value" line per entry
+  char ns[32], key[32], hex[8192];
+  while (fscanf(file, "%31s %31s %8191s", ns, key, hex) == 3) {
+    std::string value;
+    for (size_t i = 1; hex[i] != 0 && hex[i + 1] != 0; i += 2) {
+      unsigned int byte;
+      sscanf(hex + i, "%2x", &byte);
+      value += (char)byte;
+    }
+    store[ns][key] = value;
+  }
+  fclose(file);
+}
+
+static void saveStore() {
+  std::string path = nativeDataPath("nvs.txt");
+  FILE* file = fopen((path + ".tmp").c_str(), "w");
+  if (file == NULL) {
+    return;
+  }
+  for (const auto& ns : store) {
+    for (const auto& entry : ns.second) {
+      // The "x" prefix keeps empty values parseable
+      fprintf(file, "%s %s x", ns.first.c_str(), entry.first.c_str());
+      for (unsigned char c : entry.second) {
+        fprintf(file, "%02x", c);
+      }
+      fputc('\n', file);
+    }
+  }
+  fclose(file);
+  rename((path + ".tmp").c_str(), path.c_str());
+}
+
+esp_err_t nvs_flash_init() {
+  std::lock_guard<std::mutex> guard(storeLock);
+  loadStore();
+  return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase() {
+  std::lock_guard<std::mutex> guard(storeLock);
+  storeLoaded = true;
+  store.clear();
+  saveStore();
+  return ESP_OK;
+}
+
+// Raw NVS handles: index + 1 into a table of open namespaces
+struct NvsHandle {
+  std::string ns;
+  bool readOnly;
+  bool open;
+};
+
+static std::vector<NvsHandle> handles;
+
+static NvsHandle* findHandle(nvs_handle_t handle) {
+  return handle > 0 && handle <= handles.size() && handles[handle - 1].open ? &handles[handle - 1] : NULL;
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t mode, nvs_handle_t* handle) {
+  std::lock_guard<std::mutex> guard(storeLock);
+  loadStore();
+  if (strlen(name) > 15) {
+    return ESP_ERR_NVS_KEY_TOO_LONG;
+  }
+  if (mode == NVS_READONLY && store.find(name) == store.end()) {
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+  store[name];
+  handles.push_back({name, mode == NVS_READONLY, true});
+  *handle = handles.size();
+  return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+  std::lock_guard<std::mutex> guard(storeLock);
+  NvsHandle* h = findHandle(handle);
+  if (h != NULL) {
+    h->open = false;
+  }
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+  std::lock_guard<std::mutex> guard(storeLock);
+  if (findHandle(handle) == NULL) {
+    return ESP_ERR_NVS_INVALID_HANDLE;
+  }
+  saveStore();
+  return ESP_OK;
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value) {
+  std::lock_guard<std::mutex> guard(storeLock);
+  NvsHandle* h = findHandle(handle);
+  if (h == NULL) {
+    return ESP_ERR_NVS_INVALID_HANDLE;
+  }
+  if (h->readOnly) {
+    return ESP_ERR_NVS_READ_ONLY;
+  }
+  if (strlen(key) > 15) {
+    return ESP_ERR_NVS_KEY_TOO_LONG;
+  }
+  store[h->ns][key] = value;
+  return ESP_OK;
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char* key, char* out, size_t* length) {
+  std::lock_guard<std::mutex> guard(storeLock);
+  NvsHandle* h = findHandle(handle);
+  if (h == NULL) {
+    return ESP_ERR_NVS_INVALID_HANDLE;
+  }
+  Namespace& ns = store[h->ns];
+  auto it = ns.find(key);
+  if (it == ns.end()) {
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+  size_t needed = it->second.size() + 1;
+  if (out == NULL) {
+    *length = needed;
+    return ESP_OK;
+  }
+  if (*length < needed) {
+    return ESP_ERR_NVS_INVALID_LENGTH;
+  }
+  memcpy(out, it->second.c_str(), needed);
+  *length = needed;
+  return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key) {
+  std::lock_guard<std::mutex> guard(storeLock);
+  NvsHandle* h = findHandle(handle);
+  if (h == NULL) {
+    return ESP_ERR_NVS_INVALID_HANDLE;
+  }
+  if (h->readOnly) {
+    return ESP_ERR_NVS_READ_ONLY;
+  }
+  return store[h->ns].erase(key) > 0 ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+bool Preferences::begin(const char* name, bool readOnly, const char* partitionLabel) {
+  if (open_ || name == NULL || strlen(name) > 15) {
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(storeLock);
+  loadStore();
+  if (readOnly && store.find(name) == store.end()) {
+    // NVS refuses to open a namespace read-only before it exists
+    return false;
+  }
+  name_ = name;
+  readOnly_ = readOnly;
+  open_ = true;
+  return true;
+}
+
+void Preferences::end() {
+  if (!open_) {
+    return;
+  }
+  open_ = false;
+  if (!readOnly_) {
+    std::lock_guard<std::mutex> guard(storeLock);
+    saveStore();
+  }
+}
+
+bool Preferences::clear() {
+  if (!open_ || readOnly_) {
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(storeLock);
+  store[name_.str()].clear();
+  return true;
+}
+
+bool Preferences::remove(const char* key) {
+  if (!open_ || readOnly_) {
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(storeLock);
+  return store[name_.str()].erase(key) > 0;
+}
+
+bool Preferences::isKey(const char* key) {
+  if (!open_) {
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(storeLock);
+  Namespace& ns = store[name_.str()];
+  return ns.find(key) != ns.end();
+}
+
+size_t Preferences::putValue(const char* key, const void* value, size_t len) {
+  if (!open_ || readOnly_ || key == NULL || strlen(key) > 15) {
+    return 0;
+  }
+  std::lock_guard<std::mutex> guard(storeLock);
+  store[name_.str()][key] = std::string((const char*)value, len);
+  return len;
+}
+
+bool Preferences::readValue(const char* key, void* value, size_t len) {
+  if (!open_) {
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(storeLock);
+  Namespace& ns = store[name_.str()];
+  auto it = ns.find(key);
+  if (it == ns.end() || it->second.size() != len) {
+    return false;
+  }
+  memcpy(value, it->second.data(), len);
+  return true;
+}
+
+String Preferences::getString(const char* key, const String& defaultValue) {
+  size_t len = getBytesLength(key);
+  if (!isKey(key)) {
+    return defaultValue;
+  }
+  std::string value(len, 0);
+  getBytes(key, &value[0], len);
+  return String(value);
+}
+
+size_t Preferences::getString(const char* key, char* value, size_t maxLen) {
+  size_t len = getBytesLength(key);
+  if (!isKey(key) || len + 1 > maxLen) {
+    return 0;
+  }
+  getBytes(key, value, len);
+  value[len] = 0;
+  return len + 1;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+  if (!open_) {
+    return 0;
+  }
+  std::lock_guard<std::mutex> guard(storeLock);
+  Namespace& ns = store[name_.str()];
+  auto it = ns.find(key);
+  return it == ns.end() ? 0 : it->second.size();
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+  if (!open_) {
+    return 0;
+  }
+  std::lock_guard<std::mutex> guard(storeLock);
+  Namespace& ns = store[name_.str()];
+  auto it = ns.find(key);
+  if (it == ns.end() || it->second.size() > maxLen) {
+    return 0;
+  }
+  memcpy(buf, it->second.data(), it->second.size());
+  return it->second.size();
+}
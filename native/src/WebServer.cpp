@@ -0,0 +1,449 @@
+#include <WebServer.h>
+#include <lwip/sockets.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define HTTP_MAX_BODY (4 * 1024 * 1024)
+#define HTTP_READ_TIMEOUT_MS 5000
+
+static const char* reasonPhrase(int code) {
+  switch (code) {
+    case 200: return "OK";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 409: return "Conflict";
+    case 413: return "Payload Too Large";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    default: return "";
+  }
+}
+
+static HTTPMethod parseMethod(const String& method) {
+  if (method == "GET") return HTTP_GET;
+  if (method == "HEAD") return HTTP_HEAD;
+  if (method == "POST") return HTTP_POST;
+  if (method == "PUT") return HTTP_PUT;
+  if (method == "PATCH") return HTTP_PATCH;
+  if (method == "DELETE") return HTTP_DELETE;
+  if (method == "OPTIONS") return HTTP_OPTIONS;
+  return HTTP_ANY;
+}
+
+static String urlDecode(const String& text) {
+  std::string out;
+  const std::string& in = text.str();
+  for (size_t i = 0; i < in.size(); i++) {
+    if (in[i] == '+') {
+      out += ' ';
+    } else if (in[i] == '%' && i + 2 < in.size()) {
+      out += (char)strtol(in.substr(i + 1, 2).c_str(), NULL, 16);
+      i += 2;
+    } else {
+      out += in[i];
+    }
+  }
+  return String(out);
+}
+
+// Value of a parameter such as name="x" in a header value
+static String headerParam(const String& value, const char* param) {
+  String key = String(param) + "=";
+  int pos = value.indexOf(key.c_str());
+  if (pos < 0) {
+    return String();
+  }
+  pos += key.length();
+  if (value[pos] == '"') {
+    int end = value.indexOf('"', pos + 1);
+    return value.substring(pos + 1, end < 0 ? value.length() : end);
+  }
+  int end = value.indexOf(';', pos);
+  String result = value.substring(pos, end < 0 ? value.length() : end);
+  result.trim();
+  return result;
+}
+
+uint16_t nativeListenPort(uint16_t port) {
+  const char* env = getenv("NATIVE_HTTP_PORT");
+  if (env != NULL && atoi(env) > 0) {
+    return atoi(env);
+  }
+  return port == 80 ? 8080 : port;
+}
+
+WebServer::WebServer(int port)
+  : port_(nativeListenPort(port)), listenFd_(-1), method_(HTTP_ANY),
+    contentLength_(CONTENT_LENGTH_NOT_SET), chunked_(false), route_(NULL) {}
+
+WebServer::~WebServer() {
+  close();
+}
+
+void WebServer::begin() {
+  listenFd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  int on = 1;
+  setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port_);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(listenFd_, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd_, 4) != 0) {
+    printf("[native] WebServer: cannot listen on port %d: %s\n", port_, strerror(errno));
+    close();
+    return;
+  }
+  fcntl(listenFd_, F_SETFL, fcntl(listenFd_, F_GETFL) | O_NONBLOCK);
+  printf("[native] WebServer: listening on http://127.0.0.1:%d/\n", port_);
+}
+
+void WebServer::close() {
+  if (listenFd_ >= 0) {
+    ::close(listenFd_);
+    listenFd_ = -1;
+  }
+}
+
+void WebServer::on(const String& uri, THandlerFunction handler) {
+  on(uri, HTTP_ANY, handler);
+}
+
+void WebServer::on(const String& uri, HTTPMethod method, THandlerFunction handler) {
+  on(uri, method, handler, NULL);
+}
+
+void WebServer::on(const String& uri, HTTPMethod method, THandlerFunction handler, THandlerFunction upload) {
+  routes_.push_back({uri, method, handler, upload});
+}
+
+void WebServer::onNotFound(THandlerFunction handler) {
+  notFound_ = handler;
+}
+
+void WebServer::handleClient() {
+  if (listenFd_ < 0) {
+    return;
+  }
+  int fd = accept4(listenFd_, NULL, NULL, SOCK_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  client_ = WiFiClient(fd);
+  client_.setTimeout(HTTP_READ_TIMEOUT_MS / 1000);
+  args_.clear();
+  headers_.clear();
+  responseHeaders_ = "";
+  contentLength_ = CONTENT_LENGTH_NOT_SET;
+  chunked_ = false;
+  route_ = NULL;
+
+  if (readRequest()) {
+    if (route_ != NULL) {
+      route_->handler();
+    } else if (notFound_) {
+      notFound_();
+    } else {
+      send(404, "text/plain", String("Not found: ") + uri_);
+    }
+  } else {
+    send(400, "text/plain", "Bad request");
+  }
+  client_.stop();
+}
+
+bool WebServer::readLine(String& line) {
+  line = client_.readStringUntil('\n');
+  if (line.endsWith("\r")) {
+    line = line.substring(0, line.length() - 1);
+  }
+  return true;
+}
+
+bool WebServer::readRequest() {
+  String line;
+  readLine(line);
+  int sp1 = line.indexOf(' ');
+  int sp2 = line.indexOf(' ', sp1 + 1);
+  if (sp1 < 0 || sp2 < 0) {
+    return false;
+  }
+  method_ = parseMethod(line.substring(0, sp1));
+  String target = line.substring(sp1 + 1, sp2);
+  int query = target.indexOf('?');
+  uri_ = query < 0 ? target : target.substring(0, query);
+  if (query >= 0) {
+    parseQuery(target.substring(query + 1));
+  }
+
+  size_t length = 0;
+  String contentType;
+  for (;;) {
+    readLine(line);
+    if (line.length() == 0) {
+      break;
+    }
+    int colon = line.indexOf(':');
+    if (colon < 0) {
+      continue;
+    }
+    String name = line.substring(0, colon);
+    String value = line.substring(colon + 1);
+    value.trim();
+    headers_.push_back({name, value});
+    if (name.equalsIgnoreCase("Content-Length")) {
+      length = value.toInt();
+    } else if (name.equalsIgnoreCase("Content-Type")) {
+      contentType = value;
+    }
+  }
+  if (length > HTTP_MAX_BODY) {
+    return false;
+  }
+
+  for (const Route& route : routes_) {
+    if (route.uri == uri_ && (route.method == HTTP_ANY || route.method == method_)) {
+      route_ = &route;
+      break;
+    }
+  }
+
+  if (contentType.startsWith("multipart/form-data")) {
+    return parseMultipart(headerParam(contentType, "boundary"), length);
+  }
+  std::string body(length, 0);
+  if (length > 0 && client_.readBytes((uint8_t*)&body[0], length) != length) {
+    return false;
+  }
+  if (contentType.startsWith("application/x-www-form-urlencoded")) {
+    parseQuery(String(body));
+  } else if (length > 0) {
+    args_.push_back({"plain", String(body)});
+  }
+  return true;
+}
+
+void WebServer::parseQuery(const String& query) {
+  int start = 0;
+  while (start < (int)query.length()) {
+    int end = query.indexOf('&', start);
+    if (end < 0) {
+      end = query.length();
+    }
+    String pair = query.substring(start, end);
+    int eq = pair.indexOf('=');
+    if (pair.length() > 0) {
+      args_.push_back({urlDecode(eq < 0 ? pair : pair.substring(0, eq)),
+                       eq < 0 ? String() : urlDecode(pair.substring(eq + 1))});
+    }
+    start = end + 1;
+  }
+}
+
+// Reads the whole body, then replays file parts to the route's upload
+// handler in HTTP_UPLOAD_BUFLEN pieces as the device server would
+bool WebServer::parseMultipart(const String& boundary, size_t length) {
+  std::string body(length, 0);
+  if (boundary.length() == 0 || client_.readBytes((uint8_t*)&body[0], length) != length) {
+    return false;
+  }
+  std::string delimiter = "--" + boundary.str();
+  size_t pos = body.find(delimiter);
+  while (pos != std::string::npos) {
+    pos += delimiter.size();
+    if (body.compare(pos, 2, "--") == 0) {
+      break;
+    }
+    size_t headersEnd = body.find("\r\n\r\n", pos);
+    if (headersEnd == std::string::npos) {
+      return false;
+    }
+    String partHeaders(body.substr(pos, headersEnd - pos));
+    size_t dataStart = headersEnd + 4;
+    size_t dataEnd = body.find("\r\n" + delimiter, dataStart);
+    if (dataEnd == std::string::npos) {
+      return false;
+    }
+
+    String disposition, type;
+    int lineStart = 0;
+    while (lineStart < (int)partHeaders.length()) {
+      int lineEnd = partHeaders.indexOf("\r\n", lineStart);
+      if (lineEnd < 0) {
+        lineEnd = partHeaders.length();
+      }
+      String headerLine = partHeaders.substring(lineStart, lineEnd);
+      if (headerLine.startsWith("Content-Disposition:") || headerLine.startsWith("content-disposition:")) {
+        disposition = headerLine;
+      } else if (headerLine.startsWith("Content-Type:") || headerLine.startsWith("content-type:")) {
+        type = headerLine.substring(13);
+        type.trim();
+      }
+      lineStart = lineEnd + 2;
+    }
+    String name = headerParam(disposition, "name");
+    bool isFile = disposition.indexOf("filename=") >= 0;
+
+    if (!isFile) {
+      args_.push_back({name, String(body.substr(dataStart, dataEnd - dataStart))});
+    } else if (route_ != NULL && route_->upload) {
+      upload_.filename = headerParam(disposition, "filename");
+      upload_.name = name;
+      upload_.type = type;
+      upload_.totalSize = 0;
+      upload_.currentSize = 0;
+      upload_.status = UPLOAD_FILE_START;
+      route_->upload();
+      upload_.status = UPLOAD_FILE_WRITE;
+      for (size_t at = dataStart; at < dataEnd; at += HTTP_UPLOAD_BUFLEN) {
+        size_t n = dataEnd - at < HTTP_UPLOAD_BUFLEN ? dataEnd - at : HTTP_UPLOAD_BUFLEN;
+        memcpy(upload_.buf, body.data() + at, n);
+        upload_.currentSize = n;
+        route_->upload();
+        upload_.totalSize += n;
+      }
+      upload_.status = UPLOAD_FILE_END;
+      route_->upload();
+    }
+    pos = body.find(delimiter, dataEnd);
+  }
+  return true;
+}
+
+String WebServer::arg(const String& name) const {
+  for (const Pair& pair : args_) {
+    if (pair.name == name) {
+      return pair.value;
+    }
+  }
+  return String();
+}
+
+String WebServer::arg(int i) const {
+  return i >= 0 && i < (int)args_.size() ? args_[i].value : String();
+}
+
+String WebServer::argName(int i) const {
+  return i >= 0 && i < (int)args_.size() ? args_[i].name : String();
+}
+
+bool WebServer::hasArg(const String& name) const {
+  for (const Pair& pair : args_) {
+    if (pair.name == name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Every request header is kept, so collecting is a no-op here
+void WebServer::collectHeaders(const char* headerKeys[], const size_t count) {}
+
+String WebServer::header(const String& name) const {
+  for (const Pair& pair : headers_) {
+    if (pair.name.equalsIgnoreCase(name)) {
+      return pair.value;
+    }
+  }
+  return String();
+}
+
+bool WebServer::hasHeader(const String& name) const {
+  for (const Pair& pair : headers_) {
+    if (pair.name.equalsIgnoreCase(name)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void WebServer::sendHeader(const String& name, const String& value, bool first) {
+  String line = name + ": " + value + "\r\n";
+  responseHeaders_ = first ? line + responseHeaders_ : responseHeaders_ + line;
+}
+
+void WebServer::writeRaw(const char* data, size_t len) {
+  client_.write((const uint8_t*)data, len);
+}
+
+void WebServer::sendStatus(int code, const char* contentType, size_t length) {
+  char line[64];
+  snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\n", code, reasonPhrase(code));
+  String head = line;
+  head += String("Content-Type: ") + (contentType != NULL ? contentType : "text/html") + "\r\n";
+  if (contentLength_ == CONTENT_LENGTH_UNKNOWN) {
+    head += "Transfer-Encoding: chunked\r\n";
+    chunked_ = true;
+  } else {
+    head += "Content-Length: " + String((unsigned long)(contentLength_ == CONTENT_LENGTH_NOT_SET ? length : contentLength_)) + "\r\n";
+  }
+  head += "Connection: close\r\n";
+  head += responseHeaders_;
+  head += "\r\n";
+  writeRaw(head.c_str(), head.length());
+  responseHeaders_ = "";
+  contentLength_ = CONTENT_LENGTH_NOT_SET;
+}
+
+void WebServer::send(int code, const char* contentType, const String& content) {
+  send_P(code, contentType, content.c_str(), content.length());
+}
+
+void WebServer::send(int code, const String& contentType, const String& content) {
+  send(code, contentType.c_str(), content);
+}
+
+void WebServer::send(int code, const char* contentType, const char* content) {
+  send_P(code, contentType, content, strlen(content));
+}
+
+void WebServer::send_P(int code, PGM_P contentType, PGM_P content) {
+  send_P(code, contentType, content, strlen(content));
+}
+
+void WebServer::send_P(int code, PGM_P contentType, PGM_P content, size_t len) {
+  sendStatus(code, contentType, len);
+  if (len > 0) {
+    sendContent(content, len);
+  }
+}
+
+void WebServer::sendContent(const String& content) {
+  sendContent(content.c_str(), content.length());
+}
+
+void WebServer::sendContent(const char* content, size_t len) {
+  if (!chunked_) {
+    writeRaw(content, len);
+    return;
+  }
+  char size[16];
+  int n = snprintf(size, sizeof(size), "%zx\r\n", len);
+  writeRaw(size, n);
+  writeRaw(content, len);
+  writeRaw("\r\n", 2);
+  if (len == 0) {
+    chunked_ = false;
+  }
+}
+
+void WebServer::sendContent_P(PGM_P content) {
+  sendContent(content, strlen(content));
+}
+
+void WebServer::sendContent_P(PGM_P content, size_t len) {
+  sendContent(content, len);
+}
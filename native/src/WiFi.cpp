@@ -0,0 +1,381 @@
+#include <WiFi.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "native.h"
+
+WiFiClass WiFi;
+
+static const uint8_t nativeMac[6] = {0x02, 0xAB, 0xCD, 0x12, 0x34, 0x56};
+static const uint8_t nativeBssid[6] = {0x02, 0x11, 0x22, 0x33, 0x44, 0x55};
+static const uint8_t nativeChannel = 6;
+
+// Rough figures for a real association
+#define NATIVE_SCAN_MS 1200
+#define NATIVE_DHCP_MS 300
+#define NATIVE_ASSOC_MS 80
+
+static std::vector<std::pair<WiFiEventFuncCb, arduino_event_id_t>> eventHandlers;
+static std::atomic<uint32_t> connectGeneration(0);
+
+static void dispatch(arduino_event_id_t event, const arduino_event_info_t& info) {
+  for (auto& handler : eventHandlers) {
+    if (handler.second == ARDUINO_EVENT_MAX || handler.second == event) {
+      handler.first(event, info);
+    }
+  }
+}
+
+wifi_event_id_t WiFiClass::onEvent(WiFiEventFuncCb cb, arduino_event_id_t event) {
+  eventHandlers.push_back(std::make_pair(cb, event));
+  return eventHandlers.size();
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* password, int32_t channel,
+                             const uint8_t* bssid, bool connect) {
+  ssid_ = ssid;
+  status_ = WL_IDLE_STATUS;
+  uint32_t generation = ++connectGeneration;
+  uint32_t delayMs = NATIVE_ASSOC_MS + (bssid != NULL && channel > 0 ? 0 : NATIVE_SCAN_MS) +
+                     (staticIp_ != 0 ? 0 : NATIVE_DHCP_MS);
+  uint32_t ip = staticIp_ != 0 ? staticIp_ : (uint32_t)IPAddress(127, 0, 0, 1);
+  // NATIVE_WIFI_FAIL makes that many connection attempts fail
+  static int failuresLeft = getenv("NATIVE_WIFI_FAIL") ? atoi(getenv("NATIVE_WIFI_FAIL")) : 0;
+  bool fail = failuresLeft > 0;
+  if (fail) {
+    failuresLeft--;
+  }
+  std::thread([this, generation, delayMs, ip, fail]() {
+    delay(delayMs);
+    if (connectGeneration != generation) {
+      return;
+    }
+    if (fail) {
+      status_ = WL_NO_SSID_AVAIL;
+      printf("[native] WiFi: \"%s\" not found\n", ssid_.c_str());
+      arduino_event_info_t info = {};
+      info.wifi_sta_disconnected.reason = 201;  // WIFI_REASON_NO_AP_FOUND
+      dispatch(ARDUINO_EVENT_WIFI_STA_DISCONNECTED, info);
+      return;
+    }
+    status_ = WL_CONNECTED;
+    printf("[native] WiFi: joined \"%s\" in %u ms\n", ssid_.c_str(), delayMs);
+    arduino_event_info_t info = {};
+    memcpy(info.wifi_sta_connected.bssid, nativeBssid, sizeof(nativeBssid));
+    info.wifi_sta_connected.channel = nativeChannel;
+    dispatch(ARDUINO_EVENT_WIFI_STA_CONNECTED, info);
+    info = {};
+    info.got_ip.ip_info.ip.addr = ip;
+    info.got_ip.ip_info.gw.addr = IPAddress(127, 0, 0, 1);
+    info.got_ip.ip_info.netmask.addr = IPAddress(255, 0, 0, 0);
+    dispatch(ARDUINO_EVENT_WIFI_STA_GOT_IP, info);
+  }).detach();
+  return status_;
+}
+
+bool WiFiClass::disconnect(bool wifiOff, bool eraseAp) {
+  connectGeneration++;
+  bool wasUp = status_ == WL_CONNECTED || status_ == WL_IDLE_STATUS;
+  status_ = WL_DISCONNECTED;
+  if (wifiOff) {
+    mode_ = WIFI_OFF;
+  }
+  if (wasUp) {
+    arduino_event_info_t info = {};
+    info.wifi_sta_disconnected.reason = 8;  // WIFI_REASON_ASSOC_LEAVE
+    dispatch(ARDUINO_EVENT_WIFI_STA_DISCONNECTED, info);
+  }
+  return true;
+}
+
+void nativeWifiDrop() {
+  connectGeneration++;
+  WiFi.status_ = WL_CONNECTION_LOST;
+  arduino_event_info_t info = {};
+  info.wifi_sta_disconnected.reason = 200;  // WIFI_REASON_BEACON_TIMEOUT
+  printf("[native] WiFi: link lost\n");
+  dispatch(ARDUINO_EVENT_WIFI_STA_DISCONNECTED, info);
+}
+
+bool WiFiClass::reconnect() {
+  if (ssid_.length() == 0) {
+    return false;
+  }
+  begin(ssid_.c_str());
+  return true;
+}
+
+bool WiFiClass::config(IPAddress localIp, IPAddress gateway, IPAddress subnet,
+                       IPAddress dns1, IPAddress dns2) {
+  staticIp_ = localIp;
+  return true;
+}
+
+uint8_t* WiFiClass::BSSID() {
+  return status_ == WL_CONNECTED ? (uint8_t*)nativeBssid : NULL;
+}
+
+int32_t WiFiClass::channel() {
+  return nativeChannel;
+}
+
+IPAddress WiFiClass::gatewayIP() {
+  return status_ == WL_CONNECTED ? IPAddress(127, 0, 0, 1) : IPAddress();
+}
+
+IPAddress WiFiClass::subnetMask() {
+  return status_ == WL_CONNECTED ? IPAddress(255, 0, 0, 0) : IPAddress();
+}
+
+IPAddress WiFiClass::dnsIP(uint8_t index) {
+  return status_ == WL_CONNECTED && index == 0 ? IPAddress(127, 0, 0, 1) : IPAddress();
+}
+
+wl_status_t WiFiClass::status() {
+  return status_;
+}
+
+bool WiFiClass::mode(wifi_mode_t mode) {
+  mode_ = mode;
+  return true;
+}
+
+wifi_mode_t WiFiClass::getMode() {
+  return mode_;
+}
+
+bool WiFiClass::softAP(const char* ssid, const char* password, int channel, int hidden, int maxConnection) {
+  if (password != NULL && password[0] != 0 && strlen(password) < 8) {
+    return false;
+  }
+  mode_ = (wifi_mode_t)(mode_ | WIFI_AP);
+  printf("[native] WiFi: soft AP \"%s\" on loopback\n", ssid);
+  return true;
+}
+
+// No stations on loopback unless NATIVE_AP_STATIONS says otherwise
+uint8_t WiFiClass::softAPgetStationNum() {
+  static int stations = getenv("NATIVE_AP_STATIONS") ? atoi(getenv("NATIVE_AP_STATIONS")) : 0;
+  return (mode_ & WIFI_AP) ? stations : 0;
+}
+
+IPAddress WiFiClass::softAPIP() {
+  return IPAddress(127, 0, 0, 1);
+}
+
+IPAddress WiFiClass::localIP() {
+  if (status_ != WL_CONNECTED) {
+    return IPAddress();
+  }
+  return staticIp_ != 0 ? IPAddress(staticIp_) : IPAddress(127, 0, 0, 1);
+}
+
+String WiFiClass::SSID() {
+  return status_ == WL_CONNECTED ? ssid_ : String();
+}
+
+int8_t WiFiClass::RSSI() {
+  return status_ == WL_CONNECTED ? -55 : 0;
+}
+
+uint8_t* WiFiClass::macAddress(uint8_t* mac) {
+  memcpy(mac, nativeMac, sizeof(nativeMac));
+  return mac;
+}
+
+String WiFiClass::macAddress() {
+  char buf[18];
+  snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", nativeMac[0], nativeMac[1],
+           nativeMac[2], nativeMac[3], nativeMac[4], nativeMac[5]);
+  return String(buf);
+}
+
+int WiFiClass::hostByName(const char* host, IPAddress& result) {
+  struct addrinfo hints = {}, *info;
+  hints.ai_family = AF_INET;
+  if (getaddrinfo(host, NULL, &hints, &info) != 0) {
+    return 0;
+  }
+  result = IPAddress(((struct sockaddr_in*)info->ai_addr)->sin_addr.s_addr);
+  freeaddrinfo(info);
+  return 1;
+}
+
+// WiFiClient
+
+// Outgoing sockets opened while PPP carries traffic pay the modem line's
+// latency, rate and loss (modem.cpp)
+class WiFiSocket {
+ public:
+  explicit WiFiSocket(int fd, bool shaped = false) : fd(fd), shaped(shaped), awaitingReply(false) {}
+  ~WiFiSocket() { close(fd); }
+  int fd;
+  bool shaped;
+  bool awaitingReply;   // a request went out; its reply costs a round trip
+};
+
+WiFiClient::WiFiClient(int fd) : socket_(std::make_shared<WiFiSocket>(fd)) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+  return connect(ip.toString().c_str(), port, 3000);
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port, int32_t timeout) {
+  return connect(ip.toString().c_str(), port, timeout);
+}
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+  return connect(host, port, 3000);
+}
+
+int WiFiClient::connect(const char* host, uint16_t port, int32_t timeout) {
+  stop();
+  IPAddress ip;
+  if (!WiFi.hostByName(host, ip)) {
+    return 0;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return 0;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = (uint32_t)ip;
+  int ret = ::connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+  if (ret < 0 && errno == EINPROGRESS) {
+    struct pollfd pfd = {fd, POLLOUT, 0};
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (poll(&pfd, 1, timeout) == 1 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) {
+      ret = 0;
+    }
+  }
+  if (ret < 0) {
+    close(fd);
+    return 0;
+  }
+  bool shaped = nativeLinkShaped();
+  if (shaped) {
+    nativeLinkRoundTrip();
+  }
+  socket_ = std::make_shared<WiFiSocket>(fd, shaped);
+  return 1;
+}
+
+size_t WiFiClient::write(uint8_t data) {
+  return write(&data, 1);
+}
+
+size_t WiFiClient::write(const uint8_t* buf, size_t size) {
+  if (!socket_) {
+    return 0;
+  }
+  size_t sent = 0;
+  uint32_t start = millis();
+  while (sent < size && millis() - start < 10000) {
+    ssize_t n = send(socket_->fd, buf + sent, size - sent, MSG_NOSIGNAL);
+    if (n > 0) {
+      sent += n;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      struct pollfd pfd = {socket_->fd, POLLOUT, 0};
+      poll(&pfd, 1, 100);
+    } else {
+      break;
+    }
+  }
+  if (socket_->shaped && sent > 0) {
+    nativeLinkTransfer(sent);
+    socket_->awaitingReply = true;
+  }
+  return sent;
+}
+
+int WiFiClient::available() {
+  if (!socket_) {
+    return 0;
+  }
+  int count = 0;
+  return ioctl(socket_->fd, FIONREAD, &count) == 0 ? count : 0;
+}
+
+int WiFiClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t* buf, size_t size) {
+  if (!socket_) {
+    return -1;
+  }
+  ssize_t n = recv(socket_->fd, buf, size, 0);
+  if (n > 0 && socket_->shaped) {
+    if (socket_->awaitingReply) {
+      socket_->awaitingReply = false;
+      nativeLinkRoundTrip();
+    }
+    nativeLinkTransfer(n);
+  }
+  return n > 0 ? (int)n : -1;
+}
+
+int WiFiClient::peek() {
+  uint8_t c;
+  return socket_ && recv(socket_->fd, &c, 1, MSG_PEEK) == 1 ? c : -1;
+}
+
+void WiFiClient::stop() {
+  socket_.reset();
+}
+
+uint8_t WiFiClient::connected() {
+  if (!socket_) {
+    return 0;
+  }
+  uint8_t c;
+  ssize_t n = recv(socket_->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    // Peer closed; keep the socket while unread data remains
+    return available() > 0;
+  }
+  return 1;
+}
+
+int WiFiClient::fd() const {
+  return socket_ ? socket_->fd : -1;
+}
+
+int WiFiClient::setNoDelay(bool nodelay) {
+  int flag = nodelay;
+  return socket_ ? setsockopt(socket_->fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag)) : -1;
+}
+
+int WiFiClient::setTimeout(uint32_t seconds) {
+  Stream::setTimeout(seconds * 1000);
+  return 0;
+}
+
+IPAddress WiFiClient::remoteIP() const {
+  struct sockaddr_in addr = {};
+  socklen_t len = sizeof(addr);
+  if (!socket_ || getpeername(socket_->fd, (struct sockaddr*)&addr, &len) != 0) {
+    return IPAddress();
+  }
+  return IPAddress(addr.sin_addr.s_addr);
+}
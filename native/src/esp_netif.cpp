@@ -0,0 +1,244 @@
+#include <Arduino.h>
+#include <esp_event.h>
+#include <esp_netif.h>
+#include <esp_netif_ppp.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "native.h"
+
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+ESP_EVENT_DEFINE_BASE(NETIF_PPP_STATUS);
+
+// Event loop
+
+struct Handler {
+  esp_event_base_t base;
+  int32_t id;
+  esp_event_handler_t handler;
+  void* arg;
+};
+
+static std::mutex handlersMutex;
+static std::vector<Handler> handlers;
+
+esp_err_t esp_event_loop_create_default() {
+  return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t base, int32_t id, esp_event_handler_t handler,
+                                     void* arg) {
+  std::lock_guard<std::mutex> lock(handlersMutex);
+  handlers.push_back({base, id, handler, arg});
+  return ESP_OK;
+}
+
+esp_err_t esp_event_post(esp_event_base_t base, int32_t id, const void* data, size_t size,
+                         uint32_t ticks) {
+  std::vector<Handler> matching;
+  {
+    std::lock_guard<std::mutex> lock(handlersMutex);
+    for (const Handler& h : handlers) {
+      if (h.base == base && (h.id == ESP_EVENT_ANY_ID || h.id == id)) {
+        matching.push_back(h);
+      }
+    }
+  }
+  for (const Handler& h : matching) {
+    h.handler(h.arg, base, id, (void*)data);
+  }
+  return ESP_OK;
+}
+
+// PPP interface: LCP and IPCP stand-ins. Each frame is sent to the modem
+// and has to come back intact before the next one goes; a frame lost on
+// the line is resent after the restart timer, and PPP gives up after as
+// many tries as lwIP's LCP does.
+
+#define PPP_FRAMES 4             // configure request and ack each way, IPCP
+#define PPP_FRAME_PAYLOAD 24
+#define PPP_RESTART_MS 3000
+#define PPP_MAX_TRIES 10
+#define PPP_FLAG 0x7E
+
+struct esp_netif_obj {
+  esp_netif_driver_ifconfig_t driver;
+  esp_netif_ppp_config_t ppp;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::vector<uint8_t> frame;     // bytes received since the last flag
+  int awaiting;                   // sequence number of the frame sent, -1 when none
+  bool answered;
+  std::atomic<bool> running;
+  std::thread negotiation;
+  bool up;
+};
+
+esp_err_t esp_netif_init() {
+  return ESP_OK;
+}
+
+esp_netif_t* esp_netif_new(const esp_netif_config_t* config) {
+  esp_netif_t* netif = new esp_netif_obj();
+  memset(&netif->driver, 0, sizeof(netif->driver));
+  netif->ppp.ppp_phase_event_enabled = false;
+  netif->ppp.ppp_error_event_enabled = false;
+  netif->awaiting = -1;
+  netif->answered = false;
+  netif->running = false;
+  netif->up = false;
+  return netif;
+}
+
+void esp_netif_destroy(esp_netif_t* netif) {
+  if (netif == NULL) {
+    return;
+  }
+  esp_netif_action_stop(netif, NULL, 0, NULL);
+  delete netif;
+}
+
+esp_err_t esp_netif_attach(esp_netif_t* netif, esp_netif_iodriver_handle driver) {
+  esp_netif_driver_base_t* base = (esp_netif_driver_base_t*)driver;
+  return base->post_attach != NULL ? base->post_attach(netif, driver) : ESP_OK;
+}
+
+esp_err_t esp_netif_set_driver_config(esp_netif_t* netif, const esp_netif_driver_ifconfig_t* config) {
+  netif->driver = *config;
+  return ESP_OK;
+}
+
+esp_err_t esp_netif_ppp_set_params(esp_netif_t* netif, const esp_netif_ppp_config_t* config) {
+  netif->ppp = *config;
+  return ESP_OK;
+}
+
+static void postStatus(esp_netif_t* netif, int32_t id) {
+  bool phase = id >= NETIF_PP_PHASE_OFFSET;
+  if (phase ? netif->ppp.ppp_phase_event_enabled : netif->ppp.ppp_error_event_enabled) {
+    esp_event_post(NETIF_PPP_STATUS, id, &netif, sizeof(netif), 0);
+  }
+}
+
+// A frame: sequence number, payload, one-byte sum, between flags
+static std::vector<uint8_t> pppFrame(uint8_t seq) {
+  std::vector<uint8_t> f;
+  f.push_back(PPP_FLAG);
+  f.push_back(seq);
+  uint8_t sum = seq;
+  for (int i = 0; i < PPP_FRAME_PAYLOAD; i++) {
+    uint8_t b = 0x21 + (seq * 7 + i) % 10;  // printable, no '+'
+    f.push_back(b);
+    sum += b;
+  }
+  f.push_back(sum);
+  f.push_back(PPP_FLAG);
+  return f;
+}
+
+esp_err_t esp_netif_receive(esp_netif_t* netif, void* buffer, size_t len, void* eb) {
+  const uint8_t* data = (const uint8_t*)buffer;
+  std::lock_guard<std::mutex> lock(netif->mutex);
+  for (size_t i = 0; i < len; i++) {
+    if (data[i] != PPP_FLAG) {
+      netif->frame.push_back(data[i]);
+      continue;
+    }
+    std::vector<uint8_t>& f = netif->frame;
+    if (f.size() == PPP_FRAME_PAYLOAD + 2) {
+      uint8_t sum = 0;
+      for (size_t j = 0; j + 1 < f.size(); j++) {
+        sum += f[j];
+      }
+      // A frame that lost a byte fails the check and is ignored
+      if (sum == f.back() && f[0] == netif->awaiting) {
+        netif->answered = true;
+        netif->cv.notify_all();
+      }
+    }
+    f.clear();
+  }
+  return ESP_OK;
+}
+
+static void negotiate(esp_netif_t* netif) {
+  uint32_t start = millis();
+  int resent = 0;
+  postStatus(netif, NETIF_PPP_PHASE_ESTABLISH);
+  for (uint8_t seq = 0; seq < PPP_FRAMES; seq++) {
+    std::vector<uint8_t> f = pppFrame(seq);
+    bool answered = false;
+    for (int tries = 0; tries < PPP_MAX_TRIES && !answered && netif->running; tries++) {
+      if (tries > 0) {
+        resent++;
+      }
+      {
+        std::lock_guard<std::mutex> lock(netif->mutex);
+        netif->awaiting = seq;
+        netif->answered = false;
+      }
+      netif->driver.transmit(netif->driver.handle, f.data(), f.size());
+      std::unique_lock<std::mutex> lock(netif->mutex);
+      answered = netif->cv.wait_for(lock, std::chrono::milliseconds(PPP_RESTART_MS), [netif]() {
+        return netif->answered || !netif->running;
+      }) && netif->answered;
+    }
+    if (!netif->running) {
+      return;
+    }
+    if (!answered) {
+      printf("[native] PPP: no answer from the peer after %d tries\n", PPP_MAX_TRIES);
+      postStatus(netif, NETIF_PPP_ERRORPEERDEAD);
+      postStatus(netif, NETIF_PPP_PHASE_DEAD);
+      return;
+    }
+    if (seq == PPP_FRAMES / 2) {
+      postStatus(netif, NETIF_PPP_PHASE_NETWORK);
+    }
+  }
+  printf("[native] PPP: up in %u ms, %d frames resent\n", millis() - start, resent);
+  netif->up = true;
+  nativePppSetUp(true);
+  postStatus(netif, NETIF_PPP_PHASE_RUNNING);
+  ip_event_got_ip_t event = {};
+  event.esp_netif = netif;
+  event.ip_info.ip.addr = IPAddress(10, 64, 64, 64);
+  event.ip_info.gw.addr = IPAddress(10, 64, 64, 1);
+  event.ip_info.netmask.addr = IPAddress(255, 255, 255, 255);
+  esp_event_post(IP_EVENT, IP_EVENT_PPP_GOT_IP, &event, sizeof(event), 0);
+}
+
+void esp_netif_action_start(void* esp_netif, esp_event_base_t base, int32_t id, void* data) {
+  esp_netif_t* netif = (esp_netif_t*)esp_netif;
+  if (netif->running) {
+    return;
+  }
+  netif->running = true;
+  netif->negotiation = std::thread(negotiate, netif);
+}
+
+void esp_netif_action_stop(void* esp_netif, esp_event_base_t base, int32_t id, void* data) {
+  esp_netif_t* netif = (esp_netif_t*)esp_netif;
+  if (!netif->running) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(netif->mutex);
+    netif->running = false;
+    netif->cv.notify_all();
+  }
+  netif->negotiation.join();
+  if (netif->up) {
+    netif->up = false;
+    nativePppSetUp(false);
+    ip_event_got_ip_t event = {};
+    event.esp_netif = netif;
+    esp_event_post(IP_EVENT, IP_EVENT_PPP_LOST_IP, &event, sizeof(event), 0);
+  }
+  postStatus(netif, NETIF_PPP_ERRORUSER);
+  postStatus(netif, NETIF_PPP_PHASE_DEAD);
+}
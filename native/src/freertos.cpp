@@ -0,0 +1,189 @@
+#include <Arduino.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
+
+struct NativeTask {
+  std::mutex lock;
+  std::condition_variable notified;
+  uint32_t notifications = 0;
+};
+
+struct NativeQueue {
+  std::mutex lock;
+  std::condition_variable notEmpty;
+  std::condition_variable notFull;
+  std::deque<std::vector<uint8_t>> items;
+  size_t length;
+  size_t itemSize;
+};
+
+static thread_local NativeTask* currentTask = NULL;
+
+// Thrown by vTaskDelete(NULL) to unwind the calling task's thread
+struct TaskExit {};
+
+static bool waitFor(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+                    TickType_t ticks, const std::function<bool()>& ready) {
+  if (ticks == portMAX_DELAY) {
+    cv.wait(lock, ready);
+    return true;
+  }
+  return cv.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackDepth,
+                                   void* arg, UBaseType_t priority, TaskHandle_t* handle,
+                                   BaseType_t core) {
+  NativeTask* task = new NativeTask();
+  if (handle != NULL) {
+    *handle = task;
+  }
+  std::thread([fn, arg, task]() {
+    currentTask = task;
+    try {
+      fn(arg);
+    } catch (const TaskExit&) {
+    }
+  }).detach();
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* arg,
+                       UBaseType_t priority, TaskHandle_t* handle) {
+  return xTaskCreatePinnedToCore(fn, name, stackDepth, arg, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t handle) {
+  // A task deleting itself ends its thread; deleting others is not supported
+  if (handle == NULL || handle == currentTask) {
+    throw TaskExit();
+  }
+}
+
+void vTaskDelay(TickType_t ticks) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount() {
+  return millis();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return currentTask;
+}
+
+BaseType_t xPortGetCoreID() {
+  return currentTask == NULL ? ARDUINO_RUNNING_CORE : 0;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  std::lock_guard<std::mutex> guard(task->lock);
+  task->notifications++;
+  task->notified.notify_one();
+  return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+  NativeTask* task = currentTask;
+  if (task == NULL) {
+    return 0;
+  }
+  std::unique_lock<std::mutex> lock(task->lock);
+  waitFor(task->notified, lock, ticks, [task]() { return task->notifications > 0; });
+  uint32_t count = task->notifications;
+  if (count > 0) {
+    task->notifications = clearOnExit ? 0 : count - 1;
+  }
+  return count;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  NativeQueue* queue = new NativeQueue();
+  queue->length = length;
+  queue->itemSize = itemSize;
+  return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+  delete queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks) {
+  std::unique_lock<std::mutex> lock(queue->lock);
+  if (!waitFor(queue->notFull, lock, ticks, [queue]() { return queue->items.size() < queue->length; })) {
+    return pdFALSE;
+  }
+  const uint8_t* bytes = (const uint8_t*)item;
+  queue->items.emplace_back(bytes, bytes + queue->itemSize);
+  queue->notEmpty.notify_one();
+  return pdTRUE;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item, TickType_t ticks) {
+  return xQueueSend(queue, item, ticks);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) {
+  std::unique_lock<std::mutex> lock(queue->lock);
+  if (!waitFor(queue->notEmpty, lock, ticks, [queue]() { return !queue->items.empty(); })) {
+    return pdFALSE;
+  }
+  if (queue->itemSize > 0) {
+    memcpy(item, queue->items.front().data(), queue->itemSize);
+  }
+  queue->items.pop_front();
+  queue->notFull.notify_one();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+  std::lock_guard<std::mutex> guard(queue->lock);
+  queue->items.clear();
+  queue->notFull.notify_all();
+  return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  std::lock_guard<std::mutex> guard(queue->lock);
+  return queue->items.size();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+  std::lock_guard<std::mutex> guard(queue->lock);
+  return queue->length - queue->items.size();
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+  return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  SemaphoreHandle_t sem = xQueueCreate(1, 0);
+  xSemaphoreGive(sem);
+  return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial) {
+  SemaphoreHandle_t sem = xQueueCreate(max, 0);
+  for (UBaseType_t i = 0; i < initial; i++) {
+    xSemaphoreGive(sem);
+  }
+  return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+  return xQueueReceive(sem, NULL, ticks);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+  return xQueueSend(sem, NULL, 0);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+  vQueueDelete(sem);
+}
@@ -0,0 +1,130 @@
+#include <Arduino.h>
+
+#include <atomic>
+#include <errno.h>
+#include <malloc.h>
+
+// Counts the process's heap use by standing in for the C allocator; every
+// call goes on to glibc. operator new and String land here too, so
+// ESP.getFreeHeap() and friends follow what the firmware allocates, and
+// benchmarks can count allocations per request (nativeHeapStats()).
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+// About what an ESP32 has left for the application with WiFi running
+#define NATIVE_HEAP_SIZE (300 * 1024)
+#define NATIVE_LARGEST_REGION (110 * 1024)
+
+static std::atomic<uint32_t> allocations(0);
+static std::atomic<size_t> inUse(0);
+static std::atomic<size_t> peakSinceBoot(0);
+static std::atomic<size_t> peakSinceReset(0);
+
+static void raisePeak(std::atomic<size_t>& peak, size_t value) {
+  size_t seen = peak.load(std::memory_order_relaxed);
+  while (value > seen && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+  }
+}
+
+static void* counted(void* ptr) {
+  if (ptr != NULL) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t size = malloc_usable_size(ptr);
+    size_t now = inUse.fetch_add(size, std::memory_order_relaxed) + size;
+    raisePeak(peakSinceBoot, now);
+    raisePeak(peakSinceReset, now);
+  }
+  return ptr;
+}
+
+static void released(void* ptr) {
+  if (ptr != NULL) {
+    inUse.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+  }
+}
+
+extern "C" {
+
+void* malloc(size_t size) {
+  return counted(__libc_malloc(size));
+}
+
+void* calloc(size_t count, size_t size) {
+  return counted(__libc_calloc(count, size));
+}
+
+void* realloc(void* ptr, size_t size) {
+  if (ptr == NULL) {
+    return malloc(size);
+  }
+  size_t before = malloc_usable_size(ptr);
+  void* moved = __libc_realloc(ptr, size);
+  if (moved == NULL) {
+    if (size == 0) {
+      inUse.fetch_sub(before, std::memory_order_relaxed);
+    }
+    return NULL;
+  }
+  // A resize is an allocation on the device too
+  inUse.fetch_sub(before, std::memory_order_relaxed);
+  return counted(moved);
+}
+
+void free(void* ptr) {
+  released(ptr);
+  __libc_free(ptr);
+}
+
+void* memalign(size_t alignment, size_t size) {
+  return counted(__libc_memalign(alignment, size));
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+  return counted(__libc_memalign(alignment, size));
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+  void* p = counted(__libc_memalign(alignment, size));
+  if (p == NULL) {
+    return ENOMEM;
+  }
+  *ptr = p;
+  return 0;
+}
+
+}  // extern "C"
+
+NativeHeapStats nativeHeapStats() {
+  NativeHeapStats stats;
+  stats.allocations = allocations.load(std::memory_order_relaxed);
+  stats.inUse = inUse.load(std::memory_order_relaxed);
+  stats.peak = peakSinceReset.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void nativeHeapResetPeak() {
+  peakSinceReset.store(inUse.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+static uint32_t freeBelow(size_t used) {
+  return used < NATIVE_HEAP_SIZE ? NATIVE_HEAP_SIZE - used : 0;
+}
+
+uint32_t EspClass::getFreeHeap() {
+  return freeBelow(inUse.load(std::memory_order_relaxed));
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+  return freeBelow(peakSinceBoot.load(std::memory_order_relaxed));
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+  uint32_t free = getFreeHeap();
+  return free < NATIVE_LARGEST_REGION ? free : NATIVE_LARGEST_REGION;
+}
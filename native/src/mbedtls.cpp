@@ -0,0 +1,229 @@
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/error.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Session ids handed out by "full" handshakes; a stored id resumes
+static uint32_t nextSessionId = 1;
+
+void mbedtls_x509_crt_init(mbedtls_x509_crt* crt) {
+  crt->parsed = 0;
+}
+
+void mbedtls_x509_crt_free(mbedtls_x509_crt* crt) {
+  crt->parsed = 0;
+}
+
+int mbedtls_x509_crt_parse(mbedtls_x509_crt* crt, const unsigned char* buf, size_t len) {
+  if (len == 0 || strstr((const char*)buf, "-----BEGIN CERTIFICATE-----") == NULL) {
+    return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+  }
+  crt->parsed = 1;
+  return 0;
+}
+
+// DER certificates and keys are SEQUENCEs; nothing more is checked
+int mbedtls_x509_crt_parse_der(mbedtls_x509_crt* crt, const unsigned char* buf, size_t len) {
+  if (len == 0 || buf[0] != 0x30) {
+    return MBEDTLS_ERR_X509_INVALID_FORMAT;
+  }
+  crt->parsed = 1;
+  return 0;
+}
+
+int mbedtls_x509_crt_parse_der_nocopy(mbedtls_x509_crt* crt, const unsigned char* buf, size_t len) {
+  return mbedtls_x509_crt_parse_der(crt, buf, len);
+}
+
+void mbedtls_pk_init(mbedtls_pk_context* pk) {
+  pk->parsed = 0;
+}
+
+void mbedtls_pk_free(mbedtls_pk_context* pk) {
+  pk->parsed = 0;
+}
+
+int mbedtls_pk_parse_key(mbedtls_pk_context* pk, const unsigned char* key, size_t keyLen,
+                         const unsigned char* pwd, size_t pwdLen) {
+  bool der = keyLen > 0 && key[0] == 0x30;
+  if (keyLen == 0 || (!der && strstr((const char*)key, "PRIVATE KEY-----") == NULL)) {
+    return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+  }
+  pk->parsed = 1;
+  return 0;
+}
+
+void mbedtls_entropy_init(mbedtls_entropy_context* ctx) {}
+void mbedtls_entropy_free(mbedtls_entropy_context* ctx) {}
+
+int mbedtls_entropy_func(void* ctx, unsigned char* out, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    out[i] = (unsigned char)rand();
+  }
+  return 0;
+}
+
+void mbedtls_ctr_drbg_init(mbedtls_ctr_drbg_context* ctx) {}
+void mbedtls_ctr_drbg_free(mbedtls_ctr_drbg_context* ctx) {}
+
+int mbedtls_ctr_drbg_seed(mbedtls_ctr_drbg_context* ctx, int (*entropy)(void*, unsigned char*, size_t),
+                          void* entropyCtx, const unsigned char* custom, size_t len) {
+  return 0;
+}
+
+int mbedtls_ctr_drbg_random(void* ctx, unsigned char* out, size_t len) {
+  return mbedtls_entropy_func(NULL, out, len);
+}
+
+void mbedtls_strerror(int err, char* buf, size_t len) {
+  snprintf(buf, len, "native TLS error -0x%04X", (unsigned)-err);
+}
+
+void mbedtls_ssl_init(mbedtls_ssl_context* ssl) {
+  memset(ssl, 0, sizeof(*ssl));
+}
+
+void mbedtls_ssl_free(mbedtls_ssl_context* ssl) {
+  memset(ssl, 0, sizeof(*ssl));
+}
+
+void mbedtls_ssl_config_init(mbedtls_ssl_config* conf) {
+  conf->authmode = MBEDTLS_SSL_VERIFY_REQUIRED;
+}
+
+void mbedtls_ssl_config_free(mbedtls_ssl_config* conf) {}
+
+int mbedtls_ssl_config_defaults(mbedtls_ssl_config* conf, int endpoint, int transport, int preset) {
+  return 0;
+}
+
+void mbedtls_ssl_conf_authmode(mbedtls_ssl_config* conf, int authmode) {
+  conf->authmode = authmode;
+}
+
+void mbedtls_ssl_conf_ca_chain(mbedtls_ssl_config* conf, mbedtls_x509_crt* ca, void* crl) {}
+
+int mbedtls_ssl_conf_own_cert(mbedtls_ssl_config* conf, mbedtls_x509_crt* cert, mbedtls_pk_context* key) {
+  return 0;
+}
+
+void mbedtls_ssl_conf_rng(mbedtls_ssl_config* conf, int (*rng)(void*, unsigned char*, size_t), void* ctx) {}
+void mbedtls_ssl_conf_session_tickets(mbedtls_ssl_config* conf, int enabled) {}
+
+int mbedtls_ssl_setup(mbedtls_ssl_context* ssl, const mbedtls_ssl_config* conf) {
+  ssl->state = MBEDTLS_SSL_HELLO_REQUEST;
+  ssl->handshake = &ssl->handshakeParams;
+  return 0;
+}
+
+int mbedtls_ssl_set_hostname(mbedtls_ssl_context* ssl, const char* host) {
+  return 0;
+}
+
+void mbedtls_ssl_set_bio(mbedtls_ssl_context* ssl, void* bio, mbedtls_ssl_send_t* send,
+                         mbedtls_ssl_recv_t* recv, mbedtls_ssl_recv_timeout_t* recvTimeout) {
+  ssl->bio = bio;
+  ssl->send = send;
+  ssl->recv = recv;
+}
+
+// Two steps: the first decides full or resumed, the second finishes
+int mbedtls_ssl_handshake_step(mbedtls_ssl_context* ssl) {
+  if (ssl->state == MBEDTLS_SSL_HELLO_REQUEST) {
+    ssl->handshake->resume = ssl->session.id != 0;
+    if (ssl->session.id == 0) {
+      ssl->session.id = nextSessionId++;
+    }
+    ssl->state = 1;
+  } else if (ssl->state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+    ssl->state = MBEDTLS_SSL_HANDSHAKE_OVER;
+    ssl->handshake = NULL;
+  }
+  return 0;
+}
+
+int mbedtls_ssl_handshake(mbedtls_ssl_context* ssl) {
+  while (ssl->state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+    mbedtls_ssl_handshake_step(ssl);
+  }
+  return 0;
+}
+
+int mbedtls_ssl_read(mbedtls_ssl_context* ssl, unsigned char* buf, size_t len) {
+  if (len == 0) {
+    // Pull what the socket has so get_bytes_avail() can report it
+    if (ssl->pendingLen < sizeof(ssl->pending)) {
+      int ret = ssl->recv(ssl->bio, ssl->pending + ssl->pendingLen, sizeof(ssl->pending) - ssl->pendingLen);
+      if (ret < 0) {
+        return ret;
+      }
+      ssl->pendingLen += ret;
+    }
+    return 0;
+  }
+  if (ssl->pendingLen > 0) {
+    size_t n = len < ssl->pendingLen ? len : ssl->pendingLen;
+    memcpy(buf, ssl->pending, n);
+    memmove(ssl->pending, ssl->pending + n, ssl->pendingLen - n);
+    ssl->pendingLen -= n;
+    return (int)n;
+  }
+  return ssl->recv(ssl->bio, buf, len);
+}
+
+int mbedtls_ssl_write(mbedtls_ssl_context* ssl, const unsigned char* buf, size_t len) {
+  return ssl->send(ssl->bio, buf, len);
+}
+
+size_t mbedtls_ssl_get_bytes_avail(const mbedtls_ssl_context* ssl) {
+  return ssl->pendingLen;
+}
+
+int mbedtls_ssl_close_notify(mbedtls_ssl_context* ssl) {
+  return 0;
+}
+
+uint32_t mbedtls_ssl_get_verify_result(const mbedtls_ssl_context* ssl) {
+  return 0;
+}
+
+void mbedtls_ssl_session_init(mbedtls_ssl_session* session) {
+  session->id = 0;
+}
+
+void mbedtls_ssl_session_free(mbedtls_ssl_session* session) {
+  session->id = 0;
+}
+
+int mbedtls_ssl_get_session(const mbedtls_ssl_context* ssl, mbedtls_ssl_session* session) {
+  *session = ssl->session;
+  return 0;
+}
+
+int mbedtls_ssl_set_session(mbedtls_ssl_context* ssl, const mbedtls_ssl_session* session) {
+  ssl->session = *session;
+  return 0;
+}
+
+int mbedtls_ssl_session_save(const mbedtls_ssl_session* session, unsigned char* buf, size_t len, size_t* olen) {
+  *olen = sizeof(session->id);
+  if (len < sizeof(session->id)) {
+    return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+  }
+  memcpy(buf, &session->id, sizeof(session->id));
+  return 0;
+}
+
+int mbedtls_ssl_session_load(mbedtls_ssl_session* session, const unsigned char* buf, size_t len) {
+  if (len != sizeof(session->id)) {
+    return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+  }
+  memcpy(&session->id, buf, sizeof(session->id));
+  return 0;
+}
@@ -0,0 +1,46 @@
+#include <rom/miniz.h>
+#include <esp_rom_crc.h>
+
+#include <string.h>
+
+tinfl_status tinfl_decompress(tinfl_decompressor* r, const mz_uint8* in, size_t* inSize,
+                              mz_uint8* outStart, mz_uint8* outNext, size_t* outSize,
+                              const mz_uint32 flags) {
+  if (r->m_state == 0) {
+    // The ROM API has no teardown call: zlib's state is released when the
+    // stream ends or fails, and leaks if the caller abandons it mid-way.
+    memset(&r->m_zlib, 0, sizeof(r->m_zlib));
+    int windowBits = (flags & TINFL_FLAG_PARSE_ZLIB_HEADER) ? MAX_WBITS : -MAX_WBITS;
+    if (inflateInit2(&r->m_zlib, windowBits) != Z_OK) {
+      return TINFL_STATUS_FAILED;
+    }
+    r->m_state = 1;
+  }
+  z_stream& zs = r->m_zlib;
+  zs.next_in = (Bytef*)in;
+  zs.avail_in = *inSize;
+  zs.next_out = outNext;
+  zs.avail_out = *outSize;
+  int ret = inflate(&zs, Z_NO_FLUSH);
+  *inSize -= zs.avail_in;
+  *outSize -= zs.avail_out;
+
+  if (ret == Z_STREAM_END) {
+    inflateEnd(&zs);
+    r->m_state = 2;
+    return TINFL_STATUS_DONE;
+  }
+  if (ret != Z_OK && ret != Z_BUF_ERROR) {
+    inflateEnd(&zs);
+    r->m_state = 2;
+    return TINFL_STATUS_FAILED;
+  }
+  if (zs.avail_out == 0) {
+    return TINFL_STATUS_HAS_MORE_OUTPUT;
+  }
+  return TINFL_STATUS_NEEDS_MORE_INPUT;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len) {
+  return crc32(crc, buf, len);
+}
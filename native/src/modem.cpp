@@ -0,0 +1,311 @@
+// A cellular modem on the far side of Serial2. It answers the AT commands
+// CellularTransport sends, takes a while to register, and in data mode
+// returns each PPP frame after a network round trip, so the esp_netif
+// stand-in can negotiate over it. Bytes cross the UART at the line rate and
+// each one may be lost.
+//
+//   NATIVE_MODEM=none           no modem on the UART
+//   NATIVE_MODEM_BAUD           line rate, default the rate Serial2 opens at
+//   NATIVE_MODEM_LATENCY_MS     one-way network latency, default 150
+//   NATIVE_MODEM_LOSS           chance of losing each byte, default 0
+//   NATIVE_MODEM_REGISTER_MS    power on to registered, default 2000
+//   NATIVE_MODEM_CSQ            signal quality reported, default 18
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "native.h"
+
+#define MODEM_GUARD_US 1000000
+#define MODEM_DIAL_MS 800          // ATD to CONNECT
+#define TCP_SEGMENT 512
+#define TCP_CONTROL_PACKET 64
+#define TCP_SYN_RTO_MS 3000
+
+static uint64_t nowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const char* env(const char* name, const char* fallback) {
+  const char* value = getenv(name);
+  return value != NULL && value[0] != '\0' ? value : fallback;
+}
+
+// One direction of the UART
+struct Line {
+  std::deque<std::pair<uint64_t, uint8_t>> bytes;  // when each arrives
+  uint64_t last = 0;                               // when the last one finished
+};
+
+static std::mutex modemMutex;
+static std::mt19937 modemRandom(1);
+static bool modemPresent = false;
+static bool modemStarted = false;
+static uint64_t byteUs = 0;
+static uint64_t latencyUs = 150000;
+static double lossRate = 0;
+static uint64_t registeredAtUs = 0;
+static int signalQuality = 18;
+static Line toModem;
+static Line toHost;
+
+// Modem state, guarded by modemMutex
+static bool echo = true;
+static bool dataMode = false;
+static std::string commandLine;
+static std::string apn;
+static std::string frame;
+static uint64_t lastRxUs = 0;      // last byte the modem received
+static int pluses = 0;
+static uint64_t escapeUs = 0;      // the third '+', 0 when none pending
+static uint64_t connectUs = 0;     // when a dial answers, 0 when none pending
+
+static std::atomic<bool> pppUp(false);
+static uint64_t networkFreeUs = 0;
+
+static bool lost(size_t bytes) {
+  if (lossRate <= 0) {
+    return false;
+  }
+  std::uniform_real_distribution<double> chance(0, 1);
+  return chance(modemRandom) < 1 - pow(1 - lossRate, (double)bytes);
+}
+
+// Queues bytes to arrive no earlier than notBefore, one byte time apart
+static void send(Line& line, const uint8_t* data, size_t len, uint64_t notBefore) {
+  for (size_t i = 0; i < len; i++) {
+    uint64_t due = max(notBefore, line.last + byteUs);
+    line.last = due;
+    if (!lost(1)) {
+      line.bytes.push_back(std::make_pair(due, data[i]));
+    }
+  }
+}
+
+static void reply(const char* text) {
+  std::string s = std::string("\r\n") + text + "\r\n";
+  send(toHost, (const uint8_t*)s.data(), s.size(), nowUs());
+}
+
+static void runCommand(std::string cmd) {
+  for (char& c : cmd) {
+    c = toupper(c);
+  }
+  if (cmd.empty()) {
+    return;
+  }
+  if (cmd == "AT" || cmd == "ATH" || cmd == "ATZ") {
+    reply("OK");
+  } else if (cmd == "ATE0" || cmd == "ATE1") {
+    echo = cmd == "ATE1";
+    reply("OK");
+  } else if (cmd == "AT+CSQ") {
+    char line[32];
+    snprintf(line, sizeof(line), "+CSQ: %d,0", signalQuality);
+    reply(line);
+    reply("OK");
+  } else if (cmd == "AT+CGREG?") {
+    reply(nowUs() >= registeredAtUs ? "+CGREG: 0,1" : "+CGREG: 0,2");
+    reply("OK");
+  } else if (cmd.compare(0, 19, "AT+CGDCONT=1,\"IP\",\"") == 0 && cmd.size() > 20 &&
+             cmd.back() == '"') {
+    apn = cmd.substr(19, cmd.size() - 20);
+    reply("OK");
+  } else if (cmd == "ATD*99#" || cmd == "ATD*99***1#") {
+    if (apn.empty() || nowUs() < registeredAtUs) {
+      reply("NO CARRIER");
+    } else {
+      connectUs = nowUs() + MODEM_DIAL_MS * 1000ULL;
+    }
+  } else {
+    reply("ERROR");
+  }
+}
+
+static void receive(uint8_t c, uint64_t now) {
+  uint64_t silence = now - lastRxUs;
+  lastRxUs = now;
+  if (!dataMode) {
+    if (echo) {
+      send(toHost, &c, 1, now);
+    }
+    if (c == '\r') {
+      runCommand(commandLine);
+      commandLine.clear();
+    } else if (c != '\n' && commandLine.size() < 256) {
+      commandLine += (char)c;
+    }
+    return;
+  }
+
+  // "+++" between guard times leaves data mode
+  if (c == '+' && (pluses > 0 || silence >= MODEM_GUARD_US) && pluses < 3) {
+    if (++pluses == 3) {
+      escapeUs = now;
+    }
+    return;
+  }
+  pluses = 0;
+  escapeUs = 0;
+
+  // Frames come back from the network one round trip later
+  if (c == 0x7E) {
+    if (!frame.empty()) {
+      frame += (char)c;
+      send(toHost, (const uint8_t*)frame.data(), frame.size(), now + 2 * latencyUs);
+    }
+    frame.assign(1, (char)c);
+  } else if (!frame.empty() && frame.size() < 2048) {
+    frame += (char)c;
+  }
+}
+
+static void simulate() {
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(modemMutex);
+      uint64_t now = nowUs();
+      while (!toModem.bytes.empty() && toModem.bytes.front().first <= now) {
+        uint8_t c = toModem.bytes.front().second;
+        toModem.bytes.pop_front();
+        receive(c, now);
+      }
+      if (connectUs != 0 && now >= connectUs) {
+        connectUs = 0;
+        dataMode = true;
+        frame.clear();
+        pluses = 0;
+        reply("CONNECT 115200");
+      }
+      if (escapeUs != 0 && now - escapeUs >= MODEM_GUARD_US) {
+        escapeUs = 0;
+        pluses = 0;
+        dataMode = false;
+        commandLine.clear();
+        reply("OK");
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void nativeModemBegin(unsigned long baud) {
+  std::lock_guard<std::mutex> lock(modemMutex);
+  if (modemStarted) {
+    return;
+  }
+  modemStarted = true;
+  modemPresent = strcmp(env("NATIVE_MODEM", ""), "none") != 0;
+  if (!modemPresent) {
+    printf("[native] Serial2: no modem\n");
+    return;
+  }
+  unsigned long rate = strtoul(env("NATIVE_MODEM_BAUD", "0"), NULL, 10);
+  byteUs = 10000000ULL / (rate > 0 ? rate : baud > 0 ? baud : 115200);
+  latencyUs = strtoull(env("NATIVE_MODEM_LATENCY_MS", "150"), NULL, 10) * 1000;
+  lossRate = atof(env("NATIVE_MODEM_LOSS", "0"));
+  signalQuality = atoi(env("NATIVE_MODEM_CSQ", "18"));
+  registeredAtUs = nowUs() + strtoull(env("NATIVE_MODEM_REGISTER_MS", "2000"), NULL, 10) * 1000;
+  printf("[native] Serial2: modem at %lu baud, %u ms latency, %.4f byte loss\n",
+         (unsigned long)(10000000ULL / byteUs), (unsigned)(latencyUs / 1000), lossRate);
+  std::thread(simulate).detach();
+}
+
+// The modem keeps its state while the UART is closed
+void nativeModemEnd() {
+  std::lock_guard<std::mutex> lock(modemMutex);
+  toHost.bytes.clear();
+}
+
+size_t nativeModemWrite(const uint8_t* buf, size_t len) {
+  std::lock_guard<std::mutex> lock(modemMutex);
+  if (modemPresent) {
+    send(toModem, buf, len, nowUs());
+  }
+  return len;
+}
+
+int nativeModemAvailable() {
+  std::lock_guard<std::mutex> lock(modemMutex);
+  uint64_t now = nowUs();
+  int n = 0;
+  for (auto& b : toHost.bytes) {
+    if (b.first > now) {
+      break;
+    }
+    n++;
+  }
+  return n;
+}
+
+size_t nativeModemRead(uint8_t* buf, size_t len) {
+  std::lock_guard<std::mutex> lock(modemMutex);
+  uint64_t now = nowUs();
+  size_t n = 0;
+  while (n < len && !toHost.bytes.empty() && toHost.bytes.front().first <= now) {
+    buf[n++] = toHost.bytes.front().second;
+    toHost.bytes.pop_front();
+  }
+  return n;
+}
+
+int nativeModemPeek() {
+  std::lock_guard<std::mutex> lock(modemMutex);
+  return !toHost.bytes.empty() && toHost.bytes.front().first <= nowUs() ? toHost.bytes.front().second : -1;
+}
+
+// Sockets over PPP
+
+void nativePppSetUp(bool up) {
+  pppUp = up;
+}
+
+// lwIP routes over the station interface while it is up
+bool nativeLinkShaped() {
+  return pppUp && WiFi.status() != WL_CONNECTED;
+}
+
+void nativeLinkRoundTrip() {
+  uint32_t ms;
+  {
+    std::lock_guard<std::mutex> lock(modemMutex);
+    ms = 2 * latencyUs / 1000;
+    if (lost(TCP_CONTROL_PACKET)) {
+      ms += TCP_SYN_RTO_MS;
+    }
+  }
+  delay(ms);
+}
+
+// Bytes share the line with every other socket; a lost segment stalls the
+// stream until it is retransmitted
+void nativeLinkTransfer(size_t bytes) {
+  uint64_t until;
+  {
+    std::lock_guard<std::mutex> lock(modemMutex);
+    uint64_t now = nowUs();
+    uint64_t rto = max((uint64_t)1000000, 4 * latencyUs);
+    uint64_t start = max(now, networkFreeUs);
+    until = start + bytes * byteUs;
+    for (size_t sent = 0; sent < bytes; sent += TCP_SEGMENT) {
+      if (lost(min((size_t)TCP_SEGMENT, bytes - sent))) {
+        until += rto;
+      }
+    }
+    networkFreeUs = until;
+  }
+  uint64_t now = nowUs();
+  if (until > now) {
+    std::this_thread::sleep_for(std::chrono::microseconds(until - now));
+  }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// Path of a file or directory under the native data directory
+// (NATIVE_DATA_DIR, default "native_data"), which is created on first use.
+std::string nativeDataPath(const char* name);
+
+// Restarts the process in place, like ESP.restart() on the device
+void nativeRestart();
+
+// Simulated modem behind Serial2 (modem.cpp)
+void nativeModemBegin(unsigned long baud);
+void nativeModemEnd();
+size_t nativeModemWrite(const uint8_t* buf, size_t len);
+int nativeModemAvailable();
+size_t nativeModemRead(uint8_t* buf, size_t len);
+int nativeModemPeek();
+
+// While PPP is up and WiFi is not, outgoing sockets pay the modem line's
+// latency, rate and loss
+void nativePppSetUp(bool up);
+bool nativeLinkShaped();
+void nativeLinkRoundTrip();
+void nativeLinkTransfer(size_t bytes);
@@ -0,0 +1,113 @@
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "native.h"
+
+// Same layout as the default 4 MB table: app0 runs, app1 takes updates.
+// app1 is a file in the native data directory so a resumed download finds
+// what was written before a restart.
+static const esp_partition_t app0 = {0x10000, 0x140000, "app0"};
+static const esp_partition_t app1 = {0x150000, 0x140000, "app1"};
+
+// Flash access does not allocate on the device, so the stand-in does not
+// either: benchmarks count the firmware's allocations, not these
+static int openPartition(const esp_partition_t* partition) {
+  static const std::string app0Path = nativeDataPath(app0.label) + ".bin";
+  static const std::string app1Path = nativeDataPath(app1.label) + ".bin";
+  const std::string& path = partition == &app0 ? app0Path : app1Path;
+  int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  off_t end = fd >= 0 ? lseek(fd, 0, SEEK_END) : 0;
+  if (fd >= 0 && end < (off_t)partition->size) {
+    // Flash past the end of the file reads as erased
+    static uint8_t erased[SPI_FLASH_SEC_SIZE];
+    memset(erased, 0xff, sizeof(erased));
+    for (uint32_t offset = end; offset < partition->size; offset += sizeof(erased)) {
+      size_t n = partition->size - offset < sizeof(erased) ? partition->size - offset : sizeof(erased);
+      pwrite(fd, erased, n, offset);
+    }
+  }
+  return fd;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+  if (offset % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0 ||
+      offset + size > partition->size) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  int fd = openPartition(partition);
+  if (fd < 0) {
+    return ESP_FAIL;
+  }
+  uint8_t erased[SPI_FLASH_SEC_SIZE];
+  memset(erased, 0xff, sizeof(erased));
+  for (size_t pos = offset; pos < offset + size; pos += sizeof(erased)) {
+    pwrite(fd, erased, sizeof(erased), pos);
+  }
+  close(fd);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t offset, const void* src, size_t size) {
+  if (offset + size > partition->size) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  int fd = openPartition(partition);
+  if (fd < 0) {
+    return ESP_FAIL;
+  }
+  // NOR flash can only clear bits, so writing over unerased data corrupts it
+  uint8_t current[SPI_FLASH_SEC_SIZE];
+  bool ok = true;
+  for (size_t done = 0; done < size && ok; done += sizeof(current)) {
+    size_t n = size - done < sizeof(current) ? size - done : sizeof(current);
+    pread(fd, current, n, offset + done);
+    for (size_t i = 0; i < n; i++) {
+      current[i] &= ((const uint8_t*)src)[done + i];
+    }
+    ok = pwrite(fd, current, n, offset + done) == (ssize_t)n;
+  }
+  close(fd);
+  return ok ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t offset, void* dst, size_t size) {
+  if (offset + size > partition->size) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  int fd = openPartition(partition);
+  if (fd < 0) {
+    return ESP_FAIL;
+  }
+  ssize_t got = pread(fd, dst, size, offset);
+  close(fd);
+  return got == (ssize_t)size ? ESP_OK : ESP_FAIL;
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start) {
+  return &app1;
+}
+
+const esp_partition_t* esp_ota_get_running_partition() {
+  return &app0;
+}
+
+const esp_partition_t* esp_ota_get_boot_partition() {
+  return &app0;
+}
+
+// The image is only checked for the ESP32 image magic; the process keeps
+// running the host build after the "reboot"
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) {
+  uint8_t magic = 0;
+  if (esp_partition_read(partition, 0, &magic, 1) != ESP_OK || magic != 0xE9) {
+    return ESP_ERR_OTA_VALIDATE_FAILED;
+  }
+  printf("[native] boot partition set to %s\n", partition->label);
+  return ESP_OK;
+}
@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""Measures portal latency under concurrent clients.
+
+Each client keeps one HTTP/1.1 connection open and sends its requests on
+it back to back, opening a new one when the portal closes it (after
+PORTAL_MAX_KEEPALIVE_REQUESTS, or on an error). With more clients than
+PORTAL_MAX_CLIENTS the portal closes idle connections to admit new ones,
+and a request that finds its connection closed is sent again on a new one
+and counted as a retry. Clients start together, and each level of
+concurrency runs in turn:
+
+    scripts/loadtest.py 127.0.0.1:8080 -c 1,4,8,16 -n 200 --path / --path /metrics
+
+Requests cycle through the --path values (GET only, so a run changes no
+settings). With --close every request gets a connection of its own, as
+the synchronous server used to give, for comparison. Throughput, p50, p99
+and max latency per level are printed; the exit status is 1 if any request
+failed.
+
+Works against the native build: run .pio/build/native/program and point it
+at 127.0.0.1:8080 (or the NATIVE_HTTP_PORT it was started with).
+"""
+
+import argparse
+import http.client
+import sys
+import threading
+import time
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p))]
+
+
+class Client(threading.Thread):
+    def __init__(self, host, port, paths, count, close, timeout, start_barrier):
+        super().__init__(daemon=True)
+        self.host, self.port = host, port
+        self.paths, self.count, self.close = paths, count, close
+        self.timeout = timeout
+        self.start_barrier = start_barrier
+        self.latencies = []
+        self.errors = 0
+        self.retries = 0
+        self.connections = 0
+
+    def connect(self):
+        self.connections += 1
+        return http.client.HTTPConnection(self.host, self.port, timeout=self.timeout)
+
+    def run(self):
+        conn = None
+        used = 0  # responses read on conn
+        headers = {"Connection": "close"} if self.close else {}
+        self.start_barrier.wait()
+        for i in range(self.count):
+            start = time.monotonic()
+            while True:
+                if conn is None:
+                    conn, used = self.connect(), 0
+                try:
+                    conn.request("GET", self.paths[i % len(self.paths)], headers=headers)
+                    response = conn.getresponse()
+                    response.read()
+                except (OSError, http.client.HTTPException):
+                    conn.close()
+                    conn = None
+                    # A kept-alive connection the portal closed to make room
+                    # for another client: sent again on a new one, as browsers
+                    # do for a GET (RFC 7230, section 6.3.1)
+                    if used > 0:
+                        self.retries += 1
+                        continue
+                    self.errors += 1
+                    break
+                used += 1
+                if response.status != 200:
+                    self.errors += 1
+                else:
+                    self.latencies.append(time.monotonic() - start)
+                if self.close or response.will_close:
+                    conn.close()
+                    conn = None
+                break
+        if conn is not None:
+            conn.close()
+
+
+def run_level(args, host, port, clients):
+    barrier = threading.Barrier(clients + 1)
+    threads = [Client(host, port, args.path, args.requests, args.close, args.timeout, barrier)
+               for _ in range(clients)]
+    for t in threads:
+        t.start()
+    barrier.wait()
+    start = time.monotonic()
+    for t in threads:
+        t.join()
+    wall = time.monotonic() - start
+
+    latencies = [l for t in threads for l in t.latencies]
+    errors = sum(t.errors for t in threads)
+    retries = sum(t.retries for t in threads)
+    connections = sum(t.connections for t in threads)
+    if latencies:
+        print("%7d %8d %6d %7d %6d %8.0f %8.1f %8.1f %8.1f"
+              % (clients, len(latencies), errors, retries, connections, len(latencies) / wall,
+                 percentile(latencies, 0.5) * 1000, percentile(latencies, 0.99) * 1000,
+                 max(latencies) * 1000), flush=True)
+    else:
+        print("%7d %8d %6d %7d %6d  no request succeeded" % (clients, 0, errors, retries, connections),
+              flush=True)
+    return errors
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("host", nargs="?", default="127.0.0.1:8080",
+                        help="portal address, host[:port] (default 127.0.0.1:8080)")
+    parser.add_argument("-c", "--clients", default="1,4,8,16",
+                        help="comma-separated concurrency levels (default 1,4,8,16)")
+    parser.add_argument("-n", "--requests", type=int, default=200, help="requests per client (default 200)")
+    parser.add_argument("--path", action="append", help="path to GET, repeatable (default /)")
+    parser.add_argument("--close", action="store_true", help="a new connection for every request")
+    parser.add_argument("--timeout", type=float, default=10, help="seconds per request (default 10)")
+    args = parser.parse_args()
+    args.path = args.path or ["/"]
+
+    host, _, port = args.host.partition(":")
+    port = int(port or 80)
+    levels = [int(c) for c in args.clients.split(",") if c]
+    print("%s:%d, %d requests per client on %s connections, GET %s"
+          % (host, port, args.requests, "new" if args.close else "keep-alive", " ".join(args.path)))
+    print("%7s %8s %6s %7s %6s %8s %8s %8s %8s"
+          % ("clients", "requests", "errors", "retries", "conns", "req/s", "p50 ms", "p99 ms", "max ms"))
+    failed = 0
+    for clients in levels:
+        failed += run_level(args, host, port, clients)
+    sys.exit(1 if failed else 0)
+
+
+main()
@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+"""Provisions many portals at once through POST /provision.
+
+Each device gets one multipart request carrying its certificate, key,
+settings and optional firmware target, which the portal applies together
+or not at all. Devices are listed in a CSV file:
+
+    host,cert,key,wifi_ssid,wifi_password,gsm_apn,firmware
+    192.168.4.1,certs/unit1.pem,certs/unit1.key,bench,secret,internet,
+    10.0.0.12:8080,certs/unit2.pem,certs/unit2.key,bench,secret,internet,fw-2.5.0
+
+Columns other than host, cert, key and firmware are sent as settings
+(the keys POST /config accepts); empty cells are left out, and --set gives
+a value to every device that has none. The time per device and a summary
+are printed; the exit status is 1 if any device failed.
+
+Works against the native build too: start several portals with their own
+NATIVE_HTTP_PORT and NATIVE_DATA_DIR and list them as 127.0.0.1:<port>.
+"""
+
+import argparse
+import concurrent.futures
+import csv
+import http.client
+import json
+import os
+import sys
+import time
+import uuid
+
+FILE_FIELDS = ("cert", "key")
+
+
+def multipart(fields, files):
+    boundary = uuid.uuid4().hex
+    parts = []
+    for name, value in fields:
+        parts.append(('--%s\r\nContent-Disposition: form-data; name="%s"\r\n\r\n' % (boundary, name)).encode())
+        parts.append(value.encode() + b"\r\n")
+    for name, path in files:
+        with open(path, "rb") as f:
+            data = f.read()
+        parts.append(('--%s\r\nContent-Disposition: form-data; name="%s"; filename="%s"\r\n'
+                      'Content-Type: application/x-pem-file\r\n\r\n'
+                      % (boundary, name, os.path.basename(path))).encode())
+        parts.append(data + b"\r\n")
+    parts.append(("--%s--\r\n" % boundary).encode())
+    return "multipart/form-data; boundary=" + boundary, b"".join(parts)
+
+
+def provision(device, timeout):
+    host = device["host"]
+    fields = [(k, v) for k, v in device.items() if k not in FILE_FIELDS + ("host",) and v]
+    files = [(k, device[k]) for k in FILE_FIELDS if device.get(k)]
+    start = time.monotonic()
+    try:
+        content_type, body = multipart(fields, files)
+        name, _, port = host.partition(":")
+        conn = http.client.HTTPConnection(name, int(port or 80), timeout=timeout)
+        conn.request("POST", "/provision", body=body,
+                     headers={"Content-Type": content_type, "Connection": "close"})
+        response = conn.getresponse()
+        text = response.read().decode(errors="replace")
+        conn.close()
+        try:
+            result = json.loads(text)
+        except ValueError:
+            result = {"result": "http_%d" % response.status, "error": text[:80]}
+        ok = response.status == 200 and result.get("result") == "ok"
+    except (OSError, http.client.HTTPException) as e:
+        ok, result = False, {"result": "unreachable", "error": str(e)}
+    return host, ok, time.monotonic() - start, result
+
+
+def describe(result):
+    if result.get("result") == "ok":
+        done = [k for k in FILE_FIELDS if result.get(k)]
+        text = "%s, %d settings" % ("+".join(done) or "no files", result.get("settings", 0))
+        if result.get("ota_job"):
+            text += ", OTA job %d" % result["ota_job"]
+        return text + ", commit %d ms" % result.get("commit_ms", 0)
+    field = result.get("field")
+    return "%s%s: %s" % (result.get("result"), " (%s)" % field if field else "", result.get("error", ""))
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("devices", help="CSV file with a host column and one row per device")
+    parser.add_argument("-j", "--jobs", type=int, default=16, help="devices provisioned at once (default 16)")
+    parser.add_argument("--timeout", type=float, default=30, help="seconds per request (default 30)")
+    parser.add_argument("--set", action="append", default=[], metavar="KEY=VALUE",
+                        help="value for devices whose row leaves KEY empty")
+    args = parser.parse_args()
+
+    defaults = dict(item.split("=", 1) for item in args.set)
+    with open(args.devices, newline="") as f:
+        devices = []
+        for row in csv.DictReader(f):
+            row = {k.strip(): (v or "").strip() for k, v in row.items() if k}
+            for key, value in defaults.items():
+                if not row.get(key):
+                    row[key] = value
+            if row.get("host"):
+                devices.append(row)
+    if not devices:
+        sys.exit("no devices in %s" % args.devices)
+
+    start = time.monotonic()
+    times = []
+    failed = 0
+    with concurrent.futures.ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        for host, ok, elapsed, result in pool.map(lambda d: provision(d, args.timeout), devices):
+            times.append(elapsed)
+            failed += not ok
+            print("%-22s %-4s %7.0f ms  %s" % (host, "ok" if ok else "FAIL", elapsed * 1000, describe(result)),
+                  flush=True)
+    wall = time.monotonic() - start
+
+    print("\n%d devices, %d ok, %d failed in %.1f s (%.0f devices/min, %d at once)"
+          % (len(devices), len(devices) - failed, failed, wall, len(devices) / wall * 60, args.jobs))
+    print("per device: median %.0f ms, p90 %.0f ms, max %.0f ms"
+          % (percentile(times, 0.5) * 1000, percentile(times, 0.9) * 1000, max(times) * 1000))
+    sys.exit(1 if failed else 0)
+
+
+main()
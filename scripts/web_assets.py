@@ -0,0 +1,100 @@
+# Compresses the files in web/ and embeds them in the firmware.
+#
+# Runs before every build as a PlatformIO extra script, or by hand with
+# `python3 scripts/web_assets.py`. Each file is gzipped (deterministically,
+# so an unchanged file keeps its ETag) and written as a byte array into
+# src/web_assets_gen.cpp; include/web_assets_gen.h gets a version string per
+# asset for cache-busting links. Prints the size of each asset.
+
+import gzip
+import hashlib
+import os
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+    PROJECT_DIR = env["PROJECT_DIR"]  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+WEB_DIR = os.path.join(PROJECT_DIR, "web")
+SOURCE_OUT = os.path.join(PROJECT_DIR, "src", "web_assets_gen.cpp")
+HEADER_OUT = os.path.join(PROJECT_DIR, "include", "web_assets_gen.h")
+
+CONTENT_TYPES = {
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".html": "text/html",
+    ".json": "application/json",
+    ".svg": "image/svg+xml",
+    ".ico": "image/x-icon",
+}
+
+GENERATED = "// Generated by scripts/web_assets.py from web/; do not edit.\n"
+
+
+def symbol(name):
+    return "WEB_" + "".join(c.upper() if c.isalnum() else "_" for c in name)
+
+
+def write_if_changed(path, text):
+    if os.path.exists(path):
+        with open(path) as f:
+            if f.read() == text:
+                return
+    with open(path, "w") as f:
+        f.write(text)
+
+
+def main():
+    assets = []
+    for root, _, files in os.walk(WEB_DIR):
+        for file in sorted(files):
+            path = os.path.join(root, file)
+            ext = os.path.splitext(file)[1].lower()
+            if ext not in CONTENT_TYPES:
+                continue
+            with open(path, "rb") as f:
+                raw = f.read()
+            packed = gzip.compress(raw, compresslevel=9, mtime=0)
+            rel = os.path.relpath(path, WEB_DIR).replace(os.sep, "/")
+            assets.append({
+                "uri": "/" + rel,
+                "type": CONTENT_TYPES[ext],
+                "symbol": symbol(rel),
+                "raw": len(raw),
+                "data": packed,
+                "hash": hashlib.sha256(packed).hexdigest()[:16],
+            })
+    assets.sort(key=lambda a: a["uri"])
+
+    header = "#pragma once\n\n" + GENERATED + "\n"
+    header += "// Appended to asset links as ?v=, so a new build is fetched at once\n"
+    for a in assets:
+        header += '#define %s_VERSION "%s"\n' % (a["symbol"], a["hash"][:8])
+    write_if_changed(HEADER_OUT, header)
+
+    source = GENERATED + '\n#include "web_assets.h"\n'
+    for a in assets:
+        source += "\n// %s: %u bytes, %u gzipped\n" % (a["uri"], a["raw"], len(a["data"]))
+        source += "static const uint8_t %s_GZ[] PROGMEM = {" % a["symbol"]
+        for i, b in enumerate(a["data"]):
+            source += ("\n  " if i % 16 == 0 else " ") + "0x%02x," % b
+        source += "\n};\n"
+    source += "\nconst WebAsset WEB_ASSETS[] = {\n"
+    for a in assets:
+        source += '  { "%s", "%s", %s_GZ, sizeof(%s_GZ), "\\"%s\\"" },\n' % (
+            a["uri"], a["type"], a["symbol"], a["symbol"], a["hash"])
+    source += "};\n\nconst size_t WEB_ASSET_COUNT = %u;\n" % len(assets)
+    write_if_changed(SOURCE_OUT, source)
+
+    print("Web assets (web/ -> src/web_assets_gen.cpp):")
+    total_raw = total_gz = 0
+    for a in assets:
+        size = len(a["data"])
+        total_raw += a["raw"]
+        total_gz += size
+        print("  %-24s %7u B  gzip %7u B  (%u%%)" % (a["uri"], a["raw"], size, size * 100 // max(a["raw"], 1)))
+    print("  %-24s %7u B  gzip %7u B  in flash" % ("total", total_raw, total_gz))
+
+
+main()
@@ -0,0 +1,123 @@
+#include "boot.h"
+
+#include <Logger.h>
+#include <Preferences.h>
+#include <nvs_flash.h>
+
+#define BOOT_NAMESPACE "system"
+
+typedef bool (*NvsMigration)();
+
+// Schema 0 is every release before versioning. It erased NVS on each boot,
+// so whatever is stored was written by the running firmware in the current
+// layout and carries over unchanged.
+static bool migrateFrom0() {
+  return true;
+}
+
+// migrations[n] upgrades schema n to n + 1
+static const NvsMigration migrations[NVS_SCHEMA_VERSION] = {
+  migrateFrom0,
+};
+
+static BootStats stats = {NVS_KEPT, 0, 0, 0, 0};
+
+static bool eraseNvs() {
+  LOG_INFO("NVS: erasing");
+  return nvs_flash_erase() == ESP_OK && nvs_flash_init() == ESP_OK;
+}
+
+static uint32_t readSchema() {
+  Preferences prefs;
+  // Read-only open fails when the namespace does not exist yet
+  if (!prefs.begin(BOOT_NAMESPACE, true)) {
+    return 0;
+  }
+  uint32_t version = prefs.getUInt("schema", 0);
+  stats.lastApReadyMs = prefs.getUInt("ready_ms", 0);
+  prefs.end();
+  return version;
+}
+
+static void writeSchema() {
+  Preferences prefs;
+  prefs.begin(BOOT_NAMESPACE, false);
+  prefs.putUInt("schema", NVS_SCHEMA_VERSION);
+  prefs.end();
+}
+
+NvsBootAction bootPrepareNvs() {
+  uint32_t start = millis();
+  stats.nvs = NVS_KEPT;
+
+  esp_err_t err = nvs_flash_init();
+  if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+    // A full partition or one written by a newer IDF cannot be opened
+    LOG_WARN("NVS: init failed (%s)", esp_err_to_name(err));
+    eraseNvs();
+    stats.nvs = NVS_ERASED;
+  }
+
+  stats.schemaFound = readSchema();
+  if (stats.schemaFound > NVS_SCHEMA_VERSION) {
+    // Written by newer firmware; its layout is unknown here
+    LOG_WARN("NVS: schema %u is newer than %u", (unsigned)stats.schemaFound, NVS_SCHEMA_VERSION);
+    eraseNvs();
+    stats.nvs = NVS_ERASED;
+  } else {
+    for (uint32_t v = stats.schemaFound; v < NVS_SCHEMA_VERSION; v++) {
+      if (!migrations[v]()) {
+        LOG_ERROR("NVS: migration from schema %u failed", (unsigned)v);
+        eraseNvs();
+        stats.nvs = NVS_ERASED;
+        break;
+      }
+      if (stats.nvs == NVS_KEPT) {
+        stats.nvs = NVS_MIGRATED;
+      }
+    }
+  }
+  if (stats.nvs != NVS_KEPT) {
+    writeSchema();
+  }
+
+  stats.nvsMs = millis() - start;
+  LOG_INFO("NVS: %s, schema %u -> %u in %u ms", nvsBootActionName(stats.nvs),
+           (unsigned)stats.schemaFound, NVS_SCHEMA_VERSION, (unsigned)stats.nvsMs);
+  return stats.nvs;
+}
+
+void bootMarkApReady() {
+  stats.apReadyMs = millis();
+  LOG_INFO("Boot: AP ready in %u ms (previous boot %u ms)",
+           (unsigned)stats.apReadyMs, (unsigned)stats.lastApReadyMs);
+  Preferences prefs;
+  prefs.begin(BOOT_NAMESPACE, false);
+  prefs.putUInt("ready_ms", stats.apReadyMs);
+  prefs.end();
+}
+
+const BootStats& bootStats() {
+  return stats;
+}
+
+const char* nvsBootActionName(NvsBootAction action) {
+  switch (action) {
+    case NVS_KEPT: return "kept";
+    case NVS_MIGRATED: return "migrated";
+    case NVS_ERASED: return "erased";
+  }
+  return "unknown";
+}
+
+size_t bootStatsJson(const BootStats& s, char* buf, size_t len) {
+  int n = snprintf(buf, len,
+                   "{\"ap_ready_ms\":%u,\"last_ap_ready_ms\":%u,\"nvs_ms\":%u,"
+                   "\"nvs\":\"%s\",\"schema_found\":%u,\"schema\":%u}",
+                   (unsigned)s.apReadyMs, (unsigned)s.lastApReadyMs, (unsigned)s.nvsMs,
+                   nvsBootActionName(s.nvs), (unsigned)s.schemaFound, NVS_SCHEMA_VERSION);
+  if (n < 0) {
+    return 0;
+  }
+  return (size_t)n < len ? (size_t)n : len - 1;
+}
@@ -0,0 +1,221 @@
+#include "config_store.h"
+
+#include <nvs.h>
+#include <stddef.h>
+
+#define CONFIG_JSON_KEY_MAX 16
+#define CONFIG_JSON_VALUE_MAX 160
+
+struct ConfigField {
+  const char* key;
+  size_t offset;
+  size_t size;
+};
+
+static const ConfigField fields[] = {
+  { "wifi_ssid", offsetof(DeviceConfig, wifiSsid), sizeof(DeviceConfig::wifiSsid) },
+  { "wifi_password", offsetof(DeviceConfig, wifiPassword), sizeof(DeviceConfig::wifiPassword) },
+  { "gsm_apn", offsetof(DeviceConfig, gsmApn), sizeof(DeviceConfig::gsmApn) },
+  { "manifest_url", offsetof(DeviceConfig, manifestUrl), sizeof(DeviceConfig::manifestUrl) },
+};
+static const size_t fieldCount = sizeof(fields) / sizeof(fields[0]);
+
+ConfigStore Config;
+
+static int findField(const char* key) {
+  for (size_t i = 0; i < fieldCount; i++) {
+    if (strcmp(fields[i].key, key) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+ConfigStore::ConfigStore() : dirty_(0) {
+  memset(&values_, 0, sizeof(values_));
+}
+
+bool ConfigStore::begin() {
+  memset(&values_, 0, sizeof(values_));
+  dirty_ = 0;
+  nvs_handle_t handle;
+  esp_err_t err = nvs_open(CONFIG_NAMESPACE, NVS_READONLY, &handle);
+  if (err == ESP_ERR_NVS_NOT_FOUND) {
+    // Nothing saved yet
+    return true;
+  }
+  if (err != ESP_OK) {
+    return false;
+  }
+  for (size_t i = 0; i < fieldCount; i++) {
+    size_t len = fields[i].size;
+    char* value = (char*)&values_ + fields[i].offset;
+    if (nvs_get_str(handle, fields[i].key, value, &len) != ESP_OK) {
+      // Missing, or too long for the field: treat as unset
+      value[0] = 0;
+    }
+  }
+  nvs_close(handle);
+  return true;
+}
+
+ConfigResult ConfigStore::check(const char* key, const char* value) const {
+  int index = findField(key);
+  if (index < 0) {
+    return CONFIG_UNKNOWN_KEY;
+  }
+  return strlen(value) < fields[index].size ? CONFIG_OK : CONFIG_TOO_LONG;
+}
+
+ConfigResult ConfigStore::set(const char* key, const char* value) {
+  ConfigResult result = check(key, value);
+  if (result != CONFIG_OK) {
+    return result;
+  }
+  int index = findField(key);
+  char* current = (char*)&values_ + fields[index].offset;
+  if (strcmp(current, value) != 0) {
+    strcpy(current, value);
+    dirty_ |= 1u << index;
+  }
+  return CONFIG_OK;
+}
+
+int ConfigStore::commit() {
+  if (dirty_ == 0) {
+    return 0;
+  }
+  nvs_handle_t handle;
+  if (nvs_open(CONFIG_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+    return -1;
+  }
+  int written = 0;
+  esp_err_t err = ESP_OK;
+  for (size_t i = 0; i < fieldCount && err == ESP_OK; i++) {
+    if (dirty_ & (1u << i)) {
+      err = nvs_set_str(handle, fields[i].key, (const char*)&values_ + fields[i].offset);
+      written++;
+    }
+  }
+  if (err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+  if (err != ESP_OK) {
+    return -1;
+  }
+  dirty_ = 0;
+  return written;
+}
+
+// Only \u escapes below 0x80 are accepted
+const char* jsonParseString(const char* p, char* out, size_t size, bool& overflow) {
+  size_t len = 0;
+  overflow = false;
+  while (*p != '"') {
+    char c = *p++;
+    if (c == 0 || (unsigned char)c < 0x20) {
+      return NULL;
+    }
+    if (c == '\\') {
+      c = *p++;
+      switch (c) {
+        case '"': case '\\': case '/': break;
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'n': c = '\n'; break;
+        case 'r': c = '\r'; break;
+        case 't': c = '\t'; break;
+        case 'u': {
+          char hex[5] = {0};
+          for (int i = 0; i < 4; i++) {
+            if (!isxdigit((unsigned char)p[i])) {
+              return NULL;
+            }
+            hex[i] = p[i];
+          }
+          long code = strtol(hex, NULL, 16);
+          if (code == 0 || code >= 0x80) {
+            return NULL;
+          }
+          c = (char)code;
+          p += 4;
+          break;
+        }
+        default:
+          return NULL;
+      }
+    }
+    if (len + 1 >= size) {
+      overflow = true;
+      return NULL;
+    }
+    out[len++] = c;
+  }
+  out[len] = 0;
+  return p + 1;
+}
+
+const char* jsonSkipSpace(const char* p) {
+  while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+    p++;
+  }
+  return p;
+}
+
+ConfigResult configParseJson(const char* json, ConfigVisitor visit) {
+  char key[CONFIG_JSON_KEY_MAX];
+  char value[CONFIG_JSON_VALUE_MAX];
+  bool overflow;
+  const char* p = jsonSkipSpace(json);
+  if (*p++ != '{') {
+    return CONFIG_BAD_REQUEST;
+  }
+  p = jsonSkipSpace(p);
+  if (*p == '}') {
+    return *jsonSkipSpace(p + 1) == 0 ? CONFIG_OK : CONFIG_BAD_REQUEST;
+  }
+  for (;;) {
+    if (*p++ != '"') {
+      return CONFIG_BAD_REQUEST;
+    }
+    // A key that does not fit cannot name a setting
+    if ((p = jsonParseString(p, key, sizeof(key), overflow)) == NULL) {
+      return overflow ? CONFIG_UNKNOWN_KEY : CONFIG_BAD_REQUEST;
+    }
+    p = jsonSkipSpace(p);
+    if (*p++ != ':') {
+      return CONFIG_BAD_REQUEST;
+    }
+    p = jsonSkipSpace(p);
+    if (*p++ != '"') {
+      return CONFIG_BAD_REQUEST;
+    }
+    if ((p = jsonParseString(p, value, sizeof(value), overflow)) == NULL) {
+      return overflow ? CONFIG_TOO_LONG : CONFIG_BAD_REQUEST;
+    }
+    ConfigResult result = visit(key, value);
+    if (result != CONFIG_OK) {
+      return result;
+    }
+    p = jsonSkipSpace(p);
+    if (*p == '}') {
+      return *jsonSkipSpace(p + 1) == 0 ? CONFIG_OK : CONFIG_BAD_REQUEST;
+    }
+    if (*p++ != ',') {
+      return CONFIG_BAD_REQUEST;
+    }
+    p = jsonSkipSpace(p);
+  }
+}
+
+const char* configResultName(ConfigResult result) {
+  switch (result) {
+    case CONFIG_OK: return "ok";
+    case CONFIG_UNKNOWN_KEY: return "unknown_key";
+    case CONFIG_TOO_LONG: return "too_long";
+    case CONFIG_BAD_REQUEST: return "bad_request";
+    case CONFIG_STORAGE_ERROR: return "storage_error";
+  }
+  return "unknown";
+}
@@ -0,0 +1,220 @@
+#include "metrics.h"
+
+#include <stdarg.h>
+#include <LinkManager.h>
+#include <TlsSessionCache.h>
+
+#include "ota.h"
+#include "portal_server.h"
+#include "power.h"
+
+static const uint32_t LATENCY_BOUNDS_US[METRICS_LATENCY_BUCKETS] = {
+  500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 1000000
+};
+// The same bounds as "le" labels, in seconds
+static const char* const LATENCY_LABELS[METRICS_LATENCY_BUCKETS + 1] = {
+  "0.0005", "0.001", "0.0025", "0.005", "0.01", "0.025", "0.05", "0.1", "0.25", "1", "+Inf"
+};
+
+void LatencyHistogram::record(uint32_t us) {
+  size_t i = 0;
+  while (i < METRICS_LATENCY_BUCKETS && us > LATENCY_BOUNDS_US[i]) {
+    i++;
+  }
+  buckets[i]++;
+  count++;
+  sumUs += us;
+}
+
+static const char* methodName(HTTPMethod method) {
+  switch (method) {
+    case HTTP_GET: return "GET";
+    case HTTP_HEAD: return "HEAD";
+    case HTTP_POST: return "POST";
+    case HTTP_PUT: return "PUT";
+    case HTTP_PATCH: return "PATCH";
+    case HTTP_DELETE: return "DELETE";
+    case HTTP_OPTIONS: return "OPTIONS";
+    default: return "ANY";
+  }
+}
+
+// Gathers lines into one buffer and sends it as a chunk when it fills, so
+// the page costs a few socket writes and no heap
+class MetricsWriter {
+ public:
+  explicit MetricsWriter(PortalServer& server) : server_(server), used_(0) {}
+
+  void line(const char* fmt, ...) {
+    for (int tries = 0; tries < 2; tries++) {
+      va_list args;
+      va_start(args, fmt);
+      int n = vsnprintf(buf_ + used_, sizeof(buf_) - used_, fmt, args);
+      va_end(args);
+      if (n >= 0 && (size_t)n < sizeof(buf_) - used_) {
+        used_ += n;
+        return;
+      }
+      flush();
+    }
+  }
+
+  void flush() {
+    if (used_ > 0) {
+      server_.sendContent(buf_, used_);
+      used_ = 0;
+    }
+  }
+
+ private:
+  PortalServer& server_;
+  char buf_[1024];
+  size_t used_;
+};
+
+static void writeLatency(MetricsWriter& out, const char* labels, const RouteMetrics& m) {
+  uint32_t cumulative = 0;
+  for (size_t b = 0; b <= METRICS_LATENCY_BUCKETS; b++) {
+    cumulative += m.latency.buckets[b];
+    out.line("portal_request_duration_seconds_bucket{%s,le=\"%s\"} %u\n", labels,
+             LATENCY_LABELS[b], (unsigned)cumulative);
+  }
+  out.line("portal_request_duration_seconds_sum{%s} %u.%06u\n", labels,
+           (unsigned)(m.latency.sumUs / 1000000), (unsigned)(m.latency.sumUs % 1000000));
+  out.line("portal_request_duration_seconds_count{%s} %u\n", labels, (unsigned)m.latency.count);
+}
+
+static void writeBytes(MetricsWriter& out, const char* labels, const RouteMetrics& m) {
+  out.line("portal_response_bytes_total{%s} %llu\n", labels, (unsigned long long)m.responseBytes);
+}
+
+static void writeErrors(MetricsWriter& out, const char* labels, const RouteMetrics& m) {
+  out.line("portal_request_errors_total{%s} %u\n", labels, (unsigned)m.errors);
+}
+
+// Writes one metric family for every route; a family's lines must not be
+// interleaved with another's
+static void writeRoutes(MetricsWriter& out, PortalServer& server, const char* type,
+                        void (*write)(MetricsWriter&, const char*, const RouteMetrics&)) {
+  out.line("%s", type);
+  char labels[96];
+  for (size_t i = 0; i < server.routeCount(); i++) {
+    snprintf(labels, sizeof(labels), "route=\"%s\",method=\"%s\"", server.routeUri(i).c_str(),
+             methodName(server.routeMethod(i)));
+    write(out, labels, server.routeMetrics(i));
+  }
+  write(out, "route=\"unmatched\",method=\"ANY\"", server.unmatchedMetrics());
+}
+
+static void writeSeconds(MetricsWriter& out, const char* name, const char* labels, uint32_t ms) {
+  out.line("%s%s%s%s %u.%03u\n", name, labels[0] ? "{" : "", labels, labels[0] ? "}" : "",
+           (unsigned)(ms / 1000), (unsigned)(ms % 1000));
+}
+
+void sendMetrics(PortalServer& server) {
+  server.sendHeader("Cache-Control", "no-store");
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain; version=0.0.4");
+  MetricsWriter out(server);
+
+  // The request for this page is still running, so it is counted from the
+  // next scrape on
+  writeRoutes(out, server, "# TYPE portal_request_duration_seconds histogram\n", writeLatency);
+  writeRoutes(out, server, "# TYPE portal_response_bytes_total counter\n", writeBytes);
+  writeRoutes(out, server, "# TYPE portal_request_errors_total counter\n", writeErrors);
+
+  out.line("# TYPE esp_heap_free_bytes gauge\nesp_heap_free_bytes %u\n"
+           "# TYPE esp_heap_min_free_bytes gauge\nesp_heap_min_free_bytes %u\n"
+           "# TYPE esp_heap_largest_free_block_bytes gauge\nesp_heap_largest_free_block_bytes %u\n"
+           "# TYPE esp_uptime_seconds counter\nesp_uptime_seconds %u\n",
+           (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getMinFreeHeap(),
+           (unsigned)ESP.getMaxAllocHeap(), (unsigned)(millis() / 1000));
+
+  // Last OTA job; the phases stay 0 until the job reaches them
+  OtaStatus ota;
+  otaGetStatus(ota);
+  out.line("# TYPE ota_job_id gauge\nota_job_id %u\n"
+           "# TYPE ota_state gauge\nota_state{state=\"%s\"} 1\n"
+           "# TYPE ota_written_bytes gauge\nota_written_bytes %u\n"
+           "# TYPE ota_total_bytes gauge\nota_total_bytes %u\n"
+           "# TYPE ota_download_bytes_per_second gauge\nota_download_bytes_per_second %u\n"
+           "# TYPE ota_verified gauge\nota_verified %u\n"
+           "# TYPE ota_phase_seconds gauge\n",
+           (unsigned)ota.jobId, otaStateName(ota.state), (unsigned)ota.written,
+           (unsigned)ota.total, (unsigned)ota.bytesPerSec, ota.verified ? 1u : 0u);
+  writeSeconds(out, "ota_phase_seconds", "phase=\"wifi\"", ota.wifiMs);
+  writeSeconds(out, "ota_phase_seconds", "phase=\"link\"", ota.linkMs);
+  writeSeconds(out, "ota_phase_seconds", "phase=\"manifest\"", ota.manifestMs);
+  writeSeconds(out, "ota_phase_seconds", "phase=\"tls_handshake\"", ota.tlsHandshakeMs);
+  writeSeconds(out, "ota_phase_seconds", "phase=\"download\"", ota.downloadMs);
+  writeSeconds(out, "ota_phase_seconds", "phase=\"finish\"", ota.finishMs);
+  writeSeconds(out, "ota_phase_seconds", "phase=\"total\"", ota.elapsedMs);
+
+  // Every handshake made through TlsClient, OTA and MQTT alike
+  TlsHandshakeStats tls = TlsSessions.stats();
+  out.line("# TYPE tls_handshake_seconds summary\n");
+  out.line("tls_handshake_seconds_count{resumed=\"false\"} %u\n", (unsigned)tls.full);
+  writeSeconds(out, "tls_handshake_seconds_sum", "resumed=\"false\"", tls.fullMsTotal);
+  out.line("tls_handshake_seconds_count{resumed=\"true\"} %u\n", (unsigned)tls.resumed);
+  writeSeconds(out, "tls_handshake_seconds_sum", "resumed=\"true\"", tls.resumedMsTotal);
+  out.line("# TYPE tls_handshake_last_seconds gauge\n");
+  writeSeconds(out, "tls_handshake_last_seconds", "", tls.lastMs);
+
+  // Link in use, what it measured and the tuning transfers get from it
+  LinkStats link = Link.stats();
+  LinkTuning tuning = Link.tuning();
+  out.line("# TYPE link_active gauge\nlink_active{link=\"%s\"} 1\n"
+           "# TYPE link_switches_total counter\nlink_switches_total %u\n"
+           "# TYPE link_failovers_total counter\nlink_failovers_total %u\n"
+           "# TYPE link_chunk_bytes gauge\nlink_chunk_bytes %u\n"
+           "# TYPE link_in_flight gauge\nlink_in_flight %u\n"
+           "# TYPE link_timeout_seconds gauge\n",
+           linkTypeName(link.active), (unsigned)link.switches, (unsigned)link.failovers,
+           (unsigned)tuning.chunkBytes, (unsigned)tuning.inFlight);
+  writeSeconds(out, "link_timeout_seconds", "", tuning.timeoutMs);
+  out.line("# TYPE link_rtt_seconds gauge\n");
+  for (int type = LINK_WIFI; type < LINK_TYPES; type++) {
+    char labels[24];
+    snprintf(labels, sizeof(labels), "link=\"%s\"", linkTypeName((LinkType)type));
+    writeSeconds(out, "link_rtt_seconds", labels, Link.estimate((LinkType)type).rttMs);
+  }
+  out.line("# TYPE link_throughput_bytes_per_second gauge\n");
+  for (int type = LINK_WIFI; type < LINK_TYPES; type++) {
+    out.line("link_throughput_bytes_per_second{link=\"%s\"} %u\n", linkTypeName((LinkType)type),
+             (unsigned)Link.estimate((LinkType)type).bytesPerSec);
+  }
+  CellularStats cell = Link.cellularStats();
+  out.line("# TYPE cellular_dials_total counter\ncellular_dials_total %u\n"
+           "# TYPE cellular_connects_total counter\ncellular_connects_total %u\n"
+           "# TYPE cellular_dial_failures_total counter\ncellular_dial_failures_total %u\n"
+           "# TYPE cellular_at_retries_total counter\ncellular_at_retries_total %u\n"
+           "# TYPE cellular_signal_quality gauge\ncellular_signal_quality %d\n"
+           "# TYPE cellular_uart_bytes_total counter\n"
+           "cellular_uart_bytes_total{direction=\"rx\"} %u\n"
+           "cellular_uart_bytes_total{direction=\"tx\"} %u\n"
+           "# TYPE cellular_dial_seconds gauge\n",
+           (unsigned)cell.dials, (unsigned)cell.connects, (unsigned)cell.failures,
+           (unsigned)cell.atRetries, cell.signal, (unsigned)cell.rxBytes, (unsigned)cell.txBytes);
+  writeSeconds(out, "cellular_dial_seconds", "", cell.lastDialMs);
+
+  // Idle current proxy: time at each clock, and how fast a wake answers
+  PowerStats power = Power.stats();
+  out.line("# TYPE power_state_seconds_total counter\n");
+  for (size_t i = 0; i < POWER_STATES; i++) {
+    char labels[24];
+    snprintf(labels, sizeof(labels), "state=\"%s\"", powerStateName((PowerState)i));
+    writeSeconds(out, "power_state_seconds_total", labels, power.stateMs[i]);
+  }
+  out.line("# TYPE power_cpu_mhz gauge\npower_cpu_mhz %u\n"
+           "# TYPE power_wakes_total counter\npower_wakes_total %u\n"
+           "# TYPE power_wake_seconds gauge\npower_wake_seconds %u.%06u\n"
+           "# TYPE power_wake_first_request_seconds gauge\n"
+           "power_wake_first_request_seconds{stat=\"last\"} %u.%06u\n"
+           "power_wake_first_request_seconds{stat=\"max\"} %u.%06u\n",
+           (unsigned)power.cpuMhz, (unsigned)power.wakes,
+           (unsigned)(power.lastWakeUs / 1000000), (unsigned)(power.lastWakeUs % 1000000),
+           (unsigned)(power.lastFirstRequestUs / 1000000), (unsigned)(power.lastFirstRequestUs % 1000000),
+           (unsigned)(power.maxFirstRequestUs / 1000000), (unsigned)(power.maxFirstRequestUs % 1000000));
+
+  out.flush();
+}
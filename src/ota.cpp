@@ -0,0 +1,857 @@
+#include "ota.h"
+
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include <Preferences.h>
+#include <ConnectionManager.h>
+#include <LinkManager.h>
+#include <CredentialCache.h>
+#include <FileStorage.h>
+#include <Logger.h>
+#include <TlsClient.h>
+
+#include <esp_ota_ops.h>
+
+#include "ota_flash.h"
+#include "ota_inflate.h"
+#include "ota_manifest.h"
+
+#ifndef ARDUINO_RUNNING_CORE
+#define ARDUINO_RUNNING_CORE 1
+#endif
+
+#define OTA_TASK_STACK 12288
+#define OTA_TASK_PRIORITY 1
+#define OTA_TASK_CORE (ARDUINO_RUNNING_CORE == 0 ? 1 : 0)
+
+struct OtaJob {
+  String url;
+  String ssid;
+  String password;
+  String apn;          // cellular fallback; empty for WiFi only
+  String manifestUrl;  // set for manifest jobs
+  String entryId;      // image to install; empty for a check only
+  size_t size;         // expected download size, 0 if unknown
+  bool verify;         // sha256 holds the expected digest of the download
+  uint8_t sha256[32];
+};
+
+static OtaJob job;
+static OtaStatus status = { 0, OTA_IDLE, 0, 0, 0, 0, false, 0, 0, 0, false, false, 0, false,
+                            LINK_NONE, 0, 0, 0, 0, "" };
+static portMUX_TYPE statusMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t nextJobId = 1;
+static uint32_t jobStartMs = 0;
+static uint32_t downloadStartMs = 0;
+static size_t downloadStartBytes = 0;
+static OtaManifest jobManifest;
+static bool manifestChanged = false;
+
+static void setState(OtaState state, const char* message) {
+  portENTER_CRITICAL(&statusMux);
+  status.state = state;
+  strncpy(status.message, message, sizeof(status.message) - 1);
+  status.message[sizeof(status.message) - 1] = '\0';
+  portEXIT_CRITICAL(&statusMux);
+}
+
+static void setProgress(size_t written, size_t total, size_t imageBytes) {
+  uint32_t elapsed = millis() - downloadStartMs;
+  portENTER_CRITICAL(&statusMux);
+  status.written = written;
+  status.total = total;
+  status.imageBytes = imageBytes;
+  status.bytesPerSec = elapsed > 0 ? (uint32_t)((uint64_t)(written - downloadStartBytes) * 1000 / elapsed) : 0;
+  portEXIT_CRITICAL(&statusMux);
+}
+
+static void fail(const char* message) {
+  LOG_ERROR("OTA: %s", message);
+  setState(OTA_FAILED, message);
+}
+
+#define OTA_WIFI_TIMEOUT_MS 30000
+#define OTA_CELLULAR_TIMEOUT_MS 90000  // failover delay, registration and dial
+
+// Brings up a link through the shared link manager: WiFi, which reuses the
+// last association when it can, or the modem when WiFi stays down
+static bool connectLink() {
+  Link.begin(job.ssid.c_str(), job.password.c_str(), job.apn.c_str());
+  bool wasUp = Link.connected();
+  uint32_t start = millis();
+  bool up = Link.waitConnected(job.apn.length() > 0 ? OTA_CELLULAR_TIMEOUT_MS : OTA_WIFI_TIMEOUT_MS);
+  if (up && !wasUp) {
+    uint32_t elapsed = millis() - start;
+    WiFiConnectStats wifi = Connection.stats();
+    portENTER_CRITICAL(&statusMux);
+    status.linkMs = elapsed;
+    if (Link.active() == LINK_WIFI) {
+      status.wifiMs = wifi.lastMs;
+      status.wifiFast = wifi.lastFast;
+    }
+    portEXIT_CRITICAL(&statusMux);
+  }
+  portENTER_CRITICAL(&statusMux);
+  status.link = Link.active();
+  portEXIT_CRITICAL(&statusMux);
+  if (Link.active() == LINK_WIFI) {
+    LOG_DEBUG("WiFi status: %d", WiFi.status());
+    LOG_DEBUG("WiFi RSSI: %d dBm", WiFi.RSSI());
+  }
+  return up;
+}
+
+static void configureTls(TlsClient& net) {
+  // Client certificate and key come from the credential cache loaded at boot
+  if (Credentials.apply(net)) {
+    LOG_DEBUG("Using device certificate (%u bytes) and private key for SSL authentication",
+              (unsigned)Credentials.certificateLength());
+  } else {
+    LOG_WARN("Using insecure connection (certificate files not found)");
+  }
+  // Temporary: bypass server certificate validation for testing
+  net.setInsecure();
+}
+
+// Resume record kept in NVS while a download is in progress. The offset only
+// ever points at a sector boundary that is fully written to flash. Compressed
+// images resume within a job, where the inflater state is still in RAM, but
+// start over after a reboot.
+#define OTA_CHECKPOINT_BYTES (64 * 1024)
+#define OTA_MAX_ATTEMPTS 5
+#define OTA_RETRY_DELAY_MS 2000
+
+struct OtaResume {
+  String url;
+  String etag;
+  size_t total;
+  size_t offset;
+  uint32_t partition;
+  bool compressed;
+  bool verify;  // the expected digest survives a reboot with the offset
+  uint8_t sha256[32];
+};
+
+static Preferences otaPrefs;
+
+static bool loadResume(OtaResume& r) {
+  otaPrefs.begin("ota", true);
+  r.url = otaPrefs.getString("url", "");
+  r.etag = otaPrefs.getString("etag", "");
+  r.total = otaPrefs.getUInt("total", 0);
+  r.offset = otaPrefs.getUInt("offset", 0);
+  r.partition = otaPrefs.getUInt("part", 0);
+  r.compressed = otaPrefs.getBool("gz", false);
+  r.verify = otaPrefs.getBytes("sha", r.sha256, sizeof(r.sha256)) == sizeof(r.sha256);
+  otaPrefs.end();
+  if (r.compressed) {
+    r.offset = 0;
+  }
+  return r.url.length() > 0 && r.total > 0;
+}
+
+static void saveResume(const OtaResume& r) {
+  otaPrefs.begin("ota", false);
+  otaPrefs.putString("url", r.url);
+  otaPrefs.putString("etag", r.etag);
+  otaPrefs.putUInt("total", r.total);
+  otaPrefs.putUInt("offset", r.offset);
+  otaPrefs.putUInt("part", r.partition);
+  otaPrefs.putBool("gz", r.compressed);
+  if (r.verify) {
+    otaPrefs.putBytes("sha", r.sha256, sizeof(r.sha256));
+  } else {
+    otaPrefs.remove("sha");
+  }
+  otaPrefs.end();
+}
+
+static void saveResumeCompressed() {
+  otaPrefs.begin("ota", false);
+  otaPrefs.putBool("gz", true);
+  otaPrefs.end();
+}
+
+static void saveResumeOffset(size_t offset) {
+  otaPrefs.begin("ota", false);
+  otaPrefs.putUInt("offset", offset - offset % OTA_SECTOR_SIZE);
+  otaPrefs.end();
+}
+
+static void clearResume() {
+  otaPrefs.begin("ota", false);
+  otaPrefs.clear();
+  otaPrefs.end();
+}
+
+// Download pipeline: the OTA task reads the socket into a ring of buffers
+// while a writer task drains them into flash, so TLS decryption and flash
+// erase/write overlap instead of taking turns. The link's tuning sizes the
+// ring: buffers of about a bandwidth-delay product, up to a sector, and
+// enough of them to cover a round trip and a flash erase.
+#define OTA_BUFFER_COUNT LINK_IN_FLIGHT_MAX
+#define OTA_WRITER_STACK 4096
+#define OTA_WRITER_PRIORITY 2
+#define OTA_RATE_WINDOW (16 * 1024)  // bytes per throughput sample
+
+struct OtaChunk {
+  uint8_t index;
+  uint16_t len;  // 0 marks the end of the stream
+};
+
+struct OtaPipeline {
+  uint8_t* buffers[OTA_BUFFER_COUNT];
+  uint8_t count;
+  size_t bufferSize;
+  uint32_t timeoutMs;           // longest wait for the socket or a free buffer
+  QueueHandle_t freeQueue;
+  QueueHandle_t fullQueue;
+  SemaphoreHandle_t writerDone;
+  size_t total;
+  size_t checkpoint;
+  volatile size_t consumed;  // download bytes handed to flash or the inflater
+  volatile bool writeFailed;
+};
+
+static OtaPipeline pipeline;
+static OtaFlashWriter flash;
+static OtaInflater inflater;
+static OtaDigest digest;
+static bool compressedImage = false;
+static const char* writeError = "";
+
+static bool flashSink(const uint8_t* data, size_t len) {
+  return flash.write(data, len);
+}
+
+// Routes one downloaded buffer to flash, through the inflater when the image
+// turned out to be gzip-compressed (detected from its magic bytes).
+static bool writeChunk(const uint8_t* data, size_t len) {
+  if (pipeline.consumed == 0) {
+    compressedImage = OtaInflater::isGzip(data, len);
+    if (compressedImage) {
+      LOG_INFO("OTA: Compressed image, decompressing into flash");
+      saveResumeCompressed();
+      // The image size is only known once the stream ends
+      if (!inflater.begin(flashSink) || !flash.begin(0, 0)) {
+        writeError = inflater.lastError()[0] ? inflater.lastError() : flash.lastError();
+        return false;
+      }
+    }
+  }
+  if (compressedImage) {
+    if (!inflater.write(data, len)) {
+      writeError = flash.lastError()[0] ? flash.lastError() : inflater.lastError();
+      return false;
+    }
+    return true;
+  }
+  if (!flash.write(data, len)) {
+    writeError = flash.lastError();
+    return false;
+  }
+  return true;
+}
+
+static void writerTask(void* arg) {
+  OtaChunk chunk;
+  while (xQueueReceive(pipeline.fullQueue, &chunk, portMAX_DELAY) == pdTRUE && chunk.len > 0) {
+    if (!pipeline.writeFailed) {
+      if (writeChunk(pipeline.buffers[chunk.index], chunk.len)) {
+        digest.update(pipeline.buffers[chunk.index], chunk.len);
+        pipeline.consumed += chunk.len;
+        setProgress(pipeline.consumed, pipeline.total, flash.offset());
+        if (!compressedImage && pipeline.consumed - pipeline.checkpoint >= OTA_CHECKPOINT_BYTES) {
+          saveResumeOffset(pipeline.consumed);
+          pipeline.checkpoint = pipeline.consumed;
+        }
+      } else {
+        pipeline.writeFailed = true;
+      }
+    }
+    xQueueSend(pipeline.freeQueue, &chunk.index, portMAX_DELAY);
+  }
+  xSemaphoreGive(pipeline.writerDone);
+  vTaskDelete(NULL);
+}
+
+static void pipelineEnd() {
+  for (int i = 0; i < OTA_BUFFER_COUNT; i++) {
+    free(pipeline.buffers[i]);
+    pipeline.buffers[i] = NULL;
+  }
+  if (pipeline.freeQueue) vQueueDelete(pipeline.freeQueue);
+  if (pipeline.fullQueue) vQueueDelete(pipeline.fullQueue);
+  if (pipeline.writerDone) vSemaphoreDelete(pipeline.writerDone);
+  pipeline.freeQueue = NULL;
+  pipeline.fullQueue = NULL;
+  pipeline.writerDone = NULL;
+}
+
+static bool pipelineBegin(size_t total, size_t offset, const LinkTuning& tuning) {
+  memset(&pipeline, 0, sizeof(pipeline));
+  pipeline.total = total;
+  pipeline.consumed = offset;
+  pipeline.checkpoint = offset;
+  pipeline.count = tuning.inFlight;
+  pipeline.bufferSize = tuning.chunkBytes;
+  pipeline.timeoutMs = tuning.timeoutMs;
+  pipeline.freeQueue = xQueueCreate(pipeline.count, sizeof(uint8_t));
+  pipeline.fullQueue = xQueueCreate(pipeline.count + 1, sizeof(OtaChunk));
+  pipeline.writerDone = xSemaphoreCreateBinary();
+  if (!pipeline.freeQueue || !pipeline.fullQueue || !pipeline.writerDone) {
+    pipelineEnd();
+    return false;
+  }
+  for (uint8_t i = 0; i < pipeline.count; i++) {
+    pipeline.buffers[i] = (uint8_t*)malloc(pipeline.bufferSize);
+    if (pipeline.buffers[i] == NULL) {
+      pipelineEnd();
+      return false;
+    }
+    xQueueSend(pipeline.freeQueue, &i, 0);
+  }
+  if (xTaskCreatePinnedToCore(writerTask, "ota_writer", OTA_WRITER_STACK, NULL,
+                              OTA_WRITER_PRIORITY, NULL, tskNO_AFFINITY) != pdPASS) {
+    pipelineEnd();
+    return false;
+  }
+  return true;
+}
+
+// Fills free buffers from the socket and hands them to the writer until
+// `total` bytes arrived, the stream ends or stalls, or the writer reports an
+// error. Returns the number of bytes received; by then the writer has drained
+// every queued buffer.
+//
+// Throughput samples for the link count only time spent filling buffers,
+// so a slow flash does not read as a slow network.
+static size_t pumpStream(HTTPClient& http, WiFiClient* stream, size_t total) {
+  size_t received = 0;
+  uint32_t lastData = millis();
+  size_t windowBytes = 0;
+  uint32_t windowMs = 0;
+  while (received < total && !pipeline.writeFailed) {
+    uint8_t index;
+    if (xQueueReceive(pipeline.freeQueue, &index, pdMS_TO_TICKS(pipeline.timeoutMs)) != pdTRUE) {
+      break;
+    }
+    uint8_t* buf = pipeline.buffers[index];
+    size_t want = total - received < pipeline.bufferSize ? total - received : pipeline.bufferSize;
+    size_t fill = 0;
+    uint32_t fillStart = millis();
+    while (fill < want && !pipeline.writeFailed) {
+      if (stream->available() > 0) {
+        int n = stream->read(buf + fill, want - fill);
+        if (n > 0) {
+          fill += n;
+          lastData = millis();
+          continue;
+        }
+      }
+      if (!http.connected() || millis() - lastData > pipeline.timeoutMs) {
+        break;
+      }
+      vTaskDelay(1);
+    }
+    windowBytes += fill;
+    windowMs += millis() - fillStart;
+    if (windowBytes >= OTA_RATE_WINDOW) {
+      Link.sampleTransfer(windowBytes, windowMs);
+      windowBytes = 0;
+      windowMs = 0;
+    }
+    if (fill == 0) {
+      xQueueSend(pipeline.freeQueue, &index, 0);
+      break;
+    }
+    OtaChunk chunk = { index, (uint16_t)fill };
+    xQueueSend(pipeline.fullQueue, &chunk, portMAX_DELAY);
+    received += fill;
+    if (fill < want) {
+      break;
+    }
+  }
+  OtaChunk end = { 0, 0 };
+  xQueueSend(pipeline.fullQueue, &end, portMAX_DELAY);
+  xSemaphoreTake(pipeline.writerDone, portMAX_DELAY);
+  return received;
+}
+
+// Total image size from a "Content-Range: bytes first-last/total" header
+static size_t contentRangeTotal(const String& header) {
+  int slash = header.lastIndexOf('/');
+  if (slash < 0) {
+    return 0;
+  }
+  return (size_t)header.substring(slash + 1).toInt();
+}
+
+enum AttemptResult {
+  ATTEMPT_COMPLETE,
+  ATTEMPT_RETRY,
+  ATTEMPT_FATAL
+};
+
+// Keeps the current state but records why the last attempt stopped
+static void note(const char* message) {
+  LOG_INFO("OTA: %s", message);
+  portENTER_CRITICAL(&statusMux);
+  strncpy(status.message, message, sizeof(status.message) - 1);
+  status.message[sizeof(status.message) - 1] = '\0';
+  portEXIT_CRITICAL(&statusMux);
+}
+
+// One HTTP request for the rest of the image, starting at resume.offset. A
+// server that ignores the Range or reports a different image restarts the
+// download from zero.
+static AttemptResult downloadFrom(TlsClient& net, OtaResume& resume) {
+  const char* headerKeys[] = { "ETag", "Content-Range" };
+  LinkTuning tuning = Link.tuning();
+  HTTPClient http;
+  http.setConnectTimeout(tuning.timeoutMs);
+  http.setTimeout(tuning.timeoutMs);
+  http.begin(net, job.url);
+  http.collectHeaders(headerKeys, 2);
+  if (resume.offset > 0) {
+    char range[32];
+    snprintf(range, sizeof(range), "bytes=%u-", (unsigned)resume.offset);
+    http.addHeader("Range", range);
+    if (resume.etag.length() > 0) {
+      http.addHeader("If-Range", resume.etag);
+    }
+  }
+
+  LOG_INFO("Attempting to connect to: %s (from byte %u)", job.url.c_str(), (unsigned)resume.offset);
+  int httpCode = http.GET();
+  if (httpCode > 0) {
+    Link.sampleRtt(net.lastConnectMs());
+  }
+  portENTER_CRITICAL(&statusMux);
+  status.tlsHandshakeMs = net.lastHandshakeMs();
+  status.tlsResumed = net.lastHandshakeResumed();
+  portEXIT_CRITICAL(&statusMux);
+  size_t total = 0;
+  if (httpCode == HTTP_CODE_PARTIAL_CONTENT && resume.offset > 0) {
+    total = contentRangeTotal(http.header("Content-Range"));
+    if (total != resume.total) {
+      http.end();
+      resume.offset = 0;
+      note("Image changed on the server, starting over.");
+      return ATTEMPT_RETRY;
+    }
+  } else if (httpCode == HTTP_CODE_OK) {
+    int size = http.getSize();
+    if (size <= 0) {
+      http.end();
+      fail("Invalid firmware file.");
+      return ATTEMPT_FATAL;
+    }
+    total = (size_t)size;
+    if (job.size > 0 && total != job.size) {
+      http.end();
+      fail("Firmware size does not match the manifest.");
+      return ATTEMPT_FATAL;
+    }
+    if (resume.offset > 0) {
+      LOG_WARN("OTA: Server ignored Range, starting over");
+    }
+    resume.offset = 0;
+  } else {
+    LOG_WARN("OTA HTTP GET failed, code: %d", httpCode);
+    LOG_DEBUG("HTTPClient error: %s", http.errorToString(httpCode).c_str());
+    if (httpCode == HTTP_CODE_RANGE_NOT_SATISFIABLE) {
+      resume.offset = 0;
+    }
+    http.end();
+    note("Failed to download firmware. Check certificate and network.");
+    return ATTEMPT_RETRY;
+  }
+
+  if (resume.offset == 0) {
+    resume.total = total;
+    resume.etag = http.header("ETag");
+    resume.compressed = false;
+    compressedImage = false;
+    inflater.end();
+  }
+  // A compressed image continues into the flash position and inflater state
+  // left by the previous attempt; a raw one repositions the writer.
+  if (!(compressedImage && resume.offset > 0)) {
+    if (!flash.begin(resume.total, resume.offset)) {
+      http.end();
+      fail(flash.lastError());
+      return ATTEMPT_FATAL;
+    }
+  }
+  resume.partition = flash.partitionAddress();
+  saveResume(resume);
+
+  // The digest covers the download as served. A compressed image continues
+  // the one left in RAM along with the inflater; a raw one re-reads the
+  // sectors already in flash.
+  if (resume.offset == 0) {
+    digest.begin();
+  } else if (!compressedImage && !digest.beginFrom(flash.partition(), resume.offset)) {
+    http.end();
+    fail("Flash read failed.");
+    return ATTEMPT_FATAL;
+  }
+
+  downloadStartMs = millis();
+  downloadStartBytes = resume.offset;
+  setProgress(resume.offset, resume.total, flash.offset());
+  setState(OTA_DOWNLOADING, resume.offset > 0 ? "Resuming download..." : "Downloading firmware...");
+  portENTER_CRITICAL(&statusMux);
+  status.resumedFrom = resume.offset;
+  status.compressed = compressedImage;
+  portEXIT_CRITICAL(&statusMux);
+
+  // Sized from the estimate as it stands after the connect
+  if (!pipelineBegin(resume.total, resume.offset, Link.tuning())) {
+    http.end();
+    fail("Not enough memory for update.");
+    return ATTEMPT_FATAL;
+  }
+  pumpStream(http, http.getStreamPtr(), resume.total - resume.offset);
+  http.end();
+  size_t consumed = pipeline.consumed;
+  bool writeFailed = pipeline.writeFailed;
+  pipelineEnd();
+
+  resume.compressed = compressedImage;
+  if (consumed == resume.total || compressedImage) {
+    resume.offset = consumed;
+  } else {
+    resume.offset = consumed - consumed % OTA_SECTOR_SIZE;
+    saveResumeOffset(resume.offset);
+  }
+  if (writeFailed) {
+    fail(writeError);
+    return ATTEMPT_FATAL;
+  }
+  return consumed == resume.total ? ATTEMPT_COMPLETE : ATTEMPT_RETRY;
+}
+
+// Refreshes the manifest with a conditional GET and, for an update, picks
+// the image from it. Returns false when the job ends here.
+static bool useManifest(TlsClient& net) {
+  setState(OTA_CONNECTING, "Checking firmware manifest...");
+  uint32_t start = millis();
+  ManifestResult result = jobManifest.fetch(Storage.fs(), net, job.manifestUrl.c_str(),
+                                            Link.tuning().timeoutMs);
+  if (result != MANIFEST_FETCH_FAILED) {
+    Link.sampleRtt(net.lastConnectMs());
+  }
+  portENTER_CRITICAL(&statusMux);
+  status.manifestMs = millis() - start;
+  portEXIT_CRITICAL(&statusMux);
+  LOG_INFO("OTA: Manifest %s", manifestResultName(result));
+  if (result == MANIFEST_OK) {
+    portENTER_CRITICAL(&statusMux);
+    manifestChanged = true;
+    portEXIT_CRITICAL(&statusMux);
+  } else if (result != MANIFEST_NOT_MODIFIED && result != MANIFEST_STORAGE_ERROR &&
+             !jobManifest.load(Storage.fs())) {
+    fail("Could not get the firmware manifest.");
+    return false;
+  }
+
+  if (job.entryId.length() == 0) {
+    char message[64];
+    if (result == MANIFEST_OK || result == MANIFEST_NOT_MODIFIED) {
+      snprintf(message, sizeof(message), "Manifest %s, %u images offered.",
+               result == MANIFEST_OK ? "updated" : "unchanged", (unsigned)jobManifest.count());
+    } else {
+      snprintf(message, sizeof(message), "Manifest %s, kept %u cached images.",
+               manifestResultName(result), (unsigned)jobManifest.count());
+    }
+    setState(OTA_IDLE, message);
+    return false;
+  }
+  const ManifestEntry* entry = jobManifest.find(job.entryId.c_str());
+  if (entry == NULL) {
+    fail("Firmware is no longer in the manifest.");
+    return false;
+  }
+  if (manifestIsRunning(*entry)) {
+    LOG_INFO("OTA: %s is already running, nothing to download", entry->version);
+    setState(OTA_UP_TO_DATE, "This firmware is already installed.");
+    return false;
+  }
+  LOG_INFO("OTA: Installing %s (%u bytes)", entry->version, (unsigned)entry->size);
+  job.url = entry->url;
+  job.size = entry->size;
+  job.verify = true;
+  memcpy(job.sha256, entry->sha256, sizeof(job.sha256));
+  return true;
+}
+
+// Runs one OTA job to completion. Returns true if the new image is ready to
+// boot; on failure the status already carries the reason.
+static bool runJob() {
+  setState(OTA_CONNECTING, job.ssid.length() > 0 ? "Connecting to WiFi..." : "Dialling cellular...");
+  if (!connectLink()) {
+    fail(job.apn.length() > 0 ? "Failed to connect to WiFi or cellular for OTA."
+                              : "Failed to connect to WiFi for OTA.");
+    return false;
+  }
+  LOG_INFO("OTA: Connected over %s. Starting OTA update...", linkTypeName(Link.active()));
+
+  // Retries resume the TLS session of the previous attempt
+  TlsClient net;
+  configureTls(net);
+
+  if (job.manifestUrl.length() > 0 && !useManifest(net)) {
+    return false;
+  }
+
+  // Continue an earlier download of the same image into the same partition
+  OtaResume resume;
+  const esp_partition_t* target = esp_ota_get_next_update_partition(NULL);
+  if (!loadResume(resume) || resume.url != job.url || target == NULL ||
+      resume.partition != target->address || (job.size > 0 && resume.total != job.size)) {
+    resume.url = job.url;
+    resume.etag = "";
+    resume.total = 0;
+    resume.offset = 0;
+    resume.partition = 0;
+    resume.compressed = false;
+    resume.verify = false;
+  }
+  // A job resumed after a reboot gets its expected digest from the record
+  if (job.verify) {
+    resume.verify = true;
+    memcpy(resume.sha256, job.sha256, sizeof(resume.sha256));
+  } else if (resume.verify) {
+    job.verify = true;
+    memcpy(job.sha256, resume.sha256, sizeof(job.sha256));
+  }
+  compressedImage = false;
+
+  AttemptResult result = ATTEMPT_RETRY;
+  uint32_t phaseStart = millis();
+  for (int attempt = 1; attempt <= OTA_MAX_ATTEMPTS && result == ATTEMPT_RETRY; attempt++) {
+    if (attempt > 1) {
+      LOG_WARN("OTA: Connection lost at %u bytes, retry %d of %d",
+               (unsigned)resume.offset, attempt, OTA_MAX_ATTEMPTS);
+      vTaskDelay(pdMS_TO_TICKS(OTA_RETRY_DELAY_MS * (attempt - 1)));
+      if (!Link.connected() && !connectLink()) {
+        continue;
+      }
+    }
+    result = downloadFrom(net, resume);
+  }
+  portENTER_CRITICAL(&statusMux);
+  status.downloadMs = millis() - phaseStart;
+  portEXIT_CRITICAL(&statusMux);
+  bool inflated = compressedImage && inflater.finished();
+  size_t imageSize = inflater.outputSize();
+  inflater.end();
+  if (result == ATTEMPT_FATAL) {
+    clearResume();
+    return false;
+  }
+  if (result != ATTEMPT_COMPLETE || (compressedImage && !inflated)) {
+    if (compressedImage) {
+      clearResume();
+    }
+    fail("Firmware update failed (incomplete).");
+    return false;
+  }
+
+  phaseStart = millis();
+  uint8_t sha256[32];
+  char hex[65];
+  digest.finish(sha256);
+  for (int i = 0; i < 32; i++) {
+    snprintf(hex + i * 2, 3, "%02x", sha256[i]);
+  }
+  LOG_INFO("OTA: Download SHA-256 %s", hex);
+  if (job.verify) {
+    if (digest.length() != resume.total || memcmp(sha256, job.sha256, sizeof(sha256)) != 0) {
+      clearResume();
+      fail("Firmware checksum mismatch.");
+      return false;
+    }
+    portENTER_CRITICAL(&statusMux);
+    status.verified = true;
+    portEXIT_CRITICAL(&statusMux);
+  }
+
+  bool finished = flash.finish();
+  portENTER_CRITICAL(&statusMux);
+  status.finishMs = millis() - phaseStart;
+  portEXIT_CRITICAL(&statusMux);
+  if (!finished) {
+    clearResume();
+    fail(flash.lastError());
+    return false;
+  }
+  clearResume();
+  // Rate of the final attempt only; earlier attempts ended in a retry
+  uint32_t elapsed = millis() - downloadStartMs;
+  size_t fetched = resume.total - downloadStartBytes;
+  LOG_INFO("OTA: %u of %u bytes in %u ms (%u bytes/s)", (unsigned)fetched, (unsigned)resume.total,
+           elapsed, elapsed > 0 ? (uint32_t)((uint64_t)fetched * 1000 / elapsed) : 0);
+  if (compressedImage) {
+    LOG_INFO("OTA: Image expanded to %u bytes, %u%% less transferred", (unsigned)imageSize,
+             imageSize > 0 ? (unsigned)(100 - (uint64_t)resume.total * 100 / imageSize) : 0);
+  }
+  setState(OTA_SUCCESS, "Update successful! Rebooting...");
+  return true;
+}
+
+static void otaTask(void* arg) {
+  bool ok = runJob();
+  portENTER_CRITICAL(&statusMux);
+  status.elapsedMs = millis() - jobStartMs;
+  portEXIT_CRITICAL(&statusMux);
+  if (ok) {
+    // Leave the portal a moment to report success before rebooting
+    vTaskDelay(pdMS_TO_TICKS(3000));
+    Log.flush(1000);
+    ESP.restart();
+  } else {
+    // Cellular is paid for by the minute; WiFi stays up for the next job
+    Link.hangUp();
+  }
+  vTaskDelete(NULL);
+}
+
+bool otaBusy() {
+  portENTER_CRITICAL(&statusMux);
+  bool busy = status.state == OTA_CONNECTING || status.state == OTA_DOWNLOADING || status.state == OTA_SUCCESS;
+  portEXIT_CRITICAL(&statusMux);
+  return busy;
+}
+
+static uint32_t startJob() {
+  uint32_t id = nextJobId++;
+  jobStartMs = millis();
+  portENTER_CRITICAL(&statusMux);
+  status.jobId = id;
+  status.written = 0;
+  status.total = 0;
+  status.resumedFrom = 0;
+  status.imageBytes = 0;
+  status.compressed = false;
+  status.tlsHandshakeMs = 0;
+  status.tlsResumed = false;
+  status.verified = false;
+  status.wifiMs = 0;
+  status.wifiFast = false;
+  status.link = LINK_NONE;
+  status.linkMs = 0;
+  status.manifestMs = 0;
+  status.downloadMs = 0;
+  status.finishMs = 0;
+  status.elapsedMs = 0;
+  status.bytesPerSec = 0;
+  portEXIT_CRITICAL(&statusMux);
+  setState(OTA_CONNECTING, "Starting...");
+
+  if (xTaskCreatePinnedToCore(otaTask, "ota", OTA_TASK_STACK, NULL, OTA_TASK_PRIORITY,
+                              NULL, OTA_TASK_CORE) != pdPASS) {
+    fail("Could not start OTA task.");
+    return 0;
+  }
+  return id;
+}
+
+uint32_t otaStart(const char* url, const String& ssid, const String& password, const String& apn) {
+  if (otaBusy()) {
+    return 0;
+  }
+  job.url = url;
+  job.ssid = ssid;
+  job.password = password;
+  job.apn = apn;
+  job.manifestUrl = "";
+  job.entryId = "";
+  job.size = 0;
+  job.verify = false;
+  return startJob();
+}
+
+uint32_t otaStartManifest(const char* id, const char* manifestUrl, const String& ssid,
+                          const String& password, const String& apn) {
+  if (otaBusy()) {
+    return 0;
+  }
+  job.url = "";
+  job.ssid = ssid;
+  job.password = password;
+  job.apn = apn;
+  job.manifestUrl = manifestUrl;
+  job.entryId = id;
+  job.size = 0;
+  job.verify = false;
+  return startJob();
+}
+
+uint32_t otaCheckManifest(const char* manifestUrl, const String& ssid, const String& password,
+                          const String& apn) {
+  return otaStartManifest("", manifestUrl, ssid, password, apn);
+}
+
+bool otaManifestChanged() {
+  portENTER_CRITICAL(&statusMux);
+  bool changed = manifestChanged;
+  manifestChanged = false;
+  portEXIT_CRITICAL(&statusMux);
+  return changed;
+}
+
+void otaGetStatus(OtaStatus& out) {
+  portENTER_CRITICAL(&statusMux);
+  out = status;
+  portEXIT_CRITICAL(&statusMux);
+  if (out.state == OTA_CONNECTING || out.state == OTA_DOWNLOADING) {
+    out.elapsedMs = millis() - jobStartMs;
+  }
+}
+
+const char* otaStateName(OtaState state) {
+  switch (state) {
+    case OTA_IDLE: return "idle";
+    case OTA_CONNECTING: return "connecting";
+    case OTA_DOWNLOADING: return "downloading";
+    case OTA_SUCCESS: return "success";
+    case OTA_FAILED: return "failed";
+    case OTA_UP_TO_DATE: return "up_to_date";
+  }
+  return "unknown";
+}
+
+size_t otaStatusJson(const OtaStatus& s, char* buf, size_t len) {
+  int n = snprintf(buf, len,
+                   "{\"job\":%u,\"state\":\"%s\",\"written\":%u,\"total\":%u,"
+                   "\"resumed_from\":%u,\"image_bytes\":%u,\"compressed\":%s,"
+                   "\"bytes_per_sec\":%u,\"elapsed_ms\":%u,\"tls_ms\":%u,\"tls_resumed\":%s,"
+                   "\"verified\":%s,\"wifi_ms\":%u,\"wifi_fast\":%s,\"link\":\"%s\","
+                   "\"link_ms\":%u,\"manifest_ms\":%u,"
+                   "\"download_ms\":%u,\"finish_ms\":%u,\"message\":\"%s\"}",
+                   (unsigned)s.jobId, otaStateName(s.state), (unsigned)s.written,
+                   (unsigned)s.total, (unsigned)s.resumedFrom, (unsigned)s.imageBytes,
+                   s.compressed ? "true" : "false", (unsigned)s.bytesPerSec,
+                   (unsigned)s.elapsedMs, (unsigned)s.tlsHandshakeMs,
+                   s.tlsResumed ? "true" : "false", s.verified ? "true" : "false", (unsigned)s.wifiMs,
+                   s.wifiFast ? "true" : "false", linkTypeName(s.link), (unsigned)s.linkMs,
+                   (unsigned)s.manifestMs, (unsigned)s.downloadMs,
+                   (unsigned)s.finishMs, s.message);
+  if (n < 0) {
+    return 0;
+  }
+  return (size_t)n < len ? (size_t)n : len - 1;
+}
+
+uint32_t otaResumePending(const String& ssid, const String& password, const String& apn) {
+  OtaResume resume;
+  if ((ssid.length() == 0 && apn.length() == 0) || !loadResume(resume)) {
+    return 0;
+  }
+  LOG_INFO("OTA: Resuming interrupted update at %u of %u bytes",
+           (unsigned)resume.offset, (unsigned)resume.total);
+  return otaStart(resume.url.c_str(), ssid, password, apn);
+}
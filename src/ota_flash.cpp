@@ -0,0 +1,108 @@
+#include "ota_flash.h"
+
+#include <esp_ota_ops.h>
+
+// First byte of every ESP32 application image
+#define OTA_IMAGE_MAGIC 0xE9
+
+OtaFlashWriter::OtaFlashWriter() : partition_(NULL), total_(0), sizeKnown_(false), offset_(0), error_("") {}
+
+bool OtaFlashWriter::begin(size_t total, size_t offset) {
+  error_ = "";
+  partition_ = esp_ota_get_next_update_partition(NULL);
+  if (partition_ == NULL) {
+    error_ = "No OTA partition available.";
+    return false;
+  }
+  if (total > partition_->size) {
+    error_ = "Not enough space for update.";
+    return false;
+  }
+  if (offset % OTA_SECTOR_SIZE != 0 || (total > 0 && offset > total)) {
+    error_ = "Invalid resume offset.";
+    return false;
+  }
+  sizeKnown_ = total > 0;
+  total_ = sizeKnown_ ? total : partition_->size;
+  offset_ = offset;
+  return true;
+}
+
+bool OtaFlashWriter::write(const uint8_t* data, size_t len) {
+  if (partition_ == NULL || offset_ + len > total_) {
+    error_ = sizeKnown_ ? "Write past end of image." : "Not enough space for update.";
+    return false;
+  }
+  if (offset_ == 0 && len > 0 && data[0] != OTA_IMAGE_MAGIC) {
+    error_ = "Not a firmware image.";
+    return false;
+  }
+  // Erase every sector whose start falls inside this write; a sector that
+  // began in an earlier write was erased then.
+  size_t eraseStart = (offset_ + OTA_SECTOR_SIZE - 1) / OTA_SECTOR_SIZE * OTA_SECTOR_SIZE;
+  size_t eraseEnd = (offset_ + len + OTA_SECTOR_SIZE - 1) / OTA_SECTOR_SIZE * OTA_SECTOR_SIZE;
+  if (eraseEnd > eraseStart &&
+      esp_partition_erase_range(partition_, eraseStart, eraseEnd - eraseStart) != ESP_OK) {
+    error_ = "Flash erase failed.";
+    return false;
+  }
+  if (esp_partition_write(partition_, offset_, data, len) != ESP_OK) {
+    error_ = "Flash write failed.";
+    return false;
+  }
+  offset_ += len;
+  return true;
+}
+
+bool OtaFlashWriter::finish() {
+  if (partition_ == NULL || offset_ == 0 || (sizeKnown_ && offset_ != total_)) {
+    error_ = "Firmware update failed (incomplete).";
+    return false;
+  }
+  // esp_ota_set_boot_partition() verifies the image before switching to it
+  if (esp_ota_set_boot_partition(partition_) != ESP_OK) {
+    error_ = "Firmware image failed verification.";
+    return false;
+  }
+  return true;
+}
+
+OtaDigest::OtaDigest() : length_(0) {
+  mbedtls_sha256_init(&ctx_);
+}
+
+OtaDigest::~OtaDigest() {
+  mbedtls_sha256_free(&ctx_);
+}
+
+void OtaDigest::begin() {
+  mbedtls_sha256_free(&ctx_);
+  mbedtls_sha256_init(&ctx_);
+  mbedtls_sha256_starts_ret(&ctx_, 0);
+  length_ = 0;
+}
+
+bool OtaDigest::beginFrom(const esp_partition_t* partition, size_t len) {
+  begin();
+  if (partition == NULL || len > partition->size) {
+    return false;
+  }
+  uint8_t buf[512];
+  for (size_t at = 0; at < len; at += sizeof(buf)) {
+    size_t n = len - at < sizeof(buf) ? len - at : sizeof(buf);
+    if (esp_partition_read(partition, at, buf, n) != ESP_OK) {
+      return false;
+    }
+    update(buf, n);
+  }
+  return true;
+}
+
+void OtaDigest::update(const uint8_t* data, size_t len) {
+  mbedtls_sha256_update_ret(&ctx_, data, len);
+  length_ += len;
+}
+
+void OtaDigest::finish(uint8_t out[32]) {
+  mbedtls_sha256_finish_ret(&ctx_, out);
+}
@@ -0,0 +1,209 @@
+#include "ota_inflate.h"
+
+#include <esp_rom_crc.h>
+
+#define GZIP_ID1 0x1f
+#define GZIP_ID2 0x8b
+#define GZIP_METHOD_DEFLATE 8
+#define GZIP_HEADER_SIZE 10
+#define GZIP_TRAILER_SIZE 8
+
+#define GZIP_FLAG_HCRC 0x02
+#define GZIP_FLAG_EXTRA 0x04
+#define GZIP_FLAG_NAME 0x08
+#define GZIP_FLAG_COMMENT 0x10
+
+OtaInflater::OtaInflater()
+  : sink_(NULL), decomp_(NULL), window_(NULL), windowPos_(0), state_(STATE_ERROR),
+    flags_(0), fieldLen_(0), skip_(0), crc_(0), outputSize_(0), error_("") {}
+
+OtaInflater::~OtaInflater() {
+  end();
+}
+
+bool OtaInflater::isGzip(const uint8_t* data, size_t len) {
+  return len >= 2 && data[0] == GZIP_ID1 && data[1] == GZIP_ID2;
+}
+
+bool OtaInflater::begin(Sink sink) {
+  end();
+  decomp_ = (tinfl_decompressor*)malloc(sizeof(tinfl_decompressor));
+  window_ = (uint8_t*)malloc(TINFL_LZ_DICT_SIZE);
+  if (decomp_ == NULL || window_ == NULL) {
+    end();
+    return failWith("Not enough memory to decompress.");
+  }
+  tinfl_init(decomp_);
+  sink_ = sink;
+  windowPos_ = 0;
+  state_ = STATE_HEADER;
+  flags_ = 0;
+  fieldLen_ = 0;
+  skip_ = 0;
+  crc_ = 0;
+  outputSize_ = 0;
+  error_ = "";
+  return true;
+}
+
+void OtaInflater::end() {
+  free(decomp_);
+  free(window_);
+  decomp_ = NULL;
+  window_ = NULL;
+}
+
+bool OtaInflater::failWith(const char* error) {
+  error_ = error;
+  state_ = STATE_ERROR;
+  return false;
+}
+
+bool OtaInflater::write(const uint8_t* data, size_t len) {
+  while (len > 0) {
+    size_t used;
+    switch (state_) {
+      case STATE_DEFLATE:
+        used = inflate(data, len);
+        break;
+      case STATE_TRAILER:
+        used = parseTrailer(data, len);
+        break;
+      case STATE_DONE:
+        return failWith("Data after end of compressed image.");
+      case STATE_ERROR:
+        return false;
+      default:
+        used = parseHeader(data, len);
+        break;
+    }
+    if (state_ == STATE_ERROR) {
+      return false;
+    }
+    data += used;
+    len -= used;
+  }
+  return true;
+}
+
+size_t OtaInflater::parseHeader(const uint8_t* data, size_t len) {
+  size_t used = 0;
+  while (used < len && state_ != STATE_DEFLATE) {
+    uint8_t b = data[used++];
+    switch (state_) {
+      case STATE_HEADER:
+        field_[fieldLen_++] = b;
+        if (fieldLen_ < GZIP_HEADER_SIZE) {
+          break;
+        }
+        if (field_[0] != GZIP_ID1 || field_[1] != GZIP_ID2 || field_[2] != GZIP_METHOD_DEFLATE) {
+          failWith("Unsupported compressed image.");
+          return used;
+        }
+        flags_ = field_[3];
+        fieldLen_ = 0;
+        state_ = STATE_EXTRA_LEN;
+        break;
+      case STATE_EXTRA_LEN:
+        field_[fieldLen_++] = b;
+        if (fieldLen_ == 2) {
+          skip_ = field_[0] | (field_[1] << 8);
+          fieldLen_ = 0;
+          state_ = skip_ > 0 ? STATE_EXTRA : STATE_NAME;
+        }
+        break;
+      case STATE_EXTRA:
+        if (--skip_ == 0) {
+          state_ = STATE_NAME;
+        }
+        break;
+      case STATE_NAME:
+        if (b == 0) {
+          state_ = STATE_COMMENT;
+        }
+        break;
+      case STATE_COMMENT:
+        if (b == 0) {
+          state_ = STATE_HEADER_CRC;
+          skip_ = 2;
+        }
+        break;
+      case STATE_HEADER_CRC:
+        if (--skip_ == 0) {
+          state_ = STATE_DEFLATE;
+        }
+        break;
+      default:
+        break;
+    }
+    // Skip the optional fields this image does not carry. Each check may
+    // consume no byte at all, so keep advancing until the state needs data.
+    for (;;) {
+      if (state_ == STATE_EXTRA_LEN && !(flags_ & GZIP_FLAG_EXTRA)) {
+        state_ = STATE_NAME;
+      } else if (state_ == STATE_NAME && !(flags_ & GZIP_FLAG_NAME)) {
+        state_ = STATE_COMMENT;
+      } else if (state_ == STATE_COMMENT && !(flags_ & GZIP_FLAG_COMMENT)) {
+        state_ = STATE_HEADER_CRC;
+        skip_ = 2;
+      } else if (state_ == STATE_HEADER_CRC && !(flags_ & GZIP_FLAG_HCRC)) {
+        state_ = STATE_DEFLATE;
+      } else {
+        break;
+      }
+    }
+  }
+  return used;
+}
+
+size_t OtaInflater::inflate(const uint8_t* data, size_t len) {
+  size_t used = 0;
+  for (;;) {
+    size_t inSize = len - used;
+    size_t outSize = TINFL_LZ_DICT_SIZE - windowPos_;
+    tinfl_status status = tinfl_decompress(decomp_, data + used, &inSize, window_,
+                                           window_ + windowPos_, &outSize,
+                                           TINFL_FLAG_HAS_MORE_INPUT);
+    used += inSize;
+    if (outSize > 0) {
+      crc_ = esp_rom_crc32_le(crc_, window_ + windowPos_, outSize);
+      outputSize_ += outSize;
+      if (!sink_(window_ + windowPos_, outSize)) {
+        failWith("Write of decompressed data failed.");
+        return used;
+      }
+      windowPos_ = (windowPos_ + outSize) & (TINFL_LZ_DICT_SIZE - 1);
+    }
+    if (status == TINFL_STATUS_DONE) {
+      fieldLen_ = 0;
+      state_ = STATE_TRAILER;
+      return used;
+    }
+    if (status < TINFL_STATUS_DONE) {
+      failWith("Corrupt compressed image.");
+      return used;
+    }
+    // NEEDS_MORE_INPUT: everything given was consumed; HAS_MORE_OUTPUT: the
+    // window wrapped and decompression continues from its start.
+    if (status == TINFL_STATUS_NEEDS_MORE_INPUT && used == len) {
+      return used;
+    }
+  }
+}
+
+size_t OtaInflater::parseTrailer(const uint8_t* data, size_t len) {
+  size_t used = 0;
+  while (used < len && fieldLen_ < GZIP_TRAILER_SIZE) {
+    field_[fieldLen_++] = data[used++];
+  }
+  if (fieldLen_ == GZIP_TRAILER_SIZE) {
+    uint32_t crc = field_[0] | (field_[1] << 8) | (field_[2] << 16) | ((uint32_t)field_[3] << 24);
+    uint32_t size = field_[4] | (field_[5] << 8) | (field_[6] << 16) | ((uint32_t)field_[7] << 24);
+    if (crc != crc_ || size != (uint32_t)outputSize_) {
+      failWith("Compressed image checksum mismatch.");
+      return used;
+    }
+    state_ = STATE_DONE;
+  }
+  return used;
+}
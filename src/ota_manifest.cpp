@@ -0,0 +1,453 @@
+#include "ota_manifest.h"
+
+#include <HTTPClient.h>
+#include <Logger.h>
+#include <Preferences.h>
+#include <esp_ota_ops.h>
+
+#include "config_store.h"
+#include "ota_flash.h"
+
+#define MANIFEST_KEY_MAX 16
+
+OtaManifest Manifest;
+
+static const char* skipString(const char* p) {
+  while (*p != '"') {
+    if (*p == 0) {
+      return NULL;
+    }
+    if (*p == '\\' && p[1] != 0) {
+      p++;
+    }
+    p++;
+  }
+  return p + 1;
+}
+
+// Skips a string, number, true, false or null
+static const char* skipScalar(const char* p) {
+  if (*p == '"') {
+    return skipString(p + 1);
+  }
+  const char* start = p;
+  while (isalnum((unsigned char)*p) || *p == '-' || *p == '+' || *p == '.') {
+    p++;
+  }
+  return p > start ? p : NULL;
+}
+
+static const char* parseSize(const char* p, size_t& out) {
+  if (!isdigit((unsigned char)*p)) {
+    return NULL;
+  }
+  char* end;
+  unsigned long value = strtoul(p, &end, 10);
+  if (*end == '.' || *end == 'e' || *end == 'E' || value == 0) {
+    return NULL;
+  }
+  out = value;
+  return end;
+}
+
+static bool parseHex(const char* hex, uint8_t* out, size_t len) {
+  if (strlen(hex) != len * 2) {
+    return false;
+  }
+  for (size_t i = 0; i < len * 2; i++) {
+    if (!isxdigit((unsigned char)hex[i])) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < len; i++) {
+    char byte[3] = { hex[i * 2], hex[i * 2 + 1], 0 };
+    out[i] = (uint8_t)strtoul(byte, NULL, 16);
+  }
+  return true;
+}
+
+// Text that ends up in the portal page must not carry markup
+static bool plainText(const char* text) {
+  return strpbrk(text, "<>&\"'") == NULL;
+}
+
+static bool validId(const char* id) {
+  if (id[0] == 0) {
+    return false;
+  }
+  for (const char* p = id; *p; p++) {
+    if (!isalnum((unsigned char)*p) && *p != '.' && *p != '-' && *p != '_') {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Parses one {...} entry starting after its opening brace. url is scratch
+// space of OTA_MANIFEST_URL_MAX bytes.
+static const char* parseEntry(const char* p, ManifestEntry& e, char* url) {
+  char key[MANIFEST_KEY_MAX];
+  char sha[65] = "";
+  char imageSha[65] = "";
+  bool overflow;
+  e.id[0] = 0;
+  e.label[0] = 0;
+  e.version[0] = 0;
+  e.size = 0;
+  e.imageSize = 0;
+  url[0] = 0;
+  p = jsonSkipSpace(p);
+  if (*p == '}') {
+    return NULL;
+  }
+  for (;;) {
+    if (*p++ != '"' || (p = jsonParseString(p, key, sizeof(key), overflow)) == NULL) {
+      return NULL;
+    }
+    p = jsonSkipSpace(p);
+    if (*p++ != ':') {
+      return NULL;
+    }
+    p = jsonSkipSpace(p);
+    char* target = NULL;
+    size_t size = 0;
+    if (strcmp(key, "id") == 0) {
+      target = e.id;
+      size = sizeof(e.id);
+    } else if (strcmp(key, "label") == 0) {
+      target = e.label;
+      size = sizeof(e.label);
+    } else if (strcmp(key, "version") == 0) {
+      target = e.version;
+      size = sizeof(e.version);
+    } else if (strcmp(key, "url") == 0) {
+      target = url;
+      size = OTA_MANIFEST_URL_MAX;
+    } else if (strcmp(key, "sha256") == 0) {
+      target = sha;
+      size = sizeof(sha);
+    } else if (strcmp(key, "image_sha256") == 0) {
+      target = imageSha;
+      size = sizeof(imageSha);
+    }
+    if (target != NULL) {
+      if (*p++ != '"' || (p = jsonParseString(p, target, size, overflow)) == NULL) {
+        return NULL;
+      }
+    } else if (strcmp(key, "size") == 0) {
+      p = parseSize(p, e.size);
+    } else if (strcmp(key, "image_size") == 0) {
+      p = parseSize(p, e.imageSize);
+    } else {
+      p = skipScalar(p);
+    }
+    if (p == NULL) {
+      return NULL;
+    }
+    p = jsonSkipSpace(p);
+    if (*p == '}') {
+      break;
+    }
+    if (*p++ != ',') {
+      return NULL;
+    }
+    p = jsonSkipSpace(p);
+  }
+
+  if (e.label[0] == 0) {
+    strcpy(e.label, e.version);
+  }
+  if (!validId(e.id) || e.version[0] == 0 || !plainText(e.label) || !plainText(e.version) ||
+      e.size == 0 || !parseHex(sha, e.sha256, sizeof(e.sha256)) ||
+      (strncmp(url, "http://", 7) != 0 && strncmp(url, "https://", 8) != 0)) {
+    return NULL;
+  }
+  // The image fields come as a pair, or not at all for an uncompressed file
+  if (e.imageSize == 0 && imageSha[0] == 0) {
+    e.imageSize = e.size;
+    memcpy(e.imageSha256, e.sha256, sizeof(e.imageSha256));
+  } else if (e.imageSize == 0 || !parseHex(imageSha, e.imageSha256, sizeof(e.imageSha256))) {
+    return NULL;
+  }
+  e.url = url;
+  return p + 1;
+}
+
+OtaManifest::OtaManifest() : count_(0) {}
+
+bool OtaManifest::parse(const char* json) {
+  count_ = 0;
+  char* url = (char*)malloc(OTA_MANIFEST_URL_MAX);
+  if (url == NULL) {
+    return false;
+  }
+  char key[MANIFEST_KEY_MAX];
+  bool overflow;
+  bool seenList = false;
+  size_t parsed = 0;
+  const char* p = jsonSkipSpace(json);
+  if (*p++ != '{') {
+    p = NULL;
+  }
+  while (p != NULL) {
+    p = jsonSkipSpace(p);
+    if (*p++ != '"' || (p = jsonParseString(p, key, sizeof(key), overflow)) == NULL) {
+      p = NULL;
+      break;
+    }
+    p = jsonSkipSpace(p);
+    if (*p++ != ':') {
+      p = NULL;
+      break;
+    }
+    p = jsonSkipSpace(p);
+    if (strcmp(key, "firmware") == 0 && *p == '[') {
+      seenList = true;
+      p = jsonSkipSpace(p + 1);
+      while (p != NULL && *p != ']') {
+        ManifestEntry scratch;
+        // Entries past the limit are still checked, then dropped
+        ManifestEntry& e = parsed < OTA_MANIFEST_ENTRIES ? entries_[parsed] : scratch;
+        if (*p++ != '{' || (p = parseEntry(p, e, url)) == NULL) {
+          p = NULL;
+          break;
+        }
+        parsed++;
+        p = jsonSkipSpace(p);
+        if (*p == ',') {
+          p = jsonSkipSpace(p + 1);
+        } else if (*p != ']') {
+          p = NULL;
+        }
+      }
+      if (p != NULL) {
+        p++;
+      }
+    } else {
+      p = skipScalar(p);
+    }
+    if (p == NULL) {
+      break;
+    }
+    p = jsonSkipSpace(p);
+    if (*p == '}') {
+      p = *jsonSkipSpace(p + 1) == 0 ? p : NULL;
+      break;
+    }
+    if (*p++ != ',') {
+      p = NULL;
+    }
+  }
+  free(url);
+  if (p == NULL || !seenList) {
+    return false;
+  }
+  count_ = parsed < OTA_MANIFEST_ENTRIES ? parsed : OTA_MANIFEST_ENTRIES;
+  for (size_t i = 0; i < count_; i++) {
+    for (size_t j = 0; j < i; j++) {
+      if (strcmp(entries_[i].id, entries_[j].id) == 0) {
+        count_ = 0;
+        return false;
+      }
+    }
+  }
+  if (parsed > OTA_MANIFEST_ENTRIES) {
+    LOG_WARN("Manifest: %u entries, only the first %u are offered",
+             (unsigned)parsed, OTA_MANIFEST_ENTRIES);
+  }
+  return true;
+}
+
+bool OtaManifest::load(fs::FS& fs) {
+  count_ = 0;
+  File file = fs.open(OTA_MANIFEST_PATH, FILE_READ);
+  if (!file) {
+    return false;
+  }
+  size_t size = file.size();
+  char* json = size > 0 && size <= OTA_MANIFEST_MAX ? (char*)malloc(size + 1) : NULL;
+  if (json == NULL) {
+    file.close();
+    return false;
+  }
+  size_t got = file.read((uint8_t*)json, size);
+  file.close();
+  json[got] = 0;
+  bool ok = got == size && parse(json);
+  free(json);
+  return ok;
+}
+
+const ManifestEntry* OtaManifest::find(const char* id) const {
+  for (size_t i = 0; i < count_; i++) {
+    if (strcmp(entries_[i].id, id) == 0) {
+      return &entries_[i];
+    }
+  }
+  return NULL;
+}
+
+static bool cacheManifest(fs::FS& fs, const char* json, size_t len) {
+  const char* tmpPath = OTA_MANIFEST_PATH ".tmp";
+  File file = fs.open(tmpPath, FILE_WRITE);
+  if (!file) {
+    return false;
+  }
+  bool ok = file.write((const uint8_t*)json, len) == len;
+  file.close();
+  if (!ok) {
+    fs.remove(tmpPath);
+    return false;
+  }
+  // A crash between the two steps only loses the cache; the next check
+  // fetches the manifest in full
+  fs.remove(OTA_MANIFEST_PATH);
+  if (!fs.rename(tmpPath, OTA_MANIFEST_PATH)) {
+    fs.remove(tmpPath);
+    return false;
+  }
+  return true;
+}
+
+// Collects a response body in a fixed buffer. A write that does not fit is
+// refused, which stops HTTPClient::writeToStream().
+class ManifestBody : public Stream {
+ public:
+  ManifestBody(char* buffer, size_t capacity)
+    : buffer_(buffer), capacity_(capacity), len_(0), overflowed_(false) {}
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* data, size_t len) override {
+    if (len > capacity_ - len_) {
+      overflowed_ = true;
+      return 0;
+    }
+    memcpy(buffer_ + len_, data, len);
+    len_ += len;
+    return len;
+  }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  void flush() override {}
+
+  size_t length() const { return len_; }
+  bool overflowed() const { return overflowed_; }
+
+ private:
+  char* buffer_;
+  size_t capacity_;
+  size_t len_;
+  bool overflowed_;
+};
+
+ManifestResult OtaManifest::fetch(fs::FS& fs, WiFiClient& net, const char* url, uint32_t timeoutMs) {
+  if (url == NULL || url[0] == 0) {
+    return MANIFEST_NO_URL;
+  }
+  // The ETag is only valid for the copy fetched from this same URL
+  Preferences prefs;
+  prefs.begin("manifest", true);
+  String etag = prefs.getString("etag", "");
+  String cachedUrl = prefs.getString("url", "");
+  prefs.end();
+  bool cached = cachedUrl == url && fs.exists(OTA_MANIFEST_PATH);
+
+  const char* headerKeys[] = { "ETag" };
+  HTTPClient http;
+  http.setConnectTimeout(timeoutMs);
+  http.setTimeout(timeoutMs);
+  http.begin(net, url);
+  http.collectHeaders(headerKeys, 1);
+  if (cached && etag.length() > 0) {
+    http.addHeader("If-None-Match", etag);
+  }
+  int httpCode = http.GET();
+  if (httpCode == HTTP_CODE_NOT_MODIFIED && cached) {
+    http.end();
+    return load(fs) ? MANIFEST_NOT_MODIFIED : MANIFEST_INVALID;
+  }
+  if (httpCode != HTTP_CODE_OK) {
+    LOG_WARN("Manifest: GET failed, code %d", httpCode);
+    http.end();
+    return MANIFEST_FETCH_FAILED;
+  }
+  // Sized from Content-Length when there is one; a chunked body gets room
+  // for the largest manifest accepted, and anything longer is cut off
+  int size = http.getSize();
+  if (size > OTA_MANIFEST_MAX) {
+    http.end();
+    return MANIFEST_TOO_LARGE;
+  }
+  size_t capacity = size > 0 ? size : OTA_MANIFEST_MAX;
+  char* json = (char*)malloc(capacity + 1);
+  if (json == NULL) {
+    LOG_WARN("Manifest: no memory for %u bytes", (unsigned)capacity);
+    http.end();
+    return MANIFEST_NO_MEMORY;
+  }
+  ManifestBody body(json, capacity);
+  int written = http.writeToStream(&body);
+  etag = http.header("ETag");
+  http.end();
+  if (body.overflowed()) {
+    free(json);
+    return MANIFEST_TOO_LARGE;
+  }
+  if (written < 0 || (size > 0 && body.length() != (size_t)size)) {
+    LOG_WARN("Manifest: body incomplete, %s", HTTPClient::errorToString(written).c_str());
+    free(json);
+    return MANIFEST_FETCH_FAILED;
+  }
+  size_t len = body.length();
+  json[len] = 0;
+
+  if (!parse(json)) {
+    free(json);
+    load(fs);
+    return MANIFEST_INVALID;
+  }
+  bool stored = cacheManifest(fs, json, len);
+  free(json);
+  prefs.begin("manifest", false);
+  prefs.putString("etag", stored ? etag : String());
+  prefs.putString("url", stored ? String(url) : String());
+  prefs.end();
+  return stored ? MANIFEST_OK : MANIFEST_STORAGE_ERROR;
+}
+
+bool manifestIsRunning(const ManifestEntry& entry) {
+  // Hashing the running image costs a full flash read, so the digest is
+  // kept for the size it was taken over
+  static size_t hashedSize = 0;
+  static uint8_t digest[32];
+
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  if (running == NULL || entry.imageSize > running->size) {
+    return false;
+  }
+  if (hashedSize != entry.imageSize) {
+    OtaDigest hash;
+    if (!hash.beginFrom(running, entry.imageSize)) {
+      hashedSize = 0;
+      return false;
+    }
+    hash.finish(digest);
+    hashedSize = entry.imageSize;
+  }
+  return memcmp(digest, entry.imageSha256, sizeof(digest)) == 0;
+}
+
+const char* manifestResultName(ManifestResult result) {
+  switch (result) {
+    case MANIFEST_OK: return "updated";
+    case MANIFEST_NOT_MODIFIED: return "not_modified";
+    case MANIFEST_NO_URL: return "no_url";
+    case MANIFEST_FETCH_FAILED: return "fetch_failed";
+    case MANIFEST_TOO_LARGE: return "too_large";
+    case MANIFEST_NO_MEMORY: return "no_memory";
+    case MANIFEST_INVALID: return "invalid";
+    case MANIFEST_STORAGE_ERROR: return "storage_error";
+  }
+  return "unknown";
+}
@@ -0,0 +1,329 @@
+#include "pem_upload.h"
+
+#define PEM_BEGIN "-----BEGIN "
+#define PEM_END "-----END "
+#define PEM_DASHES "-----"
+// Free text allowed around blocks, as RFC 7468 permits
+#define PEM_PREAMBLE_MAX 1024
+
+static const char* const certificateLabels[] = { "CERTIFICATE", NULL };
+static const char* const keyLabels[] = {
+  "PRIVATE KEY", "RSA PRIVATE KEY", "EC PRIVATE KEY", "ENCRYPTED PRIVATE KEY", NULL
+};
+
+static bool isBase64(char c) {
+  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '+' || c == '/';
+}
+
+void PemValidator::begin(PemKind kind) {
+  kind_ = kind;
+  state_ = BEFORE_BLOCK;
+  lineLen_ = 0;
+  preambleLen_ = 0;
+  label_[0] = 0;
+  blocks_ = 0;
+  encrypted_ = false;
+  firstBodyLine_ = true;
+  error_ = "";
+}
+
+bool PemValidator::fail(const char* error) {
+  error_ = error;
+  return false;
+}
+
+bool PemValidator::feed(const uint8_t* data, size_t len) {
+  if (error_[0] != 0) {
+    return false;
+  }
+  for (size_t i = 0; i < len; i++) {
+    char c = (char)data[i];
+    if (c == '\n') {
+      if (!line()) {
+        return false;
+      }
+      lineLen_ = 0;
+    } else if (c == '\r') {
+      // CRLF line endings
+    } else if ((c < 0x20 && c != '\t') || (uint8_t)c >= 0x7f) {
+      return fail("Not a PEM file (binary data).");
+    } else if (lineLen_ == PEM_LINE_MAX) {
+      return fail("Not a PEM file (line too long).");
+    } else {
+      line_[lineLen_++] = c;
+    }
+  }
+  return true;
+}
+
+bool PemValidator::finish() {
+  if (error_[0] == 0 && lineLen_ > 0 && !line()) {
+    return false;
+  }
+  lineLen_ = 0;
+  if (error_[0] != 0) {
+    return false;
+  }
+  if (state_ != BEFORE_BLOCK) {
+    return fail("Truncated PEM file (missing END line).");
+  }
+  if (blocks_ == 0) {
+    return fail(kind_ == PEM_CERTIFICATE ? "No certificate found." : "No private key found.");
+  }
+  return true;
+}
+
+bool PemValidator::line() {
+  line_[lineLen_] = 0;
+  // Trailing spaces are common in hand-edited files
+  while (lineLen_ > 0 && (line_[lineLen_ - 1] == ' ' || line_[lineLen_ - 1] == '\t')) {
+    line_[--lineLen_] = 0;
+  }
+  if (state_ == BEFORE_BLOCK) {
+    return beginLine();
+  }
+  return bodyLine();
+}
+
+bool PemValidator::beginLine() {
+  if (strncmp(line_, PEM_BEGIN, strlen(PEM_BEGIN)) != 0) {
+    preambleLen_ += lineLen_ + 1;
+    if (preambleLen_ > PEM_PREAMBLE_MAX) {
+      return fail("Not a PEM file (no BEGIN line).");
+    }
+    return true;
+  }
+  const char* label = line_ + strlen(PEM_BEGIN);
+  size_t labelLen = lineLen_ - strlen(PEM_BEGIN);
+  if (labelLen < strlen(PEM_DASHES) || strcmp(line_ + lineLen_ - strlen(PEM_DASHES), PEM_DASHES) != 0) {
+    return fail("Malformed BEGIN line.");
+  }
+  labelLen -= strlen(PEM_DASHES);
+  const char* const* allowed = kind_ == PEM_CERTIFICATE ? certificateLabels : keyLabels;
+  for (; *allowed != NULL; allowed++) {
+    if (strlen(*allowed) == labelLen && strncmp(*allowed, label, labelLen) == 0) {
+      break;
+    }
+  }
+  if (*allowed == NULL) {
+    return fail(kind_ == PEM_CERTIFICATE ? "Not a certificate." : "Not a private key.");
+  }
+  if (kind_ == PEM_PRIVATE_KEY && blocks_ > 0) {
+    return fail("More than one private key.");
+  }
+  strcpy(label_, *allowed);
+  state_ = BLOCK_HEADERS;
+  encrypted_ = false;
+  firstBodyLine_ = true;
+  return true;
+}
+
+bool PemValidator::bodyLine() {
+  if (strncmp(line_, PEM_END, strlen(PEM_END)) == 0) {
+    if (firstBodyLine_) {
+      return fail("Empty PEM block.");
+    }
+    size_t labelLen = strlen(label_);
+    if (lineLen_ != strlen(PEM_END) + labelLen + strlen(PEM_DASHES) ||
+        strncmp(line_ + strlen(PEM_END), label_, labelLen) != 0 ||
+        strcmp(line_ + lineLen_ - strlen(PEM_DASHES), PEM_DASHES) != 0) {
+      return fail("END line does not match BEGIN line.");
+    }
+    state_ = BEFORE_BLOCK;
+    blocks_++;
+    return true;
+  }
+  if (state_ == BLOCK_HEADERS) {
+    // Legacy encrypted keys carry "Proc-Type:" and "DEK-Info:" headers
+    // followed by a blank line
+    if (strchr(line_, ':') != NULL) {
+      encrypted_ = true;
+      return true;
+    }
+    if (lineLen_ == 0) {
+      return true;
+    }
+    state_ = BLOCK_BODY;
+  }
+  if (state_ == BLOCK_PADDED) {
+    return fail("Data after base64 padding.");
+  }
+  if (lineLen_ == 0) {
+    return fail("Blank line inside PEM block.");
+  }
+  size_t padding = 0;
+  for (size_t i = 0; i < lineLen_; i++) {
+    if (line_[i] == '=') {
+      padding++;
+    } else if (!isBase64(line_[i]) || padding > 0) {
+      return fail("Invalid base64 in PEM block.");
+    }
+  }
+  if (padding > 2) {
+    return fail("Invalid base64 in PEM block.");
+  }
+  // Certificates and unencrypted keys are DER SEQUENCEs, whose 0x30 tag
+  // always encodes to a leading 'M'
+  if (firstBodyLine_ && !encrypted_ && line_[0] != 'M') {
+    return fail("PEM block does not contain DER data.");
+  }
+  firstBodyLine_ = false;
+  if (padding > 0) {
+    state_ = BLOCK_PADDED;
+  }
+  return true;
+}
+
+PemUpload::PemUpload()
+  : fs_(NULL), path_(NULL), size_(0), fill_(0), failed_(true), error_("") {
+  tmpPath_[0] = 0;
+}
+
+bool PemUpload::fail(const char* error) {
+  if (!failed_) {
+    error_ = error;
+    abort();
+  }
+  return false;
+}
+
+bool PemUpload::begin(fs::FS& fs, const char* path, PemKind kind, const char* suffix) {
+  abort();
+  fs_ = &fs;
+  path_ = path;
+  size_ = 0;
+  fill_ = 0;
+  failed_ = false;
+  error_ = "";
+  validator_.begin(kind);
+  snprintf(tmpPath_, sizeof(tmpPath_), "%s%s", path, suffix);
+
+  // Create the parent directory ("/cert") on first use
+  char dir[sizeof(tmpPath_)];
+  strncpy(dir, path, sizeof(dir) - 1);
+  dir[sizeof(dir) - 1] = 0;
+  char* slash = strrchr(dir, '/');
+  if (slash != NULL && slash != dir) {
+    *slash = 0;
+    if (!fs.exists(dir)) {
+      fs.mkdir(dir);
+    }
+  }
+  file_ = fs.open(tmpPath_, FILE_WRITE);
+  if (!file_) {
+    return fail("Could not create file.");
+  }
+  return true;
+}
+
+bool PemUpload::flush() {
+  if (fill_ > 0 && file_.write(buffer_, fill_) != fill_) {
+    return fail("Write to flash failed.");
+  }
+  fill_ = 0;
+  return true;
+}
+
+bool PemUpload::write(const uint8_t* data, size_t len) {
+  if (failed_) {
+    return false;
+  }
+  size_ += len;
+  if (size_ > PEM_UPLOAD_MAX) {
+    return fail("File too large.");
+  }
+  if (!validator_.feed(data, len)) {
+    return fail(validator_.lastError());
+  }
+  while (len > 0) {
+    size_t n = sizeof(buffer_) - fill_;
+    if (n > len) {
+      n = len;
+    }
+    memcpy(buffer_ + fill_, data, n);
+    fill_ += n;
+    data += n;
+    len -= n;
+    if (fill_ == sizeof(buffer_) && !flush()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool PemUpload::close() {
+  if (failed_) {
+    return false;
+  }
+  if (!validator_.finish()) {
+    return fail(validator_.lastError());
+  }
+  if (!flush()) {
+    return false;
+  }
+  file_.close();
+  return true;
+}
+
+bool PemUpload::finish() {
+  if (!close()) {
+    return false;
+  }
+  // Only a file that passed validation and closed cleanly gets the ".ok"
+  // name, so recovery never promotes a truncated temp file. SPIFFS cannot
+  // rename over an existing file; if power fails between the steps below,
+  // pemUploadRecover() finishes the swap at the next boot.
+  char okPath[sizeof(tmpPath_)];
+  snprintf(okPath, sizeof(okPath), "%s" PEM_UPLOAD_OK_SUFFIX, path_);
+  if (fs_->exists(okPath)) {
+    fs_->remove(okPath);
+  }
+  if (!fs_->rename(tmpPath_, okPath)) {
+    return fail("Could not replace file.");
+  }
+  fs_->remove(path_);
+  if (!fs_->rename(okPath, path_)) {
+    return fail("Could not replace file.");
+  }
+  failed_ = true;
+  return true;
+}
+
+bool PemUpload::stage() {
+  if (!close()) {
+    return false;
+  }
+  // The file is the caller's now; abort() must not remove it
+  tmpPath_[0] = 0;
+  failed_ = true;
+  return true;
+}
+
+void PemUpload::abort() {
+  if (file_) {
+    file_.close();
+  }
+  if (fs_ != NULL && tmpPath_[0] != 0 && fs_->exists(tmpPath_)) {
+    fs_->remove(tmpPath_);
+  }
+  fill_ = 0;
+  failed_ = true;
+}
+
+void pemUploadRecover(fs::FS& fs, const char* path) {
+  char tmpPath[48];
+  char okPath[48];
+  snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+  snprintf(okPath, sizeof(okPath), "%s" PEM_UPLOAD_OK_SUFFIX, path);
+  // A temp file may be cut short or unvalidated; the saved file stays
+  if (fs.exists(tmpPath)) {
+    fs.remove(tmpPath);
+  }
+  // A ".ok" file was complete and valid; it replaces the saved one
+  if (fs.exists(okPath)) {
+    if (fs.exists(path)) {
+      fs.remove(path);
+    }
+    fs.rename(okPath, path);
+  }
+}
@@ -0,0 +1,125 @@
+#include "portal_page.h"
+
+#include "web_assets.h"
+
+static const char PAGE_HEAD[] PROGMEM =
+  "<!DOCTYPE html><html lang=\"en\"><head><meta charset=\"UTF-8\"><title>ESP32 Portal</title>"
+  "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">"
+  "<link rel=\"stylesheet\" href=\"/style.css?v=" WEB_STYLE_CSS_VERSION "\"></head>"
+  "<body><div class=\"container\"><h2>ESP32 Portal</h2>";
+
+static const char STATUS_OPEN[] PROGMEM = "<div class=\"status\">";
+static const char STATUS_CLOSE[] PROGMEM = "</div>";
+
+static const char PAGE_FORMS[] PROGMEM =
+  "<form method=\"POST\" action=\"/upload\" enctype=\"multipart/form-data\">"
+  "<label for=\"cert\">Upload Device Certificate</label><input type=\"file\" id=\"cert\" name=\"cert\" required>"
+  "<input type=\"submit\" value=\"Upload Certificate\"></form>"
+  "<form method=\"POST\" action=\"/upload-key\" enctype=\"multipart/form-data\">"
+  "<label for=\"key\">Upload Private Key</label><input type=\"file\" id=\"key\" name=\"key\" required>"
+  "<input type=\"submit\" value=\"Upload Key\"></form><div class=\"divider\"></div>"
+  "<form method=\"POST\" action=\"/wifi\"><label for=\"ssid\">WiFi SSID</label>"
+  "<input type=\"text\" id=\"ssid\" name=\"ssid\" required><label for=\"password\">WiFi Password</label>"
+  "<input type=\"password\" id=\"password\" name=\"password\" required><input type=\"submit\" value=\"Save WiFi\"></form>"
+  "<div class=\"divider\"></div>"
+  "<form method=\"POST\" action=\"/gsm\"><label for=\"apn\">APN</label>"
+  "<input type=\"text\" id=\"apn\" name=\"apn\" placeholder=\"internet\" required>"
+  "<input type=\"submit\" value=\"Save GSM Settings\"></form>"
+  "<div class=\"divider\"></div>"
+  "<form method=\"POST\" action=\"/ota\"><label for=\"firmware\">Firmware Update</label>"
+  "<select id=\"firmware\" name=\"firmware\" required>";
+
+static const char OPTION_OPEN[] PROGMEM = "<option value=\"";
+static const char OPTION_MID[] PROGMEM = "\">";
+static const char OPTION_CLOSE[] PROGMEM = "</option>";
+
+static const char NO_OPTIONS[] PROGMEM =
+  "<option value=\"\">No firmware list yet, check for updates</option>";
+
+static const char RESULT_TAIL[] PROGMEM =
+  "<a class=\"back\" href=\"/\">Back to the portal</a></div></body></html>";
+
+static const char PAGE_TAIL[] PROGMEM =
+  "</select><input type=\"submit\" value=\"Update\"></form>"
+  "<form method=\"POST\" action=\"/ota/check\"><input type=\"submit\" value=\"Check for Updates\"></form>"
+  "</div></body></html>";
+
+// Collects the small dynamic pieces of the page so they go out as one chunk
+// instead of one TCP write each. Large static segments bypass the buffer.
+class ChunkWriter {
+ public:
+  explicit ChunkWriter(PortalServer& server) : server_(server), used_(0) {}
+
+  void write(const char* data, size_t len) {
+    if (len >= sizeof(buf_)) {
+      flush();
+      server_.sendContent_P(data, len);
+      return;
+    }
+    if (used_ + len > sizeof(buf_)) {
+      flush();
+    }
+    memcpy_P(buf_ + used_, data, len);
+    used_ += len;
+  }
+
+  void write(const char* str) {
+    write(str, strlen_P(str));
+  }
+
+  void flush() {
+    if (used_ > 0) {
+      server_.sendContent(buf_, used_);
+      used_ = 0;
+    }
+  }
+
+ private:
+  PortalServer& server_;
+  char buf_[256];
+  size_t used_;
+};
+
+void sendPortalPage(PortalServer& server, int code, const char* statusMsg,
+                    const FirmwareOption* options, size_t optionCount) {
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(code, "text/html", "");
+
+  ChunkWriter out(server);
+  out.write(PAGE_HEAD, sizeof(PAGE_HEAD) - 1);
+  if (statusMsg != nullptr && statusMsg[0] != '\0') {
+    out.write(STATUS_OPEN, sizeof(STATUS_OPEN) - 1);
+    out.write(statusMsg);
+    out.write(STATUS_CLOSE, sizeof(STATUS_CLOSE) - 1);
+  }
+  out.write(PAGE_FORMS, sizeof(PAGE_FORMS) - 1);
+  if (optionCount == 0) {
+    out.write(NO_OPTIONS, sizeof(NO_OPTIONS) - 1);
+  }
+  for (size_t i = 0; i < optionCount; i++) {
+    out.write(OPTION_OPEN, sizeof(OPTION_OPEN) - 1);
+    out.write(options[i].id);
+    out.write(OPTION_MID, sizeof(OPTION_MID) - 1);
+    out.write(options[i].label);
+    out.write(OPTION_CLOSE, sizeof(OPTION_CLOSE) - 1);
+  }
+  out.write(PAGE_TAIL, sizeof(PAGE_TAIL) - 1);
+  out.flush();
+
+  // Zero-length chunk terminates the chunked response
+  server.sendContent("");
+}
+
+void sendResultPage(PortalServer& server, int code, const char* statusMsg) {
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(code, "text/html", "");
+
+  ChunkWriter out(server);
+  out.write(PAGE_HEAD, sizeof(PAGE_HEAD) - 1);
+  out.write(STATUS_OPEN, sizeof(STATUS_OPEN) - 1);
+  out.write(statusMsg);
+  out.write(STATUS_CLOSE, sizeof(STATUS_CLOSE) - 1);
+  out.write(RESULT_TAIL, sizeof(RESULT_TAIL) - 1);
+  out.flush();
+  server.sendContent("");
+}
@@ -0,0 +1,1176 @@
+#include "portal_server.h"
+
+#include <errno.h>
+#include <Logger.h>
+#include <lwip/sockets.h>
+#include <new>
+
+static const char* reasonPhrase(int code) {
+  switch (code) {
+    case 200: return "OK";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 409: return "Conflict";
+    case 413: return "Payload Too Large";
+    case 414: return "URI Too Long";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    default: return "";
+  }
+}
+
+static HTTPMethod parseMethod(const char* method) {
+  if (strcmp(method, "GET") == 0) return HTTP_GET;
+  if (strcmp(method, "HEAD") == 0) return HTTP_HEAD;
+  if (strcmp(method, "POST") == 0) return HTTP_POST;
+  if (strcmp(method, "PUT") == 0) return HTTP_PUT;
+  if (strcmp(method, "PATCH") == 0) return HTTP_PATCH;
+  if (strcmp(method, "DELETE") == 0) return HTTP_DELETE;
+  if (strcmp(method, "OPTIONS") == 0) return HTTP_OPTIONS;
+  return HTTP_ANY;
+}
+
+static int hexValue(char ch) {
+  if (ch >= '0' && ch <= '9') return ch - '0';
+  if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+  if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+  return -1;
+}
+
+static String urlDecode(const char* text, size_t len) {
+  String out;
+  out.reserve(len);
+  for (size_t i = 0; i < len; i++) {
+    if (text[i] == '+') {
+      out += ' ';
+    } else if (text[i] == '%' && i + 2 < len && hexValue(text[i + 1]) >= 0 && hexValue(text[i + 2]) >= 0) {
+      out += (char)(hexValue(text[i + 1]) << 4 | hexValue(text[i + 2]));
+      i += 2;
+    } else {
+      out += text[i];
+    }
+  }
+  return out;
+}
+
+// Value of a parameter such as boundary=x or name="x" in a header value
+static String headerParam(const String& value, const char* param) {
+  size_t paramLen = strlen(param);
+  int start = value.indexOf(';');
+  while (start >= 0) {
+    int end = value.indexOf(';', start + 1);
+    String token = value.substring(start + 1, end < 0 ? value.length() : end);
+    token.trim();
+    if (token.length() > paramLen && token[paramLen] == '=' &&
+        token.substring(0, paramLen).equalsIgnoreCase(param)) {
+      String result = token.substring(paramLen + 1);
+      if (result.startsWith("\"")) {
+        int quote = result.indexOf('"', 1);
+        result = result.substring(1, quote < 0 ? result.length() : quote);
+      }
+      return result;
+    }
+    start = end;
+  }
+  return String();
+}
+
+PortalServer::PortalServer(uint16_t port)
+  : port_(port), listenFd_(-1), unmatchedMetrics_(), current_(NULL), uploadOwner_(-1),
+    nextRequestId_(1), requestsServed_(0) {
+  for (size_t i = 0; i < PORTAL_MAX_CLIENTS; i++) {
+    clients_[i] = NULL;
+  }
+}
+
+PortalServer::~PortalServer() {
+  for (size_t i = 0; i < PORTAL_MAX_CLIENTS; i++) {
+    if (clients_[i] != NULL) {
+      closeConnection(i);
+    }
+  }
+  if (listenFd_ >= 0) {
+    close(listenFd_);
+  }
+}
+
+void PortalServer::begin() {
+  uint16_t port = port_;
+#ifdef NATIVE_BUILD
+  port = nativeListenPort(port);
+#endif
+  listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (listenFd_ < 0) {
+    LOG_ERROR("Portal server: no socket available");
+    return;
+  }
+  int on = 1;
+  setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(listenFd_, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd_, PORTAL_MAX_CLIENTS) != 0) {
+    LOG_ERROR("Portal server: cannot listen on port %u (errno %d)", port, errno);
+    close(listenFd_);
+    listenFd_ = -1;
+    return;
+  }
+  fcntl(listenFd_, F_SETFL, fcntl(listenFd_, F_GETFL, 0) | O_NONBLOCK);
+  LOG_INFO("Portal server listening on port %u", port);
+}
+
+void PortalServer::on(const String& uri, THandlerFunction handler) {
+  on(uri, HTTP_ANY, handler);
+}
+
+void PortalServer::on(const String& uri, HTTPMethod method, THandlerFunction handler) {
+  on(uri, method, handler, NULL);
+}
+
+void PortalServer::on(const String& uri, HTTPMethod method, THandlerFunction handler, THandlerFunction upload) {
+  routes_.push_back({uri, method, handler, upload});
+  routeMetrics_.push_back(RouteMetrics());
+}
+
+void PortalServer::onNotFound(THandlerFunction handler) {
+  notFound_ = handler;
+}
+
+void PortalServer::collectHeaders(const char* headerKeys[], const size_t headerKeysCount) {
+  headerKeys_.clear();
+  for (size_t i = 0; i < headerKeysCount; i++) {
+    headerKeys_.push_back(headerKeys[i]);
+  }
+}
+
+size_t PortalServer::connections() const {
+  size_t count = 0;
+  for (size_t i = 0; i < PORTAL_MAX_CLIENTS; i++) {
+    if (clients_[i] != NULL) {
+      count++;
+    }
+  }
+  return count;
+}
+
+// A multipart body waits while another connection holds the upload buffer
+bool PortalServer::paused(size_t index) const {
+  return clients_[index]->state == CONN_MULTIPART && uploadOwner_ >= 0 && uploadOwner_ != (int)index;
+}
+
+// A connection with response bytes queued is not read from until they are
+// sent, so pipelined requests are answered in order
+bool PortalServer::writing(size_t index) const {
+  return clients_[index]->outPos < clients_[index]->out.length();
+}
+
+bool PortalServer::waitForActivity(uint32_t waitMs) {
+  if (listenFd_ < 0) {
+    delay(waitMs);
+    return false;
+  }
+  fd_set reads;
+  fd_set writes;
+  FD_ZERO(&reads);
+  FD_ZERO(&writes);
+  FD_SET(listenFd_, &reads);
+  int maxFd = listenFd_;
+  for (size_t i = 0; i < PORTAL_MAX_CLIENTS; i++) {
+    Connection* c = clients_[i];
+    if (c == NULL || paused(i)) {
+      continue;
+    }
+    if (writing(i)) {
+      FD_SET(c->fd, &writes);
+    } else if (c->inPos < c->inLen) {
+      return true;
+    } else {
+      FD_SET(c->fd, &reads);
+    }
+    maxFd = c->fd > maxFd ? c->fd : maxFd;
+  }
+  struct timeval timeout = {(long)(waitMs / 1000), (long)(waitMs % 1000) * 1000};
+  return select(maxFd + 1, &reads, &writes, NULL, &timeout) > 0;
+}
+
+void PortalServer::handleClient() {
+  if (listenFd_ < 0) {
+    return;
+  }
+
+  uint32_t now = millis();
+  bool acceptable = false;
+  for (size_t i = 0; i < PORTAL_MAX_CLIENTS; i++) {
+    Connection* c = clients_[i];
+    if (c == NULL) {
+      acceptable = true;
+      continue;
+    }
+    if (paused(i)) {
+      c->lastActivity = now;
+      continue;
+    }
+    if (writing(i)) {
+      if (now - c->blockedSince > PORTAL_WRITE_TIMEOUT_MS) {
+        closeConnection(i);
+        acceptable = true;
+      }
+      continue;
+    }
+    uint32_t limit = c->state == CONN_IDLE ? PORTAL_IDLE_TIMEOUT_MS : PORTAL_REQUEST_TIMEOUT_MS;
+    if (now - c->lastActivity > limit) {
+      closeConnection(i);
+      acceptable = true;
+    } else if (c->state == CONN_IDLE) {
+      acceptable = true;  // can be evicted for a new client
+    }
+  }
+
+  fd_set reads;
+  fd_set writes;
+  FD_ZERO(&reads);
+  FD_ZERO(&writes);
+  int maxFd = -1;
+  bool buffered = false;
+  if (acceptable) {
+    FD_SET(listenFd_, &reads);
+    maxFd = listenFd_;
+  }
+  for (size_t i = 0; i < PORTAL_MAX_CLIENTS; i++) {
+    Connection* c = clients_[i];
+    if (c == NULL || paused(i)) {
+      continue;
+    }
+    if (writing(i)) {
+      FD_SET(c->fd, &writes);
+    } else if (c->inPos < c->inLen) {
+      buffered = true;
+      continue;
+    } else {
+      FD_SET(c->fd, &reads);
+    }
+    maxFd = c->fd > maxFd ? c->fd : maxFd;
+  }
+  if (maxFd < 0 && !buffered) {
+    return;
+  }
+  struct timeval timeout = {0, 0};
+  if (maxFd >= 0 && select(maxFd + 1, &reads, &writes, NULL, &timeout) < 0) {
+    return;
+  }
+
+  for (size_t i = 0; i < PORTAL_MAX_CLIENTS; i++) {
+    Connection* c = clients_[i];
+    if (c == NULL || paused(i)) {
+      continue;
+    }
+    if (writing(i)) {
+      if (FD_ISSET(c->fd, &writes)) {
+        drain(i);
+      }
+    } else if (c->inPos < c->inLen || FD_ISSET(c->fd, &reads)) {
+      service(i);
+    }
+  }
+  if (acceptable && FD_ISSET(listenFd_, &reads)) {
+    acceptClient();
+  }
+}
+
+void PortalServer::acceptClient() {
+  int slot = -1;
+  for (size_t i = 0; i < PORTAL_MAX_CLIENTS && slot < 0; i++) {
+    if (clients_[i] == NULL) {
+      slot = i;
+    }
+  }
+  if (slot < 0) {
+    // Browsers hold spare keep-alive connections open; the longest idle one
+    // makes room for a client that has a request to send.
+    for (size_t i = 0; i < PORTAL_MAX_CLIENTS; i++) {
+      Connection* c = clients_[i];
+      if (c->state == CONN_IDLE && c->inPos == c->inLen && !writing(i) &&
+          (slot < 0 || c->lastActivity < clients_[slot]->lastActivity)) {
+        slot = i;
+      }
+    }
+    if (slot < 0) {
+      return;
+    }
+    closeConnection(slot);
+  }
+
+  int fd = accept(listenFd_, NULL, NULL);
+  if (fd < 0) {
+    return;
+  }
+  Connection* c = new (std::nothrow) Connection();
+  if (c == NULL) {
+    close(fd);
+    return;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  int on = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  c->fd = fd;
+  c->requests = 0;
+  c->inLen = 0;
+  c->inPos = 0;
+  c->out = "";
+  c->outPos = 0;
+  c->blocked = false;
+  c->blockedSince = 0;
+  c->closeAfterWrite = false;
+  resetRequest(*c);
+  clients_[slot] = c;
+}
+
+void PortalServer::closeConnection(size_t index) {
+  Connection* c = clients_[index];
+  if (uploadOwner_ == (int)index) {
+    if (c->uploading) {
+      c->failed = true;  // the handler may not answer a dropped upload
+      finishUpload(*c, UPLOAD_FILE_ABORTED);
+    }
+    uploadOwner_ = -1;
+  }
+  close(c->fd);
+  delete c;
+  clients_[index] = NULL;
+}
+
+// Closes a connection once what is queued for it has been sent
+void PortalServer::endConnection(size_t index) {
+  if (writing(index)) {
+    clients_[index]->closeAfterWrite = true;
+  } else {
+    closeConnection(index);
+  }
+}
+
+// Sends queued response bytes on a socket that became writable
+void PortalServer::drain(size_t index) {
+  Connection& c = *clients_[index];
+  if (!flushOut(c)) {
+    closeConnection(index);
+  } else if (!writing(index)) {
+    if (c.closeAfterWrite) {
+      closeConnection(index);
+    } else {
+      c.lastActivity = millis();  // idle from here
+    }
+  }
+}
+
+void PortalServer::resetRequest(Connection& c) {
+  c.state = CONN_IDLE;
+  c.lastActivity = millis();
+  c.lineLen = 0;
+  c.id = 0;
+  c.method = HTTP_ANY;
+  c.uri = String();
+  c.http11 = false;
+  c.keepAlive = false;
+  c.expectContinue = false;
+  c.chunkedBody = false;
+  c.contentLength = 0;
+  c.bodyRead = 0;
+  c.contentType = String();
+  c.body = String();
+  c.args.clear();
+  c.headers.clear();
+  c.route = NULL;
+  c.part = PART_PREAMBLE;
+  c.delimiterLen = 0;
+  c.matched = 0;
+  c.afterBoundaryLen = 0;
+  c.partIsFile = false;
+  c.uploading = false;
+  c.errorCode = 0;
+  c.responseHeaders = String();
+  c.responseLength = CONTENT_LENGTH_NOT_SET;
+  c.responded = false;
+  c.chunked = false;
+  c.failed = false;
+  c.status = 0;
+  c.sentBytes = 0;
+}
+
+void PortalServer::service(size_t index) {
+  Connection& c = *clients_[index];
+  if (c.inPos == c.inLen) {
+    int n = recv(c.fd, c.in, sizeof(c.in), 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+    }
+    if (n <= 0) {
+      closeConnection(index);
+      return;
+    }
+    c.inLen = n;
+    c.inPos = 0;
+    c.lastActivity = millis();
+  }
+  if (!processInput(index)) {
+    endConnection(index);
+  }
+}
+
+// Consumes buffered input until it runs out or one request has been
+// answered; pipelined requests behind it wait for the next pass so a busy
+// connection cannot starve the others. Returns false to close.
+bool PortalServer::processInput(size_t index) {
+  Connection& c = *clients_[index];
+  while (c.inPos < c.inLen) {
+    if (c.state == CONN_IDLE) {
+      c.state = CONN_REQUEST_LINE;
+      c.startedUs = micros();
+    }
+    if (c.state == CONN_REQUEST_LINE || c.state == CONN_HEADERS) {
+      int got = takeLine(c);
+      if (got < 0) {
+        return reject(c, c.state == CONN_REQUEST_LINE ? 414 : 431);
+      }
+      if (got == 0) {
+        continue;
+      }
+      if (c.state == CONN_REQUEST_LINE) {
+        if (c.lineLen > 0) {  // blank lines between requests are allowed
+          if (!requestLine(c)) {
+            return reject(c, 400);
+          }
+          c.state = CONN_HEADERS;
+        }
+      } else if (c.lineLen > 0) {
+        if (!headerLine(c)) {
+          return reject(c, 400);
+        }
+      } else {
+        if (!startBody(index)) {
+          return false;
+        }
+        if (c.state == CONN_IDLE) {
+          return true;  // answered without a body
+        }
+      }
+      c.lineLen = 0;
+      continue;
+    }
+
+    if (c.state == CONN_MULTIPART) {
+      if (paused(index)) {
+        return true;
+      }
+      uploadOwner_ = index;
+    }
+    size_t available = c.inLen - c.inPos;
+    size_t n = c.contentLength - c.bodyRead < available ? c.contentLength - c.bodyRead : available;
+    const uint8_t* data = c.in + c.inPos;
+    c.inPos += n;
+    c.bodyRead += n;
+    bool done = c.bodyRead == c.contentLength;
+
+    if (c.state == CONN_DISCARD) {
+      if (done) {
+        return false;
+      }
+    } else if (c.state == CONN_BODY) {
+      c.body.concat((const char*)data, n);
+      if (done) {
+        String type = c.contentType;
+        type.toLowerCase();
+        if (type.startsWith("application/x-www-form-urlencoded")) {
+          parseForm(c, c.body);
+        } else {
+          c.args.push_back({"plain", c.body});
+        }
+        c.body = String();
+        return dispatch(c);
+      }
+    } else {
+      current_ = &c;
+      bool ok = multipartBytes(c, data, n);
+      current_ = NULL;
+      if (ok && done && c.part != PART_DONE) {
+        c.errorCode = 400;  // body ended inside a part
+        ok = false;
+      }
+      if (!ok || done) {
+        if (c.uploading) {
+          finishUpload(c, UPLOAD_FILE_ABORTED);
+        }
+        uploadOwner_ = -1;
+      }
+      if (!ok) {
+        return reject(c, c.errorCode);
+      }
+      if (done) {
+        return dispatch(c);
+      }
+    }
+  }
+  return true;
+}
+
+// 1 when a whole line is in c.line, 0 when more input is needed, -1 when
+// the line is too long
+int PortalServer::takeLine(Connection& c) {
+  while (c.inPos < c.inLen) {
+    char ch = c.in[c.inPos++];
+    if (ch == '\n') {
+      if (c.lineLen > 0 && c.line[c.lineLen - 1] == '\r') {
+        c.lineLen--;
+      }
+      c.line[c.lineLen] = '\0';
+      return 1;
+    }
+    if (c.lineLen >= PORTAL_LINE_MAX) {
+      return -1;
+    }
+    c.line[c.lineLen++] = ch;
+  }
+  return 0;
+}
+
+bool PortalServer::requestLine(Connection& c) {
+  char* target = strchr(c.line, ' ');
+  if (target == NULL) {
+    return false;
+  }
+  *target++ = '\0';
+  char* version = strchr(target, ' ');
+  if (version == NULL) {
+    return false;
+  }
+  *version++ = '\0';
+
+  c.method = parseMethod(c.line);
+  if (c.method == HTTP_ANY || target[0] != '/') {
+    return false;
+  }
+  if (strcmp(version, "HTTP/1.1") == 0) {
+    c.http11 = true;
+  } else if (strcmp(version, "HTTP/1.0") != 0) {
+    return false;
+  }
+  c.requests++;
+  c.id = nextRequestId_++;
+  c.keepAlive = c.http11 && c.requests < PORTAL_MAX_KEEPALIVE_REQUESTS;
+
+  char* query = strchr(target, '?');
+  if (query != NULL) {
+    *query++ = '\0';
+    parseForm(c, String(query));
+  }
+  c.uri = target;
+  return true;
+}
+
+bool PortalServer::headerLine(Connection& c) {
+  char* value = strchr(c.line, ':');
+  if (value == NULL) {
+    return false;
+  }
+  *value++ = '\0';
+  String name = c.line;
+  String text = value;
+  text.trim();
+
+  if (name.equalsIgnoreCase("Content-Length")) {
+    char* end;
+    c.contentLength = strtoul(text.c_str(), &end, 10);
+    if (text.length() == 0 || *end != '\0') {
+      return false;
+    }
+  } else if (name.equalsIgnoreCase("Content-Type")) {
+    c.contentType = text;
+  } else if (name.equalsIgnoreCase("Transfer-Encoding")) {
+    c.chunkedBody = !text.equalsIgnoreCase("identity");
+  } else if (name.equalsIgnoreCase("Expect")) {
+    c.expectContinue = text.equalsIgnoreCase("100-continue");
+  } else if (name.equalsIgnoreCase("Connection")) {
+    text.toLowerCase();
+    if (text.indexOf("close") >= 0) {
+      c.keepAlive = false;
+    } else if (text.indexOf("keep-alive") >= 0 && !c.http11) {
+      c.keepAlive = c.requests < PORTAL_MAX_KEEPALIVE_REQUESTS;
+    }
+  }
+  for (const String& key : headerKeys_) {
+    if (name.equalsIgnoreCase(key)) {
+      c.headers.push_back({key, text});
+      break;
+    }
+  }
+  return true;
+}
+
+// Called once the headers are in: picks the route and gets ready for the
+// body. Returns false to close the connection.
+bool PortalServer::startBody(size_t index) {
+  Connection& c = *clients_[index];
+  for (const Route& route : routes_) {
+    if (route.uri == c.uri && (route.method == HTTP_ANY || route.method == c.method)) {
+      c.route = &route;
+      break;
+    }
+  }
+  c.state = CONN_BODY;
+  if (c.chunkedBody) {
+    return reject(c, 501);
+  }
+  if (c.contentLength == 0) {
+    return dispatch(c);
+  }
+
+  String type = c.contentType;
+  type.toLowerCase();
+  if (type.startsWith("multipart/form-data")) {
+    String boundary = headerParam(c.contentType, "boundary");
+    if (boundary.length() == 0 || boundary.length() > PORTAL_BOUNDARY_MAX) {
+      return reject(c, 400);
+    }
+    memcpy(c.delimiter, "\r\n--", 4);
+    memcpy(c.delimiter + 4, boundary.c_str(), boundary.length());
+    c.delimiterLen = 4 + boundary.length();
+    c.failure[0] = 0;
+    size_t k = 0;
+    for (size_t i = 1; i < c.delimiterLen; i++) {
+      while (k > 0 && c.delimiter[i] != c.delimiter[k]) {
+        k = c.failure[k - 1];
+      }
+      if (c.delimiter[i] == c.delimiter[k]) {
+        k++;
+      }
+      c.failure[i] = k;
+    }
+    // The body opens with "--boundary", which is the delimiter minus the
+    // CRLF that normally ends the previous part
+    c.matched = 2;
+    c.part = PART_PREAMBLE;
+    c.state = CONN_MULTIPART;
+  } else if (c.contentLength > PORTAL_BODY_MAX) {
+    return reject(c, 413);
+  } else {
+    c.body.reserve(c.contentLength);
+  }
+
+  if (c.expectContinue && c.http11) {
+    static const char CONTINUE[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    writeOut(c, CONTINUE, sizeof(CONTINUE) - 1);
+    return flushOut(c);
+  }
+  return true;
+}
+
+// Splits a multipart body on the boundary as it streams past, using a KMP
+// matcher so no part has to be buffered to find its end. Bytes held back
+// as a possible boundary are a prefix of the delimiter, so they are
+// replayed from it when the match fails.
+bool PortalServer::multipartBytes(Connection& c, const uint8_t* data, size_t len) {
+  const uint8_t* run = NULL;  // plain part bytes not yet passed on
+  size_t runLen = 0;
+  for (size_t i = 0; i < len && c.errorCode == 0; i++) {
+    uint8_t b = data[i];
+    if (c.part == PART_PREAMBLE || c.part == PART_DATA) {
+      if (c.matched == 0 && b != (uint8_t)c.delimiter[0]) {
+        if (run == NULL) {
+          run = data + i;
+        }
+        runLen++;
+        continue;
+      }
+      if (c.part == PART_DATA && runLen > 0) {
+        partBytes(c, run, runLen);
+      }
+      run = NULL;
+      runLen = 0;
+      while (c.matched > 0 && b != (uint8_t)c.delimiter[c.matched]) {
+        size_t fallback = c.failure[c.matched - 1];
+        if (c.part == PART_DATA) {
+          partBytes(c, (const uint8_t*)c.delimiter, c.matched - fallback);
+        }
+        c.matched = fallback;
+      }
+      if (b != (uint8_t)c.delimiter[c.matched]) {
+        run = data + i;
+        runLen = 1;
+      } else if (++c.matched == c.delimiterLen) {
+        if (c.part == PART_DATA) {
+          endPart(c);
+        }
+        c.part = PART_AFTER_BOUNDARY;
+        c.matched = 0;
+        c.afterBoundaryLen = 0;
+      }
+    } else if (c.part == PART_AFTER_BOUNDARY) {
+      c.afterBoundary[c.afterBoundaryLen++] = b;
+      if (c.afterBoundaryLen < 2) {
+        continue;
+      }
+      if (memcmp(c.afterBoundary, "--", 2) == 0) {
+        c.part = PART_DONE;
+      } else if (memcmp(c.afterBoundary, "\r\n", 2) == 0) {
+        c.part = PART_HEADERS;
+        c.lineLen = 0;
+        c.partIsFile = false;
+        upload_.name = String();
+        upload_.filename = String();
+        upload_.type = String();
+      } else {
+        c.errorCode = 400;
+      }
+    } else if (c.part == PART_HEADERS) {
+      if (b == '\n') {
+        if (c.lineLen > 0 && c.line[c.lineLen - 1] == '\r') {
+          c.lineLen--;
+        }
+        c.line[c.lineLen] = '\0';
+        if (c.lineLen == 0) {
+          startPart(c);
+        } else if (!partHeaderLine(c)) {
+          c.errorCode = 400;
+        }
+        c.lineLen = 0;
+      } else if (c.lineLen >= PORTAL_LINE_MAX) {
+        c.errorCode = 431;
+      } else {
+        c.line[c.lineLen++] = b;
+      }
+    } else {
+      break;  // epilogue after the closing boundary
+    }
+  }
+  if (c.part == PART_DATA && runLen > 0 && c.errorCode == 0) {
+    partBytes(c, run, runLen);
+  }
+  return c.errorCode == 0 && !c.failed;
+}
+
+bool PortalServer::partHeaderLine(Connection& c) {
+  char* value = strchr(c.line, ':');
+  if (value == NULL) {
+    return false;
+  }
+  *value++ = '\0';
+  String name = c.line;
+  String text = value;
+  text.trim();
+  if (name.equalsIgnoreCase("Content-Disposition")) {
+    upload_.name = headerParam(text, "name");
+    upload_.filename = headerParam(text, "filename");
+    c.partIsFile = text.indexOf("filename=") >= 0;
+  } else if (name.equalsIgnoreCase("Content-Type")) {
+    upload_.type = text;
+  }
+  return true;
+}
+
+void PortalServer::startPart(Connection& c) {
+  c.part = PART_DATA;
+  c.matched = 0;
+  c.body = String();
+  if (c.partIsFile && c.route != NULL && c.route->upload) {
+    upload_.status = UPLOAD_FILE_START;
+    upload_.totalSize = 0;
+    upload_.currentSize = 0;
+    c.route->upload();
+    upload_.status = UPLOAD_FILE_WRITE;
+    c.uploading = true;
+  }
+}
+
+// File data goes to the upload handler in HTTP_UPLOAD_BUFLEN pieces; other
+// fields are collected as args. A file part without a handler is dropped.
+void PortalServer::partBytes(Connection& c, const uint8_t* data, size_t len) {
+  if (c.uploading) {
+    while (len > 0) {
+      size_t room = HTTP_UPLOAD_BUFLEN - upload_.currentSize;
+      size_t n = len < room ? len : room;
+      memcpy(upload_.buf + upload_.currentSize, data, n);
+      upload_.currentSize += n;
+      data += n;
+      len -= n;
+      if (upload_.currentSize == HTTP_UPLOAD_BUFLEN) {
+        upload_.totalSize += upload_.currentSize;
+        upload_.status = UPLOAD_FILE_WRITE;
+        c.route->upload();
+        upload_.currentSize = 0;
+      }
+    }
+  } else if (!c.partIsFile) {
+    if (c.body.length() + len > PORTAL_BODY_MAX) {
+      c.errorCode = 413;
+      return;
+    }
+    c.body.concat((const char*)data, len);
+  }
+}
+
+void PortalServer::endPart(Connection& c) {
+  if (c.uploading) {
+    finishUpload(c, UPLOAD_FILE_END);
+  } else if (!c.partIsFile) {
+    c.args.push_back({upload_.name, c.body});
+    c.body = String();
+  }
+}
+
+void PortalServer::finishUpload(Connection& c, HTTPUploadStatus status) {
+  Connection* previous = current_;
+  current_ = &c;
+  if (status == UPLOAD_FILE_END && upload_.currentSize > 0) {
+    upload_.totalSize += upload_.currentSize;
+    upload_.status = UPLOAD_FILE_WRITE;
+    c.route->upload();
+    upload_.currentSize = 0;
+  }
+  upload_.status = status;
+  c.route->upload();
+  c.uploading = false;
+  current_ = previous;
+}
+
+void PortalServer::parseForm(Connection& c, const String& form) {
+  const char* text = form.c_str();
+  while (*text != '\0') {
+    const char* end = strchr(text, '&');
+    size_t len = end != NULL ? end - text : strlen(text);
+    const char* eq = (const char*)memchr(text, '=', len);
+    if (len > 0) {
+      size_t nameLen = eq != NULL ? eq - text : len;
+      c.args.push_back({urlDecode(text, nameLen),
+                        eq != NULL ? urlDecode(eq + 1, len - nameLen - 1) : String()});
+    }
+    text += len;
+    if (*text == '&') {
+      text++;
+    }
+  }
+}
+
+// Runs the route handler and makes sure the client got a complete
+// response. Returns whether the connection stays open for another request.
+bool PortalServer::dispatch(Connection& c) {
+  current_ = &c;
+  if (c.route != NULL) {
+    c.route->handler();
+  } else if (notFound_) {
+    notFound_();
+  } else {
+    send(404, "text/plain", String("Not found: ") + c.uri);
+  }
+  if (!c.responded) {
+    send(500, "text/plain", "No response");
+  }
+  if (c.chunked) {
+    sendContent("", 0);
+  }
+  flushOut(c);
+  current_ = NULL;
+  recordRequest(c);
+  bool keep = c.keepAlive && !c.failed;
+  resetRequest(c);
+  return keep;
+}
+
+// Answers a request that cannot be served and closes the connection. A
+// short remaining body is read and dropped first, so the client is not
+// reset before it has seen the error.
+bool PortalServer::reject(Connection& c, int code) {
+  current_ = &c;
+  c.keepAlive = false;
+  if (!c.responded) {
+    send(code, "text/plain", reasonPhrase(code));
+  }
+  flushOut(c);
+  current_ = NULL;
+  recordRequest(c);
+  size_t remaining = c.contentLength - c.bodyRead;
+  if (c.state >= CONN_BODY && remaining > 0 && remaining <= PORTAL_DISCARD_MAX && !c.failed) {
+    c.state = CONN_DISCARD;
+    return true;
+  }
+  return false;
+}
+
+// Runs once per request, after its response has been written out
+void PortalServer::recordRequest(Connection& c) {
+  RouteMetrics& m = c.route != NULL ? routeMetrics_[c.route - routes_.data()] : unmatchedMetrics_;
+  m.latency.record(micros() - c.startedUs);
+  m.responseBytes += c.sentBytes;
+  if (c.status >= 400 || c.failed) {
+    m.errors++;
+  }
+  requestsServed_++;
+}
+
+String PortalServer::uri() const {
+  return current_ != NULL ? current_->uri : String();
+}
+
+HTTPMethod PortalServer::method() const {
+  return current_ != NULL ? current_->method : HTTP_ANY;
+}
+
+HTTPUpload& PortalServer::upload() {
+  return upload_;
+}
+
+String PortalServer::arg(const String& name) const {
+  if (current_ != NULL) {
+    for (const Pair& pair : current_->args) {
+      if (pair.name == name) {
+        return pair.value;
+      }
+    }
+  }
+  return String();
+}
+
+String PortalServer::arg(int i) const {
+  return current_ != NULL && i >= 0 && i < (int)current_->args.size() ? current_->args[i].value : String();
+}
+
+String PortalServer::argName(int i) const {
+  return current_ != NULL && i >= 0 && i < (int)current_->args.size() ? current_->args[i].name : String();
+}
+
+int PortalServer::args() const {
+  return current_ != NULL ? current_->args.size() : 0;
+}
+
+bool PortalServer::hasArg(const String& name) const {
+  if (current_ != NULL) {
+    for (const Pair& pair : current_->args) {
+      if (pair.name == name) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+String PortalServer::header(const String& name) const {
+  if (current_ != NULL) {
+    for (const Pair& pair : current_->headers) {
+      if (pair.name.equalsIgnoreCase(name)) {
+        return pair.value;
+      }
+    }
+  }
+  return String();
+}
+
+bool PortalServer::hasHeader(const String& name) const {
+  if (current_ != NULL) {
+    for (const Pair& pair : current_->headers) {
+      if (pair.name.equalsIgnoreCase(name)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+uint32_t PortalServer::requestId() const {
+  return current_ != NULL ? current_->id : 0;
+}
+
+void PortalServer::setContentLength(const size_t length) {
+  if (current_ != NULL) {
+    current_->responseLength = length;
+  }
+}
+
+void PortalServer::sendHeader(const String& name, const String& value, bool first) {
+  if (current_ == NULL) {
+    return;
+  }
+  String line = name + ": " + value + "\r\n";
+  current_->responseHeaders = first ? line + current_->responseHeaders : current_->responseHeaders + line;
+}
+
+void PortalServer::sendStatus(int code, const char* contentType, size_t length) {
+  Connection& c = *current_;
+  c.responded = true;
+  c.status = code;
+  if (c.responseLength != CONTENT_LENGTH_NOT_SET) {
+    length = c.responseLength;
+  }
+  char line[80];
+  snprintf(line, sizeof(line), "HTTP/1.%d %d %s\r\n", c.http11 ? 1 : 0, code, reasonPhrase(code));
+  String head;
+  head.reserve(160 + c.responseHeaders.length());
+  head += line;
+  head += "Content-Type: ";
+  head += contentType != NULL ? contentType : "text/html";
+  head += "\r\n";
+  if (length != CONTENT_LENGTH_UNKNOWN) {
+    head += "Content-Length: ";
+    head += (unsigned long)length;
+    head += "\r\n";
+  } else if (c.http11) {
+    head += "Transfer-Encoding: chunked\r\n";
+    c.chunked = c.method != HTTP_HEAD;
+  } else {
+    c.keepAlive = false;  // an HTTP/1.0 body of unknown length ends at close
+  }
+  head += c.keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+  head += c.responseHeaders;
+  head += "\r\n";
+  writeOut(c, head.c_str(), head.length());
+  c.responseHeaders = String();
+  c.responseLength = CONTENT_LENGTH_NOT_SET;
+}
+
+// Only the first response to a request is sent; the upload routes answer
+// from the upload handler and then again from the request handler.
+void PortalServer::send(int code, const char* contentType, const String& content) {
+  send_P(code, contentType, content.c_str(), content.length());
+}
+
+void PortalServer::send(int code, const String& contentType, const String& content) {
+  send_P(code, contentType.c_str(), content.c_str(), content.length());
+}
+
+void PortalServer::send(int code, const char* contentType, const char* content) {
+  send_P(code, contentType, content, strlen(content));
+}
+
+void PortalServer::send_P(int code, PGM_P contentType, PGM_P content) {
+  send_P(code, contentType, content, strlen_P(content));
+}
+
+void PortalServer::send_P(int code, PGM_P contentType, PGM_P content, size_t len) {
+  if (current_ == NULL || current_->responded) {
+    return;
+  }
+  sendStatus(code, contentType, len);
+  if (len > 0) {
+    sendContent(content, len);
+  }
+}
+
+void PortalServer::sendContent(const String& content) {
+  sendContent(content.c_str(), content.length());
+}
+
+// With chunked transfer encoding an empty piece ends the response
+void PortalServer::sendContent(const char* content, size_t len) {
+  if (current_ == NULL || !current_->responded || current_->method == HTTP_HEAD) {
+    return;
+  }
+  Connection& c = *current_;
+  if (c.chunked) {
+    char size[12];
+    int n = snprintf(size, sizeof(size), "%x\r\n", (unsigned)len);
+    writeOut(c, size, n);
+    writeOut(c, content, len);
+    writeOut(c, "\r\n", 2);
+    c.chunked = len > 0;
+  } else {
+    writeOut(c, content, len);
+  }
+}
+
+void PortalServer::sendContent_P(PGM_P content) {
+  sendContent(content, strlen_P(content));
+}
+
+void PortalServer::sendContent_P(PGM_P content, size_t len) {
+  sendContent(content, len);
+}
+
+// Small writes are gathered into one segment; large ones go straight out.
+// Whatever the socket does not take is queued and sent by drain().
+void PortalServer::writeOut(Connection& c, const char* data, size_t len) {
+  if (c.failed || len == 0) {
+    return;
+  }
+  c.sentBytes += len;
+  if (c.out.length() - c.outPos + len > PORTAL_RECV_SIZE) {
+    flushOut(c);
+    if (c.failed) {
+      return;
+    }
+    if (c.out.length() == 0 && len >= PORTAL_RECV_SIZE) {
+      size_t n = sendNow(c, data, len);
+      data += n;
+      len -= n;
+    }
+  }
+  if (len == 0 || c.failed) {
+    return;
+  }
+  if (c.outPos > 0) {
+    c.out = c.out.substring(c.outPos);
+    c.outPos = 0;
+  }
+  c.out.concat(data, len);
+  if (c.blocked && c.out.length() > PORTAL_OUT_MAX) {
+    waitWritable(c);
+  }
+}
+
+// Sends what the socket takes now; false once the connection has failed
+bool PortalServer::flushOut(Connection& c) {
+  if (c.outPos < c.out.length()) {
+    c.outPos += sendNow(c, c.out.c_str() + c.outPos, c.out.length() - c.outPos);
+  }
+  if (c.failed || c.outPos == c.out.length()) {
+    c.out = "";
+    c.outPos = 0;
+    c.blocked = false;
+  }
+  return !c.failed;
+}
+
+// Never waits. The first refusal starts the clock PORTAL_WRITE_TIMEOUT_MS
+// runs on, and partial sends do not restart it, so a client that takes a
+// few bytes at a time still has to take the whole response in that time.
+size_t PortalServer::sendNow(Connection& c, const char* data, size_t len) {
+  size_t sent = 0;
+  while (sent < len) {
+    int n = ::send(c.fd, data + sent, len - sent, MSG_NOSIGNAL);
+    if (n > 0) {
+      sent += n;
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      if (!c.blocked) {
+        c.blocked = true;
+        c.blockedSince = millis();
+      }
+    } else {
+      c.failed = true;
+    }
+    break;
+  }
+  return sent;
+}
+
+// A handler has queued more than PORTAL_OUT_MAX for a client that is not
+// reading: waits for the socket, but only until the response's deadline
+void PortalServer::waitWritable(Connection& c) {
+  while (flushOut(c) && c.out.length() - c.outPos > PORTAL_OUT_MAX) {
+    if (millis() - c.blockedSince > PORTAL_WRITE_TIMEOUT_MS) {
+      c.failed = true;
+      flushOut(c);
+      return;
+    }
+    fd_set writes;
+    FD_ZERO(&writes);
+    FD_SET(c.fd, &writes);
+    struct timeval timeout = {0, 100000};
+    select(c.fd + 1, NULL, &writes, NULL, &timeout);
+  }
+}
@@ -0,0 +1,115 @@
+#include "power.h"
+
+#include <Logger.h>
+
+PowerManager Power;
+
+static const uint32_t STATE_MHZ[POWER_STATES] = {
+  POWER_ACTIVE_MHZ, POWER_IDLE_MHZ, POWER_SLEEP_MHZ
+};
+static const uint32_t STATE_WAIT_MS[POWER_STATES] = {
+  POWER_ACTIVE_WAIT_MS, POWER_IDLE_WAIT_MS, POWER_SLEEP_WAIT_MS
+};
+
+PowerManager::PowerManager()
+  : state_(POWER_ACTIVE), enteredMs_(0), lastActivityMs_(0), lastStationMs_(0), wakes_(0),
+    wakeStartUs_(0), requests_(0), wakeRequests_(0), measuring_(false), lastWakeUs_(0),
+    lastFirstRequestUs_(0), maxFirstRequestUs_(0) {
+  for (size_t i = 0; i < POWER_STATES; i++) {
+    stateMs_[i] = 0;
+  }
+}
+
+void PowerManager::begin() {
+  uint32_t now = millis();
+  enteredMs_ = now;
+  lastActivityMs_ = now;
+  lastStationMs_ = now;
+  state_ = POWER_ACTIVE;
+  setCpuFrequencyMhz(POWER_ACTIVE_MHZ);
+}
+
+uint32_t PowerManager::waitMs() const {
+  return STATE_WAIT_MS[state_];
+}
+
+void PowerManager::enter(PowerState state) {
+  uint32_t now = millis();
+  stateMs_[state_] += now - enteredMs_;
+  enteredMs_ = now;
+  state_ = state;
+  setCpuFrequencyMhz(STATE_MHZ[state]);
+  LOG_DEBUG("Power: %s, %u MHz", powerStateName(state), (unsigned)STATE_MHZ[state]);
+}
+
+void PowerManager::activity() {
+  uint32_t now = millis();
+  lastActivityMs_ = now;
+  lastStationMs_ = now;  // whoever opened the socket is associated
+  if (state_ == POWER_ACTIVE) {
+    return;
+  }
+  uint32_t start = micros();
+  enter(POWER_ACTIVE);
+  wakes_++;
+  lastWakeUs_ = micros() - start;
+  wakeStartUs_ = start;
+  wakeRequests_ = requests_;
+  measuring_ = true;
+}
+
+void PowerManager::update(uint8_t stations, bool busy, uint32_t requestsServed) {
+  uint32_t now = millis();
+  requests_ = requestsServed;
+  if (measuring_ && requestsServed != wakeRequests_) {
+    lastFirstRequestUs_ = micros() - wakeStartUs_;
+    if (lastFirstRequestUs_ > maxFirstRequestUs_) {
+      maxFirstRequestUs_ = lastFirstRequestUs_;
+    }
+    measuring_ = false;
+  }
+  if (stations > 0) {
+    lastStationMs_ = now;
+  }
+  if (busy) {
+    lastActivityMs_ = now;
+  }
+
+  PowerState target;
+  if (now - lastActivityMs_ < POWER_IDLE_AFTER_MS) {
+    target = POWER_ACTIVE;
+  } else if (now - lastStationMs_ < POWER_SLEEP_AFTER_MS) {
+    target = POWER_IDLE;
+  } else {
+    target = POWER_SLEEP;
+  }
+  if (target != state_) {
+    // A wake that ends without a request has nothing to measure
+    measuring_ = false;
+    enter(target);
+  }
+}
+
+PowerStats PowerManager::stats() const {
+  PowerStats s;
+  s.state = state_;
+  s.cpuMhz = getCpuFrequencyMhz();
+  for (size_t i = 0; i < POWER_STATES; i++) {
+    s.stateMs[i] = stateMs_[i];
+  }
+  s.stateMs[state_] += millis() - enteredMs_;
+  s.wakes = wakes_;
+  s.lastWakeUs = lastWakeUs_;
+  s.lastFirstRequestUs = lastFirstRequestUs_;
+  s.maxFirstRequestUs = maxFirstRequestUs_;
+  return s;
+}
+
+const char* powerStateName(PowerState state) {
+  switch (state) {
+    case POWER_ACTIVE: return "active";
+    case POWER_IDLE: return "idle";
+    case POWER_SLEEP: return "sleep";
+    default: return "unknown";
+  }
+}
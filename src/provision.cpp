@@ -0,0 +1,305 @@
+#include "provision.h"
+
+#include <CredentialCache.h>
+#include <Logger.h>
+
+#define PROVISION_JOURNAL_TMP "/provision.tmp"
+
+static const char CERT_STAGED[] = DEVICE_CERT_PATH PROVISION_SUFFIX;
+static const char KEY_STAGED[] = DEVICE_KEY_PATH PROVISION_SUFFIX;
+
+// File system the journal entries are applied to
+static fs::FS* applyFs = NULL;
+
+static void removeStaged(fs::FS& fs) {
+  if (fs.exists(CERT_STAGED)) {
+    fs.remove(CERT_STAGED);
+  }
+  if (fs.exists(KEY_STAGED)) {
+    fs.remove(KEY_STAGED);
+  }
+}
+
+static void swapIn(fs::FS& fs, const char* staged, const char* path) {
+  // Absent when a previous attempt already moved it
+  if (fs.exists(staged)) {
+    fs.remove(path);
+    fs.rename(staged, path);
+  }
+}
+
+static ConfigResult applyEntry(const char* key, const char* value) {
+  if (strcmp(key, "cert") == 0) {
+    swapIn(*applyFs, CERT_STAGED, DEVICE_CERT_PATH);
+    return CONFIG_OK;
+  }
+  if (strcmp(key, "key") == 0) {
+    swapIn(*applyFs, KEY_STAGED, DEVICE_KEY_PATH);
+    return CONFIG_OK;
+  }
+  return Config.set(key, value);
+}
+
+// Applies a journal and removes it once the settings are saved. Every step
+// can be repeated, so a reset part way through is finished at the next
+// boot. Returns false if the journal cannot be parsed.
+static bool applyJournal(fs::FS& fs, const char* journal, int& written) {
+  applyFs = &fs;
+  written = -1;
+  if (configParseJson(journal, applyEntry) != CONFIG_OK) {
+    return false;
+  }
+  written = Config.commit();
+  if (written >= 0) {
+    fs.remove(PROVISION_JOURNAL);
+  }
+  return true;
+}
+
+ProvisionBundle::ProvisionBundle(PemUpload& upload)
+  : fs_(NULL), requestId_(0), upload_(upload), fileName_(NULL), cert_(false), key_(false),
+    result_(PROVISION_OK), written_(0), journalLen_(0), error_("") {
+  journal_[0] = 0;
+  field_[0] = 0;
+}
+
+void ProvisionBundle::begin(fs::FS& fs, uint32_t requestId) {
+  fs_ = &fs;
+  discard();
+  requestId_ = requestId;
+  result_ = PROVISION_OK;
+  written_ = 0;
+  error_ = "";
+  field_[0] = 0;
+  journal_[0] = '{';
+  journal_[1] = 0;
+  journalLen_ = 1;
+}
+
+bool ProvisionBundle::fail(ProvisionResult result, const char* field, const char* error) {
+  if (result_ == PROVISION_OK) {
+    result_ = result;
+    error_ = error;
+    // Names come from the request; keep them safe to echo in JSON
+    size_t n = 0;
+    for (; field[n] != 0 && n < sizeof(field_) - 1; n++) {
+      field_[n] = isalnum((unsigned char)field[n]) || field[n] == '_' ? field[n] : '_';
+    }
+    field_[n] = 0;
+  }
+  discard();
+  return false;
+}
+
+// Removes the staged files; the live ones are untouched
+void ProvisionBundle::discard() {
+  upload_.abort();
+  fileName_ = NULL;
+  if (fs_ != NULL) {
+    removeStaged(*fs_);
+  }
+  cert_ = false;
+  key_ = false;
+}
+
+bool ProvisionBundle::startFile(const char* name) {
+  if (fs_ == NULL || result_ != PROVISION_OK) {
+    return false;
+  }
+  bool started;
+  if (strcmp(name, "cert") == 0) {
+    fileName_ = "cert";
+    started = upload_.begin(*fs_, DEVICE_CERT_PATH, PEM_CERTIFICATE, PROVISION_SUFFIX);
+  } else if (strcmp(name, "key") == 0) {
+    fileName_ = "key";
+    started = upload_.begin(*fs_, DEVICE_KEY_PATH, PEM_PRIVATE_KEY, PROVISION_SUFFIX);
+  } else {
+    return fail(PROVISION_BAD_FILE, name, "Unknown file part.");
+  }
+  if (!started) {
+    return fail(PROVISION_STORAGE_ERROR, fileName_, upload_.lastError());
+  }
+  return true;
+}
+
+bool ProvisionBundle::writeFile(const uint8_t* data, size_t len) {
+  if (fileName_ == NULL) {
+    return false;
+  }
+  if (!upload_.write(data, len)) {
+    return fail(PROVISION_BAD_FILE, fileName_, upload_.lastError());
+  }
+  return true;
+}
+
+bool ProvisionBundle::endFile() {
+  if (fileName_ == NULL) {
+    return false;
+  }
+  if (!upload_.stage()) {
+    return fail(PROVISION_BAD_FILE, fileName_, upload_.lastError());
+  }
+  if (fileName_[0] == 'c') {
+    cert_ = true;
+  } else {
+    key_ = true;
+  }
+  fileName_ = NULL;
+  return true;
+}
+
+// Appends len bytes to the journal, keeping room for the terminator.
+// Refuses, writing nothing, if they do not fit.
+bool ProvisionBundle::append(const char* data, size_t len) {
+  if (journalLen_ + len >= sizeof(journal_)) {
+    return false;
+  }
+  memcpy(journal_ + journalLen_, data, len);
+  journalLen_ += len;
+  journal_[journalLen_] = 0;
+  return true;
+}
+
+// Keys passed Config.check(), so they hold no quotes. In the journal a key
+// follows '{' or ','; inside a value every quote is escaped, so a match
+// there is never preceded by one of those.
+bool ProvisionBundle::hasSetting(const char* key) const {
+  size_t n = strlen(key);
+  for (const char* at = strstr(journal_, key); at != NULL; at = strstr(at + 1, key)) {
+    if (at - journal_ >= 2 && at[-1] == '"' && (at[-2] == '{' || at[-2] == ',') &&
+        at[n] == '"' && at[n + 1] == ':') {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Appends "key":"value", to the journal, escaped for configParseJson
+ConfigResult ProvisionBundle::addSetting(const char* key, const char* value) {
+  if (result_ != PROVISION_OK) {
+    return CONFIG_BAD_REQUEST;
+  }
+  ConfigResult result = Config.check(key, value);
+  if (result != CONFIG_OK) {
+    fail(PROVISION_BAD_SETTING, key, configResultName(result));
+    return result;
+  }
+  if (hasSetting(key)) {
+    fail(PROVISION_BAD_SETTING, key, "Setting given twice.");
+    return CONFIG_BAD_REQUEST;
+  }
+  size_t start = journalLen_;
+  bool ok = append("\"", 1) && append(key, strlen(key)) && append("\":\"", 3);
+  for (const char* c = value; ok && *c; c++) {
+    char escaped[8];
+    size_t n;
+    if (*c == '"' || *c == '\\') {
+      escaped[0] = '\\';
+      escaped[1] = *c;
+      n = 2;
+    } else if ((unsigned char)*c < 0x20) {
+      n = snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned)*c);
+    } else {
+      escaped[0] = *c;
+      n = 1;
+    }
+    ok = append(escaped, n);
+  }
+  if (!ok || !append("\",", 2)) {
+    journalLen_ = start;
+    journal_[start] = 0;
+    fail(PROVISION_BAD_SETTING, key, configResultName(CONFIG_TOO_LONG));
+    return CONFIG_TOO_LONG;
+  }
+  return CONFIG_OK;
+}
+
+ProvisionResult ProvisionBundle::commit() {
+  if (fs_ == NULL) {
+    return PROVISION_EMPTY;
+  }
+  if (result_ != PROVISION_OK) {
+    return result_;
+  }
+  if (fileName_ != NULL) {
+    fail(PROVISION_BAD_FILE, fileName_, "File part incomplete.");
+    return result_;
+  }
+  static const char CERT_ENTRY[] = "\"cert\":\"1\",";
+  static const char KEY_ENTRY[] = "\"key\":\"1\",";
+  if ((cert_ && !append(CERT_ENTRY, sizeof(CERT_ENTRY) - 1)) ||
+      (key_ && !append(KEY_ENTRY, sizeof(KEY_ENTRY) - 1))) {
+    fail(PROVISION_BAD_SETTING, "", "Bundle too large.");
+    return result_;
+  }
+  if (journalLen_ <= 1) {
+    fail(PROVISION_EMPTY, "", "Empty bundle.");
+    return result_;
+  }
+  journal_[journalLen_ - 1] = '}';
+
+  // Once the journal is in place the bundle is committed
+  File f = fs_->open(PROVISION_JOURNAL_TMP, FILE_WRITE);
+  bool ok = f && f.write((const uint8_t*)journal_, journalLen_) == journalLen_;
+  f.close();
+  if (fs_->exists(PROVISION_JOURNAL)) {
+    fs_->remove(PROVISION_JOURNAL);
+  }
+  if (!ok || !fs_->rename(PROVISION_JOURNAL_TMP, PROVISION_JOURNAL)) {
+    fs_->remove(PROVISION_JOURNAL_TMP);
+    fail(PROVISION_STORAGE_ERROR, "", "Could not write the journal.");
+    return result_;
+  }
+
+  applyJournal(*fs_, journal_, written_);
+  if (written_ < 0) {
+    // The journal stays, so the next boot tries again
+    result_ = PROVISION_STORAGE_ERROR;
+    error_ = "Could not save settings.";
+    return result_;
+  }
+  LOG_INFO("Provision: committed%s%s and %d settings", cert_ ? " certificate" : "",
+           key_ ? " key" : "", written_);
+  fs_ = NULL;
+  return PROVISION_OK;
+}
+
+void ProvisionBundle::abort() {
+  if (fs_ != NULL) {
+    discard();
+  }
+  fs_ = NULL;
+}
+
+void provisionRecover(fs::FS& fs) {
+  if (fs.exists(PROVISION_JOURNAL_TMP)) {
+    fs.remove(PROVISION_JOURNAL_TMP);
+  }
+  if (fs.exists(PROVISION_JOURNAL)) {
+    char journal[PROVISION_JOURNAL_MAX];
+    File f = fs.open(PROVISION_JOURNAL, FILE_READ);
+    size_t len = f ? f.read((uint8_t*)journal, sizeof(journal) - 1) : 0;
+    f.close();
+    journal[len] = 0;
+    int written;
+    if (applyJournal(fs, journal, written)) {
+      LOG_INFO("Provision: finished an interrupted bundle (%d settings)", written);
+      return;
+    }
+    // Unreadable: drop it, as if it never committed
+    LOG_WARN("Provision: discarding an unreadable journal");
+    fs.remove(PROVISION_JOURNAL);
+  }
+  removeStaged(fs);
+}
+
+const char* provisionResultName(ProvisionResult result) {
+  switch (result) {
+    case PROVISION_OK: return "ok";
+    case PROVISION_BAD_FILE: return "bad_file";
+    case PROVISION_BAD_SETTING: return "bad_setting";
+    case PROVISION_EMPTY: return "empty";
+    case PROVISION_STORAGE_ERROR: return "storage_error";
+    default: return "unknown";
+  }
+}
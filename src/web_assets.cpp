@@ -0,0 +1,32 @@
+#include "web_assets.h"
+
+// If-None-Match holds one or more entity tags, or "*"; weak comparison
+// is what the header calls for, so a W/ prefix still matches
+static bool clientHasCurrent(const String& ifNoneMatch, const char* etag) {
+  if (ifNoneMatch.length() == 0) {
+    return false;
+  }
+  return ifNoneMatch == "*" || strstr(ifNoneMatch.c_str(), etag) != NULL;
+}
+
+void sendWebAsset(PortalServer& server, const WebAsset& asset) {
+  server.sendHeader("ETag", asset.etag);
+  server.sendHeader("Cache-Control", "public, max-age=" + String(WEB_ASSET_MAX_AGE));
+  server.sendHeader("Vary", "Accept-Encoding");
+  if (clientHasCurrent(server.header("If-None-Match"), asset.etag)) {
+    // No body; Content-Length still describes the representation
+    server.setContentLength(asset.length);
+    server.send_P(304, asset.contentType, "", 0);
+    return;
+  }
+  // Every browser accepts gzip, so there is no uncompressed copy
+  server.sendHeader("Content-Encoding", "gzip");
+  server.send_P(200, asset.contentType, (PGM_P)asset.data, asset.length);
+}
+
+void registerWebAssets(PortalServer& server) {
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++) {
+    const WebAsset* asset = &WEB_ASSETS[i];
+    server.on(asset->uri, HTTP_GET, [&server, asset]() { sendWebAsset(server, *asset); });
+  }
+}
@@ -0,0 +1,46 @@
+// Generated by scripts/web_assets.py from web/; do not edit.
+
+#include "web_assets.h"
+
+// /style.css: 1085 bytes, 521 gzipped
+static const uint8_t WEB_STYLE_CSS_GZ[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x85, 0x53, 0x4d, 0x8f, 0x9b, 0x30,
+  0x10, 0xbd, 0xf3, 0x2b, 0x90, 0xa2, 0x2a, 0xbb, 0x52, 0x40, 0x86, 0x26, 0x69, 0x62, 0x54, 0xa9,
+  0x3d, 0xf6, 0x5c, 0xf5, 0x54, 0xf5, 0x60, 0xfc, 0x41, 0x46, 0x6b, 0x6c, 0x64, 0x9b, 0x4d, 0x52,
+  0xc4, 0x7f, 0xaf, 0x0d, 0x9b, 0x10, 0xd8, 0x95, 0x2a, 0x5f, 0xfc, 0x35, 0x33, 0xef, 0xbd, 0x79,
+  0x53, 0x6a, 0x76, 0xed, 0x4a, 0x42, 0x5f, 0x2a, 0xa3, 0x5b, 0xc5, 0xf0, 0x4a, 0x6c, 0xc5, 0x41,
+  0x94, 0x85, 0xd0, 0xca, 0x25, 0x82, 0xd4, 0x20, 0xaf, 0x78, 0xfd, 0x93, 0x57, 0x9a, 0xc7, 0xbf,
+  0x7e, 0xac, 0x37, 0xdf, 0x0d, 0x10, 0xb9, 0xb1, 0x44, 0xd9, 0xc4, 0x72, 0x03, 0xa2, 0xa8, 0x89,
+  0xa9, 0x40, 0x61, 0x54, 0x34, 0x84, 0x31, 0x50, 0x95, 0xdf, 0x51, 0x2d, 0xb5, 0xc1, 0xab, 0x3c,
+  0xcf, 0xfb, 0x28, 0xa5, 0x3e, 0x0f, 0x01, 0xc5, 0x4d, 0x57, 0x93, 0x4b, 0x72, 0x06, 0xe6, 0x4e,
+  0x78, 0x8b, 0x50, 0x73, 0xb9, 0x45, 0x6e, 0xfd, 0x3e, 0x26, 0xad, 0xd3, 0xf7, 0x0c, 0xf9, 0xd6,
+  0xbf, 0xce, 0x20, 0x09, 0x51, 0x94, 0xda, 0x30, 0x6e, 0x12, 0x43, 0x18, 0xb4, 0x16, 0x67, 0xfb,
+  0xf0, 0x45, 0x5f, 0x12, 0x7b, 0x22, 0x4c, 0x9f, 0x31, 0x8a, 0x7d, 0x4c, 0x1c, 0x02, 0x63, 0x53,
+  0x95, 0xe4, 0x09, 0x6d, 0x86, 0x95, 0xa2, 0xc3, 0x73, 0x1f, 0x9d, 0xf2, 0x6e, 0xac, 0x95, 0x38,
+  0xdd, 0x4c, 0xf8, 0xb2, 0xe3, 0x97, 0x3d, 0xcb, 0x47, 0xa2, 0x67, 0x0e, 0xd5, 0xc9, 0xe1, 0x3d,
+  0x42, 0xe3, 0xd9, 0xc2, 0x5f, 0x8e, 0xb3, 0x74, 0xcb, 0xeb, 0x3e, 0x12, 0xda, 0xd4, 0xb7, 0x04,
+  0xa5, 0x76, 0x4e, 0xd7, 0x03, 0xc2, 0x3e, 0x92, 0xa4, 0xe4, 0xb2, 0x63, 0x60, 0x1b, 0x49, 0xae,
+  0xb8, 0x94, 0x9a, 0xbe, 0x14, 0xf3, 0x7f, 0x01, 0xe5, 0x63, 0xfe, 0x1d, 0x42, 0x7d, 0x04, 0xaa,
+  0x69, 0xdd, 0x6f, 0x77, 0x6d, 0xf8, 0xd7, 0xb5, 0xe3, 0x17, 0xb7, 0xfe, 0xb3, 0x79, 0xbc, 0x6a,
+  0x88, 0xb5, 0x67, 0x4f, 0x76, 0x71, 0x2d, 0x40, 0x72, 0x7f, 0x65, 0xb9, 0xe4, 0xd4, 0x75, 0xa3,
+  0x8e, 0x19, 0x42, 0x9f, 0xee, 0xaa, 0x1d, 0x3c, 0xf7, 0x6c, 0xd2, 0xf5, 0x06, 0x21, 0x1b, 0xc4,
+  0x1c, 0xc4, 0xc3, 0x99, 0xff, 0x62, 0xb5, 0x04, 0x16, 0xaf, 0xa8, 0x60, 0x07, 0x46, 0x17, 0xaa,
+  0xde, 0xe1, 0x8e, 0xf4, 0x79, 0x3d, 0xef, 0xc2, 0x51, 0x94, 0x82, 0xce, 0xf1, 0xdb, 0xb6, 0xac,
+  0xc1, 0x33, 0x98, 0x39, 0xe8, 0x4d, 0xd8, 0x37, 0x99, 0xa7, 0xe6, 0x61, 0xa5, 0x15, 0xbf, 0xe3,
+  0x0d, 0x58, 0x63, 0x54, 0x3c, 0x30, 0xf9, 0x1f, 0x98, 0x65, 0xa7, 0x68, 0x6b, 0xac, 0xaf, 0xd0,
+  0x68, 0x50, 0x8e, 0x9b, 0xc2, 0x19, 0xef, 0x4a, 0x70, 0xa0, 0x15, 0x9e, 0xd0, 0xc4, 0x28, 0xcd,
+  0xed, 0xc7, 0x98, 0xf1, 0x49, 0xbf, 0x7a, 0x5b, 0xce, 0x90, 0xef, 0xf6, 0x3b, 0xea, 0x5b, 0x94,
+  0x32, 0x78, 0x05, 0x16, 0x1e, 0x47, 0x48, 0xc1, 0x37, 0x0f, 0xe2, 0x71, 0x14, 0xd6, 0xcd, 0xc0,
+  0x83, 0xeb, 0x42, 0x90, 0x75, 0xc4, 0xb5, 0xb6, 0x7b, 0x24, 0x38, 0x13, 0x90, 0x7f, 0x16, 0xb9,
+  0x60, 0x0b, 0xfb, 0xbd, 0x27, 0xbd, 0xe8, 0x9f, 0xef, 0x6b, 0x11, 0x6c, 0x92, 0x10, 0x09, 0x95,
+  0xc2, 0x94, 0x0f, 0x64, 0x27, 0x65, 0x50, 0x7a, 0x3c, 0x04, 0x9b, 0xa6, 0xa1, 0xd4, 0xc2, 0x8d,
+  0xef, 0xe3, 0x66, 0xc5, 0xfb, 0xe8, 0x5b, 0xcd, 0x19, 0x90, 0xf8, 0x69, 0x9a, 0xcd, 0x5d, 0x98,
+  0xcd, 0xe7, 0x6e, 0x36, 0xb7, 0x03, 0xcd, 0x81, 0xce, 0x9d, 0x5b, 0xee, 0x07, 0xa0, 0x8f, 0xfe,
+  0x01, 0x0a, 0x04, 0x51, 0xe6, 0x3d, 0x04, 0x00, 0x00,
+};
+
+const WebAsset WEB_ASSETS[] = {
+  { "/style.css", "text/css", WEB_STYLE_CSS_GZ, sizeof(WEB_STYLE_CSS_GZ), "\"058669b36696057e\"" },
+};
+
+const size_t WEB_ASSET_COUNT = 1;
@@ -1,5 +1,5 @@
 #include <Arduino.h>
-#include <SPIFFS.h>
+#include <FileStorage.h>
 #include <Preferences.h>
 
 Preferences preferences;
@@ -10,12 +10,12 @@ void setup() {
 
   Serial.println("\n\n=== Credential Clearing Test ===\n");
 
-  // Initialize SPIFFS
-  if (!SPIFFS.begin(true)) {
-    Serial.println("SPIFFS Mount Failed");
+  if (!Storage.begin()) {
+    Serial.println("Storage mount failed");
     return;
   }
-  Serial.println("SPIFFS mounted successfully");
+  Serial.println(String(Storage.name()) + " mounted successfully");
+  fs::FS& files = Storage.fs();
 
   // Show current credentials before clearing
   Serial.println("\n--- Current Stored Credentials ---");
@@ -31,20 +31,20 @@ void setup() {
 
   // Check certificate files
   Serial.println("\n--- Certificate Files ---");
-  bool deviceCertExists = SPIFFS.exists("/cert/device.pem");
-  bool privateKeyExists = SPIFFS.exists("/cert/private.pem");
+  bool deviceCertExists = files.exists("/cert/device.pem");
+  bool privateKeyExists = files.exists("/cert/private.pem");
 
   Serial.println("Device cert exists: " + String(deviceCertExists ? "YES" : "NO"));
   Serial.println("Private key exists: " + String(privateKeyExists ? "YES" : "NO"));
 
   if (deviceCertExists) {
-    File f = SPIFFS.open("/cert/device.pem", FILE_READ);
+    File f = files.open("/cert/device.pem", FILE_READ);
     Serial.println("Device cert size: " + String(f.size()) + " bytes");
     f.close();
   }
 
   if (privateKeyExists) {
-    File f = SPIFFS.open("/cert/private.pem", FILE_READ);
+    File f = files.open("/cert/private.pem", FILE_READ);
     Serial.println("Private key size: " + String(f.size()) + " bytes");
     f.close();
   }
@@ -65,7 +65,7 @@ void setup() {
   Serial.println("\n--- Deleting Certificate Files ---");
 
   if (deviceCertExists) {
-    if (SPIFFS.remove("/cert/device.pem")) {
+    if (files.remove("/cert/device.pem")) {
       Serial.println("✓ Deleted /cert/device.pem");
     } else {
       Serial.println("✗ Failed to delete /cert/device.pem");
@@ -73,7 +73,7 @@ void setup() {
   }
 
   if (privateKeyExists) {
-    if (SPIFFS.remove("/cert/private.pem")) {
+    if (files.remove("/cert/private.pem")) {
       Serial.println("✓ Deleted /cert/private.pem");
     } else {
       Serial.println("✗ Failed to delete /cert/private.pem");
@@ -92,8 +92,8 @@ void setup() {
   Serial.println("WiFi Password: " + (savedPassword.length() > 0 ? savedPassword : "(empty)"));
   Serial.println("GSM APN: " + (savedApn.length() > 0 ? savedApn : "(empty)"));
 
-  deviceCertExists = SPIFFS.exists("/cert/device.pem");
-  privateKeyExists = SPIFFS.exists("/cert/private.pem");
+  deviceCertExists = files.exists("/cert/device.pem");
+  privateKeyExists = files.exists("/cert/private.pem");
 
   Serial.println("Device cert exists: " + String(deviceCertExists ? "YES" : "NO"));
   Serial.println("Private key exists: " + String(privateKeyExists ? "YES" : "NO"));
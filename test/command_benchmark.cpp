@@ -0,0 +1,184 @@
+#include <Arduino.h>
+#include <CommandDispatcher.h>
+#include <Logger.h>
+
+// Times the inbound command path of mqtt_aws_test.cpp without a broker.
+// The MQTT callback's cost is compared with printing or logging the
+// payload, which is what the callback used to do; dispatch latency (submit
+// to handler start) is measured for single messages, which wake the
+// worker, and for bursts, which queue behind each other; and the route
+// table lookup is timed for hits and misses.
+
+#define PREFIX "kloudtrack/test/inbound/"
+#define ROUNDS 1000
+#define CALLBACK_ROUNDS 100  // printing at 115200 baud takes ~12 ms a call
+#define BURST 16
+#define GAP_MS 2             // between single messages, so the worker is asleep
+#define SETTLE_MS 2000       // lets the previous run's lines reach the UART
+
+uint32_t latencies[ROUNDS];
+volatile size_t recorded = 0;
+
+void recordLatency(const Command& command) {
+  uint32_t latency = micros() - command.receivedUs;
+  if (recorded < ROUNDS) {
+    latencies[recorded] = latency;
+  }
+  recorded = recorded + 1;
+}
+
+// A device-sized table; every route records its latency
+static const CommandRoute routes[] = {
+  { "ota", recordLatency },
+  { "config", recordLatency },
+  { "metrics", recordLatency },
+  { "reboot", recordLatency },
+  { "telemetry/interval", recordLatency },
+  { "telemetry/flush", recordLatency },
+  { "log/level", recordLatency },
+  { "ping", recordLatency },
+};
+
+const char* payload =
+    "{\"wifi_ssid\":\"bench\",\"wifi_password\":\"secret123\",\"gsm_apn\":\"internet\","
+    "\"manifest_url\":\"https://updates.example.com/kloudtrack/manifest.json\"}";
+
+void waitIdle() {
+  while (!Commands.idle()) {
+    delay(1);
+  }
+}
+
+int compareU32(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*)a;
+  uint32_t y = *(const uint32_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+void reportLatency(const char* name) {
+  size_t n = recorded < ROUNDS ? recorded : ROUNDS;
+  qsort(latencies, n, sizeof(latencies[0]), compareU32);
+  Serial.printf("  %-22s p50 %6u us  p90 %6u us  p99 %6u us  max %6u us\n", name,
+                (unsigned)latencies[n / 2], (unsigned)latencies[n * 9 / 10],
+                (unsigned)latencies[n * 99 / 100], (unsigned)latencies[n - 1]);
+}
+
+// Average cost per call of what the MQTT callback runs: the payload printed
+// a character at a time (the sketch's first callback), the payload logged,
+// and the message queued for the worker
+void callbackCost() {
+  size_t length = strlen(payload);
+  char topic[] = PREFIX "config";
+
+  uint32_t start = micros();
+  for (int i = 0; i < CALLBACK_ROUNDS; i++) {
+    Serial.print("Message received on topic: ");
+    Serial.println(topic);
+    for (size_t j = 0; j < length; j++) {
+      Serial.print((char)payload[j]);
+    }
+    Serial.println();
+  }
+  uint32_t printed = micros() - start;
+  Serial.flush();
+  delay(SETTLE_MS);
+
+  LogStats before = Log.stats();
+  start = micros();
+  for (int i = 0; i < CALLBACK_ROUNDS; i++) {
+    LOG_INFO("Message received on topic %s: %.*s", topic, (int)length, payload);
+  }
+  uint32_t logged = micros() - start;
+  Log.flush(10000);
+  LogStats after = Log.stats();
+  delay(SETTLE_MS);
+
+  uint32_t submitted = 0;
+  for (int i = 0; i < CALLBACK_ROUNDS; i++) {
+    start = micros();
+    Commands.submit(topic, (const uint8_t*)payload, length);
+    submitted += micros() - start;
+    if (i % BURST == BURST - 1) {
+      waitIdle();
+    }
+  }
+  waitIdle();
+
+  Serial.printf("\nMQTT callback, %u-byte payload, average of %u calls:\n", (unsigned)length,
+                CALLBACK_ROUNDS);
+  Serial.printf("  %-22s %8u ns\n", "Serial.print per char",
+                (unsigned)(printed * 1000ull / CALLBACK_ROUNDS));
+  Serial.printf("  %-22s %8u ns (%u of %u lines dropped)\n", "LOG_INFO",
+                (unsigned)(logged * 1000ull / CALLBACK_ROUNDS),
+                (unsigned)(after.dropped - before.dropped), CALLBACK_ROUNDS);
+  Serial.printf("  %-22s %8u ns\n", "Commands.submit",
+                (unsigned)(submitted * 1000ull / CALLBACK_ROUNDS));
+}
+
+void dispatchLatency() {
+  size_t length = strlen(payload);
+  char topic[] = PREFIX "ping";
+
+  recorded = 0;
+  for (int i = 0; i < ROUNDS; i++) {
+    Commands.submit(topic, (const uint8_t*)payload, length);
+    delay(GAP_MS);
+  }
+  waitIdle();
+  Serial.printf("\nDispatch latency, submit to handler start (%u messages):\n", ROUNDS);
+  reportLatency("single, worker asleep");
+
+  recorded = 0;
+  for (int i = 0; i < ROUNDS / BURST; i++) {
+    for (int j = 0; j < BURST; j++) {
+      Commands.submit(topic, (const uint8_t*)payload, length);
+    }
+    waitIdle();
+  }
+  reportLatency("bursts of 16");
+}
+
+void routeLookup() {
+  static const char* hits[] = { PREFIX "ota", PREFIX "telemetry/flush", PREFIX "ping" };
+  static const char* misses[] = { PREFIX "unknown", "kloudtrack/test/inbound", "other/topic/ota" };
+  const int lookups = 10000;
+
+  for (int pass = 0; pass < 2; pass++) {
+    const char** topics = pass == 0 ? hits : misses;
+    size_t lengths[3];
+    for (int i = 0; i < 3; i++) {
+      lengths[i] = strlen(topics[i]);
+    }
+    volatile int found = 0;
+    uint32_t start = micros();
+    for (int i = 0; i < lookups; i++) {
+      found = found + (Commands.match(topics[i % 3], lengths[i % 3]) >= 0);
+    }
+    uint32_t elapsed = micros() - start;
+    Serial.printf("  %-22s %6u ns (%d of %d matched)\n", pass == 0 ? "hit" : "miss",
+                  (unsigned)(elapsed * 1000ull / lookups), (int)found, lookups);
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  Log.begin();
+  delay(1000);
+
+  Serial.println("\n\n=== Command Dispatch Benchmark ===");
+  Commands.begin(PREFIX, routes, sizeof(routes) / sizeof(routes[0]));
+
+  callbackCost();
+  dispatchLatency();
+  Serial.printf("\nRoute lookup, %u routes:\n", (unsigned)(sizeof(routes) / sizeof(routes[0])));
+  routeLookup();
+
+  CommandStats stats = Commands.stats();
+  Serial.printf("\n%u received, %u dropped, %u bytes of %u queued at most\n",
+                (unsigned)stats.received, (unsigned)stats.dropped,
+                (unsigned)stats.queuedBytesMax, COMMAND_QUEUE_BYTES);
+}
+
+void loop() {
+  // Nothing to do here
+}
@@ -0,0 +1,176 @@
+#include <Arduino.h>
+#include <CommandDispatcher.h>
+#include <Logger.h>
+
+// Floods the command dispatcher the way a chatty broker would: the loop
+// task stands in for the MQTT callback and submits messages at fixed rates
+// and then as fast as it can, with payloads from a few bytes up to
+// COMMAND_PAYLOAD_MAX so records wrap around the arena in every position.
+// One message in 64 goes to a handler that takes 500 us, so the queue
+// fills and drops. Handlers check each message's route, order and
+// contents; a run passes when nothing was corrupted or reordered and every
+// message was either handled or counted as dropped.
+
+#define PREFIX "kloudtrack/test/inbound/"
+#define RUN_MS 3000
+#define SLOW_EVERY 64
+#define SLOW_HANDLER_US 500
+
+struct Tally {
+  uint32_t handled;
+  uint32_t corrupt;
+  uint32_t reordered;
+  uint32_t lastSeq;
+  uint32_t maxLatencyUs;
+};
+
+// Written by the dispatcher's task, read once it is idle
+Tally tally;
+uint8_t sendBuffer[COMMAND_PAYLOAD_MAX];
+
+// Payload: 4-byte sequence number, then bytes derived from it
+size_t fillPayload(uint32_t seq) {
+  size_t length = 4;
+  uint32_t r = seq * 2654435761u;
+  if ((r >> 28) == 0) {
+    length += r % (COMMAND_PAYLOAD_MAX - 4 + 1);   // one in 16 up to the limit
+  } else {
+    length += r % 96;
+  }
+  memcpy(sendBuffer, &seq, 4);
+  for (size_t i = 4; i < length; i++) {
+    sendBuffer[i] = (uint8_t)(seq + i * 7);
+  }
+  return length;
+}
+
+void check(const Command& command, const char* expected) {
+  uint32_t latency = micros() - command.receivedUs;
+  uint32_t seq;
+  bool ok = command.length >= 4 && strcmp(command.topic + strlen(PREFIX), expected) == 0;
+  if (ok) {
+    memcpy(&seq, command.payload, 4);
+    for (size_t i = 4; i < command.length && ok; i++) {
+      ok = command.payload[i] == (uint8_t)(seq + i * 7);
+    }
+    ok = ok && command.payload[command.length] == 0;
+  }
+  if (!ok) {
+    tally.corrupt++;
+    return;
+  }
+  if (tally.handled > 0 && seq <= tally.lastSeq) {
+    tally.reordered++;
+  }
+  tally.lastSeq = seq;
+  tally.handled++;
+  if (latency > tally.maxLatencyUs) {
+    tally.maxLatencyUs = latency;
+  }
+}
+
+void fastCommand(const Command& command) {
+  check(command, "fast");
+}
+
+void slowCommand(const Command& command) {
+  check(command, "slow");
+  uint32_t start = micros();
+  while (micros() - start < SLOW_HANDLER_US) {
+  }
+}
+
+void unrouted(const Command& command) {
+  tally.corrupt++;
+}
+
+static const CommandRoute routes[] = {
+  { "fast", fastCommand },
+  { "slow", slowCommand },
+};
+
+uint32_t nextSeq = 1;
+bool allPassed = true;
+
+// rate 0: back to back
+void run(uint32_t rate) {
+  memset(&tally, 0, sizeof(tally));
+  CommandStats before = Commands.stats();
+  uint32_t sent = 0;
+  uint32_t dropped = 0;
+  uint32_t submitMaxUs = 0;
+
+  uint32_t start = micros();
+  while (micros() - start < RUN_MS * 1000ul) {
+    if (rate > 0) {
+      // Paced against the start, so a late message does not slow the rest
+      uint32_t due = start + (uint64_t)sent * 1000000 / rate;
+      while ((int32_t)(micros() - due) < 0) {
+      }
+    }
+    uint32_t seq = nextSeq++;
+    size_t length = fillPayload(seq);
+    const char* topic = seq % SLOW_EVERY == 0 ? PREFIX "slow" : PREFIX "fast";
+    uint32_t t0 = micros();
+    if (!Commands.submit(topic, sendBuffer, length)) {
+      dropped++;
+    }
+    uint32_t took = micros() - t0;
+    if (took > submitMaxUs) {
+      submitMaxUs = took;
+    }
+    sent++;
+    if (rate == 0 && sent % 256 == 0) {
+      yield();
+    }
+  }
+  uint32_t elapsed = micros() - start;
+  while (!Commands.idle()) {
+    delay(1);
+  }
+
+  CommandStats after = Commands.stats();
+  bool passed = tally.corrupt == 0 && tally.reordered == 0 && tally.handled + dropped == sent &&
+                after.dropped - before.dropped == dropped;
+  allPassed = allPassed && passed;
+  char label[16];
+  if (rate > 0) {
+    snprintf(label, sizeof(label), "%u/s", (unsigned)rate);
+  } else {
+    snprintf(label, sizeof(label), "unpaced");
+  }
+  Serial.printf("  %-8s %7u sent (%6u/s) %7u handled %7u dropped  max latency %6u us"
+                "  max submit %4u us  %s\n",
+                label, (unsigned)sent, (unsigned)((uint64_t)sent * 1000000 / elapsed),
+                (unsigned)tally.handled, (unsigned)dropped, (unsigned)tally.maxLatencyUs,
+                (unsigned)submitMaxUs, passed ? "ok" : "FAIL");
+  if (tally.corrupt > 0 || tally.reordered > 0) {
+    Serial.printf("           %u corrupt, %u out of order\n", (unsigned)tally.corrupt,
+                  (unsigned)tally.reordered);
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  Log.begin();
+  delay(1000);
+
+  Serial.println("\n\n=== Command Dispatch Stress Test ===");
+  Commands.begin(PREFIX, routes, sizeof(routes) / sizeof(routes[0]), unrouted);
+  Serial.printf("%u-byte queue, payloads of 4 to %u bytes, 1 in %u handled in %u us\n\n",
+                COMMAND_QUEUE_BYTES, COMMAND_PAYLOAD_MAX, SLOW_EVERY, SLOW_HANDLER_US);
+
+  static const uint32_t rates[] = { 1000, 5000, 20000, 50000, 0 };
+  for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+    run(rates[i]);
+  }
+
+  CommandStats stats = Commands.stats();
+  Serial.printf("\n%u bytes of %u queued at most, longest handler %u us\n",
+                (unsigned)stats.queuedBytesMax, COMMAND_QUEUE_BYTES, (unsigned)stats.maxHandlerUs);
+  Serial.println(allPassed ? "PASS" : "FAIL");
+}
+
+void loop() {
+  // Nothing to do here
+}
@@ -0,0 +1,177 @@
+#include <Arduino.h>
+#include <FileStorage.h>
+
+// Times the file operations the firmware performs, on the backend the
+// sketch is built for (add -DSTORAGE_LITTLEFS for LittleFS), with the
+// partition empty and then partly filled, since SPIFFS slows down as it
+// fills. Uses its own files under /bench and removes them afterwards.
+
+#define ROUNDS 20
+#define CERT_SIZE 1224       // typical device certificate
+#define KEY_SIZE 1679        // RSA-2048 private key
+#define SPILL_SIZE 512       // one telemetry spill (32 samples)
+#define BATCH_SIZE 160       // one publish batch read back (10 samples)
+#define SEGMENT_SPILLS 8     // a full 4 KB segment
+#define FILL_FILE_SIZE 16384
+
+const char* certPath = "/bench/device.pem";
+const char* keyPath = "/bench/private.pem";
+const char* tmpPath = "/bench/private.pem.tmp";
+const char* missingPath = "/bench/missing.pem";
+const char* segmentPath = "/bench/00000001";
+
+uint8_t data[FILL_FILE_SIZE];
+uint32_t samples[ROUNDS];
+uint16_t fillFiles = 0;
+
+struct Timing {
+  uint32_t median;
+  uint32_t max;
+};
+
+Timing summarize() {
+  for (size_t i = 1; i < ROUNDS; i++) {
+    for (size_t j = i; j > 0 && samples[j] < samples[j - 1]; j--) {
+      uint32_t swap = samples[j];
+      samples[j] = samples[j - 1];
+      samples[j - 1] = swap;
+    }
+  }
+  return Timing{ samples[ROUNDS / 2], samples[ROUNDS - 1] };
+}
+
+void report(const char* op, Timing t) {
+  Serial.printf("  %-28s %8u %8u\n", op, (unsigned)t.median, (unsigned)t.max);
+}
+
+bool writeFile(const char* path, size_t len) {
+  File f = Storage.fs().open(path, FILE_WRITE);
+  bool ok = f && f.write(data, len) == len;
+  f.close();
+  return ok;
+}
+
+// Fills the partition with 16 KB files until it is the given percentage full
+void fillTo(unsigned percent) {
+  fs::FS& files = Storage.fs();
+  char path[32];
+  while (Storage.usedBytes() < Storage.totalBytes() / 100 * percent) {
+    sprintf(path, "/bench/fill%03u", fillFiles);
+    if (!writeFile(path, FILL_FILE_SIZE)) {
+      files.remove(path);
+      break;
+    }
+    fillFiles++;
+  }
+}
+
+void runRound() {
+  fs::FS& files = Storage.fs();
+  size_t used = Storage.usedBytes();
+  size_t total = Storage.totalBytes();
+  Serial.printf("\n%s, %u%% full (%u of %u bytes), microseconds:\n", Storage.name(),
+                (unsigned)(used / (total / 100)), (unsigned)used, (unsigned)total);
+  Serial.printf("  %-28s %8s %8s\n", "operation", "median", "max");
+
+  for (size_t i = 0; i < ROUNDS; i++) {
+    uint32_t start = micros();
+    files.exists(certPath);
+    samples[i] = micros() - start;
+  }
+  report("exists (cert)", summarize());
+
+  for (size_t i = 0; i < ROUNDS; i++) {
+    uint32_t start = micros();
+    files.exists(missingPath);
+    samples[i] = micros() - start;
+  }
+  report("exists (missing)", summarize());
+
+  for (size_t i = 0; i < ROUNDS; i++) {
+    uint32_t start = micros();
+    File f = files.open(certPath, FILE_READ);
+    f.close();
+    samples[i] = micros() - start;
+  }
+  report("open+close (cert)", summarize());
+
+  for (size_t i = 0; i < ROUNDS; i++) {
+    uint32_t start = micros();
+    File f = files.open(certPath, FILE_READ);
+    f.read(data, CERT_SIZE);
+    f.close();
+    samples[i] = micros() - start;
+  }
+  report("read cert (1.2 KB)", summarize());
+
+  // As a key upload: temp file, then rename over the old one
+  for (size_t i = 0; i < ROUNDS; i++) {
+    uint32_t start = micros();
+    writeFile(tmpPath, KEY_SIZE);
+    files.remove(keyPath);
+    files.rename(tmpPath, keyPath);
+    samples[i] = micros() - start;
+  }
+  report("replace key (1.7 KB)", summarize());
+
+  for (size_t i = 0; i < ROUNDS; i++) {
+    if (i % SEGMENT_SPILLS == 0) {
+      files.remove(segmentPath);
+    }
+    uint32_t start = micros();
+    File f = files.open(segmentPath, FILE_APPEND);
+    f.write(data, SPILL_SIZE);
+    f.close();
+    samples[i] = micros() - start;
+  }
+  report("append spill (512 B)", summarize());
+
+  for (size_t i = 0; i < ROUNDS; i++) {
+    uint32_t start = micros();
+    File f = files.open(segmentPath, FILE_READ);
+    f.seek((i % 3) * BATCH_SIZE);
+    f.read(data, BATCH_SIZE);
+    f.close();
+    samples[i] = micros() - start;
+  }
+  report("read batch (160 B)", summarize());
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+
+  Serial.println("\n\n=== File System Benchmark ===");
+  if (!Storage.begin()) {
+    Serial.println("Storage mount failed");
+    return;
+  }
+  fs::FS& files = Storage.fs();
+  for (size_t i = 0; i < sizeof(data); i++) {
+    data[i] = 'A' + i % 26;
+  }
+  files.mkdir("/bench");
+  writeFile(certPath, CERT_SIZE);
+  writeFile(keyPath, KEY_SIZE);
+
+  const unsigned levels[] = { 0, 50, 75 };
+  for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+    fillTo(levels[i]);
+    runRound();
+  }
+
+  char path[32];
+  for (uint16_t i = 0; i < fillFiles; i++) {
+    sprintf(path, "/bench/fill%03u", i);
+    files.remove(path);
+  }
+  files.remove(certPath);
+  files.remove(keyPath);
+  files.remove(segmentPath);
+  files.rmdir("/bench");
+  Serial.println("\nDone; benchmark files removed.");
+}
+
+void loop() {
+  // Nothing to do here
+}
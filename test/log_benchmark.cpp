@@ -0,0 +1,78 @@
+#include <Arduino.h>
+#include <Logger.h>
+#include <mbedtls/sha256.h>
+
+// Runs the OTA copy loop's own work, a SHA-256 update per 4 KB chunk, three
+// times: without logging, with a Serial.printf progress line per chunk, and
+// with the same line through LOG_INFO. The printf run waits for the UART;
+// the logger run should take about as long as the one without logging,
+// with the lines the UART could not keep up with counted as dropped.
+
+#define CHUNK_SIZE 4096      // OTA_BUFFER_SIZE
+#define CHUNK_COUNT 256      // a 1 MB image
+#define SETTLE_MS 2000       // lets the previous run's lines reach the UART
+
+uint8_t chunk[CHUNK_SIZE];
+
+enum Mode { NO_LOGGING, SERIAL_PRINTF, LOGGER };
+
+uint32_t copyLoop(Mode mode) {
+  mbedtls_sha256_context ctx;
+  uint8_t digest[32];
+  mbedtls_sha256_init(&ctx);
+  mbedtls_sha256_starts_ret(&ctx, 0);
+
+  uint32_t start = micros();
+  for (uint32_t i = 0; i < CHUNK_COUNT; i++) {
+    mbedtls_sha256_update_ret(&ctx, chunk, sizeof(chunk));
+    uint32_t written = (i + 1) * CHUNK_SIZE;
+    if (mode == SERIAL_PRINTF) {
+      Serial.printf("OTA: %u of %u bytes written\n", (unsigned)written, CHUNK_SIZE * CHUNK_COUNT);
+    } else if (mode == LOGGER) {
+      LOG_INFO("OTA: %u of %u bytes written", (unsigned)written, CHUNK_SIZE * CHUNK_COUNT);
+    }
+  }
+  mbedtls_sha256_finish_ret(&ctx, digest);
+  uint32_t elapsed = micros() - start;
+  mbedtls_sha256_free(&ctx);
+  return elapsed;
+}
+
+void report(const char* name, uint32_t us) {
+  Serial.printf("  %-16s %8u ms %8u us/chunk\n", name, (unsigned)(us / 1000),
+                (unsigned)(us / CHUNK_COUNT));
+}
+
+void setup() {
+  Serial.begin(115200);
+  Log.begin();
+  delay(1000);
+
+  Serial.println("\n\n=== Logging Benchmark ===");
+  for (size_t i = 0; i < sizeof(chunk); i++) {
+    chunk[i] = i * 31;
+  }
+
+  uint32_t quiet = copyLoop(NO_LOGGING);
+  uint32_t printed = copyLoop(SERIAL_PRINTF);
+  Serial.flush();
+  delay(SETTLE_MS);
+
+  LogStats before = Log.stats();
+  uint32_t logged = copyLoop(LOGGER);
+  Log.flush(10000);
+  LogStats after = Log.stats();
+  delay(SETTLE_MS);
+
+  Serial.printf("\n%u chunks of %u bytes, SHA-256 each:\n", CHUNK_COUNT, CHUNK_SIZE);
+  report("no logging", quiet);
+  report("Serial.printf", printed);
+  report("LOG_INFO", logged);
+  Serial.printf("Logger: %u lines written, %u dropped (ring of %u)\n",
+                (unsigned)(after.written - before.written),
+                (unsigned)(after.dropped - before.dropped), LOG_SLOTS);
+}
+
+void loop() {
+  // Nothing to do here
+}
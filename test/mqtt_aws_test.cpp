@@ -1,259 +1,494 @@
 #include <Arduino.h>
 #include <WiFi.h>
-#include <WiFiClientSecure.h>
+#include <HTTPUpdate.h>
 #include <PubSubClient.h>
-#include <SPIFFS.h>
 #include <Preferences.h>
+#include <atomic>
+#include <CommandDispatcher.h>
+#include <ConnectionManager.h>
+#include <LinkManager.h>
+#include <CredentialCache.h>
+#include <FileStorage.h>
+#include <Logger.h>
+#include <TlsClient.h>
+#include <TelemetryQueue.h>
+#include <TelemetryEncoder.h>
 
 // AWS IoT endpoint - UPDATE THIS with your endpoint
 const char* aws_iot_endpoint = "your-endpoint.iot.ap-southeast-1.amazonaws.com";
 const int aws_iot_port = 8883;
 
+// Root CA the OTA command checks the firmware server against. Amazon Root
+// CA 1 covers S3 and CloudFront; replace it when images are served elsewhere.
+const char* ota_root_ca =
+"-----BEGIN CERTIFICATE-----\n"
+"MIIDQTCCAimgAwIBAgITBmyfz5m/jAo54vB4ikPmljZbyjANBgkqhkiG9w0BAQsF\n"
+"ADA5MQswCQYDVQQGEwJVUzEPMA0GA1UEChMGQW1hem9uMRkwFwYDVQQDExBBbWF6\n"
+"b24gUm9vdCBDQSAxMB4XDTE1MDUyNjAwMDAwMFoXDTM4MDExNzAwMDAwMFowOTEL\n"
+"MAkGA1UEBhMCVVMxDzANBgNVBAoTBkFtYXpvbjEZMBcGA1UEAxMQQW1hem9uIFJv\n"
+"b3QgQ0EgMTCCASIwDQYJKoZIhvcNAQEBBQADggEPADCCAQoCggEBALJ4gHHKeNXj\n"
+"ca9HgFB0fW7Y14h29Jlo91ghYPl0hAEvrAIthtOgQ3pOsqTQNroBvo3bSMgHFzZM\n"
+"9O6II8c+6zf1tRn4SWiw3te5djgdYZ6k/oI2peVKVuRF4fn9tBb6dNqcmzU5L/qw\n"
+"IFAGbHrQgLKm+a/sRxmPUDgH3KKHOVj4utWp+UhnMJbulHheb4mjUcAwhmahRWa6\n"
+"VOujw5H5SNz/0egwLX0tdHA114gk957EWW67c4cX8jJGKLhD+rcdqsq08p8kDi1L\n"
+"93FcXmn/6pUCyziKrlA4b9v7LWIbxcceVOF34GfID5yHI9Y/QCB/IIDEgEw+OyQm\n"
+"jgSubJrIqg0CAwEAAaNCMEAwDwYDVR0TAQH/BAUwAwEB/zAOBgNVHQ8BAf8EBAMC\n"
+"AYYwHQYDVR0OBBYEFIQYzIU07LwMlJQuCFmcx7IQTgoIMA0GCSqGSIb3DQEBCwUA\n"
+"A4IBAQCY8jdaQZChGsV2USggNiMOruYou6r4lK5IpDB/G/wkjUu0yKGX9rbxenDI\n"
+"U5PMCCjjmCXPI6T53iHTfIUJrU6adTrCC2qJeHZERxhlbI1Bjjt/msv0tadQ1wUs\n"
+"N+gDS63pYaACbvXy8MWy7Vu33PqUXHeeE6V/Uq2V8viTO96LXFvKWlJbYK8U90vv\n"
+"o/ufQJVtMVT8QtPHRh8jrdkPSHCa2XV4cdFyQzR1bldZwgJcJmApzyMZFo6IQ6XU\n"
+"5MsI+yMRQ+hDKXJioaldXgjUkK642M4UwtBV8ob2xJNDd2ZhwLnoQdeXeGADbkpy\n"
+"rqXRfboQnoZsG4q5WTP468SQvvG5\n"
+"-----END CERTIFICATE-----\n";
+
 // MQTT topics
 const char* publish_topic = "kloudtrack/test/outbound";
-const char* subscribe_topic = "kloudtrack/test/inbound";
-
-WiFiClientSecure net;
+const char* report_topic = "kloudtrack/test/report";
+// Commands arrive on <command_prefix><name>; anything else under the
+// subscription is only logged
+const char* subscribe_topic = "kloudtrack/test/inbound/#";
+const char* command_prefix = "kloudtrack/test/inbound/";
+
+#define SAMPLE_INTERVAL_MS 10000
+#define MQTT_BACKOFF_BASE_MS 1000
+#define MQTT_BACKOFF_MAX_MS 60000
+#define TELEMETRY_BATCH 10          // samples per MQTT message
+#define MQTT_PAYLOAD_MAX 1024       // on a slow link, messages are kept to the link's chunk size
+#define REPORT_MAX 512
+
+// CBOR on the wire; build with -DTELEMETRY_FORMAT=TELEMETRY_JSON to read the
+// payloads in the AWS IoT console
+#ifndef TELEMETRY_FORMAT
+#define TELEMETRY_FORMAT TELEMETRY_CBOR
+#endif
+
+// Reconnects resume the cached TLS session instead of a full handshake
+TlsClient net;
 PubSubClient mqttClient(net);
 Preferences preferences;
 
-unsigned long lastPublish = 0;
-int messageCount = 0;
-
+// Samples are recorded on schedule whether or not the broker is reachable
+// and published from the queue, oldest first
+TelemetryQueue telemetry;
+char deviceId[18];
+
+unsigned long lastSample = 0;
+unsigned long nextMqttAttempt = 0;
+uint32_t linkGeneration = 0;        // link the MQTT socket was opened on
+Backoff mqttBackoff(MQTT_BACKOFF_BASE_MS, MQTT_BACKOFF_MAX_MS);
+uint32_t messageCount = 0;
+
+// Command handlers run on the dispatcher's task. The MQTT client, the
+// telemetry queue and the link belong to loop(), so handlers leave their
+// results here for loop() to act on.
+std::atomic<bool> reportReady(false);
+char report[REPORT_MAX];
+std::atomic<bool> networkChanged(false);
+std::atomic<bool> restartPending(false);
+
+// Runs inside mqttClient.loop(): queue the message and return, so
+// keepalives and publishing carry on while a command runs
 void mqttCallback(char* topic, byte* payload, unsigned int length) {
-  Serial.print("Message received on topic: ");
-  Serial.println(topic);
-  Serial.print("Message: ");
-  for (unsigned int i = 0; i < length; i++) {
-    Serial.print((char)payload[i]);
+  if (!Commands.submit(topic, payload, length)) {
+    LOG_WARN("Command queue full, dropped message on %s", topic);
   }
-  Serial.println();
 }
 
-bool loadCertificates() {
-  if (!SPIFFS.exists("/cert/device.pem")) {
-    Serial.println("ERROR: Device certificate not found!");
-    return false;
+// Payload: the firmware URL. Downloads and flashes the image; loop()
+// restarts once the queued telemetry is on flash.
+void otaCommand(const Command& command) {
+  const char* url = (const char*)command.payload;
+  bool https = strncmp(url, "https://", 8) == 0;
+  if (!https && strncmp(url, "http://", 7) != 0) {
+    LOG_WARN("OTA command: expected a firmware URL");
+    return;
+  }
+  if (restartPending.load()) {
+    return;
+  }
+  LOG_INFO("OTA command: updating from %s", url);
+  HTTPUpdate updater(Link.tuning().timeoutMs);
+  updater.rebootOnUpdate(false);
+  t_httpUpdate_return result;
+  if (https) {
+    // Verified against ota_root_ca, with the device certificate from the
+    // cache; a retried update resumes the TLS session of the last one
+    TlsClient client;
+    client.setCACert(ota_root_ca);
+    Credentials.apply(client);
+    result = updater.update(client, url);
+  } else {
+    WiFiClient client;
+    result = updater.update(client, url);
+  }
+  if (result == HTTP_UPDATE_OK) {
+    LOG_INFO("OTA command: update installed");
+    restartPending.store(true);
+  } else if (result == HTTP_UPDATE_NO_UPDATES) {
+    LOG_INFO("OTA command: no update offered");
+  } else {
+    LOG_WARN("OTA command failed: %s", updater.getLastErrorString().c_str());
   }
+}
 
-  if (!SPIFFS.exists("/cert/private.pem")) {
-    Serial.println("ERROR: Private key not found!");
-    return false;
+struct SettingLimit {
+  const char* key;
+  size_t max;      // characters
+};
+
+// The portal's limits for the same keys
+static const SettingLimit settingLimits[] = {
+  { "wifi_ssid", 32 },
+  { "wifi_password", 63 },
+  { "gsm_apn", 63 },
+};
+
+static const SettingLimit* findSetting(const char* key) {
+  for (size_t i = 0; i < sizeof(settingLimits) / sizeof(settingLimits[0]); i++) {
+    if (strcmp(settingLimits[i].key, key) == 0) {
+      return &settingLimits[i];
+    }
   }
+  return NULL;
+}
 
-  File certFile = SPIFFS.open("/cert/device.pem", FILE_READ);
-  File keyFile = SPIFFS.open("/cert/private.pem", FILE_READ);
+// Payload: key=value pairs, one per line or separated by '&'. Nothing is
+// saved unless every pair is valid; loop() reconnects with the new network.
+void configCommand(const Command& command) {
+  static char text[COMMAND_PAYLOAD_MAX + 1];
+  memcpy(text, command.payload, command.length + 1);
+
+  // Split in place and check everything before writing anything
+  const char* keys[8];
+  const char* values[8];
+  size_t count = 0;
+  char* save = NULL;
+  for (char* pair = strtok_r(text, "&\r\n", &save); pair != NULL;
+       pair = strtok_r(NULL, "&\r\n", &save)) {
+    char* eq = strchr(pair, '=');
+    if (eq == NULL || count == sizeof(keys) / sizeof(keys[0])) {
+      LOG_WARN("Config command: expected key=value pairs");
+      return;
+    }
+    *eq = 0;
+    const SettingLimit* limit = findSetting(pair);
+    if (limit == NULL || strlen(eq + 1) > limit->max) {
+      LOG_WARN("Config command: %s %s", limit == NULL ? "unknown key" : "value too long for", pair);
+      return;
+    }
+    keys[count] = pair;
+    values[count] = eq + 1;
+    count++;
+  }
+  if (count == 0) {
+    LOG_WARN("Config command: no settings given");
+    return;
+  }
 
-  if (!certFile || !keyFile) {
-    Serial.println("ERROR: Failed to open certificate files!");
-    return false;
+  Preferences settings;
+  settings.begin("credentials", false);
+  size_t changed = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (settings.getString(keys[i], "") != values[i]) {
+      settings.putString(keys[i], values[i]);
+      changed++;
+    }
+  }
+  settings.end();
+  LOG_INFO("Config command: %u of %u settings changed", (unsigned)changed, (unsigned)count);
+  if (changed > 0) {
+    networkChanged.store(true);
   }
+}
 
-  String cert = certFile.readString();
-  String key = keyFile.readString();
+// Builds a JSON report for loop() to publish on report_topic
+void metricsCommand(const Command& command) {
+  if (reportReady.load(std::memory_order_acquire)) {
+    return;  // the last one has not gone out yet
+  }
+  LinkStats link = Link.stats();
+  LinkEstimate estimate = Link.estimate(link.active);
+  LogStats log = Log.stats();
+  CommandStats commands = Commands.stats();
+  uint32_t dispatched = commands.handled + commands.unrouted;
+  snprintf(report, sizeof(report),
+           "{\"device\":\"%s\",\"uptime\":%u,\"free_heap\":%u,\"min_free_heap\":%u,"
+           "\"link\":\"%s\",\"link_rtt_ms\":%u,\"link_bytes_per_sec\":%u,\"failovers\":%u,"
+           "\"log_dropped\":%u,\"commands\":{\"received\":%u,\"dropped\":%u,\"unrouted\":%u,"
+           "\"latency_us_avg\":%u,\"latency_us_max\":%u,\"handler_us_max\":%u}}",
+           deviceId, (unsigned)(millis() / 1000), (unsigned)ESP.getFreeHeap(),
+           (unsigned)ESP.getMinFreeHeap(), linkTypeName(link.active), (unsigned)estimate.rttMs,
+           (unsigned)estimate.bytesPerSec, (unsigned)link.failovers, (unsigned)log.dropped,
+           (unsigned)commands.received, (unsigned)commands.dropped, (unsigned)commands.unrouted,
+           (unsigned)(dispatched ? commands.latencyUsTotal / dispatched : 0),
+           (unsigned)commands.maxLatencyUs, (unsigned)commands.maxHandlerUs);
+  reportReady.store(true, std::memory_order_release);
+}
 
-  certFile.close();
-  keyFile.close();
+// Messages with no command route
+void logMessage(const Command& command) {
+  LOG_INFO("Message received on topic %s: %.*s", command.topic, (int)command.length,
+           (const char*)command.payload);
+}
 
-  Serial.println("Certificate loaded: " + String(cert.length()) + " bytes");
-  Serial.println("Private key loaded: " + String(key.length()) + " bytes");
+static const CommandRoute commandRoutes[] = {
+  { "ota", otaCommand },
+  { "config", configCommand },
+  { "metrics", metricsCommand },
+};
 
-  net.setCertificate(cert.c_str());
-  net.setPrivateKey(key.c_str());
+bool loadCertificates() {
+  // The cache keeps the PEM data alive for as long as net may reconnect
+  if (!Credentials.load(Storage.fs())) {
+    LOG_ERROR("Device certificate or private key not found!");
+    return false;
+  }
+
+  LOG_INFO("Certificate loaded: %u bytes", (unsigned)Credentials.certificateLength());
+  LOG_INFO("Private key loaded: %u bytes", (unsigned)Credentials.privateKeyLength());
+
+  Credentials.apply(net);
 
   // For AWS IoT, you may need to skip server verification or add root CA
   net.setInsecure(); // TODO: Add Amazon Root CA for production
 
-  Serial.println("Certificates configured successfully");
+  LOG_INFO("Certificates configured successfully");
   return true;
 }
 
-bool connectToWiFi() {
+// Hands the saved network and APN to the link manager, which joins WiFi in
+// the background, dials the modem when WiFi stays down, and keeps a link up
+bool startLink() {
   preferences.begin("credentials", true);
   String ssid = preferences.getString("wifi_ssid", "");
   String password = preferences.getString("wifi_password", "");
+  String apn = preferences.getString("gsm_apn", "");
   preferences.end();
 
-  if (ssid.length() == 0) {
-    Serial.println("ERROR: No WiFi credentials saved!");
-    Serial.println("Please configure WiFi first");
+  if (ssid.length() == 0 && apn.length() == 0) {
+    LOG_ERROR("No WiFi or GSM settings saved! Please configure a network first");
     return false;
   }
 
-  Serial.print("Connecting to WiFi: ");
-  Serial.println(ssid);
-
+  LOG_INFO("Connecting to WiFi: %s, cellular fallback: %s", ssid.c_str(),
+           apn.length() > 0 ? apn.c_str() : "none");
   WiFi.mode(WIFI_STA);
-  WiFi.begin(ssid.c_str(), password.c_str());
-
-  int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 30) {
-    delay(500);
-    Serial.print(".");
-    attempts++;
-  }
-  Serial.println();
-
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("ERROR: WiFi connection failed!");
-    return false;
-  }
-
-  Serial.println("WiFi connected!");
-  Serial.print("IP address: ");
-  Serial.println(WiFi.localIP());
-  Serial.print("RSSI: ");
-  Serial.print(WiFi.RSSI());
-  Serial.println(" dBm");
-
+  Link.begin(ssid.c_str(), password.c_str(), apn.c_str());
   return true;
 }
 
 bool connectToAWS() {
-  Serial.println("\n--- Connecting to AWS IoT ---");
-  Serial.print("Endpoint: ");
-  Serial.println(aws_iot_endpoint);
-  Serial.print("Port: ");
-  Serial.println(aws_iot_port);
+  LOG_INFO("--- Connecting to AWS IoT ---");
+  LOG_DEBUG("Endpoint: %s, port %d", aws_iot_endpoint, aws_iot_port);
 
   // Generate unique client ID based on MAC address
   String clientId = "ESP32_" + WiFi.macAddress();
   clientId.replace(":", "");
 
-  Serial.print("Client ID: ");
-  Serial.println(clientId);
+  LOG_DEBUG("Client ID: %s", clientId.c_str());
 
   mqttClient.setServer(aws_iot_endpoint, aws_iot_port);
   mqttClient.setCallback(mqttCallback);
   mqttClient.setKeepAlive(60);
-  mqttClient.setSocketTimeout(30);
+  // A few round trips of the link in use, at least 10 s
+  mqttClient.setSocketTimeout((Link.tuning().timeoutMs + 999) / 1000);
+  mqttClient.setBufferSize(MQTT_PAYLOAD_MAX + 128);  // payload plus header and topic
 
-  Serial.println("Attempting MQTT connection...");
+  LOG_INFO("Attempting MQTT connection...");
 
   if (mqttClient.connect(clientId.c_str())) {
-    Serial.println("✓ MQTT connected successfully!");
+    LOG_INFO("✓ MQTT connected successfully over %s!", linkTypeName(Link.active()));
+    Link.sampleRtt(net.lastConnectMs());
+
+    TlsHandshakeStats tls = TlsSessions.stats();
+    LOG_INFO("TLS handshake: %u ms (%s)", tls.lastMs, tls.lastResumed ? "resumed" : "full");
+    LOG_INFO("TLS handshakes so far: %u full (avg %u ms), %u resumed (avg %u ms)",
+             tls.full, tls.full ? tls.fullMsTotal / tls.full : 0,
+             tls.resumed, tls.resumed ? tls.resumedMsTotal / tls.resumed : 0);
 
     // Subscribe to test topic
     if (mqttClient.subscribe(subscribe_topic)) {
-      Serial.print("✓ Subscribed to topic: ");
-      Serial.println(subscribe_topic);
+      LOG_INFO("✓ Subscribed to topic: %s", subscribe_topic);
     } else {
-      Serial.println("✗ Failed to subscribe");
+      LOG_WARN("✗ Failed to subscribe");
     }
 
     return true;
   } else {
-    Serial.print("✗ MQTT connection failed, rc=");
-    Serial.println(mqttClient.state());
-
+    const char* reason = "";
     switch(mqttClient.state()) {
-      case -4: Serial.println("  MQTT_CONNECTION_TIMEOUT"); break;
-      case -3: Serial.println("  MQTT_CONNECTION_LOST"); break;
-      case -2: Serial.println("  MQTT_CONNECT_FAILED"); break;
-      case -1: Serial.println("  MQTT_DISCONNECTED"); break;
-      case 1: Serial.println("  MQTT_CONNECT_BAD_PROTOCOL"); break;
-      case 2: Serial.println("  MQTT_CONNECT_BAD_CLIENT_ID"); break;
-      case 3: Serial.println("  MQTT_CONNECT_UNAVAILABLE"); break;
-      case 4: Serial.println("  MQTT_CONNECT_BAD_CREDENTIALS"); break;
-      case 5: Serial.println("  MQTT_CONNECT_UNAUTHORIZED"); break;
+      case -4: reason = "MQTT_CONNECTION_TIMEOUT"; break;
+      case -3: reason = "MQTT_CONNECTION_LOST"; break;
+      case -2: reason = "MQTT_CONNECT_FAILED"; break;
+      case -1: reason = "MQTT_DISCONNECTED"; break;
+      case 1: reason = "MQTT_CONNECT_BAD_PROTOCOL"; break;
+      case 2: reason = "MQTT_CONNECT_BAD_CLIENT_ID"; break;
+      case 3: reason = "MQTT_CONNECT_UNAVAILABLE"; break;
+      case 4: reason = "MQTT_CONNECT_BAD_CREDENTIALS"; break;
+      case 5: reason = "MQTT_CONNECT_UNAUTHORIZED"; break;
     }
+    LOG_WARN("✗ MQTT connection failed, rc=%d %s", mqttClient.state(), reason);
 
     return false;
   }
 }
 
-void publishTestMessage() {
-  if (!mqttClient.connected()) {
-    Serial.println("MQTT not connected, attempting reconnect...");
-    if (!connectToAWS()) {
+void recordSample() {
+  TelemetrySample sample;
+  sample.seq = ++messageCount;
+  sample.uptime = millis() / 1000;
+  sample.freeHeap = ESP.getFreeHeap();
+  sample.rssi = Link.active() == LINK_WIFI ? WiFi.RSSI() : 0;
+  sample.reserved = 0;
+  telemetry.push(sample);
+}
+
+// Publishes queued samples in batches. A sample leaves the queue only once
+// the message carrying it was handed to the client. The link's tuning caps
+// the message size and how many go out before mqttClient.loop() runs again.
+void drainTelemetry() {
+  static TelemetrySample batch[TELEMETRY_BATCH];
+  static uint8_t payload[MQTT_PAYLOAD_MAX];
+
+  LinkTuning tuning = Link.tuning();
+  size_t payloadMax = tuning.chunkBytes < sizeof(payload) ? tuning.chunkBytes : sizeof(payload);
+  // Sized for the worst case, so every batch encodes on the first try
+  size_t batchMax = telemetryBatchMax(TELEMETRY_FORMAT, deviceId, payloadMax);
+  if (batchMax > TELEMETRY_BATCH) {
+    batchMax = TELEMETRY_BATCH;
+  }
+  if (batchMax == 0) {
+    LOG_ERROR("✗ %u-byte payload cannot hold a sample", (unsigned)payloadMax);
+    return;
+  }
+  for (int i = 0; i < tuning.inFlight && telemetry.pending() > 0; i++) {
+    size_t count = telemetry.peek(batch, batchMax);
+    size_t len = telemetryEncode(TELEMETRY_FORMAT, deviceId, batch, count, payload, payloadMax);
+    if (count == 0 || len == 0) {
       return;
     }
-  }
-
-  messageCount++;
-
-  String payload = "{";
-  payload += "\"device_id\":\"" + WiFi.macAddress() + "\",";
-  payload += "\"message_count\":" + String(messageCount) + ",";
-  payload += "\"uptime\":" + String(millis() / 1000) + ",";
-  payload += "\"rssi\":" + String(WiFi.RSSI()) + ",";
-  payload += "\"free_heap\":" + String(ESP.getFreeHeap());
-  payload += "}";
-
-  Serial.print("Publishing to ");
-  Serial.print(publish_topic);
-  Serial.print(": ");
-  Serial.println(payload);
-
-  if (mqttClient.publish(publish_topic, payload.c_str())) {
-    Serial.println("✓ Message published successfully");
-  } else {
-    Serial.println("✗ Publish failed");
+    if (!mqttClient.publish(publish_topic, payload, len)) {
+      LOG_WARN("✗ Publish failed, samples stay queued");
+      return;
+    }
+    telemetry.pop(count);
+    LOG_INFO("✓ Published samples %u-%u (%u bytes %s), %u still queued",
+             (unsigned)batch[0].seq, (unsigned)batch[count - 1].seq, (unsigned)len,
+             telemetryFormatName(TELEMETRY_FORMAT), (unsigned)telemetry.pending());
   }
 }
 
 void setup() {
   Serial.begin(115200);
+  Log.begin();
   delay(1000);
 
-  Serial.println("\n\n=== AWS IoT MQTT Test ===\n");
+  LOG_INFO("=== AWS IoT MQTT Test ===");
 
-  // Initialize SPIFFS
-  if (!SPIFFS.begin(true)) {
-    Serial.println("ERROR: SPIFFS mount failed!");
+  // Certificates and queued telemetry live on the build's file system
+  if (!Storage.begin()) {
+    LOG_ERROR("Storage mount failed!");
     while(1) delay(1000);
   }
-  Serial.println("✓ SPIFFS mounted");
+  LOG_INFO("✓ %s mounted", Storage.name());
+
+  // Keep TLS sessions in NVS so the first connection after a reboot resumes
+  TlsSessions.begin(true);
+
+  // Samples queued on flash before a reset are sent first; seq carries on
+  // after the newest of them, so the replayed ones can be told apart
+  telemetry.begin(Storage.fs(), "/telemetry");
+  messageCount = telemetry.lastSeq();
 
   // Load certificates
   if (!loadCertificates()) {
-    Serial.println("\nERROR: Certificate loading failed!");
-    Serial.println("Please upload certificates first");
+    LOG_ERROR("Certificate loading failed! Please upload certificates first");
     while(1) delay(1000);
   }
 
-  // Connect to WiFi
-  if (!connectToWiFi()) {
-    Serial.println("\nERROR: WiFi connection failed!");
+  // Connect to WiFi or cellular; MQTT follows from loop() once a link is up
+  WiFi.macAddress().toCharArray(deviceId, sizeof(deviceId));
+  if (!startLink()) {
     while(1) delay(1000);
   }
 
-  // Connect to AWS IoT
-  if (!connectToAWS()) {
-    Serial.println("\nERROR: AWS IoT connection failed!");
-    Serial.println("Check your endpoint, certificates, and IoT policies");
-    while(1) delay(5000);
-  }
+  Commands.begin(command_prefix, commandRoutes, sizeof(commandRoutes) / sizeof(commandRoutes[0]),
+                 logMessage);
 
-  Serial.println("\n=== Test Running ===");
-  Serial.println("Publishing test messages every 10 seconds...");
-  Serial.println("Listening for messages on: " + String(subscribe_topic));
-  Serial.println();
+  LOG_INFO("=== Test Running ===");
+  LOG_INFO("Recording a sample every 10 seconds, published in batches...");
+  LOG_INFO("Listening for messages on: %s", subscribe_topic);
+  LOG_INFO("Commands: %sota (firmware URL), %sconfig (key=value), %smetrics",
+           command_prefix, command_prefix, command_prefix);
 }
 
 void loop() {
+  // Record a sample every 10 seconds, connected or not
+  if (millis() - lastSample >= SAMPLE_INTERVAL_MS) {
+    lastSample = millis();
+    recordSample();
+  }
+
+  // An update was installed by the ota command
+  if (restartPending.load()) {
+    LOG_INFO("Restarting into the new firmware");
+    telemetry.flush();
+    mqttClient.disconnect();
+    Log.flush(2000);
+    ESP.restart();
+  }
+  // The config command saved a new network
+  if (networkChanged.exchange(false)) {
+    Link.end();
+    startLink();
+  }
+
+  // WiFi retries run from events and backoff timers, the modem from its
+  // own task; nothing here blocks except hanging up after WiFi returns
+  Link.loop();
+  if (!Link.connected()) {
+    return;
+  }
+  // The socket died with the link it was opened on
+  if (Link.generation() != linkGeneration && mqttClient.connected()) {
+    LOG_INFO("Link changed to %s, reconnecting MQTT", linkTypeName(Link.active()));
+    mqttClient.disconnect();
+    nextMqttAttempt = millis();
+  }
+
   if (!mqttClient.connected()) {
-    Serial.println("MQTT disconnected! Reconnecting...");
-    if (connectToAWS()) {
-      Serial.println("Reconnected successfully");
-    } else {
-      Serial.println("Reconnection failed, retrying in 5s...");
-      delay(5000);
+    if ((long)(millis() - nextMqttAttempt) < 0) {
       return;
     }
+    TelemetryStats stats = telemetry.stats();
+    LOG_INFO("MQTT disconnected, %u samples queued (%u on flash, %u dropped)",
+             (unsigned)stats.pending, (unsigned)stats.onFlash, (unsigned)stats.dropped);
+    if (!connectToAWS()) {
+      uint32_t wait = mqttBackoff.next();
+      nextMqttAttempt = millis() + wait;
+      LOG_WARN("Reconnection failed, retrying in %u ms...", wait);
+      return;
+    }
+    mqttBackoff.reset();
+    linkGeneration = Link.generation();
+    if (Link.active() == LINK_WIFI) {
+      WiFiConnectStats wifi = Connection.stats();
+      LOG_INFO("Connected: WiFi took %u ms (%s), %u of %u joins used the cached AP",
+               wifi.lastMs, wifi.lastFast ? "fast" : "scan", wifi.fastConnects, wifi.connects);
+    } else {
+      CellularStats cell = Link.cellularStats();
+      LOG_INFO("Connected: dial took %u ms, signal %d, %u of %u dials connected",
+               cell.lastDialMs, cell.signal, cell.connects, cell.dials);
+    }
   }
 
   mqttClient.loop();
-
-  // Publish test message every 10 seconds
-  if (millis() - lastPublish > 10000) {
-    lastPublish = millis();
-    publishTestMessage();
-  }
-
-  // Monitor WiFi connection
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("WiFi disconnected! Reconnecting...");
-    connectToWiFi();
+  if (reportReady.load(std::memory_order_acquire)) {
+    if (!mqttClient.publish(report_topic, report)) {
+      LOG_WARN("✗ Report publish failed");
+    }
+    reportReady.store(false, std::memory_order_release);
   }
+  drainTelemetry();
 }
@@ -0,0 +1,172 @@
+#include <Arduino.h>
+#include <zlib.h>
+#include <CellularTransport.h>
+#include <WiFiTransport.h>
+#include <Logger.h>
+
+#include "ota_inflate.h"
+
+// Round trip for compressed OTA images on the native build: an image is
+// gzipped with the host's zlib, as `gzip -9` would, and fed through
+// OtaInflater in pieces of several sizes. The output has to match the image
+// byte for byte every time, and a damaged trailer has to be refused. It also
+// reports how much transfer time the compression saves at each link's prior
+// throughput, against the inflate time it costs.
+
+#ifndef NATIVE_BUILD
+#error "Compresses with the host's zlib; build with -e native"
+#endif
+
+#define IMAGE_SIZE (1024 * 1024)
+#define FEED_MAX 4096
+
+uint8_t image[IMAGE_SIZE];
+size_t imageSize;
+uint8_t* compressed;
+size_t compressedSize;
+
+// Where the sink is in the image, and whether everything so far matched
+size_t checked;
+bool matched;
+
+bool compareSink(const uint8_t* data, size_t len) {
+  if (checked + len > imageSize || memcmp(image + checked, data, len) != 0) {
+    matched = false;
+    return false;
+  }
+  checked += len;
+  return true;
+}
+
+// Machine code compresses about as well as a firmware image does
+size_t loadImage() {
+  FILE* f = fopen("/proc/self/exe", "rb");
+  if (f == NULL) {
+    return 0;
+  }
+  size_t n = fread(image, 1, IMAGE_SIZE, f);
+  fclose(f);
+  if (n > 0) {
+    image[0] = 0xE9;  // image magic, as the flash writer expects
+  }
+  return n;
+}
+
+bool gzipImage() {
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  // 15 window bits plus 16 for a gzip header and trailer
+  if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return false;
+  }
+  size_t bound = deflateBound(&zs, imageSize);
+  compressed = (uint8_t*)malloc(bound);
+  if (compressed == NULL) {
+    deflateEnd(&zs);
+    return false;
+  }
+  zs.next_in = image;
+  zs.avail_in = imageSize;
+  zs.next_out = compressed;
+  zs.avail_out = bound;
+  int rc = deflate(&zs, Z_FINISH);
+  compressedSize = zs.total_out;
+  deflateEnd(&zs);
+  return rc == Z_STREAM_END;
+}
+
+// Feeds data in pieces of `piece` bytes, or of varying sizes up to
+// FEED_MAX when piece is 0; true if the inflater finished with the image
+bool roundTrip(const uint8_t* data, size_t len, size_t piece, uint32_t& elapsed) {
+  static OtaInflater inflater;
+  checked = 0;
+  matched = true;
+  if (!inflater.begin(compareSink)) {
+    return false;
+  }
+  uint32_t seed = 1;
+  uint32_t start = micros();
+  bool ok = true;
+  for (size_t pos = 0; ok && pos < len;) {
+    size_t n = piece;
+    if (n == 0) {
+      seed = seed * 1103515245 + 12345;
+      n = 1 + (seed >> 16) % FEED_MAX;
+    }
+    if (n > len - pos) {
+      n = len - pos;
+    }
+    ok = inflater.write(data + pos, n);
+    pos += n;
+  }
+  elapsed = micros() - start;
+  bool done = ok && inflater.finished() && inflater.outputSize() == imageSize;
+  inflater.end();
+  return done && matched && checked == imageSize;
+}
+
+bool check(bool ok, const char* what) {
+  Serial.printf("  %-50s %s\n", what, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+void reportLink(const char* name, uint32_t bytesPerSec, uint32_t inflateUs) {
+  double plain = (double)imageSize / bytesPerSec;
+  double packed = (double)compressedSize / bytesPerSec + inflateUs / 1e6;
+  Serial.printf("  %-22s %9u %10.2f %10.2f %10.2f\n", name, (unsigned)bytesPerSec, plain, packed,
+                plain - packed);
+}
+
+void setup() {
+  Serial.begin(115200);
+  Log.begin();
+  delay(1000);
+
+  Serial.println("\n\n=== OTA Inflate Round Trip ===");
+  imageSize = loadImage();
+  if (imageSize == 0 || !gzipImage()) {
+    Serial.println("Could not build the compressed image");
+    exit(1);
+  }
+  Serial.printf("\n%u-byte image, %u bytes gzipped (%.1f%%)\n\n", (unsigned)imageSize,
+                (unsigned)compressedSize, 100.0 * compressedSize / imageSize);
+
+  static const size_t pieces[] = { 1, 7, 1460, 4096, 0 };
+  uint32_t inflateUs = 0;
+  bool passed = true;
+  for (size_t i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++) {
+    char what[64];
+    if (pieces[i] == 0) {
+      snprintf(what, sizeof(what), "byte-identical, fed in pieces of 1 to %u bytes", FEED_MAX);
+    } else {
+      snprintf(what, sizeof(what), "byte-identical, fed %u bytes at a time", (unsigned)pieces[i]);
+    }
+    uint32_t us;
+    passed &= check(roundTrip(compressed, compressedSize, pieces[i], us), what);
+    if (pieces[i] == 1460) {
+      inflateUs = us;  // a TCP segment per write, as it arrives on the device
+    }
+  }
+
+  // The trailer's CRC-32 covers the output, so a flipped byte must fail
+  compressed[compressedSize - 6] ^= 0x01;
+  uint32_t us;
+  passed &= check(!roundTrip(compressed, compressedSize, 1460, us), "refused with a damaged CRC-32");
+  compressed[compressedSize - 6] ^= 0x01;
+  passed &= check(!roundTrip(compressed, compressedSize - 1, 1460, us), "refused when the trailer is cut short");
+
+  Serial.printf("\nInflating took %u us on this host. Transfer time at each link's prior:\n",
+                (unsigned)inflateUs);
+  Serial.printf("  %-22s %9s %10s %10s %10s\n", "link", "bytes/s", "plain s", "gzip s", "saved s");
+  reportLink("WiFi", WIFI_PRIOR_BYTES_PER_SEC, inflateUs);
+  reportLink("cellular", CELLULAR_PRIOR_BYTES_PER_SEC, inflateUs);
+
+  free(compressed);
+  Serial.printf("\n%s\n", passed ? "PASSED" : "FAILED");
+  Serial.flush();
+  exit(passed ? 0 : 1);
+}
+
+void loop() {
+  // Nothing to do here
+}
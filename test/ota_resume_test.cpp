@@ -0,0 +1,199 @@
+#include <Arduino.h>
+#include <Preferences.h>
+#include <lwip/sockets.h>
+#include <esp_ota_ops.h>
+#include <Logger.h>
+
+#include "ota.h"
+
+// Runs an OTA job on the native build against a local HTTP server that
+// drops the connection part way through the image, twice. The job has to
+// continue each time with a Range request from a sector boundary it had
+// already written, carry the ETag in If-Range, and end with the image in
+// the update partition byte for byte. The test ends the process when it is
+// done, before the job's success would restart it.
+
+#ifndef NATIVE_BUILD
+#error "Needs a host server for the OTA client to reach; build with -e native"
+#endif
+
+#define SERVER_PORT 8083
+#define IMAGE_SIZE (1024 * 1024)
+#define SECTOR_SIZE 4096
+#define ETAG "\"fw-resume-test-1\""
+#define TEST_TIMEOUT_MS 60000
+
+// Each request is cut off once the image offset reaches its entry
+static const size_t dropAt[] = { 300 * 1024 + 1000, 700 * 1024 + 123 };
+#define DROPS (sizeof(dropAt) / sizeof(dropAt[0]))
+
+struct ServedRequest {
+  size_t rangeStart;   // 0 without a Range header
+  bool ifRangeMatched;
+  size_t sent;
+};
+
+uint8_t image[IMAGE_SIZE];
+ServedRequest served[8];
+volatile size_t requestCount = 0;
+
+uint8_t imageByte(size_t i) {
+  return i == 0 ? 0xE9 : (uint8_t)(i * 2654435761u >> 24);
+}
+
+// Reads the request head; returns false if the client went away
+bool readRequest(int fd, char* head, size_t size) {
+  size_t len = 0;
+  while (len < size - 1) {
+    ssize_t n = recv(fd, head + len, size - 1 - len, 0);
+    if (n <= 0) {
+      return false;
+    }
+    len += n;
+    head[len] = 0;
+    if (strstr(head, "\r\n\r\n") != NULL) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void serve(int fd) {
+  char head[1024];
+  if (!readRequest(fd, head, sizeof(head))) {
+    return;
+  }
+  ServedRequest& r = served[requestCount < 8 ? requestCount : 7];
+  const char* range = strstr(head, "Range: bytes=");
+  r.rangeStart = range != NULL ? strtoul(range + 13, NULL, 10) : 0;
+  r.ifRangeMatched = strstr(head, "If-Range: " ETAG) != NULL;
+  r.sent = 0;
+  size_t index = requestCount++;
+
+  char reply[256];
+  int len;
+  size_t start = r.rangeStart;
+  if (start > 0) {
+    len = snprintf(reply, sizeof(reply),
+                   "HTTP/1.1 206 Partial Content\r\nETag: " ETAG "\r\n"
+                   "Content-Range: bytes %u-%u/%u\r\nContent-Length: %u\r\n\r\n",
+                   (unsigned)start, IMAGE_SIZE - 1, IMAGE_SIZE, (unsigned)(IMAGE_SIZE - start));
+  } else {
+    len = snprintf(reply, sizeof(reply),
+                   "HTTP/1.1 200 OK\r\nETag: " ETAG "\r\nContent-Length: %u\r\n\r\n", IMAGE_SIZE);
+  }
+  send(fd, reply, len, MSG_NOSIGNAL);
+  size_t end = index < DROPS ? dropAt[index] : IMAGE_SIZE;
+  for (size_t pos = start; pos < end;) {
+    size_t n = end - pos < 1460 ? end - pos : 1460;
+    ssize_t sent = send(fd, image + pos, n, MSG_NOSIGNAL);
+    if (sent <= 0) {
+      break;
+    }
+    pos += sent;
+    r.sent += sent;
+  }
+}
+
+void serverTask(void* arg) {
+  int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  int on = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(SERVER_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd, 2) != 0) {
+    Serial.println("Test server: cannot listen");
+    vTaskDelete(NULL);
+    return;
+  }
+  for (;;) {
+    int fd = accept(listenFd, NULL, NULL);
+    if (fd >= 0) {
+      serve(fd);
+      close(fd);
+    }
+  }
+}
+
+bool check(bool ok, const char* what) {
+  Serial.printf("  %-58s %s\n", what, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+void setup() {
+  Serial.begin(115200);
+  Log.begin();
+  delay(1000);
+
+  Serial.println("\n\n=== OTA Resume Test ===");
+  for (size_t i = 0; i < IMAGE_SIZE; i++) {
+    image[i] = imageByte(i);
+  }
+  // No resume record from an earlier run
+  Preferences prefs;
+  prefs.begin("ota", false);
+  prefs.clear();
+  prefs.end();
+  xTaskCreate(serverTask, "test_server", 4096, NULL, 1, NULL);
+  delay(100);
+
+  char url[64];
+  snprintf(url, sizeof(url), "https://127.0.0.1:%u/firmware.bin", SERVER_PORT);
+  if (otaStart(url, "bench", "secret", "") == 0) {
+    Serial.println("Could not start the OTA job");
+    return;
+  }
+  OtaStatus status;
+  uint32_t start = millis();
+  do {
+    delay(100);
+    otaGetStatus(status);
+  } while (otaBusy() && status.state != OTA_SUCCESS && millis() - start < TEST_TIMEOUT_MS);
+
+  Serial.printf("\nJob ended in %s after %u ms: %s\n", otaStateName(status.state),
+                (unsigned)(millis() - start), status.message);
+  size_t servedBytes = 0;
+  for (size_t i = 0; i < requestCount && i < 8; i++) {
+    Serial.printf("  request %u: from byte %u, %u bytes sent%s\n", (unsigned)(i + 1),
+                  (unsigned)served[i].rangeStart, (unsigned)served[i].sent,
+                  served[i].ifRangeMatched ? ", If-Range matched" : "");
+    servedBytes += served[i].sent;
+  }
+  Serial.printf("  %u bytes served for a %u-byte image (%u resent)\n\n", (unsigned)servedBytes,
+                IMAGE_SIZE, (unsigned)(servedBytes - IMAGE_SIZE));
+
+  bool passed = check(status.state == OTA_SUCCESS, "job succeeded");
+  passed &= check(requestCount == DROPS + 1, "one request per dropped connection, plus the last");
+  for (size_t i = 1; i < requestCount && i <= DROPS; i++) {
+    size_t from = served[i].rangeStart;
+    char what[64];
+    snprintf(what, sizeof(what), "retry %u resumes at a sector boundary before the drop", (unsigned)i);
+    passed &= check(from > served[i - 1].rangeStart && from % SECTOR_SIZE == 0 && from <= dropAt[i - 1],
+                    what);
+    snprintf(what, sizeof(what), "retry %u sends If-Range with the ETag", (unsigned)i);
+    passed &= check(served[i].ifRangeMatched, what);
+  }
+  passed &= check(requestCount > 1 && status.resumedFrom == served[requestCount - 1].rangeStart,
+                  "status reports the last resume offset");
+
+  const esp_partition_t* partition = esp_ota_get_next_update_partition(NULL);
+  uint8_t block[SECTOR_SIZE];
+  bool same = partition != NULL;
+  for (size_t pos = 0; same && pos < IMAGE_SIZE; pos += sizeof(block)) {
+    same = esp_partition_read(partition, pos, block, sizeof(block)) == ESP_OK &&
+           memcmp(block, image + pos, sizeof(block)) == 0;
+  }
+  passed &= check(same, "update partition holds the image byte for byte");
+
+  Serial.printf("\n%s\n", passed ? "PASSED" : "FAILED");
+  Serial.flush();
+  // The OTA task restarts the device a few seconds after a success
+  exit(passed ? 0 : 1);
+}
+
+void loop() {
+  // Nothing to do here
+}
@@ -0,0 +1,171 @@
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <lwip/sockets.h>
+#include <Logger.h>
+
+#include "portal_page.h"
+#include "portal_server.h"
+
+// Compares the streamed portal page with the String-built page it
+// replaced, on the native build: the whole page, and the page answering a
+// form post. Each response is requested over a keep-alive connection to a
+// PortalServer stepped on this task, and the allocations and peak heap
+// counted are those made inside handleClient(), i.e. while the response
+// is built and sent.
+
+#ifndef NATIVE_BUILD
+#error "Allocation counts come from the native heap stand-in; build with -e native"
+#endif
+
+#define BENCH_PORT 8082
+#define ROUNDS 200
+#define RESPONSE_MAX 8192
+
+PortalServer server(BENCH_PORT);
+WiFiClient client;
+
+char response[RESPONSE_MAX];
+size_t responseLen;
+uint32_t latencies[ROUNDS];
+uint32_t allocations;
+size_t peakBytes;
+
+static const FirmwareOption options[] = {
+  { "v1.1", "Firmware v1.1" },
+  { "v1.2", "Firmware v1.2" },
+  { "v2.0", "Firmware v2.0" },
+};
+
+// The page as main.cpp used to build it: inline stylesheet, concatenated
+// on every request
+String basePage(String statusMsg = "") {
+  String statusDiv = statusMsg.length() > 0 ? "<div class=\"status\">" + statusMsg + "</div>" : "";
+  String otaForm =
+    "<form method=\"POST\" action=\"/ota\">"
+    "<label for=\"firmware\">Firmware Update</label>"
+    "<select id=\"firmware\" name=\"firmware\" required>"
+    "<option value=\"v1.1\">Firmware v1.1</option>"
+    "<option value=\"v1.2\">Firmware v1.2</option>"
+    "<option value=\"v2.0\">Firmware v2.0</option>"
+    "</select>"
+    "<input type=\"submit\" value=\"Update\">"
+    "</form>";
+
+  String gsmForm =
+    "<form method=\"POST\" action=\"/gsm\">"
+    "<label for=\"apn\">APN</label>"
+    "<input type=\"text\" id=\"apn\" name=\"apn\" placeholder=\"internet\" required>"
+    "<input type=\"submit\" value=\"Save GSM Settings\">"
+    "</form>";
+
+  return "<!DOCTYPE html><html lang=\"en\"><head><meta charset=\"UTF-8\"><title>ESP32 Portal</title><meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\"><style>body{background:#f4f8fb;font-family:'Segoe UI',Arial,sans-serif;margin:0;padding:0;color:#222}.container{max-width:400px;margin:40px auto;padding:24px;background:#fff;border-radius:16px;box-shadow:0 4px 24px rgba(0,0,0,0.08)}h2{margin-top:0;color:#1976d2;font-weight:600;font-size:1.4em}form{margin-bottom:24px}label{display:block;margin-bottom:6px;font-weight:500}input[type='text'],input[type='password'],input[type='file'],select{width:100%;padding:8px 10px;margin-bottom:14px;border:1px solid #cfd8dc;border-radius:6px;font-size:1em;background:#f9fbfc}input[type='submit']{background:#1976d2;color:#fff;border:none;padding:10px 0;width:100%;border-radius:6px;font-size:1em;font-weight:600;cursor:pointer;transition:background 0.2s}input[type='submit']:hover{background:#1565c0}.divider{border-top:1px solid #e0e0e0;margin:24px 0}.status{padding:10px;background:#e3f2fd;color:#1976d2;border-radius:6px;margin-bottom:18px;text-align:center;font-size:0.98em}@media (max-width:500px){.container{margin:10px;padding:12px}}</style></head><body><div class=\"container\"><h2>ESP32 Portal</h2>" + statusDiv + "<form method=\"POST\" action=\"/upload\" enctype=\"multipart/form-data\"><label for=\"cert\">Upload Device Certificate</label><input type=\"file\" id=\"cert\" name=\"cert\" required><input type=\"submit\" value=\"Upload Certificate\"></form><form method=\"POST\" action=\"/upload-key\" enctype=\"multipart/form-data\"><label for=\"key\">Upload Private Key</label><input type=\"file\" id=\"key\" name=\"key\" required><input type=\"submit\" value=\"Upload Key\"></form><div class=\"divider\"></div><form method=\"POST\" action=\"/wifi\"><label for=\"ssid\">WiFi SSID</label><input type=\"text\" id=\"ssid\" name=\"ssid\" required><label for=\"password\">WiFi Password</label><input type=\"password\" id=\"password\" name=\"password\" required><input type=\"submit\" value=\"Save WiFi\"></form><div class=\"divider\"></div>" + gsmForm + "<div class=\"divider\"></div>" + otaForm + "</div></body></html>";
+}
+
+void connectClient() {
+  client.connect("127.0.0.1", nativeListenPort(BENCH_PORT));
+  for (int i = 0; i < 100 && server.connections() == 0; i++) {
+    server.handleClient();
+    delay(1);
+  }
+}
+
+bool responseComplete() {
+  response[responseLen] = 0;
+  const char* body = strstr(response, "\r\n\r\n");
+  if (body == NULL) {
+    return false;
+  }
+  body += 4;
+  const char* length = strstr(response, "Content-Length: ");
+  if (length != NULL && length < body) {
+    return (size_t)(response + responseLen - body) >= (size_t)atoi(length + 16);
+  }
+  return responseLen >= 5 && strcmp(response + responseLen - 5, "0\r\n\r\n") == 0;
+}
+
+bool roundTrip(const char* path, uint32_t& latency) {
+  char request[96];
+  size_t len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: 192.168.4.1\r\n\r\n", path);
+  if (!client.connected()) {
+    connectClient();
+  }
+  responseLen = 0;
+  nativeHeapResetPeak();
+  size_t base = nativeHeapStats().inUse;
+  uint32_t start = micros();
+  client.write((const uint8_t*)request, len);
+  while (!responseComplete()) {
+    if (micros() - start > 1000000) {
+      return false;
+    }
+    NativeHeapStats before = nativeHeapStats();
+    server.handleClient();
+    allocations += nativeHeapStats().allocations - before.allocations;
+    int n = client.available();
+    if (n > 0 && responseLen + n < RESPONSE_MAX) {
+      responseLen += client.read((uint8_t*)response + responseLen, n);
+    }
+  }
+  latency = micros() - start;
+  if (nativeHeapStats().peak - base > peakBytes) {
+    peakBytes = nativeHeapStats().peak - base;
+  }
+  return strncmp(response, "HTTP/1.1 200", 12) == 0;
+}
+
+int compareU32(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*)a;
+  uint32_t y = *(const uint32_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+void run(const char* name, const char* path) {
+  allocations = 0;
+  peakBytes = 0;
+  for (int i = 0; i < ROUNDS; i++) {
+    if (!roundTrip(path, latencies[i])) {
+      Serial.printf("  %-24s failed: %.40s\n", name, response);
+      return;
+    }
+  }
+  qsort(latencies, ROUNDS, sizeof(latencies[0]), compareU32);
+  const char* body = strstr(response, "\r\n\r\n") + 4;
+  Serial.printf("  %-24s %7u %7u %10.1f %9u %8u\n", name, (unsigned)latencies[ROUNDS / 2],
+                (unsigned)latencies[ROUNDS * 99 / 100], (double)allocations / ROUNDS,
+                (unsigned)peakBytes, (unsigned)(response + responseLen - body));
+}
+
+void setup() {
+  Serial.begin(115200);
+  Log.begin();
+  delay(1000);
+
+  Serial.println("\n\n=== Portal Page Benchmark ===");
+  server.on("/", HTTP_GET, []() {
+    sendPortalPage(server, 200, "", options, sizeof(options) / sizeof(options[0]));
+  });
+  server.on("/result", HTTP_GET, []() {
+    sendResultPage(server, 200, "WiFi credentials saved!");
+  });
+  server.on("/string", HTTP_GET, []() {
+    server.send(200, "text/html", basePage());
+  });
+  server.on("/string/result", HTTP_GET, []() {
+    server.send(200, "text/html", basePage("WiFi credentials saved!"));
+  });
+  server.begin();
+
+  Serial.printf("\n%u responses each; allocations and peak heap per response:\n", ROUNDS);
+  Serial.printf("  %-24s %7s %7s %10s %9s %8s\n", "response", "p50 us", "p99 us", "allocs",
+                "peak B", "body B");
+  run("page, String (before)", "/string");
+  run("page, streamed", "/");
+  run("result, String (before)", "/string/result");
+  run("result, streamed", "/result");
+  client.stop();
+  Serial.println("\nDone.");
+}
+
+void loop() {
+  // Nothing to do here
+}
@@ -0,0 +1,327 @@
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <lwip/sockets.h>
+#include <FileStorage.h>
+#include <Logger.h>
+
+#include "config_store.h"
+#include "metrics.h"
+#include "ota_flash.h"
+#include "pem_upload.h"
+#include "portal_page.h"
+#include "portal_server.h"
+
+// Per-handler benchmark for the native build. Requests go over a keep-alive
+// connection to a PortalServer stepped on this task until the response is
+// complete, so each latency covers parsing, the handler and sending, and
+// only allocations made inside handleClient() are counted. The handlers are
+// main.cpp's, on the same modules. The OTA copy loop (flash write and
+// digest update per buffer, as the writer task does) runs without a
+// network. The per-request metrics cost is timed on its own, as it is too
+// small to show in a round trip. Run it at each commit to track the numbers; it restores the
+// WiFi settings and removes its files afterwards.
+
+#ifndef NATIVE_BUILD
+#error "Allocation counts come from the native heap stand-in; build with -e native"
+#endif
+
+#define BENCH_PORT 8081
+#define ROUNDS 200
+#define CERT_LINES 22        // ~1.4 KB, a typical device certificate
+#define OTA_CHUNK_SIZE 4096  // the writer task's buffers on a fast link
+#define OTA_IMAGE_SIZE (1024 * 1024)
+#define RESPONSE_MAX 8192
+#define RECORD_ROUNDS 100000
+
+const char* certPath = "/bench/device.pem";
+
+PortalServer server(BENCH_PORT);
+PemUpload pemUpload;
+WiFiClient client;
+
+char response[RESPONSE_MAX];
+size_t responseLen;
+char request[4096];
+uint32_t latencies[ROUNDS];
+uint32_t allocations;
+size_t peakBytes;
+uint8_t chunk[OTA_CHUNK_SIZE];
+
+static const FirmwareOption options[] = {
+  { "v2.3.4", "Firmware 2.3.4" },
+  { "v2.4.0", "Firmware 2.4.0" },
+  { "v2.5.0-rc1", "Firmware 2.5.0 (release candidate)" },
+};
+
+// As in main.cpp, with a fixed drop-down instead of the cached manifest
+void handleRoot() {
+  sendPortalPage(server, 200, "", options, sizeof(options) / sizeof(options[0]));
+}
+
+void handleWifiCredentials() {
+  if (server.hasArg("ssid") && server.hasArg("password")) {
+    String ssid = server.arg("ssid");
+    String password = server.arg("password");
+    if (Config.check("wifi_ssid", ssid.c_str()) != CONFIG_OK ||
+        Config.check("wifi_password", password.c_str()) != CONFIG_OK) {
+      sendResultPage(server, 400, "SSID or password is too long.");
+      return;
+    }
+    Config.set("wifi_ssid", ssid.c_str());
+    Config.set("wifi_password", password.c_str());
+    if (Config.commit() < 0) {
+      sendResultPage(server, 500, "Could not save WiFi credentials.");
+      return;
+    }
+    sendResultPage(server, 200, "WiFi credentials saved!");
+  } else {
+    sendResultPage(server, 400, "Missing SSID or password.");
+  }
+}
+
+void handleFileUpload() {
+  HTTPUpload& upload = server.upload();
+  if (upload.status == UPLOAD_FILE_START) {
+    pemUpload.begin(Storage.fs(), certPath, PEM_CERTIFICATE);
+  } else if (upload.status == UPLOAD_FILE_WRITE) {
+    pemUpload.write(upload.buf, upload.currentSize);
+  } else if (upload.status == UPLOAD_FILE_END) {
+    if (pemUpload.finish()) {
+      sendResultPage(server, 200, "Device certificate uploaded successfully!");
+    } else {
+      sendResultPage(server, 400, pemUpload.lastError());
+    }
+  } else if (upload.status == UPLOAD_FILE_ABORTED) {
+    pemUpload.abort();
+  }
+}
+
+// True once the buffer holds a whole response, by Content-Length or the
+// last chunk of a chunked one
+bool responseComplete() {
+  response[responseLen] = 0;
+  const char* body = strstr(response, "\r\n\r\n");
+  if (body == NULL) {
+    return false;
+  }
+  body += 4;
+  const char* length = strstr(response, "Content-Length: ");
+  if (length != NULL && length < body) {
+    return (size_t)(response + responseLen - body) >= (size_t)atoi(length + 16);
+  }
+  return responseLen >= 5 && strcmp(response + responseLen - 5, "0\r\n\r\n") == 0;
+}
+
+// The server closes a keep-alive connection after
+// PORTAL_MAX_KEEPALIVE_REQUESTS; a new one is opened outside the timing
+void connectClient() {
+  client.connect("127.0.0.1", nativeListenPort(BENCH_PORT));
+  for (int i = 0; i < 100 && server.connections() == 0; i++) {
+    server.handleClient();
+    delay(1);
+  }
+}
+
+// Steps the server until the response has arrived; false on a timeout or
+// an unexpected status
+bool roundTrip(const char* data, size_t len, uint32_t& latency) {
+  if (!client.connected()) {
+    connectClient();
+  }
+  responseLen = 0;
+  nativeHeapResetPeak();
+  size_t base = nativeHeapStats().inUse;
+  uint32_t start = micros();
+  client.write((const uint8_t*)data, len);
+  while (!responseComplete()) {
+    if (micros() - start > 1000000) {
+      return false;
+    }
+    NativeHeapStats before = nativeHeapStats();
+    server.handleClient();
+    allocations += nativeHeapStats().allocations - before.allocations;
+    int n = client.available();
+    if (n > 0 && responseLen + n < RESPONSE_MAX) {
+      responseLen += client.read((uint8_t*)response + responseLen, n);
+    }
+  }
+  latency = micros() - start;
+  size_t peak = nativeHeapStats().peak - base;
+  if (peak > peakBytes) {
+    peakBytes = peak;
+  }
+  return strncmp(response, "HTTP/1.1 200", 12) == 0;
+}
+
+int compareU32(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*)a;
+  uint32_t y = *(const uint32_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+void report(const char* name, size_t count) {
+  qsort(latencies, count, sizeof(latencies[0]), compareU32);
+  Serial.printf("  %-24s %7u %7u %7u %10.1f %9u\n", name, (unsigned)latencies[count / 2],
+                (unsigned)latencies[count * 99 / 100], (unsigned)latencies[count - 1],
+                (double)allocations / count, (unsigned)peakBytes);
+}
+
+// Sends request (built by the caller) ROUNDS times
+void run(const char* name, size_t (*build)(int round)) {
+  allocations = 0;
+  peakBytes = 0;
+  for (int i = 0; i < ROUNDS; i++) {
+    size_t len = build(i);
+    if (!roundTrip(request, len, latencies[i])) {
+      Serial.printf("  %-24s failed: %.40s\n", name, response);
+      return;
+    }
+  }
+  report(name, ROUNDS);
+}
+
+size_t rootRequest(int round) {
+  return snprintf(request, sizeof(request), "GET / HTTP/1.1\r\nHost: 192.168.4.1\r\n\r\n");
+}
+
+// Alternates between two networks, so every request commits a change
+size_t wifiRequest(int round) {
+  char form[96];
+  int formLen = snprintf(form, sizeof(form), "ssid=bench-%d&password=secret%%21%d", round % 2, round % 2);
+  return snprintf(request, sizeof(request),
+                  "POST /wifi HTTP/1.1\r\nHost: 192.168.4.1\r\n"
+                  "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: %d\r\n\r\n%s",
+                  formLen, form);
+}
+
+size_t uploadRequest(int round) {
+  static const char boundary[] = "----benchBoundary7MA4YWxkTrZu0gW";
+  char body[2048];
+  int len = snprintf(body, sizeof(body),
+                     "--%s\r\nContent-Disposition: form-data; name=\"cert\"; filename=\"device.pem\"\r\n"
+                     "Content-Type: application/x-x509-ca-cert\r\n\r\n-----BEGIN CERTIFICATE-----\n",
+                     boundary);
+  for (int line = 0; line < CERT_LINES; line++) {
+    for (int i = 0; i < 64; i++) {
+      body[len++] = line == 0 && i == 0 ? 'M' : "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdef"[(line * 7 + i) % 32];
+    }
+    body[len++] = '\n';
+  }
+  len += snprintf(body + len, sizeof(body) - len, "-----END CERTIFICATE-----\n\r\n--%s--\r\n", boundary);
+  size_t head = snprintf(request, sizeof(request),
+                         "POST /upload HTTP/1.1\r\nHost: 192.168.4.1\r\n"
+                         "Content-Type: multipart/form-data; boundary=%s\r\nContent-Length: %d\r\n\r\n",
+                         boundary, len);
+  memcpy(request + head, body, len);
+  return head + len;
+}
+
+// The writer task's work per buffer, without the queues around it
+void otaCopyLoop() {
+  static OtaFlashWriter flash;
+  static OtaDigest digest;
+  allocations = 0;
+  peakBytes = 0;
+  const int images = 5;
+  for (int i = 0; i < images; i++) {
+    nativeHeapResetPeak();
+    NativeHeapStats before = nativeHeapStats();
+    uint32_t start = micros();
+    bool ok = flash.begin(OTA_IMAGE_SIZE, 0);
+    digest.begin();
+    for (size_t offset = 0; ok && offset < OTA_IMAGE_SIZE; offset += sizeof(chunk)) {
+      ok = flash.write(chunk, sizeof(chunk));
+      digest.update(chunk, sizeof(chunk));
+    }
+    uint8_t sha256[32];
+    digest.finish(sha256);
+    latencies[i] = micros() - start;
+    NativeHeapStats after = nativeHeapStats();
+    if (!ok) {
+      Serial.printf("  OTA copy loop failed: %s\n", flash.lastError());
+      return;
+    }
+    allocations += after.allocations - before.allocations;
+    if (after.peak - before.inUse > peakBytes) {
+      peakBytes = after.peak - before.inUse;
+    }
+  }
+  report("OTA copy loop (1 MB)", images);
+}
+
+// What PortalServer::recordRequest() adds to every request: a micros()
+// read, a histogram record and the route counters. Latencies cycle through
+// every bucket, so the bucket search is averaged rather than best case.
+void recordCost() {
+  static const uint32_t samples[] = { 120, 800, 1800, 4000, 7500, 18000, 40000, 80000,
+                                      200000, 600000, 2000000 };
+  const size_t sampleCount = sizeof(samples) / sizeof(samples[0]);
+  static RouteMetrics m;
+
+  uint32_t start = micros();
+  for (size_t i = 0; i < RECORD_ROUNDS; i++) {
+    m.latency.record(samples[i % sampleCount]);
+  }
+  uint32_t recordUs = micros() - start;
+
+  uint32_t startedUs = micros();
+  start = micros();
+  for (size_t i = 0; i < RECORD_ROUNDS; i++) {
+    m.latency.record(micros() - startedUs + samples[i % sampleCount]);
+    m.responseBytes += 1024;
+    if (i % 8 == 0) {
+      m.errors++;
+    }
+  }
+  uint32_t requestUs = micros() - start;
+
+  Serial.printf("\nMetrics per request, %u rounds (%u recorded):\n", RECORD_ROUNDS,
+                (unsigned)m.latency.count);
+  Serial.printf("  %-24s %7.1f ns\n", "LatencyHistogram::record", recordUs * 1000.0 / RECORD_ROUNDS);
+  Serial.printf("  %-24s %7.1f ns\n", "recordRequest", requestUs * 1000.0 / RECORD_ROUNDS);
+}
+
+void setup() {
+  Serial.begin(115200);
+  Log.begin();
+  delay(1000);
+
+  Serial.println("\n\n=== Portal Handler Benchmark ===");
+  if (!Storage.begin()) {
+    Serial.println("Storage mount failed");
+    return;
+  }
+  Config.begin();
+  DeviceConfig saved = Config.get();
+  for (size_t i = 0; i < sizeof(chunk); i++) {
+    chunk[i] = i * 31;
+  }
+  chunk[0] = 0xE9;  // image magic, checked on the first write
+
+  server.on("/", HTTP_GET, handleRoot);
+  server.on("/upload", HTTP_POST, [](){ server.send(200); }, handleFileUpload);
+  server.on("/wifi", HTTP_POST, handleWifiCredentials);
+  server.begin();
+
+  Serial.printf("\n%u requests each over keep-alive connections. Allocations and peak heap\n", ROUNDS);
+  Serial.println("are per request, or per 1 MB image for the copy loop:");
+  Serial.printf("  %-24s %7s %7s %7s %10s %9s\n", "handler", "p50 us", "p99 us", "max us",
+                "allocs", "peak B");
+  run("handleRoot", rootRequest);
+  run("handleWifiCredentials", wifiRequest);
+  run("handleFileUpload", uploadRequest);
+  otaCopyLoop();
+  recordCost();
+
+  client.stop();
+  Config.set("wifi_ssid", saved.wifiSsid);
+  Config.set("wifi_password", saved.wifiPassword);
+  Config.commit();
+  Storage.fs().remove(certPath);
+  Storage.fs().rmdir("/bench");
+  Serial.println("\nDone; settings restored and benchmark files removed.");
+}
+
+void loop() {
+  // Nothing to do here
+}
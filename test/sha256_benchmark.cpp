@@ -0,0 +1,141 @@
+#include <Arduino.h>
+#include <esp_ota_ops.h>
+#include <mbedtls/sha256.h>
+
+#include "ota_flash.h"
+
+// Cost of verifying an OTA image's SHA-256, per MB. The digest is updated
+// on each buffer as the writer task receives it, at the buffer sizes the
+// link tuning uses; the copy loop is then timed with and without it, and
+// against a second pass that reads the image back from flash to hash it,
+// which inline hashing avoids. On the device the SHA peripheral does the
+// work; on the native build it is the host's software SHA-256.
+
+#define IMAGE_SIZE (1024 * 1024)
+#define ROUNDS 5
+#define CHUNK_MAX 16384
+
+uint8_t chunk[CHUNK_MAX];
+uint32_t samples[ROUNDS];
+
+uint32_t median() {
+  for (size_t i = 1; i < ROUNDS; i++) {
+    for (size_t j = i; j > 0 && samples[j] < samples[j - 1]; j--) {
+      uint32_t swap = samples[j];
+      samples[j] = samples[j - 1];
+      samples[j - 1] = swap;
+    }
+  }
+  return samples[ROUNDS / 2];
+}
+
+void report(const char* name, uint32_t usPerMb) {
+  Serial.printf("  %-34s %9u %8.2f\n", name, (unsigned)usPerMb, usPerMb > 0 ? 1e6 / usPerMb : 0.0);
+}
+
+// One image through OtaDigest in pieces of len bytes
+uint32_t hashImage(size_t len, uint8_t out[32]) {
+  static OtaDigest digest;
+  uint32_t start = micros();
+  digest.begin();
+  for (size_t offset = 0; offset < IMAGE_SIZE; offset += len) {
+    digest.update(chunk, IMAGE_SIZE - offset < len ? IMAGE_SIZE - offset : len);
+  }
+  digest.finish(out);
+  return micros() - start;
+}
+
+// The writer task's loop: flash write per buffer, with or without the digest
+uint32_t copyImage(bool hash, bool& ok) {
+  static OtaFlashWriter flash;
+  static OtaDigest digest;
+  const size_t len = 4096;
+  uint32_t start = micros();
+  ok = flash.begin(IMAGE_SIZE, 0);
+  digest.begin();
+  for (size_t offset = 0; ok && offset < IMAGE_SIZE; offset += len) {
+    ok = flash.write(chunk, len);
+    if (hash) {
+      digest.update(chunk, len);
+    }
+  }
+  uint8_t sha256[32];
+  digest.finish(sha256);
+  return micros() - start;
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+
+  Serial.println("\n\n=== SHA-256 Benchmark ===");
+  for (size_t i = 0; i < sizeof(chunk); i++) {
+    chunk[i] = i * 31;
+  }
+  chunk[0] = 0xE9;  // image magic, checked on the first flash write
+
+  Serial.printf("\n1 MB images, median of %u; microseconds per MB:\n", ROUNDS);
+  Serial.printf("  %-34s %9s %8s\n", "work", "us/MB", "MB/s");
+  const size_t sizes[] = { 1460, 4096, CHUNK_MAX };
+  uint8_t inPieces[32];
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    uint8_t digest[32];
+    for (size_t i = 0; i < ROUNDS; i++) {
+      samples[i] = hashImage(sizes[s], digest);
+    }
+    char name[40];
+    snprintf(name, sizeof(name), "SHA-256, %u-byte updates", (unsigned)sizes[s]);
+    report(name, median());
+    if (sizes[s] == 4096) {
+      memcpy(inPieces, digest, sizeof(inPieces));
+    }
+  }
+
+  // The streamed digest has to be the plain mbedtls one over the same bytes
+  mbedtls_sha256_context ctx;
+  uint8_t oneShot[32];
+  mbedtls_sha256_init(&ctx);
+  mbedtls_sha256_starts_ret(&ctx, 0);
+  for (size_t offset = 0; offset < IMAGE_SIZE; offset += 4096) {
+    mbedtls_sha256_update_ret(&ctx, chunk, 4096);
+  }
+  mbedtls_sha256_finish_ret(&ctx, oneShot);
+  mbedtls_sha256_free(&ctx);
+  bool same = memcmp(inPieces, oneShot, sizeof(oneShot)) == 0;
+
+  bool ok = true;
+  for (size_t i = 0; i < ROUNDS && ok; i++) {
+    samples[i] = copyImage(false, ok);
+  }
+  uint32_t plain = ok ? median() : 0;
+  for (size_t i = 0; i < ROUNDS && ok; i++) {
+    samples[i] = copyImage(true, ok);
+  }
+  uint32_t hashed = ok ? median() : 0;
+  if (!ok) {
+    Serial.println("  copy loop failed: could not write the update partition");
+    return;
+  }
+  report("copy loop, no digest", plain);
+  report("copy loop, digest inline", hashed);
+
+  // What verifying afterwards would add: the image read back and hashed
+  const esp_partition_t* partition = esp_ota_get_next_update_partition(NULL);
+  for (size_t i = 0; i < ROUNDS; i++) {
+    OtaDigest second;
+    uint8_t digest[32];
+    uint32_t start = micros();
+    second.beginFrom(partition, IMAGE_SIZE);
+    second.finish(digest);
+    samples[i] = micros() - start;
+  }
+  report("second pass over flash", median());
+
+  Serial.printf("\nInline digest adds %.1f%% to the copy loop; 4 KB digest %s mbedtls.\n",
+                plain > 0 ? 100.0 * ((double)hashed - plain) / plain : 0.0,
+                same ? "matches" : "DOES NOT match");
+}
+
+void loop() {
+  // Nothing to do here
+}
@@ -0,0 +1,116 @@
+#include <Arduino.h>
+#include <TelemetryEncoder.h>
+#include <Transport.h>
+
+// Compares the telemetry encoder with the payload mqtt_aws_test.cpp used to
+// build: one JSON object per sample, concatenated into a String and
+// published as its own message. The same 10-sample batch goes through the
+// old String code, the JSON batch and the CBOR batch; each reports time and
+// bytes per sample. It then checks that batches sized with
+// telemetryBatchMax() encode even when every field is at its widest.
+
+#define ROUNDS 1000
+#define BATCH 10             // TELEMETRY_BATCH in mqtt_aws_test.cpp
+#define PAYLOAD_MAX 1024     // MQTT_PAYLOAD_MAX in mqtt_aws_test.cpp
+
+const char* deviceId = "24:6F:28:AB:CD:EF";  // WiFi.macAddress()
+
+TelemetrySample batch[BATCH];
+uint8_t payload[PAYLOAD_MAX];
+volatile size_t sink;        // keeps the encoded length live
+
+// The payload built per sample before the encoder
+size_t stringJson(const TelemetrySample& sample) {
+  String payload = "{";
+  payload += "\"device_id\":\"" + String(deviceId) + "\",";
+  payload += "\"message_count\":" + String((unsigned long)sample.seq) + ",";
+  payload += "\"uptime\":" + String((unsigned long)sample.uptime) + ",";
+  payload += "\"rssi\":" + String((int)sample.rssi) + ",";
+  payload += "\"free_heap\":" + String((unsigned long)sample.freeHeap);
+  payload += "}";
+  return payload.length();
+}
+
+void report(const char* name, uint32_t us, size_t bytes, size_t messages) {
+  Serial.printf("  %-28s %8u %8u %8u %8u\n", name,
+                (unsigned)((uint64_t)us * 1000 / ROUNDS / BATCH), (unsigned)(bytes / BATCH),
+                (unsigned)bytes, (unsigned)messages);
+}
+
+void runString() {
+  size_t bytes = 0;
+  uint32_t start = micros();
+  for (size_t r = 0; r < ROUNDS; r++) {
+    bytes = 0;
+    for (size_t i = 0; i < BATCH; i++) {
+      bytes += stringJson(batch[i]);
+    }
+    sink = bytes;
+  }
+  report("String JSON (before)", micros() - start, bytes, BATCH);
+}
+
+void runEncoder(const char* name, TelemetryFormat format) {
+  size_t len = 0;
+  uint32_t start = micros();
+  for (size_t r = 0; r < ROUNDS; r++) {
+    len = telemetryEncode(format, deviceId, batch, BATCH, payload, sizeof(payload));
+    sink = len;
+  }
+  uint32_t us = micros() - start;
+  if (len == 0) {
+    Serial.printf("  %-28s did not fit in %u bytes\n", name, PAYLOAD_MAX);
+    return;
+  }
+  report(name, us, len, 1);
+}
+
+// Every field at its widest encoding; a batch of telemetryBatchMax()
+// samples has to fit, whatever the payload size
+bool checkBatchMax(TelemetryFormat format, size_t len) {
+  static TelemetrySample widest[PAYLOAD_MAX / 8];
+  size_t count = telemetryBatchMax(format, deviceId, len);
+  if (count > sizeof(widest) / sizeof(widest[0])) {
+    count = sizeof(widest) / sizeof(widest[0]);
+  }
+  for (size_t i = 0; i < count; i++) {
+    widest[i] = { 0xffffffff, 0xffffffff, 0xffffffff, -32768, 0 };
+  }
+  size_t used = telemetryEncode(format, deviceId, widest, count, payload, len);
+  bool ok = count > 0 && used > 0;
+  Serial.printf("  %-5s %6u bytes: %3u samples, %4u bytes used  %s\n", telemetryFormatName(format),
+                (unsigned)len, (unsigned)count, (unsigned)used, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+
+  Serial.println("\n\n=== Telemetry Encoder Benchmark ===");
+  for (size_t i = 0; i < BATCH; i++) {
+    // An hour into a run: typical widths rather than best or worst case
+    batch[i] = { 360 + (uint32_t)i, 3600 + 10 * (uint32_t)i, 187432 - 64 * (uint32_t)i,
+                 (int16_t)(-58 - (int)i % 5), 0 };
+  }
+
+  Serial.printf("\n%u samples, %u rounds:\n", BATCH, ROUNDS);
+  Serial.printf("  %-28s %8s %8s %8s %8s\n", "payload", "ns/smpl", "B/smpl", "bytes", "messages");
+  runString();
+  runEncoder("JSON batch", TELEMETRY_JSON);
+  runEncoder("CBOR batch", TELEMETRY_CBOR);
+
+  Serial.println("\nBatches sized with telemetryBatchMax(), widest values:");
+  bool passed = true;
+  // Half of LINK_CHUNK_MIN for margin, LINK_CHUNK_MIN, and the sketch's cap
+  const size_t sizes[] = { LINK_CHUNK_MIN / 2, LINK_CHUNK_MIN, PAYLOAD_MAX };
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    passed &= checkBatchMax(TELEMETRY_CBOR, sizes[i]);
+    passed &= checkBatchMax(TELEMETRY_JSON, sizes[i]);
+  }
+  Serial.println(passed ? "\nPASS" : "\nFAIL");
+}
+
+void loop() {
+  // Nothing to do here
+}
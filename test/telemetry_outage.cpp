@@ -0,0 +1,177 @@
+#include <Arduino.h>
+#include <FileStorage.h>
+#include <Logger.h>
+#include <TelemetryQueue.h>
+
+// Simulates broker outages against the telemetry queue: samples are pushed
+// with nothing drained, as mqtt_aws_test.cpp records them while offline,
+// then drained in publish-sized batches once "the connection returns".
+// Each run checks that samples come out in order with no gap in seq, and
+// that every sample pushed was either drained or counted as dropped (only
+// once the flash budget is used up, oldest first). One run loses power part
+// way through, after a short reconnect: what was in RAM is lost, the head
+// segment is replayed, and the replayed samples have to be recognisable by
+// seq alone. On the native build the segments go to the file system
+// stand-in.
+
+#define QUEUE_DIR "/tq_test"
+#define DRAIN_BATCH 10        // TELEMETRY_BATCH in mqtt_aws_test.cpp
+#define DRAIN_MAX_MS 10000    // an hour's backlog at 1 s has to clear in this
+
+struct Outage {
+  const char* name;
+  uint32_t intervalSec;       // between samples
+  uint32_t samples;
+  bool reboot;                // power lost half way, as a reset would
+};
+
+bool allPassed = true;
+
+void removeQueueFiles() {
+  fs::FS& fs = Storage.fs();
+  File root = fs.open(QUEUE_DIR);
+  if (!root || !root.isDirectory()) {
+    return;
+  }
+  char paths[TELEMETRY_MAX_SEGMENTS + 4][32];
+  size_t count = 0;
+  for (File f = root.openNextFile(); f && count < sizeof(paths) / sizeof(paths[0]); f = root.openNextFile()) {
+    const char* name = strrchr(f.name(), '/');
+    snprintf(paths[count++], sizeof(paths[0]), QUEUE_DIR "/%s", name ? name + 1 : f.name());
+  }
+  root.close();
+  for (size_t i = 0; i < count; i++) {
+    fs.remove(paths[i]);
+  }
+  fs.rmdir(QUEUE_DIR);
+}
+
+// Drains up to max samples as a receiver would see them: seq at or below
+// the highest so far is a replay, anything else has to follow it directly
+struct Receiver {
+  uint32_t highest;
+  uint32_t received;
+  uint32_t replayed;
+  uint32_t gaps;
+
+  void drain(TelemetryQueue& queue, uint32_t max) {
+    static TelemetrySample batch[DRAIN_BATCH];
+    while (max > 0 && queue.pending() > 0) {
+      size_t count = queue.peek(batch, max < DRAIN_BATCH ? max : DRAIN_BATCH);
+      if (count == 0) {
+        break;
+      }
+      for (size_t i = 0; i < count; i++) {
+        if (batch[i].seq <= highest) {
+          replayed++;
+          continue;
+        }
+        if (batch[i].seq != highest + 1) {
+          gaps++;
+        }
+        highest = batch[i].seq;
+        received++;
+      }
+      queue.pop(count);
+      max -= count;
+    }
+  }
+};
+
+void run(const Outage& outage) {
+  removeQueueFiles();
+  static TelemetryQueue queues[2];
+  TelemetryQueue* queue = &queues[0];
+  *queue = TelemetryQueue();
+  queue->begin(Storage.fs(), QUEUE_DIR);
+  Receiver receiver = {};
+
+  // Offline: record only
+  uint32_t seq = 0;
+  uint32_t lost = 0;
+  uint32_t pushStart = micros();
+  for (uint32_t i = 1; i <= outage.samples; i++) {
+    seq++;
+    TelemetrySample sample = { seq, seq * outage.intervalSec, 200000 - seq % 1000, -60, 0 };
+    queue->push(sample);
+    if (outage.reboot && i == outage.samples / 2) {
+      // The link came back for two batches, then the power went: what was
+      // in RAM is gone and the head segment is sent again from its start.
+      // seq carries on from the newest sample on flash, as the sketch does.
+      receiver.drain(*queue, 2 * DRAIN_BATCH);
+      queue = &queues[1];
+      *queue = TelemetryQueue();
+      queue->begin(Storage.fs(), QUEUE_DIR);
+      lost = seq - queue->lastSeq();
+      seq = queue->lastSeq();
+    }
+  }
+  uint32_t pushUs = micros() - pushStart;
+  TelemetryStats recorded = queue->stats();
+  // A reopened queue counts from zero; the first one's counts still apply
+  uint32_t spilled = recorded.spilled + (outage.reboot ? queues[0].stats().spilled : 0);
+  uint32_t dropped = recorded.dropped + (outage.reboot ? queues[0].stats().dropped : 0);
+
+  // Back online: drain in batches. Samples dropped for the flash budget are
+  // the oldest, so the first one through follows them.
+  uint32_t before = receiver.received;
+  if (before == 0) {
+    receiver.highest = dropped;
+  }
+  uint32_t drainStart = micros();
+  receiver.drain(*queue, UINT32_MAX);
+  uint32_t drainUs = micros() - drainStart;
+  uint32_t drained = receiver.received - before + receiver.replayed;
+
+  bool passed = receiver.gaps == 0 && receiver.highest == seq &&
+                receiver.received + dropped == seq && queue->pending() == 0 &&
+                receiver.replayed == (outage.reboot ? 2 * DRAIN_BATCH : 0) &&
+                drainUs / 1000 < DRAIN_MAX_MS;
+  allPassed = allPassed && passed;
+  Serial.printf("  %-22s %6u pushed %6u spilled %6u dropped %6u drained  push %5u us per 1000"
+                "  drain %6u ms (%7u/s)  %s\n",
+                outage.name, (unsigned)outage.samples, (unsigned)spilled, (unsigned)dropped,
+                (unsigned)drained, (unsigned)((uint64_t)pushUs * 1000 / outage.samples),
+                (unsigned)(drainUs / 1000),
+                (unsigned)(drainUs > 0 ? (uint64_t)drained * 1000000 / drainUs : 0),
+                passed ? "ok" : "FAIL");
+  if (outage.reboot) {
+    Serial.printf("%25s%u lost from RAM, %u replayed and recognised by seq, seq ends at %u\n", "",
+                  (unsigned)lost, (unsigned)receiver.replayed, (unsigned)seq);
+  }
+  if (receiver.gaps > 0) {
+    Serial.printf("%25s%u gaps or reorderings in seq\n", "", (unsigned)receiver.gaps);
+  }
+  removeQueueFiles();
+}
+
+void setup() {
+  Serial.begin(115200);
+  Log.begin();
+  delay(1000);
+
+  Serial.println("\n\n=== Telemetry Outage Test ===");
+  if (!Storage.begin()) {
+    Serial.println("Storage mount failed");
+    return;
+  }
+  const uint32_t budget = TELEMETRY_MAX_SEGMENTS * TELEMETRY_SEGMENT_SAMPLES;
+  Serial.printf("%u samples in RAM, %u on flash at most, drained %u per batch\n\n",
+                TELEMETRY_RING_SIZE, (unsigned)budget, DRAIN_BATCH);
+
+  const Outage outages[] = {
+    { "1 h at 10 s", 10, 360, false },
+    { "1 h at 10 s, power cut", 10, 360, true },
+    { "1 h at 1 s", 1, 3600, false },
+    // Past the flash budget: the oldest segments go, the rest arrive intact
+    { "over the flash budget", 1, budget + TELEMETRY_RING_SIZE + 1000, false },
+  };
+  for (size_t i = 0; i < sizeof(outages) / sizeof(outages[0]); i++) {
+    run(outages[i]);
+  }
+  Serial.println(allPassed ? "\nPASS" : "\nFAIL");
+}
+
+void loop() {
+  // Nothing to do here
+}
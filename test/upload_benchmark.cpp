@@ -0,0 +1,130 @@
+#include <Arduino.h>
+#include <WebServer.h>
+#include <FileStorage.h>
+
+#include "pem_upload.h"
+
+// Compares the certificate upload path with the loop it replaced, which
+// wrote each upload piece straight to the target file as it arrived. Both
+// get the same PEM text in HTTP_UPLOAD_BUFLEN pieces, as the server hands
+// them to the upload handler, without a network in between; PemUpload also
+// validates each line, writes whole sectors to a temp file and swaps it in.
+// Runs on the backend the sketch is built for, like fs_benchmark.cpp, and
+// removes its files afterwards.
+
+#define ROUNDS 20
+#define CERT_LINES 22  // ~1.4 KB, a typical device certificate
+
+const char* certPath = "/bench/device.pem";
+
+char pem[PEM_UPLOAD_MAX];
+uint32_t samples[ROUNDS];
+
+struct Timing {
+  uint32_t median;
+  uint32_t max;
+};
+
+Timing summarize() {
+  for (size_t i = 1; i < ROUNDS; i++) {
+    for (size_t j = i; j > 0 && samples[j] < samples[j - 1]; j--) {
+      uint32_t swap = samples[j];
+      samples[j] = samples[j - 1];
+      samples[j - 1] = swap;
+    }
+  }
+  return Timing{ samples[ROUNDS / 2], samples[ROUNDS - 1] };
+}
+
+void report(const char* op, size_t len, Timing t) {
+  // Bytes per microsecond is MB/s; KB/s reads better at flash speeds
+  double kbPerSec = t.median > 0 ? len * 1e6 / 1024 / t.median : 0;
+  Serial.printf("  %-32s %8u %8u %9.1f\n", op, (unsigned)t.median, (unsigned)t.max, kbPerSec);
+}
+
+// A chain of certificates of CERT_LINES body lines each, at least len bytes
+size_t buildChain(size_t len) {
+  size_t n = 0;
+  while (n < len) {
+    n += sprintf(pem + n, "-----BEGIN CERTIFICATE-----\n");
+    for (int line = 0; line < CERT_LINES; line++) {
+      for (int i = 0; i < 64; i++) {
+        pem[n++] = line == 0 && i == 0 ? 'M' : "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdef"[(line * 7 + i) % 32];
+      }
+      pem[n++] = '\n';
+    }
+    n += sprintf(pem + n, "-----END CERTIFICATE-----\n");
+  }
+  return n;
+}
+
+// The loop in main.cpp before PemUpload: no checks, one write per piece
+bool writePerPiece(size_t len) {
+  File f = Storage.fs().open(certPath, FILE_WRITE);
+  if (!f) {
+    return false;
+  }
+  bool ok = true;
+  for (size_t pos = 0; pos < len; pos += HTTP_UPLOAD_BUFLEN) {
+    size_t n = len - pos < HTTP_UPLOAD_BUFLEN ? len - pos : HTTP_UPLOAD_BUFLEN;
+    ok &= f.write((const uint8_t*)pem + pos, n) == n;
+  }
+  f.close();
+  return ok;
+}
+
+bool pemUpload(size_t len) {
+  static PemUpload upload;
+  bool ok = upload.begin(Storage.fs(), certPath, PEM_CERTIFICATE);
+  for (size_t pos = 0; ok && pos < len; pos += HTTP_UPLOAD_BUFLEN) {
+    size_t n = len - pos < HTTP_UPLOAD_BUFLEN ? len - pos : HTTP_UPLOAD_BUFLEN;
+    ok = upload.write((const uint8_t*)pem + pos, n);
+  }
+  if (ok && upload.finish()) {
+    return true;
+  }
+  Serial.printf("  upload failed: %s\n", upload.lastError());
+  return false;
+}
+
+void run(const char* op, bool (*upload)(size_t), size_t len) {
+  for (size_t i = 0; i < ROUNDS; i++) {
+    uint32_t start = micros();
+    if (!upload(len)) {
+      return;
+    }
+    samples[i] = micros() - start;
+  }
+  report(op, len, summarize());
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+
+  Serial.println("\n\n=== Certificate Upload Benchmark ===");
+  if (!Storage.begin()) {
+    Serial.println("Storage mount failed");
+    return;
+  }
+  Storage.fs().mkdir("/bench");
+
+  // One certificate, a short chain, and the largest upload accepted
+  const size_t sizes[] = { 1, 4096, PEM_UPLOAD_MAX - 2048 };
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    size_t len = buildChain(sizes[i]);
+    Serial.printf("\n%s, %u-byte PEM in %u-byte pieces, microseconds:\n", Storage.name(),
+                  (unsigned)len, HTTP_UPLOAD_BUFLEN);
+    Serial.printf("  %-32s %8s %8s %9s\n", "upload path", "median", "max", "KB/s");
+    run("write per piece (before)", writePerPiece, len);
+    run("PemUpload (checked, swapped in)", pemUpload, len);
+  }
+
+  Storage.fs().remove(certPath);
+  Storage.fs().rmdir("/bench");
+  Serial.println("\nDone; benchmark files removed.");
+}
+
+void loop() {
+  // Nothing to do here
+}